@@ -33,6 +33,7 @@ namespace QT7
     class MediaNode;
     class AudioNode;
     class AudioGraph;
+    class ResamplerAudioNode;
 
     class AudioConnection {
     public:
@@ -54,6 +55,8 @@ namespace QT7
         bool isSinkOnly();
         void freeMemoryAllocations();
         void invalidate();
+        void setSinkSampleRate(Float64 sampleRate);
+        void setSinkChannelLayoutTag(AudioChannelLayoutTag tag);
         
         MediaNode *m_source;
         AudioNode *m_sourceAudioNode;
@@ -75,6 +78,20 @@ namespace QT7
         bool m_hasSourceSpecification;
         bool m_hasSinkSpecification;
         bool m_connected;
+
+        // When the sink needs m_sinkSampleRate or m_sinkChannelLayoutTag,
+        // and the source has another, the audio goes through m_resampler:
+        Float64 m_sinkSampleRate;
+        AudioChannelLayoutTag m_sinkChannelLayoutTag;
+        ResamplerAudioNode *m_resampler;
+        AudioConnection *m_toResampler;
+        AudioConnection *m_fromResampler;
+
+    private:
+        bool needsResampler() const;
+        void attachResampler(AudioGraph *graph);
+        bool insertResampler(AudioGraph *graph);
+        void removeResampler();
     };
 
 }} // namespace Phonon::QT7
@@ -19,6 +19,7 @@
 #include "medianode.h"
 #include "audionode.h"
 #include "audiograph.h"
+#include "resampleraudionode.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -31,37 +32,43 @@ namespace QT7
         :   m_source(0), m_sourceAudioNode(0), m_sourceOutputBus(0),
             m_sink(0), m_sinkAudioNode(0), m_sinkInputBus(0),
             m_sourceChannelLayout(0), m_sinkChannelLayout(0),
-            m_hasSourceSpecification(false), m_hasSinkSpecification(false), m_connected(false)
+            m_hasSourceSpecification(false), m_hasSinkSpecification(false), m_connected(false),
+            m_sinkSampleRate(0), m_sinkChannelLayoutTag(0), m_resampler(0), m_toResampler(0), m_fromResampler(0)
     {}
 
     AudioConnection::AudioConnection(MediaNode *source, int output, MediaNode *sink, int input)
         : m_source(source), m_sourceAudioNode(source->m_audioNode), m_sourceOutputBus(output),
         m_sink(sink), m_sinkAudioNode(sink->m_audioNode), m_sinkInputBus(input),
         m_sourceChannelLayout(0), m_sinkChannelLayout(0),
-        m_hasSourceSpecification(false), m_hasSinkSpecification(false), m_connected(false)
+        m_hasSourceSpecification(false), m_hasSinkSpecification(false), m_connected(false),
+        m_sinkSampleRate(0), m_sinkChannelLayoutTag(0), m_resampler(0), m_toResampler(0), m_fromResampler(0)
     {}
 
     AudioConnection::AudioConnection(MediaNode *sink)
         : m_source(0), m_sourceAudioNode(0), m_sourceOutputBus(0),
         m_sink(sink), m_sinkAudioNode(sink->m_audioNode), m_sinkInputBus(0),
-        m_sourceChannelLayout(0), m_sinkChannelLayout(0), m_connected(false)
+        m_sourceChannelLayout(0), m_sinkChannelLayout(0), m_connected(false),
+        m_sinkSampleRate(0), m_sinkChannelLayoutTag(0), m_resampler(0), m_toResampler(0), m_fromResampler(0)
     {}
 
     AudioConnection::AudioConnection(AudioNode *source, int output, AudioNode *sink, int input)
         : m_source(0), m_sourceAudioNode(source), m_sourceOutputBus(output),
         m_sink(0), m_sinkAudioNode(sink), m_sinkInputBus(input),
         m_sourceChannelLayout(0), m_sinkChannelLayout(0),
-        m_hasSourceSpecification(false), m_hasSinkSpecification(false), m_connected(false)
+        m_hasSourceSpecification(false), m_hasSinkSpecification(false), m_connected(false),
+        m_sinkSampleRate(0), m_sinkChannelLayoutTag(0), m_resampler(0), m_toResampler(0), m_fromResampler(0)
     {}
 
     AudioConnection::AudioConnection(AudioNode *sink)
         : m_source(0), m_sourceAudioNode(0), m_sourceOutputBus(0),
         m_sink(0), m_sinkAudioNode(sink), m_sinkInputBus(0),
-        m_sourceChannelLayout(0), m_sinkChannelLayout(0), m_connected(false)
+        m_sourceChannelLayout(0), m_sinkChannelLayout(0), m_connected(false),
+        m_sinkSampleRate(0), m_sinkChannelLayoutTag(0), m_resampler(0), m_toResampler(0), m_fromResampler(0)
     {}
 
     AudioConnection::~AudioConnection()
     {
+        removeResampler();
         freeMemoryAllocations();
     }
 
@@ -90,6 +97,16 @@ namespace QT7
             if (!updateOk)
                 return false;
         }
+        if (needsResampler()){
+            // The sink cannot take the format of the source. Instead of
+            // failing (and rebuilding the graph), convert it:
+            if (!insertResampler(m_sinkAudioNode->m_audioGraph))
+                return false;
+            m_resampler->setOutputSampleRate(m_sinkSampleRate);
+            m_resampler->setOutputChannelLayoutTag(m_sinkChannelLayoutTag);
+            return m_toResampler->updateStreamSpecification() && m_fromResampler->updateStreamSpecification();
+        }
+
         updateOk = m_sinkAudioNode->fillInStreamSpecification(this, AudioNode::Sink);
         if (!updateOk)
             return false;
@@ -108,10 +125,11 @@ namespace QT7
         << int(m_sourceAudioNode) << m_sourceOutputBus << "->"
         << int(m_sinkAudioNode) << m_sinkInputBus)
 
-        AUNode sourceOut = m_sourceAudioNode->getOutputAUNode();
-        AUNode sinkIn = m_sinkAudioNode->getInputAUNode();
-        OSStatus err = AUGraphConnectNodeInput(graph->audioGraphRef(), sourceOut, m_sourceOutputBus, sinkIn, m_sinkInputBus);
-        m_connected = (err == noErr) ? true : false;
+        if (m_resampler){
+            attachResampler(graph);
+            m_connected = m_toResampler->connect(graph) && m_fromResampler->connect(graph);
+        } else
+            m_connected = m_sourceAudioNode->connectToSink(this, graph);
         return m_connected;
     }
 
@@ -124,14 +142,29 @@ namespace QT7
         << int(m_sourceAudioNode) << m_sourceOutputBus << "->"
         << int(m_sinkAudioNode) << m_sinkInputBus)
 
+        if (m_resampler){
+            m_toResampler->disconnect(graph);
+            m_fromResampler->disconnect(graph);
+            m_connected = false;
+            return true;
+        }
+
         AUNode sinkIn = m_sinkAudioNode->getInputAUNode();
 	    AUGraphDisconnectNodeInput(graph->audioGraphRef(), sinkIn, m_sinkInputBus);
+        m_sourceAudioNode->disconnectFromSink(this, graph);
         m_connected = false;
         return true;
     }
 
     void AudioConnection::invalidate()
     {
+        // The graph is going away. The resampler leaves it too,
+        // and joins the next graph when connected again:
+        if (m_resampler){
+            m_toResampler->invalidate();
+            m_fromResampler->invalidate();
+            m_resampler->setGraph(0);
+        }
         m_connected = false;
     }
 
@@ -147,6 +180,83 @@ namespace QT7
         return (m_sourceAudioNode == 0) && (m_sinkAudioNode != 0);
     }
 
+    void AudioConnection::setSinkSampleRate(Float64 sampleRate)
+    {
+        m_sinkSampleRate = sampleRate;
+    }
+
+    void AudioConnection::setSinkChannelLayoutTag(AudioChannelLayoutTag tag)
+    {
+        m_sinkChannelLayoutTag = tag;
+    }
+
+    bool AudioConnection::needsResampler() const
+    {
+        // Once in place, the resampler stays (it passes the audio
+        // straight through when the rates and layouts are equal):
+        if (m_resampler)
+            return true;
+        if (!m_hasSourceSpecification)
+            return false;
+        if (m_sinkSampleRate > 0 && m_sourceStreamDescription.mSampleRate != m_sinkSampleRate)
+            return true;
+        return m_sinkChannelLayoutTag
+            && m_sourceStreamDescription.mChannelsPerFrame != AudioChannelLayoutTag_GetNumberOfChannels(m_sinkChannelLayoutTag);
+    }
+
+    void AudioConnection::attachResampler(AudioGraph *graph)
+    {
+        if (!m_resampler){
+            m_resampler = new ResamplerAudioNode();
+            m_toResampler = new AudioConnection(m_sourceAudioNode, m_sourceOutputBus, m_resampler, 0);
+            m_fromResampler = new AudioConnection(m_resampler, 0, m_sinkAudioNode, m_sinkInputBus);
+        }
+        m_resampler->setGraph(graph);
+        m_resampler->createAndConnectAUNodes();
+    }
+
+    bool AudioConnection::insertResampler(AudioGraph *graph)
+    {
+        if (!graph || !m_sourceAudioNode)
+            return false;
+        if (m_resampler && m_resampler->m_audioGraph == graph && m_connected){
+            m_resampler->createAudioUnits();
+            return true;
+        }
+
+        DEBUG_AUDIO_GRAPH("Connection" << int(this) << "inserts resampler"
+        << m_sourceStreamDescription.mSampleRate << "->" << m_sinkSampleRate << "Hz,"
+        << m_sourceStreamDescription.mChannelsPerFrame << "->" << AudioChannelLayoutTag_GetNumberOfChannels(m_sinkChannelLayoutTag) << "channels")
+
+        // Replace the direct connection (if any) with
+        // the two connections through the resampler:
+        bool wasConnected = m_connected;
+        if (wasConnected)
+            disconnect(graph);
+        attachResampler(graph);
+        m_resampler->createAudioUnits();
+        if (wasConnected && !connect(graph))
+            return false;
+
+        // Changes to a graph that is already initialized
+        // only take effect when the graph is updated:
+        Boolean initialized = false;
+        AUGraphIsInitialized(graph->audioGraphRef(), &initialized);
+        if (initialized)
+            AUGraphUpdate(graph->audioGraphRef(), 0);
+        return true;
+    }
+
+    void AudioConnection::removeResampler()
+    {
+        delete m_toResampler;
+        delete m_fromResampler;
+        delete m_resampler;
+        m_toResampler = 0;
+        m_fromResampler = 0;
+        m_resampler = 0;
+    }
+
 }} //namespace Phonon::QT7
 
 QT_END_NAMESPACE
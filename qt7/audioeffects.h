@@ -24,6 +24,7 @@
 #include <phonon/effectparameter.h>
 #include "medianode.h"
 #include "audionode.h"
+#include "dspeffects.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -31,20 +32,43 @@ namespace Phonon
 {
 namespace QT7
 {
+    /**
+        Runs an audio unit effect, or one of the built-in effects (see
+        DspEffect). A built-in effect sits in a converter unit that
+        passes the audio through, and processes the output of it in
+        place from a render notification.
+    */
     class AudioEffectAudioNode : public AudioNode
     {
         public:
             AudioEffectAudioNode(int effectType);
+            ~AudioEffectAudioNode();
             int m_effectType;
 
             ComponentDescription getAudioNodeDescription() const;
             void initializeAudioUnit();
+            void mediaNodeEvent(const MediaNodeEvent *event);
 
             QVariant parameterValue(const Phonon::EffectParameter &value) const;
             void setParameterValue(const Phonon::EffectParameter &parameter, const QVariant &newValue);
 
         private:
+            friend class AudioEffect;
             QHash<int, float> m_alteredParameters;
+
+            // Built-in effects only. The effect is used on the render thread
+            // only, and gets its parameters through m_dspParameters. The
+            // format to run it with is published in m_dspChannels (zero
+            // when the output is not non-interleaved float) and m_dspSampleRate:
+            DspEffect *m_dsp;
+            ParameterQueue *m_dspParameters;
+            volatile int m_dspChannels;
+            volatile Float64 m_dspSampleRate;
+
+            static OSStatus dspNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+            void processDsp(const AudioTimeStamp *timeStamp, UInt32 frameCount, AudioBufferList *data);
+            void postDspParameter(int id, float value);
     };
 
 ///////////////////////////////////////////////////////////////////////
@@ -70,6 +94,7 @@ namespace QT7
 
         private:
             Phonon::EffectParameter createParameter(const AudioUnit &audioUnit, const AudioUnitParameterID &id) const;
+            Phonon::EffectParameter createParameter(const DspParameterInfo &info) const;
     };
 
 
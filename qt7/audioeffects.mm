@@ -16,6 +16,8 @@
 */
 
 #include "audioeffects.h"
+#include "medianodeevent.h"
+#include "audiograph.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -27,13 +29,31 @@ namespace QT7
 AudioEffectAudioNode::AudioEffectAudioNode(int effectType)
     : AudioNode(1, 1), m_effectType(effectType)
 {
+    m_dsp = DspEffect::create(effectType);
+    m_dspParameters = m_dsp ? new ParameterQueue() : 0;
+    m_dspChannels = 0;
+    m_dspSampleRate = 0;
+}
+
+AudioEffectAudioNode::~AudioEffectAudioNode()
+{
+    // Remove the unit (and with it the render
+    // notification) before the effect goes:
+    setGraph(0);
+    delete m_dsp;
+    delete m_dspParameters;
 }
 
 ComponentDescription AudioEffectAudioNode::getAudioNodeDescription() const
 {
 	ComponentDescription d;
-	d.componentType = kAudioUnitType_Effect;
-	d.componentSubType = m_effectType;
+    if (m_dsp){
+        d.componentType = kAudioUnitType_FormatConverter;
+        d.componentSubType = kAudioUnitSubType_AUConverter;
+    } else {
+        d.componentType = kAudioUnitType_Effect;
+        d.componentSubType = m_effectType;
+    }
 	d.componentManufacturer = kAudioUnitManufacturer_Apple;
 	d.componentFlags = 0;
 	d.componentFlagsMask = 0;
@@ -44,6 +64,16 @@ void AudioEffectAudioNode::initializeAudioUnit()
 {
     if (!m_audioUnit)
         return;
+
+    if (m_dsp){
+        m_dspChannels = 0;
+        OSStatus err = AudioUnitAddRenderNotify(m_audioUnit, dspNotification, this);
+        BACKEND_ASSERT2(err == noErr, "Could not add render notification to audio effect.", NORMAL_ERROR)
+        foreach(int id, m_alteredParameters.keys())
+            postDspParameter(id, m_alteredParameters.value(id));
+        return;
+    }
+
     foreach(int id, m_alteredParameters.keys()){
         Float32 value = m_alteredParameters.value(id);
         ComponentResult res = AudioUnitSetParameter(m_audioUnit, id, kAudioUnitScope_Global, 0, value, 0);
@@ -51,14 +81,109 @@ void AudioEffectAudioNode::initializeAudioUnit()
     }
 }
 
+void AudioEffectAudioNode::mediaNodeEvent(const MediaNodeEvent *event)
+{
+    if (!m_dsp)
+        return;
+
+    switch (event->type()){
+    case MediaNodeEvent::AudioGraphInitialized:{
+        // The converter passes the audio through, so its output
+        // format is what the effect gets. Only process it if it is
+        // non-interleaved float, and bypass the effect otherwise:
+        AudioStreamBasicDescription format;
+        UInt32 size = sizeof(format);
+        OSStatus err = AudioUnitGetProperty(m_audioUnit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Output, 0, &format, &size);
+        bool usable = (err == noErr) && (format.mFormatID == kAudioFormatLinearPCM)
+            && (format.mFormatFlags & kAudioFormatFlagIsFloat)
+            && (format.mFormatFlags & kAudioFormatFlagIsNonInterleaved)
+            && format.mBitsPerChannel == 32
+            && format.mChannelsPerFrame > 0 && format.mChannelsPerFrame <= DspEffect::MaxChannels;
+        if (usable)
+            m_dspSampleRate = format.mSampleRate;
+        m_dspChannels = usable ? int(format.mChannelsPerFrame) : 0;
+        BACKEND_ASSERT2(usable, "Audio effect cannot process this audio format, and is bypassed.", NORMAL_ERROR)
+        break; }
+    case MediaNodeEvent::AudioGraphAboutToBeDeleted:
+        m_dspChannels = 0;
+        break;
+    case MediaNodeEvent::AudioGraphStarted:
+    case MediaNodeEvent::AudioGraphStopped:
+        // Post what did not fit in the queue, or apply it:
+        if (m_audioGraph && m_audioGraph->isRunning())
+            m_dspParameters->repost();
+        else
+            m_dspParameters->flush(m_dsp);
+        break;
+    default:
+        break;
+    }
+}
+
+OSStatus AudioEffectAudioNode::dspNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp *timeStamp, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList *data)
+{
+    // Called on the render thread. Don't lock or allocate:
+    if (*actionFlags & kAudioUnitRenderAction_PostRender)
+        static_cast<AudioEffectAudioNode *>(userData)->processDsp(timeStamp, frameCount, data);
+    return noErr;
+}
+
+void AudioEffectAudioNode::processDsp(const AudioTimeStamp *timeStamp, UInt32 frameCount, AudioBufferList *data)
+{
+    m_dspParameters->process(m_dsp, timeStamp->mSampleTime, frameCount);
+
+    int channels = m_dspChannels;
+    if (!channels || !data || int(data->mNumberBuffers) != channels)
+        return; // bypassed
+    if (channels != m_dsp->channelCount() || m_dspSampleRate != m_dsp->sampleRate())
+        m_dsp->setFormat(m_dspSampleRate, channels);
+
+    float *buffers[DspEffect::MaxChannels];
+    for (int i=0; i<channels; ++i){
+        buffers[i] = static_cast<float *>(data->mBuffers[i].mData);
+        if (!buffers[i] || data->mBuffers[i].mNumberChannels != 1)
+            return;
+    }
+    m_dsp->process(buffers, int(frameCount));
+}
+
+void AudioEffectAudioNode::postDspParameter(int id, float value)
+{
+    ParameterCommand command;
+    command.parameter = id;
+    command.scope = kAudioUnitScope_Global;
+    command.element = 0;
+    command.value = value;
+    command.sampleTime = -1;
+    command.rampFrames = 0;
+    command.from = value;
+    if (m_audioGraph && m_audioGraph->isRunning()){
+        // If the queue is full, the newest value for the parameter
+        // is kept, and posted after the older ones are applied:
+        m_dspParameters->send(command);
+        return;
+    }
+
+    // Nothing renders, so stand in for the render thread:
+    m_dspParameters->flush(m_dsp);
+    m_dsp->setParameterValue(command, value, 0);
+}
+
 QVariant AudioEffectAudioNode::parameterValue(const Phonon::EffectParameter &parameter) const
 {
-    if (m_audioUnit){
+    // Changes are applied on the render thread, so
+    // the unit might not have the altered value yet:
+    if (m_alteredParameters.contains(parameter.id())){
+        return QVariant(m_alteredParameters.value(parameter.id()));
+    } else if (m_dsp){
+        const DspParameterInfo *info = m_dsp->parameterInfoForId(parameter.id());
+        return info ? QVariant(info->defaultValue) : QVariant();
+    } else if (m_audioUnit){
         Float32 value = 0;
         AudioUnitGetParameter(m_audioUnit, parameter.id(), kAudioUnitScope_Global, 0, &value);
         return QVariant(value);
-    } else if (m_alteredParameters.contains(parameter.id())){
-        return QVariant(m_alteredParameters.value(parameter.id()));
     } else {
         // Use default value:
         AudioUnit tmpAudioUnit;
@@ -78,6 +203,19 @@ QVariant AudioEffectAudioNode::parameterValue(const Phonon::EffectParameter &par
 
 void AudioEffectAudioNode::setParameterValue(const Phonon::EffectParameter &parameter, const QVariant &newValue)
 {
+    if (m_dsp){
+        const DspParameterInfo *info = m_dsp->parameterInfoForId(parameter.id());
+        BACKEND_ASSERT2(info, "Audio effect has no such parameter.", NORMAL_ERROR)
+        float value = info->defaultValue;
+        if (newValue.isValid()){
+            value = newValue.toDouble();
+            m_alteredParameters.insert(parameter.id(), value);
+        } else
+            m_alteredParameters.remove(parameter.id());
+        postDspParameter(parameter.id(), value);
+        return;
+    }
+
     Float32 value = 0;
     if (newValue.isValid()){
         value = newValue.toDouble();
@@ -101,10 +239,8 @@ void AudioEffectAudioNode::setParameterValue(const Phonon::EffectParameter &para
         }
     }
 
-    if (m_audioUnit){
-        ComponentResult res = AudioUnitSetParameter(m_audioUnit, parameter.id(), kAudioUnitScope_Global, 0, value, 0);
-        BACKEND_ASSERT2(res == noErr, "Could not set effect parameter value.", NORMAL_ERROR)
-    }
+    if (m_audioUnit)
+        setParameter(parameter.id(), kAudioUnitScope_Global, 0, value);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -119,6 +255,12 @@ AudioEffect::AudioEffect(int effectType, QObject *parent)
 QList<Phonon::EffectParameter> AudioEffect::parameters() const
 {
     QList<Phonon::EffectParameter> effectList;
+    if (m_audioNode->m_dsp){
+        for (int i=0; i<m_audioNode->m_dsp->parameterCount(); ++i)
+            effectList << createParameter(m_audioNode->m_dsp->parameterInfo(i));
+        return effectList;
+    }
+
     // Create a temporary audio unit:
     AudioUnit audioUnit;
     ComponentDescription description = m_audioNode->getAudioNodeDescription();
@@ -149,6 +291,9 @@ QList<Phonon::EffectParameter> AudioEffect::parameters() const
 
 QString AudioEffect::name()
 {
+    if (m_audioNode->m_dsp)
+        return DspEffect::name(m_audioNode->m_effectType);
+
     ComponentDescription description = m_audioNode->getAudioNodeDescription();
     Component component = FindNextComponent(0, &description);
     BACKEND_ASSERT3(component, "Could not get audio effect name.", NORMAL_ERROR, QLatin1String("<unknown effect>"))
@@ -167,6 +312,9 @@ QString AudioEffect::name()
 
 QString AudioEffect::description()
 {
+    if (m_audioNode->m_dsp)
+        return DspEffect::description(m_audioNode->m_effectType);
+
     ComponentDescription description = m_audioNode->getAudioNodeDescription();
     Component component = FindNextComponent(0, &description);
     BACKEND_ASSERT3(component, "Could not get audio effect description.", NORMAL_ERROR, QLatin1String("<unknown effect>"))
@@ -201,6 +349,9 @@ QList<int> AudioEffect::effectList()
         effects << cDesc.componentSubType;
         component = FindNextComponent(component, &d);
     }
+
+    // And the effects of our own:
+    effects << DspEffect::effectTypes();
     return effects;
 }
 
@@ -237,6 +388,31 @@ Phonon::EffectParameter AudioEffect::createParameter(const AudioUnit &audioUnit,
     return Phonon::EffectParameter(id, name, hint, def, min, max, QVariantList(), name);
 }
 
+Phonon::EffectParameter AudioEffect::createParameter(const DspParameterInfo &info) const
+{
+    Phonon::EffectParameter::Hints hint;
+    switch(info.hint){
+    case DspParameterInfo::Integer:
+        hint = Phonon::EffectParameter::IntegerHint;
+        break;
+    case DspParameterInfo::Toggled:
+        hint = Phonon::EffectParameter::ToggledHint;
+        break;
+    case DspParameterInfo::Logarithmic:
+        hint = Phonon::EffectParameter::LogarithmicHint;
+        break;
+    default:
+        hint = 0;
+        break;
+    }
+
+    QVariant def(info.defaultValue);
+    QVariant min(info.minimum);
+    QVariant max(info.maximum);
+    return Phonon::EffectParameter(info.id, QLatin1String(info.name), hint, def, min, max,
+        QVariantList(), QLatin1String(info.description));
+}
+
 QVariant AudioEffect::parameterValue(const Phonon::EffectParameter &value) const
 {
     return m_audioNode->parameterValue(value);
@@ -18,6 +18,7 @@
 #include "audiograph.h"
 #include "quicktimeaudioplayer.h"
 #include "medianode.h"
+#include "sharedaudiooutput.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -50,6 +51,10 @@ void AudioGraph::startAllOverFromScratch()
 void AudioGraph::deleteGraph()
 {
     if (m_audioGraphRef){
+        // Make sure the shared output stops pulling
+        // audio from this graph before it goes away:
+        if (SharedAudioOutput::existingInstance())
+            SharedAudioOutput::existingInstance()->releaseGraph(m_audioGraphRef);
     	AUGraphStop(m_audioGraphRef);
 	    AUGraphUninitialize(m_audioGraphRef);
         AUGraphClose(m_audioGraphRef);
@@ -185,9 +190,11 @@ void AudioGraph::tryStartGraph()
     // at a later point.
     if (m_startedLogically && !isRunning()){
         OSStatus err = AUGraphStart(m_audioGraphRef);
-        if (err == noErr)
+        if (err == noErr){
             DEBUG_AUDIO_GRAPH("Graph" << int(this) << "started")
-        else
+            MediaNodeEvent e(MediaNodeEvent::AudioGraphStarted, this);
+            m_root->notify(&e);
+        } else
             DEBUG_AUDIO_GRAPH("Graph" << int(this) << "could not start")
     }
 }
@@ -297,6 +304,8 @@ void AudioGraph::stop()
     if (m_audioGraphRef)
 	    AUGraphStop(m_audioGraphRef);
     m_startedLogically = false;
+    MediaNodeEvent e(MediaNodeEvent::AudioGraphStopped, this);
+    m_root->notify(&e);
 }
 
 void AudioGraph::notify(const MediaNodeEvent *event, bool propagate)
@@ -19,13 +19,13 @@
 #define Phonon_QT7_AUDIOMIXER_H
 
 #include <QtCore/QObject>
-#include <QtCore/QTime>
-#include <QtCore/QEvent>
 #include <phonon/effectinterface.h>
 #include <phonon/effectparameter.h>
 #include <phonon/volumefaderinterface.h>
 #include "medianode.h"
 #include "audionode.h"
+#include "gainramp.h"
+#include "lockfreequeue.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -40,6 +40,13 @@ namespace QT7
             void setVolume(float volume, int bus = 0);
             float volume(int bus = 0);
 
+            void rampGain(float to, qint64 milliseconds, GainCurve::Shape shape = GainCurve::Linear);
+            void setGain(float gain);
+            float gain() const;
+            float targetGain() const;
+
+            void mediaNodeEvent(const MediaNodeEvent *event);
+
         protected:
             ComponentDescription getAudioNodeDescription() const;
             void initializeAudioUnit();
@@ -48,6 +55,26 @@ namespace QT7
             friend class AudioMixer;
             int m_numberOfBusses;
             float m_volume;
+
+            // The gain applied to the mixed output, on the render thread,
+            // after the bus volumes. Ramps are started from the GUI thread
+            // through m_gainCommands, and the render thread publishes
+            // where it is in m_renderedGain. A command that does not fit
+            // in the queue waits (GUI side) in m_pendingGainCommand:
+            GainRamp m_gainRamp;
+            LockFreeQueue<GainRampCommand> m_gainCommands;
+            GainRampCommand m_pendingGainCommand;
+            bool m_hasPendingGainCommand;
+            float m_targetGain;
+            volatile float m_renderedGain;
+            volatile bool m_floatOutput;
+            Float64 m_sampleRate;
+
+            static OSStatus renderNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+            void applyGain(AudioBufferList *data, UInt32 frameCount);
+            void startGainRamp(const GainRampCommand &command);
+            void postGainCommand(const GainRampCommand &command);
     };
 
     class AudioMixer : public MediaNode, Phonon::EffectInterface, Phonon::VolumeFaderInterface
@@ -61,12 +88,6 @@ namespace QT7
             AudioMixerAudioNode *m_audioNode;
             Phonon::VolumeFaderEffect::FadeCurve m_fadeCurve;
 
-            int m_fadeTimer;
-            int m_fadeDuration;
-            float m_fadeToVolume;
-            float m_fadeFromVolume;
-            QTime m_fadeStartTime;
-
             // EffectInterface:
             QList<Phonon::EffectParameter> parameters() const;
             QVariant parameterValue(const Phonon::EffectParameter &parameter) const;
@@ -78,10 +99,6 @@ namespace QT7
             Phonon::VolumeFaderEffect::FadeCurve fadeCurve() const;
             void setFadeCurve(Phonon::VolumeFaderEffect::FadeCurve fadeCurve);
             void fadeTo(float volume, int fadeTime);
-            void updateFade();
-
-        protected:
-            bool event(QEvent *event);
     };
 
 }} //namespace Phonon::QT7
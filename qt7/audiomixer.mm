@@ -16,6 +16,8 @@
 */
 
 #include "audiomixer.h"
+#include "medianodeevent.h"
+#include "audiograph.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -24,10 +26,15 @@ namespace Phonon
 namespace QT7
 {
 
-AudioMixerAudioNode::AudioMixerAudioNode() : AudioNode(30, 1)
+AudioMixerAudioNode::AudioMixerAudioNode() : AudioNode(30, 1), m_gainCommands(16)
 {
     m_numberOfBusses = 2;
     m_volume = 1.0f;
+    m_renderedGain = 1.0f;
+    m_targetGain = 1.0f;
+    m_hasPendingGainCommand = false;
+    m_floatOutput = false;
+    m_sampleRate = 44100;
 }
 
 ComponentDescription AudioMixerAudioNode::getAudioNodeDescription() const
@@ -47,6 +54,138 @@ void AudioMixerAudioNode::initializeAudioUnit()
     OSStatus err = AudioUnitSetProperty(m_audioUnit,
         kAudioUnitProperty_BusCount, kAudioUnitScope_Input, 0, &m_numberOfBusses, sizeof(int));
     BACKEND_ASSERT2(err == noErr, "Could not set number of busses on audio mixer node.", FATAL_ERROR)
+
+    err = AudioUnitAddRenderNotify(m_audioUnit, renderNotification, this);
+    BACKEND_ASSERT2(err == noErr, "Could not add render notification to audio mixer node.", NORMAL_ERROR)
+}
+
+void AudioMixerAudioNode::mediaNodeEvent(const MediaNodeEvent *event)
+{
+    switch (event->type()){
+    case MediaNodeEvent::AudioGraphInitialized:{
+        // The output format is known now. The gain can only
+        // be applied by us if the mixer renders float samples:
+        AudioStreamBasicDescription format;
+        UInt32 size = sizeof(format);
+        OSStatus err = AudioUnitGetProperty(m_audioUnit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Output, 0, &format, &size);
+        m_floatOutput = (err == noErr) && (format.mFormatID == kAudioFormatLinearPCM)
+            && (format.mFormatFlags & kAudioFormatFlagIsFloat) && format.mBitsPerChannel == 32;
+        if (err == noErr && format.mSampleRate > 0)
+            m_sampleRate = format.mSampleRate;
+        break; }
+    case MediaNodeEvent::AudioGraphAboutToBeDeleted:
+        m_floatOutput = false;
+        break;
+    case MediaNodeEvent::AudioGraphStarted:
+    case MediaNodeEvent::AudioGraphStopped:
+        if (m_hasPendingGainCommand){
+            m_hasPendingGainCommand = false;
+            postGainCommand(m_pendingGainCommand);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+OSStatus AudioMixerAudioNode::renderNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp */*timeStamp*/, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList *data)
+{
+    // Called on the render thread. Don't lock or allocate:
+    if (*actionFlags & kAudioUnitRenderAction_PostRender)
+        static_cast<AudioMixerAudioNode *>(userData)->applyGain(data, frameCount);
+    return noErr;
+}
+
+void AudioMixerAudioNode::applyGain(AudioBufferList *data, UInt32 frameCount)
+{
+    GainRampCommand command;
+    while (m_gainCommands.pop(command))
+        startGainRamp(command);
+    if (!data || !m_floatOutput || m_gainRamp.isUnity()){
+        m_renderedGain = m_gainRamp.gain();
+        return;
+    }
+
+    const int BlockFrames = 256;
+    float gains[BlockFrames];
+    for (UInt32 offset = 0; offset < frameCount; offset += BlockFrames){
+        int frames = int(qMin(frameCount - offset, UInt32(BlockFrames)));
+        m_gainRamp.fillGains(gains, frames);
+        for (UInt32 i = 0; i < data->mNumberBuffers; ++i){
+            AudioBuffer &buffer = data->mBuffers[i];
+            float *samples = static_cast<float *>(buffer.mData);
+            if (!samples)
+                continue;
+            if (buffer.mNumberChannels == 1)
+                GainKernel::applyPlanar(samples + offset, gains, frames);
+            else
+                GainKernel::applyInterleaved(samples + offset * buffer.mNumberChannels, buffer.mNumberChannels, gains, frames);
+        }
+    }
+    m_renderedGain = m_gainRamp.gain();
+}
+
+void AudioMixerAudioNode::startGainRamp(const GainRampCommand &command)
+{
+    float from = (command.from < 0) ? m_gainRamp.gain() : command.from;
+    m_gainRamp.start(from, command.to, command.frames, command.shape);
+}
+
+void AudioMixerAudioNode::postGainCommand(const GainRampCommand &command)
+{
+    if (!m_audioGraph || !m_audioGraph->isRunning()){
+        // Nothing renders, so apply it here. Commands
+        // still in the queue go first:
+        GainRampCommand queued;
+        while (m_gainCommands.pop(queued))
+            startGainRamp(queued);
+        startGainRamp(command);
+        m_renderedGain = m_gainRamp.gain();
+    } else if (!m_gainCommands.push(command)){
+        // Every command ramps from wherever the gain is, so the newest
+        // one makes up for those that did not fit. It is posted when
+        // the next one is, or when the graph starts or stops:
+        m_pendingGainCommand = command;
+        m_hasPendingGainCommand = true;
+    }
+}
+
+void AudioMixerAudioNode::rampGain(float to, qint64 milliseconds, GainCurve::Shape shape)
+{
+    // Only this command crosses over to the render thread. The ramp
+    // itself runs there, starting from wherever the gain is by then:
+    GainRampCommand command;
+    command.from = -1;
+    command.to = qBound(0.0f, to, 1.0f);
+    command.frames = quint32(qMax(qint64(0), milliseconds) * m_sampleRate / 1000);
+    command.shape = shape;
+    m_targetGain = command.to;
+    m_hasPendingGainCommand = false;
+    postGainCommand(command);
+
+    if (m_audioUnit && !m_floatOutput){
+        // We cannot touch the samples, so fall back to
+        // jumping to the new volume on the first input bus:
+        setVolume(command.to, 0);
+        m_renderedGain = command.to;
+    }
+}
+
+void AudioMixerAudioNode::setGain(float gain)
+{
+    rampGain(gain, 0);
+}
+
+float AudioMixerAudioNode::gain() const
+{
+    return m_renderedGain;
+}
+
+float AudioMixerAudioNode::targetGain() const
+{
+    return m_targetGain;
 }
 
 void AudioMixerAudioNode::setVolume(float volume, int bus)
@@ -61,8 +200,8 @@ void AudioMixerAudioNode::setVolume(float volume, int bus)
     if (m_audioUnit){
 //        Float32 db = Float32(volume);//Float32(20.0 * log10(volume)); // convert to db
         Float32 db = Float32(volume);
-        OSStatus err = AudioUnitSetParameter(m_audioUnit, kStereoMixerParam_Volume, kAudioUnitScope_Input, bus, db, 0);
-        BACKEND_ASSERT2(err == noErr, "Could not set volume on audio mixer node.", NORMAL_ERROR)
+        setParameter(kStereoMixerParam_Volume, kAudioUnitScope_Input, bus, db,
+            -1, UInt32(VolumeRampMilliseconds * m_sampleRate / 1000));
     }
 }
 
@@ -84,16 +223,10 @@ AudioMixer::AudioMixer(QObject *parent) : MediaNode(AudioSink | AudioSource, 0,
     m_audioNode = new AudioMixerAudioNode();
     setAudioNode(m_audioNode);
     m_fadeCurve = Phonon::VolumeFaderEffect::Fade3Decibel;
-    m_fadeTimer = 0;
-    m_fadeDuration = 0;
-    m_fadeFromVolume = 0;
-    m_fadeToVolume = 0;
 }
 
 AudioMixer::~AudioMixer()
 {
-    if (m_fadeTimer)
-        killTimer(m_fadeTimer);
 }
 
 QList<Phonon::EffectParameter> AudioMixer::parameters() const
@@ -118,12 +251,14 @@ void AudioMixer::setParameterValue(const Phonon::EffectParameter &parameter, con
 
 float AudioMixer::volume() const
 {
-    return m_audioNode->volume(0);
+    // The volume last asked for, even if a fade
+    // towards it is still running:
+    return m_audioNode->targetGain();
 }
 
 void AudioMixer::setVolume(float volume)
 {
-    m_audioNode->setVolume(volume, 0);
+    m_audioNode->setGain(volume);
 }
 
 Phonon::VolumeFaderEffect::FadeCurve AudioMixer::fadeCurve() const
@@ -138,40 +273,14 @@ void AudioMixer::setFadeCurve(Phonon::VolumeFaderEffect::FadeCurve fadeCurve)
 
 void AudioMixer::fadeTo(float volume, int fadeTime)
 {
-    m_fadeToVolume = volume;
-    m_fadeDuration = fadeTime;
-    m_fadeFromVolume = m_audioNode->volume(0);
-    
-    m_fadeStartTime.start();
-    if (m_fadeTimer)
-        killTimer(m_fadeTimer);
-    m_fadeTimer = startTimer(100);
-}
-
-void AudioMixer::updateFade()
-{
-    float step = float(m_fadeStartTime.elapsed()) / float(m_fadeDuration);
-    if (step > 1){
-        step = 1;
-        if (m_fadeTimer)
-            killTimer(m_fadeTimer);
-    }
-    float volume = m_fadeFromVolume + ((m_fadeToVolume - m_fadeFromVolume) * step);
-    m_audioNode->setVolume(volume, 0);
-}
-
-bool AudioMixer::event(QEvent *event)
-{
-    switch (event->type()){
-        case QEvent::Timer:{
-            QTimerEvent *timerEvent = static_cast<QTimerEvent *>(event);
-            if (timerEvent->timerId() == m_fadeTimer)
-                updateFade();
-            break; }
-        default:
-            break;
+    GainCurve::Shape shape;
+    switch (m_fadeCurve){
+    case Phonon::VolumeFaderEffect::Fade3Decibel: shape = GainCurve::Fade3Decibel; break;
+    case Phonon::VolumeFaderEffect::Fade9Decibel: shape = GainCurve::Fade9Decibel; break;
+    case Phonon::VolumeFaderEffect::Fade12Decibel: shape = GainCurve::Fade12Decibel; break;
+    default: shape = GainCurve::Linear; break;
     }
-    return MediaNode::event(event);
+    m_audioNode->rampGain(volume, fadeTime, shape);
 }
 
 }} //namespace Phonon::QT7
@@ -21,6 +21,7 @@
 #include <QtCore/QObject>
 #include "backendheader.h"
 #include "audioconnection.h"
+#include "parameterqueue.h"
 #include <AudioToolbox/AudioToolbox.h>
 #include <AudioUnit/AudioUnit.h>
 
@@ -41,10 +42,29 @@ namespace QT7
         int outputPort;
     };
 
+    /**
+        Applies the commands of a ParameterQueue to an audio unit.
+    */
+    class AudioUnitParameterTarget : public ParameterTarget
+    {
+        public:
+            AudioUnitParameterTarget(AudioUnit audioUnit) : m_audioUnit(audioUnit) {}
+
+            void setParameterValue(const ParameterCommand &command, float value, quint32 bufferOffset)
+            {
+                AudioUnitSetParameter(m_audioUnit, command.parameter, command.scope, command.element, value, bufferOffset);
+            }
+
+        private:
+            AudioUnit m_audioUnit;
+    };
+
     class AudioNode
     {
         public:
             enum ConnectionSide {Source, Sink};
+            // Volume (and mute) changes ramp over this long, so they don't click:
+            enum {VolumeRampMilliseconds = 10};
 
             AudioNode(int maxInput, int maxOutput);
             virtual ~AudioNode();
@@ -56,10 +76,14 @@ namespace QT7
             virtual AUNode getOutputAUNode();
             virtual bool fillInStreamSpecification(AudioConnection *connection, ConnectionSide side);
             virtual bool setStreamSpecification(AudioConnection *connection, ConnectionSide side);
+            virtual bool connectToSink(AudioConnection *connection, AudioGraph *audioGraph);
+            virtual void disconnectFromSink(AudioConnection *connection, AudioGraph *audioGraph);
             void notify(const MediaNodeEvent *event);
 
             virtual void mediaNodeEvent(const MediaNodeEvent *event);
             Float64 getTimeInSamples(int timeProperty);
+            void setParameter(AudioUnitParameterID id, AudioUnitScope scope, AudioUnitElement element,
+                Float32 value, Float64 sampleTime = -1, UInt32 rampFrames = 0);
             
             AudioGraph *m_audioGraph;    
             AudioConnection *m_lastConnectionIn;
@@ -78,6 +102,15 @@ namespace QT7
 
         private:
             bool setStreamHelp(AudioConnection *c, int bus, OSType scope, bool fromSource);
+            void postKeptParameters();
+            static OSStatus parameterNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+
+            // Parameter changes are queued for the render thread, which
+            // applies them before the next buffer. The queue is drained
+            // by a render notification added to m_parameterQueueUnit:
+            ParameterQueue *m_parameterQueue;
+            AudioUnit volatile m_parameterQueueUnit;
     };
 }} // namespace Phonon::QT7
 
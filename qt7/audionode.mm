@@ -35,11 +35,14 @@ AudioNode::AudioNode(int maxInputBusses, int maxOutputBusses)
     m_maxInputBusses = maxInputBusses;
     m_maxOutputBusses = maxOutputBusses;
     m_lastConnectionIn = 0;
+    m_parameterQueue = 0;
+    m_parameterQueueUnit = 0;
 }
 
 AudioNode::~AudioNode()
 {
     setGraph(0);
+    delete m_parameterQueue;
 }
 
 void AudioNode::setGraph(AudioGraph *audioGraph)
@@ -48,6 +51,7 @@ void AudioNode::setGraph(AudioGraph *audioGraph)
         return;
 
     DEBUG_AUDIO_GRAPH("AudioNode" << int(this) << "is setting graph:" << int(audioGraph))    
+    m_parameterQueueUnit = 0;
     if (m_auNode){
         AUGraphRemoveNode(m_audioGraph->audioGraphRef(), m_auNode);
         m_auNode = 0;
@@ -188,6 +192,21 @@ bool AudioNode::fillInStreamSpecification(AudioConnection *connection, Connectio
     return true;
 }
 
+bool AudioNode::connectToSink(AudioConnection *connection, AudioGraph *audioGraph)
+{
+    // Override if the output should reach the sink some
+    // other way than through a connection in the graph:
+    AUNode sinkIn = connection->m_sinkAudioNode->getInputAUNode();
+    OSStatus err = AUGraphConnectNodeInput(audioGraph->audioGraphRef(),
+        getOutputAUNode(), connection->m_sourceOutputBus, sinkIn, connection->m_sinkInputBus);
+    return err == noErr;
+}
+
+void AudioNode::disconnectFromSink(AudioConnection */*connection*/, AudioGraph */*audioGraph*/)
+{
+    // Override if needed
+}
+
 /**
     Let timeProperty be one of e.g
     {kAudioUnitProperty_Latency, kAudioUnitProperty_TailTime,
@@ -218,6 +237,10 @@ void AudioNode::notify(const MediaNodeEvent *event)
     case MediaNodeEvent::NewAudioGraph:
         setGraph(static_cast<AudioGraph *>(event->data()));
         break;
+    case MediaNodeEvent::AudioGraphStarted:
+    case MediaNodeEvent::AudioGraphStopped:
+        postKeptParameters();
+        break;
     default:
         break;
     }
@@ -225,6 +248,85 @@ void AudioNode::notify(const MediaNodeEvent *event)
     mediaNodeEvent(event);
 }
 
+void AudioNode::setParameter(AudioUnitParameterID id, AudioUnitScope scope, AudioUnitElement element,
+    Float32 value, Float64 sampleTime, UInt32 rampFrames)
+{
+    // Set a parameter on the unit at the given sample time (or as
+    // soon as possible), without contending with the render thread:
+    if (!m_audioUnit)
+        return;
+
+    if (m_parameterQueueUnit != m_audioUnit){
+        // A new unit (the old one went with its graph). Nothing
+        // queued for the old one, or known about it, applies:
+        delete m_parameterQueue;
+        m_parameterQueue = new ParameterQueue();
+        OSStatus err = AudioUnitAddRenderNotify(m_audioUnit, parameterNotification, this);
+        m_parameterQueueUnit = (err == noErr) ? m_audioUnit : 0;
+    }
+
+    ParameterCommand command;
+    command.parameter = id;
+    command.scope = scope;
+    command.element = element;
+    command.value = value;
+    command.sampleTime = sampleTime;
+    command.rampFrames = rampFrames;
+    command.from = value;
+    if (rampFrames > 0){
+        // Where the ramp starts, unless the render
+        // thread has set the parameter since:
+        AudioUnitGetParameter(m_audioUnit, id, scope, element, &command.from);
+    }
+
+    bool running = m_audioGraph && m_audioGraph->isRunning();
+    if (m_parameterQueueUnit && !running){
+        // Nothing drains the queue, so stand in for the render thread
+        // and let what is still queued take effect first:
+        AudioUnitParameterTarget target(m_audioUnit);
+        m_parameterQueue->flush(&target);
+    } else if (m_parameterQueueUnit){
+        // If the queue is full, the command is kept and posted after
+        // the older ones have been applied. Setting it directly now
+        // would let those win over it:
+        m_parameterQueue->send(command);
+        return;
+    }
+
+    // Nothing renders, or we could not listen for renders. Set it directly:
+    OSStatus err = AudioUnitSetParameter(m_audioUnit, id, scope, element, value, 0);
+    BACKEND_ASSERT2(err == noErr, "Could not set parameter on audio unit.", NORMAL_ERROR)
+}
+
+void AudioNode::postKeptParameters()
+{
+    // Parameter changes that did not fit in the queue
+    // get another go whenever the graph starts or stops:
+    if (!m_audioUnit || m_parameterQueueUnit != m_audioUnit)
+        return;
+    if (m_audioGraph && m_audioGraph->isRunning())
+        m_parameterQueue->repost();
+    else {
+        AudioUnitParameterTarget target(m_audioUnit);
+        m_parameterQueue->flush(&target);
+    }
+}
+
+OSStatus AudioNode::parameterNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp *timeStamp, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList */*data*/)
+{
+    // Called on the render thread before each buffer is rendered:
+    if (!(*actionFlags & kAudioUnitRenderAction_PreRender) || !(timeStamp->mFlags & kAudioTimeStampSampleTimeValid))
+        return noErr;
+    AudioNode *node = static_cast<AudioNode *>(userData);
+    AudioUnit audioUnit = node->m_parameterQueueUnit;
+    if (!audioUnit)
+        return noErr;
+    AudioUnitParameterTarget target(audioUnit);
+    node->m_parameterQueue->process(&target, timeStamp->mSampleTime, frameCount);
+    return noErr;
+}
+
 void AudioNode::mediaNodeEvent(const MediaNodeEvent */*event*/)
 {
     // Override if needed
@@ -36,13 +36,16 @@ namespace QT7
         Q_OBJECT
         public:
             AudioOutputAudioPart();
+            ~AudioOutputAudioPart();
 
             void setVolume(float volume);
             float volume();
+            void setGraph(AudioGraph *audioGraph);
 
         protected:
             ComponentDescription getAudioNodeDescription() const;
             void initializeAudioUnit();
+            void mediaNodeEvent(const MediaNodeEvent *event);
 
         signals:
             void volumeChanged(qreal newVolume);
@@ -52,6 +55,7 @@ namespace QT7
             friend class AudioOutput;
             qreal m_volume;
             AudioDeviceID m_audioDevice;
+            bool m_shared;
             void setAudioDevice(AudioDeviceID device);
     };
 
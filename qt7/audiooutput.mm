@@ -19,6 +19,8 @@
 #include "audiograph.h"
 #include "audiodevice.h"
 #include "mediaobject.h"
+#include "medianodeevent.h"
+#include "sharedaudiooutput.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -31,13 +33,20 @@ AudioOutputAudioPart::AudioOutputAudioPart() : AudioNode(1, 0)
 {
     m_audioDevice = AudioDevice::defaultDevice(AudioDevice::Out);
     m_volume = 1;
+    m_shared = SharedAudioOutput::isEnabled();
+}
+
+AudioOutputAudioPart::~AudioOutputAudioPart()
+{
+    if (m_shared && m_audioUnit)
+        SharedAudioOutput::instance()->release(m_audioUnit);
 }
 
 ComponentDescription AudioOutputAudioPart::getAudioNodeDescription() const
 {
 	ComponentDescription description;
 	description.componentType = kAudioUnitType_Output;
-	description.componentSubType = kAudioUnitSubType_DefaultOutput;
+	description.componentSubType = m_shared ? kAudioUnitSubType_GenericOutput : kAudioUnitSubType_DefaultOutput;
 	description.componentManufacturer = kAudioUnitManufacturer_Apple;
 	description.componentFlags = 0;
 	description.componentFlagsMask = 0;
@@ -46,10 +55,47 @@ ComponentDescription AudioOutputAudioPart::getAudioNodeDescription() const
 
 void AudioOutputAudioPart::initializeAudioUnit()
 {
+    if (m_shared){
+        // Let the shared device stream pull our audio, converted
+        // by the generic output unit into the format it mixes in:
+        SharedAudioOutput *output = SharedAudioOutput::instance();
+        bool ok = output->attach(m_audioUnit, m_audioGraph->audioGraphRef());
+        BACKEND_ASSERT2(ok, "Could not attach audio output to the shared audio output.", NORMAL_ERROR)
+        AudioStreamBasicDescription format = output->streamFormat();
+        OSStatus err = AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Output, 0, &format, sizeof(format));
+        BACKEND_ASSERT2(err == noErr, "Could not set stream format on audio output unit.", NORMAL_ERROR)
+    }
     setAudioDevice(m_audioDevice);
     setVolume(m_volume);
 }
 
+void AudioOutputAudioPart::setGraph(AudioGraph *audioGraph)
+{
+    // Removing our node from the graph disposes the unit,
+    // so the shared output must stop pulling from it first:
+    if (m_shared && m_audioUnit && audioGraph != m_audioGraph)
+        SharedAudioOutput::instance()->release(m_audioUnit);
+    AudioNode::setGraph(audioGraph);
+}
+
+void AudioOutputAudioPart::mediaNodeEvent(const MediaNodeEvent *event)
+{
+    if (!m_shared || !m_audioUnit)
+        return;
+
+    switch (event->type()){
+    case MediaNodeEvent::AudioGraphStarted:
+        SharedAudioOutput::instance()->setActive(m_audioUnit, true);
+        break;
+    case MediaNodeEvent::AudioGraphStopped:
+        SharedAudioOutput::instance()->setActive(m_audioUnit, false);
+        break;
+    default:
+        break;
+    }
+}
+
 void AudioOutputAudioPart::setAudioDevice(AudioDeviceID device)
 {
     m_audioDevice = device;
@@ -57,7 +103,9 @@ void AudioOutputAudioPart::setAudioDevice(AudioDeviceID device)
         return;
     if (!m_audioUnit)
         return;
-    bool ok = AudioDevice::setDevice(m_audioUnit, m_audioDevice, AudioDevice::Out);
+    bool ok = m_shared
+        ? SharedAudioOutput::instance()->setAudioDevice(m_audioDevice)
+        : AudioDevice::setDevice(m_audioUnit, m_audioDevice, AudioDevice::Out);
     if (!ok)
         emit audioDeviceFailed();
 }
@@ -71,10 +119,18 @@ void AudioOutputAudioPart::setVolume(float volume)
     else
         m_volume = volume;
 
-    if (m_audioUnit){
+    if (m_audioUnit && m_shared){
+        SharedAudioOutput::instance()->setVolume(m_audioUnit, volume);
+        emit volumeChanged(qreal(volume));
+    } else if (m_audioUnit){
         float db = volume;//20.0 * log10(volume); // convert to db
-        OSStatus err = AudioUnitSetParameter(m_audioUnit, kHALOutputParam_Volume, kAudioUnitScope_Input, 0, db, 0);
-        BACKEND_ASSERT2(err == noErr, "Could not set volume on output audio unit.", FATAL_ERROR)
+        AudioStreamBasicDescription format;
+        UInt32 size = sizeof(format);
+        OSStatus err = AudioUnitGetProperty(m_audioUnit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Input, 0, &format, &size);
+        Float64 sampleRate = (err == noErr && format.mSampleRate > 0) ? format.mSampleRate : 44100;
+        setParameter(kHALOutputParam_Volume, kAudioUnitScope_Input, 0, db,
+            -1, UInt32(VolumeRampMilliseconds * sampleRate / 1000));
         emit volumeChanged(qreal(db));
     }
 }
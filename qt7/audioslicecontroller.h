@@ -0,0 +1,77 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_AUDIOSLICECONTROLLER_H
+#define Phonon_QT7_AUDIOSLICECONTROLLER_H
+
+#include <QtCore/QtGlobal>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Decides how many audio slices, and how many packets per slice, an
+        audio player should use. At regular intervals, the player reports
+        the fewest of its slices that were still waiting to be played just
+        before a refill since last time. If that drops below the target
+        slack (a fraction of all slices), or the slices ran out, the buffer
+        is grown. If there has been more than enough slack during a whole
+        observation window, the buffer is shrunk to lower the latency. A
+        higher target slack trades latency for fewer underruns.
+    */
+    class AudioSliceController
+    {
+        public:
+            AudioSliceController();
+
+            void setBounds(int minSlices, int maxSlices, int minPackets, int maxPackets);
+            void setTargetSlack(float slack);
+            float targetSlack() const;
+            void reset(int sliceCount, int packetCount);
+            bool addRefill(int pendingSlices);
+
+            int sliceCount() const;
+            int packetCount() const;
+            int maxSliceCount() const;
+            int underrunCount() const;
+
+        private:
+            int m_minSlices;
+            int m_maxSlices;
+            int m_minPackets;
+            int m_maxPackets;
+            float m_targetSlack;
+
+            int m_sliceCount;
+            int m_packetCount;
+            int m_refills;
+            float m_minSlack;
+            int m_underruns;
+
+            bool grow();
+            bool shrink();
+            void startWindow();
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_AUDIOSLICECONTROLLER_H
@@ -0,0 +1,148 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audioslicecontroller.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+// Number of reports to observe before shrinking the buffer, and how
+// much more slack than the target there must be for that to happen:
+static const int ObservationWindow = 32;
+static const float ShrinkMargin = 0.15f;
+
+AudioSliceController::AudioSliceController()
+{
+    m_minSlices = 4;
+    m_maxSlices = 64;
+    m_minPackets = 512;
+    m_maxPackets = 8192;
+    m_targetSlack = 0.25f;
+    m_underruns = 0;
+    reset(30, 4096);
+}
+
+void AudioSliceController::setBounds(int minSlices, int maxSlices, int minPackets, int maxPackets)
+{
+    m_minSlices = qMax(2, minSlices);
+    m_maxSlices = qMax(m_minSlices, maxSlices);
+    m_minPackets = qMax(1, minPackets);
+    m_maxPackets = qMax(m_minPackets, maxPackets);
+    reset(m_sliceCount, m_packetCount);
+}
+
+void AudioSliceController::setTargetSlack(float slack)
+{
+    m_targetSlack = qBound(0.0f, slack, 1.0f - ShrinkMargin);
+}
+
+float AudioSliceController::targetSlack() const
+{
+    return m_targetSlack;
+}
+
+void AudioSliceController::reset(int sliceCount, int packetCount)
+{
+    m_sliceCount = qBound(m_minSlices, sliceCount, m_maxSlices);
+    m_packetCount = qBound(m_minPackets, packetCount, m_maxPackets);
+    startWindow();
+}
+
+bool AudioSliceController::addRefill(int pendingSlices)
+{
+    // Returns true if the slice count or packet count changed:
+    ++m_refills;
+    float slack = float(pendingSlices) / float(m_sliceCount);
+    m_minSlack = qMin(m_minSlack, slack);
+
+    bool changed = false;
+    if (pendingSlices <= 0){
+        ++m_underruns;
+        changed = grow();
+        startWindow();
+    } else if (m_minSlack < m_targetSlack){
+        changed = grow();
+        startWindow();
+    } else if (m_refills >= ObservationWindow){
+        if (m_minSlack > m_targetSlack + ShrinkMargin)
+            changed = shrink();
+        startWindow();
+    }
+    return changed;
+}
+
+int AudioSliceController::sliceCount() const
+{
+    return m_sliceCount;
+}
+
+int AudioSliceController::packetCount() const
+{
+    return m_packetCount;
+}
+
+int AudioSliceController::maxSliceCount() const
+{
+    return m_maxSlices;
+}
+
+int AudioSliceController::underrunCount() const
+{
+    return m_underruns;
+}
+
+bool AudioSliceController::grow()
+{
+    // Prefer more slices over bigger ones, since
+    // that keeps the refill granularity:
+    if (m_sliceCount < m_maxSlices){
+        m_sliceCount = qMin(m_maxSlices, m_sliceCount + qMax(1, m_sliceCount / 2));
+        return true;
+    }
+    if (m_packetCount < m_maxPackets){
+        m_packetCount = qMin(m_maxPackets, m_packetCount * 2);
+        return true;
+    }
+    return false;
+}
+
+bool AudioSliceController::shrink()
+{
+    if (m_packetCount > m_minPackets && m_sliceCount == m_minSlices){
+        m_packetCount = qMax(m_minPackets, m_packetCount / 2);
+        return true;
+    }
+    if (m_sliceCount > m_minSlices){
+        m_sliceCount = qMax(m_minSlices, m_sliceCount - qMax(1, m_sliceCount / 4));
+        return true;
+    }
+    return false;
+}
+
+void AudioSliceController::startWindow()
+{
+    m_refills = 0;
+    m_minSlack = 1.0f;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -29,11 +29,56 @@ namespace Phonon
 {
 namespace QT7
 {
+    /**
+        Splits one audio stream into any number of outputs without
+        copying it. The input goes through a converter unit that passes
+        the audio through. The output of the converter is not connected
+        in the graph. Instead each sink gets a render callback that pulls
+        the converter once per render cycle, and hands every sink the same
+        buffers. Those buffers are only read by the sinks. A sink that
+        processes in place would write into them, so it gets a copy
+        in its own buffers instead. A render cycle is recognized by
+        its sample time, so all sinks should share one time base.
+    */
     class AudioNodeSplitter : public AudioNode
     {
         public:
             AudioNodeSplitter();
+            ~AudioNodeSplitter();
             ComponentDescription getAudioNodeDescription() const;
+
+            bool setStreamSpecification(AudioConnection *connection, ConnectionSide side);
+            bool connectToSink(AudioConnection *connection, AudioGraph *audioGraph);
+            void disconnectFromSink(AudioConnection *connection, AudioGraph *audioGraph);
+            void mediaNodeEvent(const MediaNodeEvent *event);
+
+        private:
+            enum {MaxBuffers = 32};
+
+            struct Branch
+            {
+                AudioNodeSplitter *splitter;
+                AUNode sinkNode;
+                volatile bool connected;
+                volatile bool copies;
+            };
+
+            static int maxOutputs();
+            static OSStatus branchRender(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+            OSStatus pull(const AudioTimeStamp *timeStamp, UInt32 frameCount, const AudioBufferList *layout);
+            void updateBranch(Branch &branch);
+
+            Branch *m_branches;
+            int m_branchCount;
+
+            // Render thread only. What the converter rendered
+            // last, and for which time and length:
+            AudioBufferList *m_pulled;
+            Float64 m_pulledSampleTime;
+            UInt32 m_pulledFrames;
+            AudioUnitRenderActionFlags m_pulledFlags;
+            OSStatus m_pulledStatus;
     };
 
     class AudioSplitter : public MediaNode
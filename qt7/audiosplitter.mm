@@ -16,6 +16,9 @@
 */
 
 #include "audiosplitter.h"
+#include "audiograph.h"
+#include "medianodeevent.h"
+#include <stddef.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -24,21 +27,214 @@ namespace Phonon
 namespace QT7
 {
 
-AudioNodeSplitter::AudioNodeSplitter() : AudioNode(1, 2)
+AudioNodeSplitter::AudioNodeSplitter() : AudioNode(1, maxOutputs())
 {
+    m_branchCount = m_maxOutputBusses;
+    m_branches = new Branch[m_branchCount];
+    for (int i=0; i<m_branchCount; ++i){
+        m_branches[i].splitter = this;
+        m_branches[i].sinkNode = 0;
+        m_branches[i].connected = false;
+        m_branches[i].copies = true;
+    }
+
+    m_pulled = (AudioBufferList *) malloc(offsetof(AudioBufferList, mBuffers) + MaxBuffers * sizeof(AudioBuffer));
+    m_pulled->mNumberBuffers = 0;
+    m_pulledSampleTime = -1;
+    m_pulledFrames = 0;
+    m_pulledFlags = 0;
+    m_pulledStatus = noErr;
+}
+
+AudioNodeSplitter::~AudioNodeSplitter()
+{
+    // Remove the units (and with them the
+    // callbacks) before the branches go:
+    setGraph(0);
+    delete[] m_branches;
+    free(m_pulled);
+}
+
+int AudioNodeSplitter::maxOutputs()
+{
+    static int outputs = 0;
+    if (!outputs){
+        QByteArray value = qgetenv("PHONON_QT7_SPLITTER_OUTPUTS");
+        outputs = (value.toInt() > 0) ? value.toInt() : 16;
+    }
+    return outputs;
 }
 
 ComponentDescription AudioNodeSplitter::getAudioNodeDescription() const
 {
 	ComponentDescription description;
 	description.componentType = kAudioUnitType_FormatConverter;
-	description.componentSubType = kAudioUnitSubType_Splitter;
+	description.componentSubType = kAudioUnitSubType_AUConverter;
 	description.componentManufacturer = kAudioUnitManufacturer_Apple;
 	description.componentFlags = 0;
 	description.componentFlagsMask = 0;
     return description;
 }
 
+bool AudioNodeSplitter::setStreamSpecification(AudioConnection *connection, ConnectionSide side)
+{
+    if (side == Sink)
+        return AudioNode::setStreamSpecification(connection, side);
+
+    // All outputs share the one output bus of the converter:
+    if (!connection->m_hasSourceSpecification)
+        return true;
+    OSStatus err = AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output,
+        0, &connection->m_sourceStreamDescription, sizeof(AudioStreamBasicDescription));
+    if (err != noErr){
+        DEBUG_AUDIO_STREAM("AudioNodeSplitter" << int(this) << " - failed setting stream format")
+        return false;
+    }
+    AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_AudioChannelLayout, kAudioUnitScope_Output,
+        0, connection->m_sourceChannelLayout, connection->m_sourceChannelLayoutSize);
+    return true;
+}
+
+bool AudioNodeSplitter::connectToSink(AudioConnection *connection, AudioGraph *audioGraph)
+{
+    int bus = connection->m_sourceOutputBus;
+    if (bus < 0 || bus >= m_branchCount)
+        return false;
+
+#if MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_5
+    if (QSysInfo::MacintoshVersion >= QSysInfo::MV_10_5){
+        Branch &branch = m_branches[bus];
+        branch.sinkNode = connection->m_sinkAudioNode->getInputAUNode();
+        branch.copies = true;
+        AURenderCallbackStruct callback;
+        callback.inputProc = branchRender;
+        callback.inputProcRefCon = &branch;
+        OSStatus err = AUGraphSetNodeInputCallback(audioGraph->audioGraphRef(),
+            branch.sinkNode, connection->m_sinkInputBus, &callback);
+        branch.connected = (err == noErr);
+        updateBranch(branch);
+        return branch.connected;
+    }
+#endif
+    // Without node input callbacks, only one
+    // sink can be connected to the converter:
+    return bus == 0 && AudioNode::connectToSink(connection, audioGraph);
+}
+
+void AudioNodeSplitter::disconnectFromSink(AudioConnection *connection, AudioGraph */*audioGraph*/)
+{
+    // The callback might be called until the graph is
+    // updated, so the branch itself must stay around:
+    int bus = connection->m_sourceOutputBus;
+    if (bus < 0 || bus >= m_branchCount)
+        return;
+    m_branches[bus].connected = false;
+    m_branches[bus].sinkNode = 0;
+}
+
+void AudioNodeSplitter::updateBranch(Branch &branch)
+{
+    // A sink that processes in place renders its output into the
+    // buffer it gets as input, so that sink needs a copy. Until
+    // the unit of the sink exists (or if it cannot tell), copy:
+    if (!m_audioGraph || !branch.sinkNode)
+        return;
+    AudioUnit sinkUnit = 0;
+    OSStatus err = AUGraphGetNodeInfo(m_audioGraph->audioGraphRef(), branch.sinkNode, 0, 0, 0, &sinkUnit);
+    if (err != noErr || !sinkUnit)
+        return;
+
+    UInt32 inPlace = 0;
+    UInt32 size = sizeof(inPlace);
+    err = AudioUnitGetProperty(sinkUnit, kAudioUnitProperty_InPlaceProcessing, kAudioUnitScope_Global, 0, &inPlace, &size);
+    branch.copies = (err != noErr) || inPlace;
+    DEBUG_AUDIO_GRAPH("AudioNodeSplitter" << int(this) << "output to" << int(branch.sinkNode) << (branch.copies ? "copies" : "shares buffers"))
+}
+
+void AudioNodeSplitter::mediaNodeEvent(const MediaNodeEvent *event)
+{
+    switch (event->type()){
+    case MediaNodeEvent::AudioGraphInitialized:
+        // All units exist now:
+        for (int i=0; i<m_branchCount; ++i){
+            if (m_branches[i].connected)
+                updateBranch(m_branches[i]);
+        }
+        m_pulledSampleTime = -1;
+        m_pulledFrames = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+OSStatus AudioNodeSplitter::branchRender(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp *timeStamp, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList *data)
+{
+    // Called on the render thread. Don't lock or allocate:
+    if (frameCount == 0)
+        return noErr;
+    Branch *branch = static_cast<Branch *>(userData);
+    AudioNodeSplitter *splitter = branch->splitter;
+    OSStatus err = splitter->pull(timeStamp, frameCount, data);
+    if (err != noErr)
+        return err;
+
+    const AudioBufferList *pulled = splitter->m_pulled;
+    if (data->mNumberBuffers != pulled->mNumberBuffers)
+        return kAudioUnitErr_FormatNotSupported;
+
+    for (UInt32 i=0; i<data->mNumberBuffers; ++i){
+        const AudioBuffer &in = pulled->mBuffers[i];
+        AudioBuffer &out = data->mBuffers[i];
+        UInt32 bytes = (in.mDataByteSize / splitter->m_pulledFrames) * frameCount;
+        if (branch->copies && out.mData){
+            memcpy(out.mData, in.mData, bytes);
+        } else {
+            // Hand over the buffer of the converter. It stays
+            // valid until the converter renders next time, which
+            // is after all sinks have been pulled this cycle:
+            out.mData = in.mData;
+        }
+        out.mDataByteSize = bytes;
+    }
+    *actionFlags |= (splitter->m_pulledFlags & kAudioUnitRenderAction_OutputIsSilence);
+    return noErr;
+}
+
+OSStatus AudioNodeSplitter::pull(const AudioTimeStamp *timeStamp, UInt32 frameCount, const AudioBufferList *layout)
+{
+    // Render the converter only once per cycle. The first sink
+    // to be pulled does it, and the others reuse the result.
+    // There is no cycle count to go by, so the sample time tells
+    // the cycles apart: the sinks are pulled at the time of the
+    // cycle. A sink that asks for a time inside what was rendered
+    // last (one behind a unit with its own time base) gets the same
+    // audio. Rendering again would advance the input a second time
+    // in the cycle, and overwrite the buffers shared with the other
+    // sinks. A time past that span, or before it (the timeline
+    // started over), begins a new cycle:
+    const Float64 time = timeStamp->mSampleTime;
+    if (time >= m_pulledSampleTime && time < m_pulledSampleTime + m_pulledFrames
+        && frameCount <= m_pulledFrames && layout->mNumberBuffers == m_pulled->mNumberBuffers)
+        return m_pulledStatus;
+    if (!m_audioUnit || layout->mNumberBuffers > MaxBuffers)
+        return kAudioUnitErr_Uninitialized;
+
+    // Null buffers make the converter render into its own:
+    m_pulled->mNumberBuffers = layout->mNumberBuffers;
+    for (UInt32 i=0; i<layout->mNumberBuffers; ++i){
+        m_pulled->mBuffers[i].mNumberChannels = layout->mBuffers[i].mNumberChannels;
+        m_pulled->mBuffers[i].mDataByteSize = 0;
+        m_pulled->mBuffers[i].mData = 0;
+    }
+    m_pulledFlags = 0;
+    m_pulledStatus = AudioUnitRender(m_audioUnit, &m_pulledFlags, timeStamp, 0, frameCount, m_pulled);
+    m_pulledSampleTime = timeStamp->mSampleTime;
+    m_pulledFrames = frameCount;
+    return m_pulledStatus;
+}
+
 AudioSplitter::AudioSplitter(QObject *parent) : MediaNode(AudioSink | AudioSource, new AudioNodeSplitter(), parent)
 {
 }
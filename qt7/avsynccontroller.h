@@ -0,0 +1,66 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_AVSYNCCONTROLLER_H
+#define Phonon_QT7_AVSYNCCONTROLLER_H
+
+#include <QtCore/QtGlobal>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Keeps audio in sync with video by adjusting the audio playback
+        rate slightly, rather than by seeking the audio. It is fed with
+        measurements of how far audio is ahead of video (in ms), filters
+        out the measurement noise, and answers with the rate audio
+        should play at: at most a few hundred ppm away from one, which
+        is not audible. If the drift grows beyond what such small
+        adjustments can catch up with, a hard resync is requested.
+    */
+    class AVSyncController
+    {
+        public:
+            AVSyncController();
+
+            void reset();
+            void addMeasurement(qint64 drift);
+
+            double rate() const;
+            double filteredDrift() const;
+            bool needsResync() const;
+
+            void setMaxAdjustment(double ppm);
+            void setResyncThreshold(qint64 ms);
+
+        private:
+            bool m_hasMeasurement;
+            double m_filteredDrift;
+            double m_rate;
+            double m_maxAdjustment;
+            qint64 m_resyncThreshold;
+            bool m_needsResync;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_AVSYNCCONTROLLER_H
@@ -0,0 +1,99 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "avsynccontroller.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+// How much of each new measurement goes into the filtered drift,
+// the drift (in ms) that is considered in sync, and the adjustment
+// (in ppm) per ms of drift:
+static const double FilterWeight = 0.05;
+static const double DeadBand = 5.0;
+static const double AdjustmentPerMs = 20.0;
+
+AVSyncController::AVSyncController()
+{
+    m_maxAdjustment = 500;
+    m_resyncThreshold = 100;
+    reset();
+}
+
+void AVSyncController::reset()
+{
+    m_hasMeasurement = false;
+    m_filteredDrift = 0;
+    m_rate = 1.0;
+    m_needsResync = false;
+}
+
+void AVSyncController::addMeasurement(qint64 drift)
+{
+    if (!m_hasMeasurement){
+        m_filteredDrift = double(drift);
+        m_hasMeasurement = true;
+    } else
+        m_filteredDrift += FilterWeight * (double(drift) - m_filteredDrift);
+
+    // Audio ahead of video (positive drift) means audio should play slower:
+    double magnitude = qAbs(m_filteredDrift);
+    if (magnitude <= DeadBand)
+        m_rate = 1.0;
+    else {
+        double sign = (m_filteredDrift > 0) ? 1.0 : -1.0;
+        double ppm = qMin(m_maxAdjustment, (magnitude - DeadBand) * AdjustmentPerMs);
+        m_rate = 1.0 - sign * ppm / 1000000.0;
+    }
+
+    // A single measurement far off (e.g. after a hickup in
+    // video) is also reason enough to resync right away:
+    m_needsResync = magnitude > m_resyncThreshold || qAbs(drift) > 2 * m_resyncThreshold;
+}
+
+double AVSyncController::rate() const
+{
+    return m_rate;
+}
+
+double AVSyncController::filteredDrift() const
+{
+    return m_filteredDrift;
+}
+
+bool AVSyncController::needsResync() const
+{
+    return m_needsResync;
+}
+
+void AVSyncController::setMaxAdjustment(double ppm)
+{
+    m_maxAdjustment = qMax(0.0, ppm);
+}
+
+void AVSyncController::setResyncThreshold(qint64 ms)
+{
+    m_resyncThreshold = ms;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,79 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_BUFFERINGESTIMATOR_H
+#define Phonon_QT7_BUFFERINGESTIMATOR_H
+
+#include <QtCore/QtGlobal>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Decides when playback of a progressively downloaded movie should
+        pause to buffer, and when it is safe to continue. It is fed with
+        samples of how much of the movie has been loaded (in media time)
+        at a given wall clock time, and estimates the download rate in
+        media milliseconds per wall clock millisecond. A rate above one
+        means that the download is faster than playback.
+
+        Buffering starts when the loaded time is less than the low
+        watermark ahead of the play position. It stops when the download
+        is estimated to stay ahead of playback until the end of the movie,
+        and at least the high watermark is loaded ahead. Without a download
+        rate to estimate from, it stops when the high watermark is reached.
+    */
+    class BufferingEstimator
+    {
+        public:
+            BufferingEstimator();
+
+            void reset();
+            void setWatermarks(qint64 low, qint64 high);
+            void addSample(qint64 wallTime, qint64 loadedTime, qint64 currentTime, qint64 duration);
+
+            bool isBuffering() const;
+            qint64 timeToSafePlay() const;
+            float downloadRate() const;
+            int bufferPercent() const;
+
+        private:
+            qint64 m_lowWatermark;
+            qint64 m_highWatermark;
+
+            bool m_hasSample;
+            qint64 m_lastWallTime;
+            qint64 m_lastLoadedTime;
+            bool m_hasRate;
+            float m_rate;
+            bool m_loadInfoAvailable;
+
+            qint64 m_lead;
+            qint64 m_timeToSafePlay;
+            bool m_buffering;
+            qint64 m_bufferingStart;
+            qint64 m_bufferingElapsed;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_BUFFERINGESTIMATOR_H
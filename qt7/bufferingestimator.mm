@@ -0,0 +1,143 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bufferingestimator.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+BufferingEstimator::BufferingEstimator()
+{
+    // Buffer when less than one second is loaded ahead,
+    // and make sure three seconds are before continuing:
+    m_lowWatermark = 1000;
+    m_highWatermark = 3000;
+    reset();
+}
+
+void BufferingEstimator::reset()
+{
+    m_hasSample = false;
+    m_lastWallTime = 0;
+    m_lastLoadedTime = 0;
+    m_hasRate = false;
+    m_rate = 0;
+    m_loadInfoAvailable = false;
+    m_lead = 0;
+    m_timeToSafePlay = -1;
+    m_buffering = false;
+    m_bufferingStart = 0;
+    m_bufferingElapsed = 0;
+}
+
+void BufferingEstimator::setWatermarks(qint64 low, qint64 high)
+{
+    m_lowWatermark = low;
+    m_highWatermark = qMax(low, high);
+}
+
+void BufferingEstimator::addSample(qint64 wallTime, qint64 loadedTime, qint64 currentTime, qint64 duration)
+{
+    // Movies that never report anything loaded (e.g. when the movie
+    // cannot tell) are not buffered at all:
+    if (loadedTime > 0)
+        m_loadInfoAvailable = true;
+
+    if (!m_hasSample){
+        m_hasSample = true;
+        m_lastWallTime = wallTime;
+        m_lastLoadedTime = loadedTime;
+    } else {
+        // Measure the rate over at least half a second
+        // since the loaded time grows in steps:
+        qint64 wallDelta = wallTime - m_lastWallTime;
+        if (wallDelta >= 500){
+            float rate = float(qMax(qint64(0), loadedTime - m_lastLoadedTime)) / float(wallDelta);
+            m_rate = m_hasRate ? m_rate + 0.25f * (rate - m_rate) : rate;
+            m_hasRate = true;
+            m_lastWallTime = wallTime;
+            m_lastLoadedTime = loadedTime;
+        }
+    }
+
+    bool fullyLoaded = duration > 0 && loadedTime >= duration;
+    m_lead = loadedTime - currentTime;
+
+    // The time we need to wait so that, when playing from now on, the
+    // download finishes before playback reaches the end. And so that
+    // the high watermark is reached before starting:
+    if (fullyLoaded)
+        m_timeToSafePlay = 0;
+    else if (!m_hasRate || m_rate <= 0)
+        m_timeToSafePlay = -1;
+    else {
+        float untilEnd = float(duration - loadedTime) / m_rate - float(duration - currentTime);
+        float untilWatermark = float(m_highWatermark - m_lead) / m_rate;
+        m_timeToSafePlay = qint64(qMax(0.0f, qMax(untilEnd, untilWatermark)));
+    }
+
+    if (!m_buffering){
+        if (m_loadInfoAvailable && !fullyLoaded && m_lead < m_lowWatermark){
+            m_buffering = true;
+            m_bufferingStart = wallTime;
+        }
+    } else if (fullyLoaded || m_timeToSafePlay == 0){
+        m_buffering = false;
+    } else if (m_timeToSafePlay < 0 && m_lead >= m_highWatermark){
+        // No download rate to estimate from (e.g. the loaded time has
+        // not moved lately). Settle for the high watermark:
+        m_buffering = false;
+    }
+    m_bufferingElapsed = m_buffering ? wallTime - m_bufferingStart : 0;
+}
+
+bool BufferingEstimator::isBuffering() const
+{
+    return m_buffering;
+}
+
+qint64 BufferingEstimator::timeToSafePlay() const
+{
+    // In milliseconds, or -1 if unknown:
+    return m_timeToSafePlay;
+}
+
+float BufferingEstimator::downloadRate() const
+{
+    return m_rate;
+}
+
+int BufferingEstimator::bufferPercent() const
+{
+    if (!m_buffering)
+        return 100;
+    if (m_timeToSafePlay < 0){
+        // No download rate yet. Use how much is loaded ahead:
+        qint64 lead = qBound(qint64(0), m_lead, m_highWatermark);
+        return m_highWatermark ? int(lead * 100 / m_highWatermark) : 0;
+    }
+    qint64 total = m_bufferingElapsed + m_timeToSafePlay;
+    return total ? int(m_bufferingElapsed * 100 / total) : 100;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,66 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_CACHEDURLSTREAM_H
+#define Phonon_QT7_CACHEDURLSTREAM_H
+
+#include <phonon/abstractmediastream.h>
+#include <QtCore/QUrl>
+#include "urlrangereader.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    class UrlFetchThread;
+
+    /**
+        Streams a remote (http) url through a UrlRangeReader. Requests
+        are sent from a separate thread, and needData returns without
+        writing while a request is outstanding. The stream must thus be
+        read through a QuickTimeStreamReader with read-ahead, which asks
+        again, and accepts data written from any thread.
+    */
+    class CachedUrlStream : public Phonon::AbstractMediaStream
+    {
+        Q_OBJECT
+
+    public:
+        CachedUrlStream(const QUrl &url, const QString &cacheDirectory, qint64 cacheSize, QObject *parent = 0);
+        ~CachedUrlStream();
+
+        bool open();
+        static QString defaultCacheDirectory();
+
+    protected:
+        void reset();
+        void needData();
+        void seekStream(qint64 offset);
+
+    private:
+        QUrl m_url;
+        UrlFetchThread *m_fetchThread;
+        UrlRangeReader m_reader;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_CACHEDURLSTREAM_H
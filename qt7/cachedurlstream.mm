@@ -0,0 +1,337 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cachedurlstream.h"
+#include "urlrangereader.h"
+#include "backendheader.h"
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QTime>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QDesktopServices>
+
+#import <Foundation/Foundation.h>
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+@interface PhononUrlFetchDelegate : NSObject
+{
+@private
+    Phonon::QT7::UrlFetch *m_fetch;
+}
+
+- (PhononUrlFetchDelegate *) initWithFetch:(Phonon::QT7::UrlFetch *)fetch;
+@end
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static QByteArray headerValue(NSDictionary *headers, NSString *name)
+{
+    NSString *value = [headers objectForKey:name];
+    return value ? QByteArray([value UTF8String]) : QByteArray();
+}
+
+@implementation PhononUrlFetchDelegate
+
+- (PhononUrlFetchDelegate *) initWithFetch:(Phonon::QT7::UrlFetch *)fetch
+{
+    self = [super init];
+    if (self)
+        m_fetch = fetch;
+    return self;
+}
+
+- (void) connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    Q_UNUSED(connection);
+    // Redirects can give more than one response. The last one counts:
+    m_fetch->data.clear();
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]){
+        m_fetch->failed = true;
+        m_fetch->finished = true;
+        return;
+    }
+
+    NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
+    NSDictionary *headers = [httpResponse allHeaderFields];
+    m_fetch->status = [httpResponse statusCode];
+    m_fetch->contentLength = [httpResponse expectedContentLength];
+    m_fetch->acceptRanges = headerValue(headers, @"Accept-Ranges");
+    m_fetch->contentRange = headerValue(headers, @"Content-Range");
+    m_fetch->eTag = headerValue(headers, @"ETag");
+    m_fetch->lastModified = headerValue(headers, @"Last-Modified");
+
+    // A server that ignores the range answers with the whole resource.
+    // That is only usable if we asked for the start of it (and then only
+    // the bytes asked for are read before the connection is closed):
+    if (!m_fetch->head && m_fetch->status != 206 && !(m_fetch->status == 200 && m_fetch->offset == 0)){
+        m_fetch->failed = true;
+        m_fetch->finished = true;
+    }
+}
+
+- (void) connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+    Q_UNUSED(connection);
+    int length = qMin(int([data length]), m_fetch->size - m_fetch->data.size());
+    if (length > 0)
+        m_fetch->data.append(static_cast<const char *>([data bytes]), length);
+    if (m_fetch->data.size() >= m_fetch->size)
+        m_fetch->finished = true;
+}
+
+- (void) connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+    Q_UNUSED(connection);
+    Q_UNUSED(error);
+    m_fetch->failed = true;
+    m_fetch->finished = true;
+}
+
+- (void) connectionDidFinishLoading:(NSURLConnection *)connection
+{
+    Q_UNUSED(connection);
+    m_fetch->finished = true;
+}
+
+@end
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+/**
+    Sends one request at a time to the server, and runs the connection
+    on its own run loop. This way the thread asking (e.g. the stream
+    reader's read-ahead thread) is never stuck on a server that does
+    not answer.
+*/
+class UrlFetchThread : public QThread, public UrlRangeReader::Fetcher
+{
+public:
+    UrlFetchThread(const QUrl &url);
+    void stop();
+
+    // Overridden section from UrlRangeReader::Fetcher:
+    void startFetch(UrlFetch *fetch);
+    bool waitForFetch(int timeout);
+    void cancelFetch();
+
+protected:
+    void run();
+
+private:
+    QUrl m_url;
+    QMutex m_mutex;
+    QWaitCondition m_requestWait;
+    QWaitCondition m_resultWait;
+    UrlFetch *m_fetch;
+    bool m_done;
+    bool m_cancel;
+    bool m_stop;
+
+    bool isCancelled();
+    void perform(UrlFetch *fetch);
+};
+
+UrlFetchThread::UrlFetchThread(const QUrl &url)
+{
+    m_url = url;
+    m_fetch = 0;
+    m_done = false;
+    m_cancel = false;
+    m_stop = false;
+}
+
+void UrlFetchThread::startFetch(UrlFetch *fetch)
+{
+    QMutexLocker locker(&m_mutex);
+    m_fetch = fetch;
+    m_done = false;
+    m_cancel = false;
+    if (m_stop){
+        fetch->failed = true;
+        m_done = true;
+        return;
+    }
+    m_requestWait.wakeAll();
+}
+
+bool UrlFetchThread::waitForFetch(int timeout)
+{
+    QMutexLocker locker(&m_mutex);
+    QTime time;
+    time.start();
+    while (m_fetch && !m_done){
+        int timeLeft = timeout - time.elapsed();
+        if (timeLeft <= 0)
+            return false;
+        m_resultWait.wait(&m_mutex, timeLeft);
+    }
+    return true;
+}
+
+void UrlFetchThread::cancelFetch()
+{
+    // The request must not be touched after we return, so wait
+    // for the thread to let go of it. It checks for cancel often:
+    QMutexLocker locker(&m_mutex);
+    m_cancel = true;
+    while (m_fetch && !m_done)
+        m_resultWait.wait(&m_mutex);
+    if (m_fetch)
+        m_fetch->failed = true;
+    m_fetch = 0;
+}
+
+void UrlFetchThread::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stop = true;
+        m_cancel = true;
+        m_requestWait.wakeAll();
+    }
+    wait();
+}
+
+bool UrlFetchThread::isCancelled()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cancel;
+}
+
+void UrlFetchThread::run()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stop){
+        if (!m_fetch || m_done){
+            m_requestWait.wait(&m_mutex);
+            continue;
+        }
+        UrlFetch *fetch = m_fetch;
+        locker.unlock();
+        perform(fetch);
+        locker.relock();
+        m_done = true;
+        m_resultWait.wakeAll();
+    }
+}
+
+void UrlFetchThread::perform(UrlFetch *fetch)
+{
+    PhononAutoReleasePool pool;
+    NSString *urlString = (NSString *)PhononCFString::toCFStringRef(QString::fromLatin1(m_url.toEncoded()));
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:urlString]];
+    if (fetch->head){
+        [request setHTTPMethod:@"HEAD"];
+    } else {
+        QString range = QString::fromLatin1("bytes=%1-%2").arg(fetch->offset).arg(fetch->offset + fetch->size - 1);
+        [request setValue:(NSString *)PhononCFString::toCFStringRef(range) forHTTPHeaderField:@"Range"];
+    }
+
+    PhononUrlFetchDelegate *delegate = [[PhononUrlFetchDelegate alloc] initWithFetch:fetch];
+    NSURLConnection *connection = [[NSURLConnection alloc] initWithRequest:request delegate:delegate startImmediately:NO];
+    NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+    [connection scheduleInRunLoop:runLoop forMode:NSDefaultRunLoopMode];
+    [connection start];
+    while (!fetch->finished){
+        if (isCancelled()){
+            fetch->failed = true;
+            break;
+        }
+        [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    }
+
+    // Closing the connection also stops a server that
+    // sends more than we asked for:
+    [connection cancel];
+    [connection release];
+    [delegate release];
+}
+
+CachedUrlStream::CachedUrlStream(const QUrl &url, const QString &cacheDirectory, qint64 cacheSize, QObject *parent)
+    : AbstractMediaStream(parent), m_fetchThread(new UrlFetchThread(url)),
+    m_reader(cacheDirectory, cacheSize, m_fetchThread)
+{
+    m_url = url;
+    m_fetchThread->start();
+}
+
+CachedUrlStream::~CachedUrlStream()
+{
+    m_reader.close();
+    m_fetchThread->stop();
+    delete m_fetchThread;
+}
+
+QString CachedUrlStream::defaultCacheDirectory()
+{
+    return QDesktopServices::storageLocation(QDesktopServices::CacheLocation) + QLatin1String("/phonon_qt7_urlcache");
+}
+
+bool CachedUrlStream::open()
+{
+    if (!m_reader.open(m_url.toEncoded()))
+        return false;
+    setStreamSize(m_reader.size());
+    setStreamSeekable(true);
+    return true;
+}
+
+void CachedUrlStream::reset()
+{
+    m_reader.seek(0);
+}
+
+void CachedUrlStream::seekStream(qint64 offset)
+{
+    m_reader.seek(offset);
+}
+
+void CachedUrlStream::needData()
+{
+    // Called from the stream reader's read-ahead thread. While a
+    // request is outstanding nothing is written, and the reader
+    // asks again a little later:
+    QByteArray data;
+    switch (m_reader.read(&data)){
+    case UrlRangeReader::Data:
+        writeData(data);
+        break;
+    case UrlRangeReader::EndOfData:
+        endOfData();
+        break;
+    case UrlRangeReader::Failed:
+        error(Phonon::NormalError, QLatin1String("Could not read media from the network."));
+        endOfData();
+        break;
+    case UrlRangeReader::Pending:
+        break;
+    }
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#include "moc_cachedurlstream.cpp"
@@ -0,0 +1,145 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "containersniffer.h"
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+static bool startsWith(const unsigned char *data, int size, int offset, const char *magic, int magicSize)
+{
+    return offset + magicSize <= size && memcmp(data + offset, magic, magicSize) == 0;
+}
+
+static bool isMpegAudioFrameHeader(const unsigned char *data, int size, int offset)
+{
+    // Frame sync (11 bits), then version, layer, bitrate and sample rate
+    // fields that must not contain reserved or invalid values:
+    if (offset + 4 > size)
+        return false;
+    const unsigned char *h = data + offset;
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0)
+        return false;
+    int version = (h[1] >> 3) & 0x3;
+    int layer = (h[1] >> 1) & 0x3;
+    int bitrate = (h[2] >> 4) & 0xF;
+    int sampleRate = (h[2] >> 2) & 0x3;
+    return version != 1 && layer != 0 && bitrate != 0xF && bitrate != 0 && sampleRate != 3;
+}
+
+static int mpegAudioFrameSize(const unsigned char *h)
+{
+    static const int bitratesV1[3][16] = {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},  // Layer I
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},     // Layer II
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}};     // Layer III
+    static const int bitratesV2[3][16] = {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},     // Layer I
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},          // Layer II
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}};         // Layer III
+    static const int sampleRates[3] = {44100, 48000, 32000};
+
+    int version = (h[1] >> 3) & 0x3;    // 3 = MPEG 1, 2 = MPEG 2, 0 = MPEG 2.5
+    int layer = 3 - ((h[1] >> 1) & 0x3);  // 0 = Layer I, 1 = Layer II, 2 = Layer III
+    int padding = (h[2] >> 1) & 0x1;
+    int bitrate = (version == 3 ? bitratesV1 : bitratesV2)[layer][(h[2] >> 4) & 0xF] * 1000;
+    int sampleRate = sampleRates[(h[2] >> 2) & 0x3];
+    if (version == 2)
+        sampleRate /= 2;
+    else if (version == 0)
+        sampleRate /= 4;
+
+    if (layer == 0)
+        return (12 * bitrate / sampleRate + padding) * 4;
+    if (layer == 2 && version != 3)
+        return 72 * bitrate / sampleRate + padding;
+    return 144 * bitrate / sampleRate + padding;
+}
+
+const char *sniffContainerType(const char *bytes, int size)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(bytes);
+    if (!data || size < 4)
+        return 0;
+
+    // RIFF based formats:
+    if (startsWith(data, size, 0, "RIFF", 4)){
+        if (startsWith(data, size, 8, "AVI ", 4))
+            return ".avi";
+        if (startsWith(data, size, 8, "WAVE", 4))
+            return ".wav";
+        return 0;
+    }
+
+    // ISO base media files (mp4, m4a, m4p) and QuickTime movies:
+    if (startsWith(data, size, 4, "ftyp", 4)){
+        if (startsWith(data, size, 8, "M4P ", 4))
+            return ".m4p";
+        if (startsWith(data, size, 8, "qt  ", 4))
+            return ".mov";
+        return ".mp4";
+    }
+    if (startsWith(data, size, 4, "moov", 4) || startsWith(data, size, 4, "mdat", 4)
+        || startsWith(data, size, 4, "wide", 4) || startsWith(data, size, 4, "free", 4)
+        || startsWith(data, size, 4, "skip", 4) || startsWith(data, size, 4, "pnot", 4))
+        return ".mov";
+
+    if (startsWith(data, size, 0, "OggS", 4))
+        return ".ogg";
+
+    // ASF (wmv, wma) header object GUID:
+    static const char asfGuid[16] = {
+        '\x30', '\x26', '\xB2', '\x75', '\x8E', '\x66', '\xCF', '\x11',
+        '\xA6', '\xD9', '\x00', '\xAA', '\x00', '\x62', '\xCE', '\x6C'};
+    if (startsWith(data, size, 0, asfGuid, 16))
+        return ".wmv";
+
+    // MPEG program streams start with a pack header. The bits following
+    // the start code tells if it is MPEG 1 (system stream) or MPEG 2:
+    if (startsWith(data, size, 0, "\x00\x00\x01\xBA", 4)){
+        if (size < 5)
+            return 0;
+        if ((data[4] & 0xF0) == 0x20)
+            return ".m1s";
+        if ((data[4] & 0xC0) == 0x40)
+            return ".mpeg";
+        return 0;
+    }
+    if (startsWith(data, size, 0, "\x00\x00\x01\xB3", 4))
+        return ".mpeg";
+
+    if (startsWith(data, size, 0, "ID3", 3))
+        return ".mp3";
+
+    // A raw MPEG audio stream. A single frame sync is easily found by
+    // accident, so require the following frame to line up as well:
+    if (isMpegAudioFrameHeader(data, size, 0)){
+        int next = mpegAudioFrameSize(data);
+        if (next > 0 && isMpegAudioFrameHeader(data, size, next))
+            return ".mp3";
+    }
+    return 0;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,234 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef Phonon_QT7_DECODEBLOCKQUEUE_H
+#define Phonon_QT7_DECODEBLOCKQUEUE_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include "lockfreequeue.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Hands blocks of decoded audio from a decoder thread (the producer)
+        to the thread playing them (the consumer). The blocks themselves
+        belong to the caller, and are known here only by their index.
+
+        The producer takes free blocks, fills them, and publishes them
+        through a ready queue. The consumer reads them, possibly a little
+        at a time, and releases them back to the free queue. A seek bumps
+        the generation, and hands the seek request over to the producer.
+        Blocks published before the producer took the request are dropped
+        on the consumer side, so nothing decoded before a seek is played.
+    */
+    template <typename SeekRequest>
+    class DecodeBlockQueue
+    {
+        public:
+            DecodeBlockQueue(int blockCount)
+                : m_readyBlocks(blockCount + 1), m_freeBlocks(blockCount + 1)
+            {
+                m_blockCount = blockCount;
+                m_frames = new int[blockCount];
+                m_generations = new int[blockCount];
+                m_endOfStream = new bool[blockCount];
+                m_producerGeneration = 0;
+                m_consumerGeneration = 0;
+                m_currentBlock = -1;
+                m_currentOffset = 0;
+                m_stop = false;
+                reset();
+            }
+
+            ~DecodeBlockQueue()
+            {
+                delete[] m_frames;
+                delete[] m_generations;
+                delete[] m_endOfStream;
+            }
+
+            int blockCount() const
+            {
+                return m_blockCount;
+            }
+
+            // Make all blocks free. Only while the producer is not running:
+            void reset()
+            {
+                int index;
+                while (m_readyBlocks.pop(index)) {}
+                while (m_freeBlocks.pop(index)) {}
+                for (index = 0; index < m_blockCount; ++index){
+                    m_frames[index] = 0;
+                    m_generations[index] = -1;
+                    m_endOfStream[index] = false;
+                    m_freeBlocks.push(index);
+                }
+                m_producerGeneration = m_generation;
+                m_consumerGeneration = m_generation;
+                m_currentBlock = -1;
+                m_currentOffset = 0;
+                m_stop = false;
+            }
+
+            // Consumer side:
+
+            void seek(const SeekRequest &request)
+            {
+                if (m_currentBlock != -1){
+                    releaseBlock(m_currentBlock);
+                    m_currentBlock = -1;
+                }
+                QMutexLocker locker(&m_mutex);
+                m_seekRequest = request;
+                m_consumerGeneration = m_generation.fetchAndAddOrdered(1) + 1;
+                m_wait.wakeAll();
+            }
+
+            // The block to read from next, or -1 if none is ready.
+            // Blocks decoded before the last seek are dropped:
+            int currentBlock()
+            {
+                while (m_currentBlock == -1){
+                    int index;
+                    if (!m_readyBlocks.pop(index))
+                        return -1;
+                    if (m_generations[index] != m_consumerGeneration){
+                        releaseBlock(index);
+                        continue;
+                    }
+                    m_currentBlock = index;
+                    m_currentOffset = 0;
+                }
+                return m_currentBlock;
+            }
+
+            int currentOffset() const
+            {
+                return m_currentOffset;
+            }
+
+            int framesLeft() const
+            {
+                return m_currentBlock == -1 ? 0 : m_frames[m_currentBlock] - m_currentOffset;
+            }
+
+            // 'frames' of the current block have been read. The block is
+            // released when all of it is. Returns true if it ended the stream:
+            bool advance(int frames)
+            {
+                m_currentOffset += frames;
+                if (m_currentOffset < m_frames[m_currentBlock])
+                    return false;
+                bool endOfStream = m_endOfStream[m_currentBlock];
+                releaseBlock(m_currentBlock);
+                m_currentBlock = -1;
+                return endOfStream;
+            }
+
+            void stop()
+            {
+                QMutexLocker locker(&m_mutex);
+                m_stop = true;
+                m_wait.wakeAll();
+            }
+
+            // Producer side:
+
+            bool isStopped() const
+            {
+                return m_stop;
+            }
+
+            // Returns true, and the request, if a seek was requested since
+            // last time. Blocks published from now on belong to it:
+            bool takeSeek(SeekRequest *request)
+            {
+                if (m_generation.fetchAndAddAcquire(0) == m_producerGeneration)
+                    return false;
+                QMutexLocker locker(&m_mutex);
+                m_producerGeneration = m_generation;
+                *request = m_seekRequest;
+                return true;
+            }
+
+            // A free block to fill, or -1 if all are in use:
+            int acquireBlock()
+            {
+                int index;
+                return m_freeBlocks.pop(index) ? index : -1;
+            }
+
+            void publishBlock(int index, int frames, bool endOfStream)
+            {
+                m_frames[index] = frames;
+                m_generations[index] = m_producerGeneration;
+                m_endOfStream[index] = endOfStream;
+                m_readyBlocks.push(index);
+            }
+
+            // Wait (at most 'ms') for a block to be
+            // released, for a seek, or to be stopped:
+            void waitForConsumer(int ms)
+            {
+                QMutexLocker locker(&m_mutex);
+                if (!m_stop && m_generation.fetchAndAddAcquire(0) == m_producerGeneration)
+                    m_wait.wait(&m_mutex, ms);
+            }
+
+        private:
+            void releaseBlock(int index)
+            {
+                m_freeBlocks.push(index);
+                QMutexLocker locker(&m_mutex);
+                m_wait.wakeAll();
+            }
+
+            int m_blockCount;
+            LockFreeQueue<int> m_readyBlocks;
+            LockFreeQueue<int> m_freeBlocks;
+            // Written by the producer before a block is published:
+            int *m_frames;
+            int *m_generations;
+            bool *m_endOfStream;
+
+            QAtomicInt m_generation;
+            int m_producerGeneration;
+            int m_consumerGeneration;
+            SeekRequest m_seekRequest;
+            QMutex m_mutex;
+            QWaitCondition m_wait;
+            volatile bool m_stop;
+
+            // Consumer side only:
+            int m_currentBlock;
+            int m_currentOffset;
+
+            DecodeBlockQueue(const DecodeBlockQueue &);
+            DecodeBlockQueue &operator=(const DecodeBlockQueue &);
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_DECODEBLOCKQUEUE_H
@@ -0,0 +1,203 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_DSPEFFECTS_H
+#define Phonon_QT7_DSPEFFECTS_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include "parameterqueue.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Describes one parameter of a built-in effect, in the terms
+        of Phonon::EffectParameter.
+    */
+    struct DspParameterInfo
+    {
+        enum Hint {Linear, Logarithmic, Integer, Toggled};
+
+        int id;
+        const char *name;
+        const char *description;
+        float minimum;
+        float maximum;
+        float defaultValue;
+        Hint hint;
+    };
+
+    /**
+        Base class of the effects that are built into the backend, as
+        opposed to the audio unit effects of the system. They process
+        non-interleaved float audio in place, and take their parameter
+        changes as a ParameterTarget, so that a ParameterQueue can hand
+        them over to the render thread. Everything except the parameter
+        bookkeeping happens on the render thread.
+    */
+    class DspEffect : public ParameterTarget
+    {
+        public:
+            // The effect type indexes (four char codes, like
+            // the sub types of the audio unit effects):
+            enum Type {
+                Equalizer = 0x50486571,  // 'PHeq'
+                Compressor = 0x50486370, // 'PHcp'
+                GainPan = 0x50486770     // 'PHgp'
+            };
+            enum {MaxChannels = 8, MaxParameters = 16};
+
+            static QList<int> effectTypes();
+            static bool isBuiltin(int type);
+            static DspEffect *create(int type);
+            static QString name(int type);
+            static QString description(int type);
+
+            virtual ~DspEffect();
+
+            virtual int parameterCount() const = 0;
+            virtual const DspParameterInfo &parameterInfo(int index) const = 0;
+            const DspParameterInfo *parameterInfoForId(int id) const;
+            float value(int id) const;
+            void setValue(int id, float value);
+
+            void setFormat(double sampleRate, int channels);
+            int channelCount() const;
+            double sampleRate() const;
+            virtual void reset() = 0;
+            virtual void process(float *const *channels, int frames) = 0;
+
+            // ParameterTarget:
+            void setParameterValue(const ParameterCommand &command, float value, quint32 bufferOffset);
+
+        protected:
+            DspEffect();
+            void initializeValues();
+            virtual void update() = 0;
+
+            float m_values[MaxParameters];
+            double m_sampleRate;
+            int m_channels;
+    };
+
+    /**
+        Parametric equalizer: a low shelf, two peaking bands and a high
+        shelf, run as a cascade of biquads. Bands at 0 dB are skipped.
+    */
+    class EqualizerEffect : public DspEffect
+    {
+        public:
+            enum {BandCount = 4};
+
+            EqualizerEffect();
+            int parameterCount() const;
+            const DspParameterInfo &parameterInfo(int index) const;
+            void reset();
+            void process(float *const *channels, int frames);
+
+        protected:
+            void update();
+
+        private:
+            struct Section
+            {
+                float b0, b1, b2, a1, a2;
+                bool active;
+            };
+            Section m_sections[BandCount];
+            // Filter state, per band, per channel:
+            float m_z1[BandCount][MaxChannels];
+            float m_z2[BandCount][MaxChannels];
+    };
+
+    /**
+        Feed forward compressor with a peak envelope shared by all
+        channels, so the stereo image stays put. With a high ratio
+        and a short attack, it works as a limiter.
+    */
+    class CompressorEffect : public DspEffect
+    {
+        public:
+            enum {ThresholdDb, Ratio, AttackMs, ReleaseMs, MakeupDb};
+
+            CompressorEffect();
+            int parameterCount() const;
+            const DspParameterInfo &parameterInfo(int index) const;
+            void reset();
+            void process(float *const *channels, int frames);
+            float currentGain() const;
+
+        protected:
+            void update();
+
+        private:
+            float m_attack;
+            float m_release;
+            float m_envelope;
+            float m_gain;
+    };
+
+    /**
+        Gain, and constant power panning of stereo audio. Changes
+        are smoothed over one buffer to avoid zipper noise.
+    */
+    class GainPanEffect : public DspEffect
+    {
+        public:
+            enum {GainDb, Pan};
+
+            GainPanEffect();
+            int parameterCount() const;
+            const DspParameterInfo &parameterInfo(int index) const;
+            void reset();
+            void process(float *const *channels, int frames);
+
+        protected:
+            void update();
+
+        private:
+            float m_target[2];
+            float m_current[2];
+    };
+
+    /**
+        The vectorized inner loops of the effects, exposed so that
+        they can be used (and checked) on their own.
+    */
+    class DspKernel
+    {
+        public:
+            enum {MaxSections = 8};
+
+            static void scale(float *data, float gain, int frames);
+            static void scaleRamp(float *data, float from, float to, int frames);
+            static float peak(const float *data, int frames);
+            // Up to MaxSections sections, in place:
+            static void biquadCascade(float *const *channels, int channelCount, int frames,
+                const float *coefficients, int sectionCount, float *z1, float *z2);
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_DSPEFFECTS_H
@@ -0,0 +1,580 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dspeffects.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define PHONON_QT7_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define PHONON_QT7_NEON
+#endif
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+/////////////////////////////////////////////////////////////////////////
+// Four float lanes, on SSE2, NEON, or plain C:
+
+#if defined(PHONON_QT7_SSE2)
+typedef __m128 Vec4;
+static inline Vec4 vec4Splat(float v) { return _mm_set1_ps(v); }
+static inline Vec4 vec4Set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static inline Vec4 vec4Load(const float *p) { return _mm_loadu_ps(p); }
+static inline void vec4Store(float *p, Vec4 v) { _mm_storeu_ps(p, v); }
+static inline Vec4 vec4Add(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+static inline Vec4 vec4Sub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+static inline Vec4 vec4Mul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+static inline Vec4 vec4Max(Vec4 a, Vec4 b) { return _mm_max_ps(a, b); }
+static inline Vec4 vec4Abs(Vec4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline float vec4MaxLane(Vec4 a)
+{
+    a = _mm_max_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)));
+    a = _mm_max_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(a);
+}
+#elif defined(PHONON_QT7_NEON)
+typedef float32x4_t Vec4;
+static inline Vec4 vec4Splat(float v) { return vdupq_n_f32(v); }
+static inline Vec4 vec4Set(float a, float b, float c, float d) { float v[4] = {a, b, c, d}; return vld1q_f32(v); }
+static inline Vec4 vec4Load(const float *p) { return vld1q_f32(p); }
+static inline void vec4Store(float *p, Vec4 v) { vst1q_f32(p, v); }
+static inline Vec4 vec4Add(Vec4 a, Vec4 b) { return vaddq_f32(a, b); }
+static inline Vec4 vec4Sub(Vec4 a, Vec4 b) { return vsubq_f32(a, b); }
+static inline Vec4 vec4Mul(Vec4 a, Vec4 b) { return vmulq_f32(a, b); }
+static inline Vec4 vec4Max(Vec4 a, Vec4 b) { return vmaxq_f32(a, b); }
+static inline Vec4 vec4Abs(Vec4 a) { return vabsq_f32(a); }
+static inline float vec4MaxLane(Vec4 a)
+{
+    float32x2_t m = vpmax_f32(vget_low_f32(a), vget_high_f32(a));
+    return vget_lane_f32(vpmax_f32(m, m), 0);
+}
+#else
+struct Vec4 { float v[4]; };
+static inline Vec4 vec4Set(float a, float b, float c, float d) { Vec4 r = {{a, b, c, d}}; return r; }
+static inline Vec4 vec4Splat(float v) { return vec4Set(v, v, v, v); }
+static inline Vec4 vec4Load(const float *p) { return vec4Set(p[0], p[1], p[2], p[3]); }
+static inline void vec4Store(float *p, Vec4 v) { memcpy(p, v.v, sizeof(v.v)); }
+static inline Vec4 vec4Add(Vec4 a, Vec4 b) { for (int i=0; i<4; ++i) a.v[i] += b.v[i]; return a; }
+static inline Vec4 vec4Sub(Vec4 a, Vec4 b) { for (int i=0; i<4; ++i) a.v[i] -= b.v[i]; return a; }
+static inline Vec4 vec4Mul(Vec4 a, Vec4 b) { for (int i=0; i<4; ++i) a.v[i] *= b.v[i]; return a; }
+static inline Vec4 vec4Max(Vec4 a, Vec4 b) { for (int i=0; i<4; ++i) a.v[i] = qMax(a.v[i], b.v[i]); return a; }
+static inline Vec4 vec4Abs(Vec4 a) { for (int i=0; i<4; ++i) a.v[i] = fabsf(a.v[i]); return a; }
+static inline float vec4MaxLane(Vec4 a) { return qMax(qMax(a.v[0], a.v[1]), qMax(a.v[2], a.v[3])); }
+#endif
+
+static inline float dbToGain(float db)
+{
+    return powf(10.0f, db / 20.0f);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// DspKernel:
+
+void DspKernel::scale(float *data, float gain, int frames)
+{
+    Vec4 g = vec4Splat(gain);
+    int i = 0;
+    for (; i + 4 <= frames; i += 4)
+        vec4Store(data + i, vec4Mul(vec4Load(data + i), g));
+    for (; i < frames; ++i)
+        data[i] *= gain;
+}
+
+void DspKernel::scaleRamp(float *data, float from, float to, int frames)
+{
+    if (frames <= 0)
+        return;
+    const float step = (to - from) / frames;
+    // The gain at each sample is from + (i + 1) * step,
+    // so that the last sample gets exactly to:
+    Vec4 gain = vec4Set(from + step, from + 2 * step, from + 3 * step, from + 4 * step);
+    const Vec4 advance = vec4Splat(4 * step);
+    int i = 0;
+    for (; i + 4 <= frames; i += 4){
+        vec4Store(data + i, vec4Mul(vec4Load(data + i), gain));
+        gain = vec4Add(gain, advance);
+    }
+    for (; i < frames; ++i)
+        data[i] *= (i + 1 == frames) ? to : from + (i + 1) * step;
+}
+
+float DspKernel::peak(const float *data, int frames)
+{
+    Vec4 m = vec4Splat(0);
+    int i = 0;
+    for (; i + 4 <= frames; i += 4)
+        m = vec4Max(m, vec4Abs(vec4Load(data + i)));
+    float result = vec4MaxLane(m);
+    for (; i < frames; ++i)
+        result = qMax(result, fabsf(data[i]));
+    return result;
+}
+
+void DspKernel::biquadCascade(float *const *channels, int channelCount, int frames,
+    const float *coefficients, int sectionCount, float *z1, float *z2)
+{
+    sectionCount = qMin(sectionCount, int(MaxSections));
+    // Runs four channels at a time, one in each lane, through the
+    // sections (transposed direct form II). The coefficients are
+    // b0, b1, b2, a1, a2 for each section, and the state is
+    // indexed as [section * DspEffect::MaxChannels + channel]:
+    // Missing lanes read the same zero over and over (stride 0):
+    static const float zero = 0;
+    for (int group = 0; group < channelCount; group += 4){
+        const int lanes = qMin(4, channelCount - group);
+        const float *in[4];
+        int stride[4];
+        for (int l=0; l<4; ++l){
+            in[l] = l < lanes ? channels[group + l] : &zero;
+            stride[l] = l < lanes ? 1 : 0;
+        }
+
+        Vec4 b0[MaxSections], b1[MaxSections], b2[MaxSections];
+        Vec4 a1[MaxSections], a2[MaxSections];
+        Vec4 s1[MaxSections], s2[MaxSections];
+        for (int s=0; s<sectionCount; ++s){
+            const float *c = coefficients + s * 5;
+            b0[s] = vec4Splat(c[0]);
+            b1[s] = vec4Splat(c[1]);
+            b2[s] = vec4Splat(c[2]);
+            a1[s] = vec4Splat(c[3]);
+            a2[s] = vec4Splat(c[4]);
+            s1[s] = vec4Load(z1 + s * DspEffect::MaxChannels + group);
+            s2[s] = vec4Load(z2 + s * DspEffect::MaxChannels + group);
+        }
+
+        float lane[4];
+        for (int i=0; i<frames; ++i){
+            Vec4 x = vec4Set(in[0][i * stride[0]], in[1][i * stride[1]],
+                in[2][i * stride[2]], in[3][i * stride[3]]);
+            for (int s=0; s<sectionCount; ++s){
+                Vec4 y = vec4Add(vec4Mul(b0[s], x), s1[s]);
+                s1[s] = vec4Add(vec4Sub(vec4Mul(b1[s], x), vec4Mul(a1[s], y)), s2[s]);
+                s2[s] = vec4Sub(vec4Mul(b2[s], x), vec4Mul(a2[s], y));
+                x = y;
+            }
+            vec4Store(lane, x);
+            for (int l=0; l<lanes; ++l)
+                channels[group + l][i] = lane[l];
+        }
+
+        for (int s=0; s<sectionCount; ++s){
+            vec4Store(z1 + s * DspEffect::MaxChannels + group, s1[s]);
+            vec4Store(z2 + s * DspEffect::MaxChannels + group, s2[s]);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+// DspEffect:
+
+DspEffect::DspEffect()
+{
+    memset(m_values, 0, sizeof(m_values));
+    m_sampleRate = 44100;
+    m_channels = 2;
+}
+
+DspEffect::~DspEffect()
+{
+}
+
+QList<int> DspEffect::effectTypes()
+{
+    QList<int> types;
+    types << Equalizer << Compressor << GainPan;
+    return types;
+}
+
+bool DspEffect::isBuiltin(int type)
+{
+    return type == Equalizer || type == Compressor || type == GainPan;
+}
+
+DspEffect *DspEffect::create(int type)
+{
+    switch (type){
+    case Equalizer: return new EqualizerEffect();
+    case Compressor: return new CompressorEffect();
+    case GainPan: return new GainPanEffect();
+    default: return 0;
+    }
+}
+
+QString DspEffect::name(int type)
+{
+    switch (type){
+    case Equalizer: return QLatin1String("Parametric Equalizer");
+    case Compressor: return QLatin1String("Compressor");
+    case GainPan: return QLatin1String("Gain and Pan");
+    default: return QString();
+    }
+}
+
+QString DspEffect::description(int type)
+{
+    switch (type){
+    case Equalizer: return QLatin1String("Low shelf, two peaking bands and high shelf");
+    case Compressor: return QLatin1String("Dynamic range compressor, or limiter with a high ratio");
+    case GainPan: return QLatin1String("Gain, and constant power panning of stereo audio");
+    default: return QString();
+    }
+}
+
+void DspEffect::initializeValues()
+{
+    for (int i=0; i<parameterCount(); ++i){
+        const DspParameterInfo &info = parameterInfo(i);
+        m_values[info.id] = info.defaultValue;
+    }
+    update();
+    reset();
+}
+
+const DspParameterInfo *DspEffect::parameterInfoForId(int id) const
+{
+    for (int i=0; i<parameterCount(); ++i){
+        if (parameterInfo(i).id == id)
+            return &parameterInfo(i);
+    }
+    return 0;
+}
+
+float DspEffect::value(int id) const
+{
+    if (id < 0 || id >= MaxParameters)
+        return 0;
+    return m_values[id];
+}
+
+void DspEffect::setValue(int id, float value)
+{
+    const DspParameterInfo *info = parameterInfoForId(id);
+    if (!info)
+        return;
+    m_values[id] = qBound(info->minimum, value, info->maximum);
+    update();
+}
+
+void DspEffect::setFormat(double sampleRate, int channels)
+{
+    m_sampleRate = sampleRate > 0 ? sampleRate : 44100;
+    m_channels = qBound(1, channels, int(MaxChannels));
+    update();
+    reset();
+}
+
+int DspEffect::channelCount() const
+{
+    return m_channels;
+}
+
+double DspEffect::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+void DspEffect::setParameterValue(const ParameterCommand &command, float value, quint32 /*bufferOffset*/)
+{
+    // The effects work on whole buffers, so changes
+    // take effect from the start of the buffer:
+    setValue(command.parameter, value);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// EqualizerEffect:
+
+static const DspParameterInfo equalizerParameters[] = {
+    {0, "Low Shelf Frequency", "Corner frequency of the low shelf (Hz)", 20, 1000, 100, DspParameterInfo::Logarithmic},
+    {1, "Low Shelf Gain", "Gain of the low shelf (dB)", -24, 24, 0, DspParameterInfo::Linear},
+    {2, "Low Shelf Q", "Steepness of the low shelf", 0.1f, 2, 0.707f, DspParameterInfo::Linear},
+    {3, "Band 1 Frequency", "Center frequency of the first band (Hz)", 40, 16000, 500, DspParameterInfo::Logarithmic},
+    {4, "Band 1 Gain", "Gain of the first band (dB)", -24, 24, 0, DspParameterInfo::Linear},
+    {5, "Band 1 Q", "Sharpness of the first band", 0.1f, 10, 1, DspParameterInfo::Logarithmic},
+    {6, "Band 2 Frequency", "Center frequency of the second band (Hz)", 40, 16000, 3000, DspParameterInfo::Logarithmic},
+    {7, "Band 2 Gain", "Gain of the second band (dB)", -24, 24, 0, DspParameterInfo::Linear},
+    {8, "Band 2 Q", "Sharpness of the second band", 0.1f, 10, 1, DspParameterInfo::Logarithmic},
+    {9, "High Shelf Frequency", "Corner frequency of the high shelf (Hz)", 1000, 20000, 8000, DspParameterInfo::Logarithmic},
+    {10, "High Shelf Gain", "Gain of the high shelf (dB)", -24, 24, 0, DspParameterInfo::Linear},
+    {11, "High Shelf Q", "Steepness of the high shelf", 0.1f, 2, 0.707f, DspParameterInfo::Linear}
+};
+
+EqualizerEffect::EqualizerEffect()
+{
+    memset(m_sections, 0, sizeof(m_sections));
+    initializeValues();
+}
+
+int EqualizerEffect::parameterCount() const
+{
+    return sizeof(equalizerParameters) / sizeof(equalizerParameters[0]);
+}
+
+const DspParameterInfo &EqualizerEffect::parameterInfo(int index) const
+{
+    return equalizerParameters[index];
+}
+
+void EqualizerEffect::reset()
+{
+    memset(m_z1, 0, sizeof(m_z1));
+    memset(m_z2, 0, sizeof(m_z2));
+}
+
+void EqualizerEffect::update()
+{
+    // Coefficients from the Audio EQ Cookbook (R. Bristow-Johnson):
+    for (int band=0; band<BandCount; ++band){
+        const float frequency = qMin(m_values[band * 3], float(m_sampleRate * 0.49));
+        const float gainDb = m_values[band * 3 + 1];
+        const float q = m_values[band * 3 + 2];
+        Section &s = m_sections[band];
+
+        if (qAbs(gainDb) < 0.01f){
+            if (s.active){
+                // Start from silence when the band comes back:
+                memset(m_z1[band], 0, sizeof(m_z1[band]));
+                memset(m_z2[band], 0, sizeof(m_z2[band]));
+            }
+            s.active = false;
+            continue;
+        }
+
+        const double A = pow(10.0, gainDb / 40.0);
+        const double w0 = 2 * M_PI * frequency / m_sampleRate;
+        const double cosw = cos(w0);
+        const double alpha = sin(w0) / (2 * q);
+        double b0, b1, b2, a0, a1, a2;
+        if (band == 0 || band == BandCount - 1){
+            const double sq = 2 * sqrt(A) * alpha;
+            const double sign = (band == 0) ? 1 : -1;
+            b0 = A * ((A + 1) - sign * (A - 1) * cosw + sq);
+            b1 = sign * 2 * A * ((A - 1) - sign * (A + 1) * cosw);
+            b2 = A * ((A + 1) - sign * (A - 1) * cosw - sq);
+            a0 = (A + 1) + sign * (A - 1) * cosw + sq;
+            a1 = -sign * 2 * ((A - 1) + sign * (A + 1) * cosw);
+            a2 = (A + 1) + sign * (A - 1) * cosw - sq;
+        } else {
+            b0 = 1 + alpha * A;
+            b1 = -2 * cosw;
+            b2 = 1 - alpha * A;
+            a0 = 1 + alpha / A;
+            a1 = -2 * cosw;
+            a2 = 1 - alpha / A;
+        }
+        s.b0 = b0 / a0;
+        s.b1 = b1 / a0;
+        s.b2 = b2 / a0;
+        s.a1 = a1 / a0;
+        s.a2 = a2 / a0;
+        s.active = true;
+    }
+}
+
+void EqualizerEffect::process(float *const *channels, int frames)
+{
+    // Only run the bands that do something. Gather their
+    // coefficients and state, and scatter the state back after:
+    float coefficients[BandCount * 5];
+    float z1[BandCount * MaxChannels];
+    float z2[BandCount * MaxChannels];
+    int bands[BandCount];
+    int count = 0;
+    for (int band=0; band<BandCount; ++band){
+        const Section &s = m_sections[band];
+        if (!s.active)
+            continue;
+        float *c = coefficients + count * 5;
+        c[0] = s.b0; c[1] = s.b1; c[2] = s.b2; c[3] = s.a1; c[4] = s.a2;
+        memcpy(z1 + count * MaxChannels, m_z1[band], sizeof(m_z1[band]));
+        memcpy(z2 + count * MaxChannels, m_z2[band], sizeof(m_z2[band]));
+        bands[count++] = band;
+    }
+    if (count == 0)
+        return;
+
+    DspKernel::biquadCascade(channels, m_channels, frames, coefficients, count, z1, z2);
+
+    for (int i=0; i<count; ++i){
+        for (int c=0; c<MaxChannels; ++c){
+            // Flush denormals, the filters ring down to them after silence:
+            float &s1 = z1[i * MaxChannels + c];
+            float &s2 = z2[i * MaxChannels + c];
+            if (fabsf(s1) < 1e-15f)
+                s1 = 0;
+            if (fabsf(s2) < 1e-15f)
+                s2 = 0;
+        }
+        memcpy(m_z1[bands[i]], z1 + i * MaxChannels, sizeof(m_z1[0]));
+        memcpy(m_z2[bands[i]], z2 + i * MaxChannels, sizeof(m_z2[0]));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+// CompressorEffect:
+
+// The envelope and gain are computed once per this many frames,
+// and the gain is ramped linearly over each of them:
+static const int CompressorBlock = 32;
+
+static const DspParameterInfo compressorParameters[] = {
+    {CompressorEffect::ThresholdDb, "Threshold", "Level above which the gain is reduced (dB)", -60, 0, -20, DspParameterInfo::Linear},
+    {CompressorEffect::Ratio, "Ratio", "Input to output ratio above the threshold", 1, 20, 4, DspParameterInfo::Logarithmic},
+    {CompressorEffect::AttackMs, "Attack", "Time to react to a rising level (ms)", 0.1f, 100, 5, DspParameterInfo::Logarithmic},
+    {CompressorEffect::ReleaseMs, "Release", "Time to recover when the level falls (ms)", 10, 2000, 100, DspParameterInfo::Logarithmic},
+    {CompressorEffect::MakeupDb, "Makeup Gain", "Gain applied after compression (dB)", 0, 24, 0, DspParameterInfo::Linear}
+};
+
+CompressorEffect::CompressorEffect()
+{
+    m_attack = 0;
+    m_release = 0;
+    m_envelope = 0;
+    m_gain = 1;
+    initializeValues();
+}
+
+int CompressorEffect::parameterCount() const
+{
+    return sizeof(compressorParameters) / sizeof(compressorParameters[0]);
+}
+
+const DspParameterInfo &CompressorEffect::parameterInfo(int index) const
+{
+    return compressorParameters[index];
+}
+
+void CompressorEffect::reset()
+{
+    m_envelope = 0;
+    m_gain = dbToGain(m_values[MakeupDb]);
+}
+
+void CompressorEffect::update()
+{
+    // Smoothing coefficients for one block, for time constants in ms:
+    m_attack = expf(-CompressorBlock / (m_values[AttackMs] * 0.001f * float(m_sampleRate)));
+    m_release = expf(-CompressorBlock / (m_values[ReleaseMs] * 0.001f * float(m_sampleRate)));
+}
+
+float CompressorEffect::currentGain() const
+{
+    return m_gain;
+}
+
+void CompressorEffect::process(float *const *channels, int frames)
+{
+    const float threshold = m_values[ThresholdDb];
+    const float slope = 1.0f - 1.0f / m_values[Ratio];
+    const float makeup = dbToGain(m_values[MakeupDb]);
+
+    for (int offset=0; offset<frames; offset+=CompressorBlock){
+        const int count = qMin(int(CompressorBlock), frames - offset);
+
+        // Linked detection, the loudest channel decides:
+        float peak = 0;
+        for (int c=0; c<m_channels; ++c)
+            peak = qMax(peak, DspKernel::peak(channels[c] + offset, count));
+        const float coefficient = (peak > m_envelope) ? m_attack : m_release;
+        m_envelope = peak + coefficient * (m_envelope - peak);
+
+        float gain = makeup;
+        if (m_envelope > 1e-6f){
+            const float over = 20.0f * log10f(m_envelope) - threshold;
+            if (over > 0)
+                gain *= dbToGain(-over * slope);
+        }
+
+        for (int c=0; c<m_channels; ++c){
+            if (gain == m_gain)
+                DspKernel::scale(channels[c] + offset, gain, count);
+            else
+                DspKernel::scaleRamp(channels[c] + offset, m_gain, gain, count);
+        }
+        m_gain = gain;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+// GainPanEffect:
+
+static const DspParameterInfo gainPanParameters[] = {
+    {GainPanEffect::GainDb, "Gain", "Gain (dB)", -60, 12, 0, DspParameterInfo::Linear},
+    {GainPanEffect::Pan, "Pan", "Stereo position, from -1 (left) to 1 (right)", -1, 1, 0, DspParameterInfo::Linear}
+};
+
+GainPanEffect::GainPanEffect()
+{
+    m_target[0] = m_target[1] = 1;
+    m_current[0] = m_current[1] = 1;
+    initializeValues();
+}
+
+int GainPanEffect::parameterCount() const
+{
+    return sizeof(gainPanParameters) / sizeof(gainPanParameters[0]);
+}
+
+const DspParameterInfo &GainPanEffect::parameterInfo(int index) const
+{
+    return gainPanParameters[index];
+}
+
+void GainPanEffect::reset()
+{
+    m_current[0] = m_target[0];
+    m_current[1] = m_target[1];
+}
+
+void GainPanEffect::update()
+{
+    const float gain = dbToGain(m_values[GainDb]);
+    if (m_channels != 2){
+        m_target[0] = m_target[1] = gain;
+        return;
+    }
+    // Constant power: the squares of the two gains add up to one at
+    // every position, so the middle is 3 dB down on each side:
+    const float theta = (m_values[Pan] + 1.0f) * float(M_PI) / 4.0f;
+    m_target[0] = gain * cosf(theta);
+    m_target[1] = gain * sinf(theta);
+}
+
+void GainPanEffect::process(float *const *channels, int frames)
+{
+    for (int c=0; c<m_channels; ++c){
+        const int i = (m_channels == 2) ? c : 0;
+        if (m_current[i] != m_target[i])
+            DspKernel::scaleRamp(channels[c], m_current[i], m_target[i], frames);
+        else if (m_target[i] != 1.0f)
+            DspKernel::scale(channels[c], m_target[i], frames);
+    }
+    m_current[0] = m_target[0];
+    m_current[1] = m_target[1];
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,105 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_GAINRAMP_H
+#define Phonon_QT7_GAINRAMP_H
+
+#include <QtCore/QtGlobal>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Shapes that a gain ramp can follow. Each shape is precomputed
+        into a table over [0, 1] that rises from 0 to 1, so evaluating
+        it on the render thread is a table lookup. The FadeXDecibel
+        shapes are X dB down at the midpoint (Linear being the 6 dB one).
+    */
+    class GainCurve
+    {
+        public:
+            enum Shape {Linear, CrossFadeIn, Fade3Decibel, Fade9Decibel, Fade12Decibel, ShapeCount};
+            enum {TableSize = 1024};
+
+            static float value(Shape shape, float x);
+            static const float *table(Shape shape);
+    };
+
+    /**
+        A gain that moves from one value to another over a number of
+        frames, following a GainCurve. It is evaluated frame by frame
+        on the render thread (fillGains), so a ramp is sample accurate
+        no matter how often the GUI thread looks at it. A falling ramp
+        follows its curve backwards, so that fading out mirrors fading in.
+    */
+    class GainRamp
+    {
+        public:
+            GainRamp(float gain = 1.0f);
+
+            void start(float from, float to, quint32 frames, GainCurve::Shape shape = GainCurve::Linear);
+            void setGain(float gain);
+            bool isRamping() const;
+            bool isUnity() const;
+            float gain() const;
+            float targetGain() const;
+
+            void fillGains(float *gains, int frames);
+
+        private:
+            float m_from;
+            float m_to;
+            float m_current;
+            quint32 m_length;
+            quint32 m_position;
+            const float *m_table;
+            bool m_falling;
+    };
+
+    /**
+        A request to start a GainRamp, as handed from the GUI thread
+        to the render thread (through a LockFreeQueue).
+    */
+    struct GainRampCommand
+    {
+        float from; // negative means from the current gain
+        float to;
+        quint32 frames;
+        GainCurve::Shape shape;
+    };
+
+    /**
+        The inner loops that apply per frame gains to audio. Planar
+        audio, and interleaved audio with 1, 2, 4 or 8 channels, is
+        handled by SSE2 or NEON loops where the CPU has them. Other
+        channel counts use loops specialized at compile time.
+    */
+    class GainKernel
+    {
+        public:
+            static void applyPlanar(float *data, const float *gains, int frames);
+            static void applyInterleaved(float *data, int channels, const float *gains, int frames);
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_GAINRAMP_H
@@ -0,0 +1,291 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gainramp.h"
+#include <math.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define PHONON_QT7_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define PHONON_QT7_NEON
+#endif
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+static float shapeValue(GainCurve::Shape shape, float x)
+{
+    switch (shape){
+    case GainCurve::CrossFadeIn:
+        // The curve used for fading in the next source in a
+        // crossfade: -40 dB at the start, rising to 0 dB:
+        return (x > 0.01f) ? float(0.5 * (2 + log10(x))) : 0;
+    case GainCurve::Fade3Decibel:
+        return sqrtf(x);
+    case GainCurve::Fade9Decibel:
+        return x * sqrtf(x);
+    case GainCurve::Fade12Decibel:
+        return x * x;
+    default:
+        return x;
+    }
+}
+
+// The tables are filled by a static initializer, before the render
+// thread can look at them. One extra entry per table keeps
+// interpolating at x = 1 inside the table:
+struct GainCurveTables
+{
+    GainCurveTables()
+    {
+        for (int s = 0; s < GainCurve::ShapeCount; ++s){
+            for (int i = 0; i <= GainCurve::TableSize; ++i)
+                values[s][i] = shapeValue(GainCurve::Shape(s), float(i) / GainCurve::TableSize);
+        }
+    }
+    float values[GainCurve::ShapeCount][GainCurve::TableSize + 1];
+};
+
+static const GainCurveTables gGainCurveTables;
+
+const float *GainCurve::table(Shape shape)
+{
+    return gGainCurveTables.values[shape];
+}
+
+float GainCurve::value(Shape shape, float x)
+{
+    const float *t = table(shape);
+    x = qBound(0.0f, x, 1.0f) * TableSize;
+    int i = qMin(int(x), int(TableSize) - 1);
+    return t[i] + (x - i) * (t[i + 1] - t[i]);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+GainRamp::GainRamp(float gain)
+{
+    m_table = GainCurve::table(GainCurve::Linear);
+    setGain(gain);
+}
+
+void GainRamp::start(float from, float to, quint32 frames, GainCurve::Shape shape)
+{
+    m_from = from;
+    m_to = to;
+    m_current = from;
+    m_length = frames;
+    m_position = 0;
+    m_table = GainCurve::table(shape);
+    m_falling = to < from;
+    if (frames == 0)
+        m_current = to;
+}
+
+void GainRamp::setGain(float gain)
+{
+    start(gain, gain, 0);
+}
+
+bool GainRamp::isRamping() const
+{
+    return m_position < m_length;
+}
+
+bool GainRamp::isUnity() const
+{
+    return !isRamping() && m_current == 1.0f;
+}
+
+float GainRamp::gain() const
+{
+    return m_current;
+}
+
+float GainRamp::targetGain() const
+{
+    return m_to;
+}
+
+void GainRamp::fillGains(float *gains, int frames)
+{
+    int i = 0;
+    if (isRamping()){
+        // A falling ramp walks the table from the end, and
+        // measures the curve from the target instead:
+        float base = m_falling ? m_to : m_from;
+        float range = m_falling ? m_from - m_to : m_to - m_from;
+        float step = float(GainCurve::TableSize) / float(m_length);
+        for (; i < frames && m_position < m_length; ++i, ++m_position){
+            float x = m_position * step;
+            if (m_falling)
+                x = GainCurve::TableSize - x;
+            int index = qMin(int(x), int(GainCurve::TableSize) - 1);
+            float shape = m_table[index] + (x - index) * (m_table[index + 1] - m_table[index]);
+            gains[i] = base + range * shape;
+        }
+        m_current = isRamping() ? gains[i - 1] : m_to;
+    }
+    for (; i < frames; ++i)
+        gains[i] = m_current;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// Interleaved audio with a channel count we have no vector
+// loop for is handled by loops specialized at compile time:
+template <int Channels>
+static void applyInterleavedFixed(float *data, const float *gains, int frames)
+{
+    for (int f = 0; f < frames; ++f, data += Channels){
+        float gain = gains[f];
+        for (int c = 0; c < Channels; ++c)
+            data[c] *= gain;
+    }
+}
+
+#if defined(PHONON_QT7_SSE2)
+
+static int applyPlanarVector(float *data, const float *gains, int frames)
+{
+    int i = 0;
+    for (; i + 4 <= frames; i += 4)
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), _mm_loadu_ps(gains + i)));
+    return i;
+}
+
+static int applyStereoVector(float *data, const float *gains, int frames)
+{
+    // Four gains cover two vectors of interleaved stereo frames:
+    int f = 0;
+    for (; f + 4 <= frames; f += 4, data += 8){
+        __m128 g = _mm_loadu_ps(gains + f);
+        _mm_storeu_ps(data, _mm_mul_ps(_mm_loadu_ps(data), _mm_unpacklo_ps(g, g)));
+        _mm_storeu_ps(data + 4, _mm_mul_ps(_mm_loadu_ps(data + 4), _mm_unpackhi_ps(g, g)));
+    }
+    return f;
+}
+
+static void applyQuadVectors(float *data, int vectors, const float *gains, int frames)
+{
+    // Frames of 4 and 8 channels are whole vectors,
+    // multiplied by the gain of the frame:
+    for (int f = 0; f < frames; ++f){
+        __m128 g = _mm_set1_ps(gains[f]);
+        for (int v = 0; v < vectors; ++v, data += 4)
+            _mm_storeu_ps(data, _mm_mul_ps(_mm_loadu_ps(data), g));
+    }
+}
+
+#elif defined(PHONON_QT7_NEON)
+
+static int applyPlanarVector(float *data, const float *gains, int frames)
+{
+    int i = 0;
+    for (; i + 4 <= frames; i += 4)
+        vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i), vld1q_f32(gains + i)));
+    return i;
+}
+
+static int applyStereoVector(float *data, const float *gains, int frames)
+{
+    // Four gains cover two vectors of interleaved stereo frames:
+    int f = 0;
+    for (; f + 4 <= frames; f += 4, data += 8){
+        float32x4x2_t g = vzipq_f32(vld1q_f32(gains + f), vld1q_f32(gains + f));
+        vst1q_f32(data, vmulq_f32(vld1q_f32(data), g.val[0]));
+        vst1q_f32(data + 4, vmulq_f32(vld1q_f32(data + 4), g.val[1]));
+    }
+    return f;
+}
+
+static void applyQuadVectors(float *data, int vectors, const float *gains, int frames)
+{
+    // Frames of 4 and 8 channels are whole vectors,
+    // multiplied by the gain of the frame:
+    for (int f = 0; f < frames; ++f){
+        float32x4_t g = vdupq_n_f32(gains[f]);
+        for (int v = 0; v < vectors; ++v, data += 4)
+            vst1q_f32(data, vmulq_f32(vld1q_f32(data), g));
+    }
+}
+
+#else
+
+static int applyPlanarVector(float *, const float *, int)
+{
+    return 0;
+}
+
+static int applyStereoVector(float *, const float *, int)
+{
+    return 0;
+}
+
+static void applyQuadVectors(float *data, int vectors, const float *gains, int frames)
+{
+    if (vectors == 1)
+        applyInterleavedFixed<4>(data, gains, frames);
+    else
+        applyInterleavedFixed<8>(data, gains, frames);
+}
+
+#endif
+
+void GainKernel::applyPlanar(float *data, const float *gains, int frames)
+{
+    for (int i = applyPlanarVector(data, gains, frames); i < frames; ++i)
+        data[i] *= gains[i];
+}
+
+void GainKernel::applyInterleaved(float *data, int channels, const float *gains, int frames)
+{
+    switch (channels){
+    case 1:
+        applyPlanar(data, gains, frames);
+        break;
+    case 2: {
+        int done = applyStereoVector(data, gains, frames);
+        applyInterleavedFixed<2>(data + 2 * done, gains + done, frames - done);
+        break; }
+    case 4:
+        applyQuadVectors(data, 1, gains, frames);
+        break;
+    case 6:
+        applyInterleavedFixed<6>(data, gains, frames);
+        break;
+    case 8:
+        applyQuadVectors(data, 2, gains, frames);
+        break;
+    default:
+        for (int f = 0; f < frames; ++f, data += channels){
+            for (int c = 0; c < channels; ++c)
+                data[c] *= gains[f];
+        }
+        break;
+    }
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,105 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_LOCKFREEQUEUE_H
+#define Phonon_QT7_LOCKFREEQUEUE_H
+
+#include <QtCore/QAtomicInt>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        A fixed size ring buffer for handing items from exactly one
+        producer thread to exactly one consumer thread, without locks.
+        Only the producer may call push, and only the consumer may
+        call pop. The queue holds at most capacity - 1 items.
+    */
+    template <typename T>
+    class LockFreeQueue
+    {
+        public:
+            LockFreeQueue(int capacity) : m_capacity(capacity), m_head(0), m_tail(0)
+            {
+                m_items = new T[m_capacity];
+            }
+
+            ~LockFreeQueue()
+            {
+                delete[] m_items;
+            }
+
+            bool push(const T &item)
+            {
+                int tail = m_tail;
+                int next = (tail + 1) % m_capacity;
+                if (next == m_head.fetchAndAddAcquire(0))
+                    return false; // full
+                m_items[tail] = item;
+                m_tail.fetchAndStoreRelease(next);
+                return true;
+            }
+
+            bool pop(T &item)
+            {
+                int head = m_head;
+                if (head == m_tail.fetchAndAddAcquire(0))
+                    return false; // empty
+                item = m_items[head];
+                m_items[head] = T();
+                m_head.fetchAndStoreRelease((head + 1) % m_capacity);
+                return true;
+            }
+
+            bool isEmpty() const
+            {
+                return int(m_head) == int(m_tail);
+            }
+
+            bool isFull() const
+            {
+                return (int(m_tail) + 1) % m_capacity == int(m_head);
+            }
+
+            int count() const
+            {
+                return (int(m_tail) - int(m_head) + m_capacity) % m_capacity;
+            }
+
+            int capacity() const
+            {
+                return m_capacity;
+            }
+
+        private:
+            T *m_items;
+            int m_capacity;
+            QAtomicInt m_head;
+            QAtomicInt m_tail;
+
+            LockFreeQueue(const LockFreeQueue &);
+            LockFreeQueue &operator=(const LockFreeQueue &);
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_LOCKFREEQUEUE_H
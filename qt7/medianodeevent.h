@@ -51,7 +51,9 @@ namespace QT7
                 SetMediaObject,
                 StartConnectionChange,
                 EndConnectionChange,
-				MediaPlaying
+				MediaPlaying,
+                AudioGraphStarted,
+                AudioGraphStopped
             };
 
             MediaNodeEvent(Type type, void *data = 0);
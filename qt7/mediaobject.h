@@ -24,6 +24,8 @@
 #include <phonon/addoninterface.h>
 
 #include "medianode.h"
+#include "bufferingestimator.h"
+#include "avsynccontroller.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -91,6 +93,7 @@ namespace QT7
         bool setAudioDeviceOnMovie(int id);
 
 		int videoOutputCount();
+        qint64 timeToSafePlay() const;
 
     signals:
         void stateChanged(Phonon::State,Phonon::State);
@@ -125,6 +128,10 @@ namespace QT7
         quint32 m_prefinishMark;
         quint32 m_currentTime;
         float m_percentageLoaded;
+        BufferingEstimator m_bufferingEstimator;
+        AVSyncController m_syncController;
+        AVSyncController m_nextSyncController;
+        QTime m_bufferingClock;
 
         int m_tickTimer;
         int m_bufferTimer;
@@ -133,10 +140,19 @@ namespace QT7
         bool m_waitNextSwap;
         int m_swapTimeLeft;
         QTime m_swapTime;
+        bool m_gaplessArmed;
+        double m_gaplessStartSampleTime;
+        int m_headCacheDuration;
+        int m_headCacheBudget;
+        bool m_nextHeadPrepared;
 
         void synchAudioVideo();
         void updateCurrentTime();
         void swapCurrentWithNext(qint32 transitionTime);
+        void armGaplessTransition();
+        void cancelGaplessTransition();
+        void startNextHeadCache();
+        void updateNextHeadCache();
         bool setState(Phonon::State state);
         void pause_internal();
         void play_internal();
@@ -147,6 +163,8 @@ namespace QT7
         void updateCrossFade();
         void updateAudioBuffers();
         void updateLipSynch(int allowedOffset);
+        void syncAudioToVideo(QuickTimeAudioPlayer *audioPlayer, QuickTimeVideoPlayer *videoPlayer,
+            AVSyncController &controller, int allowedOffset);
         void updateVideoFrames();
         void updateBufferStatus();
         void setMute(bool mute);
@@ -16,6 +16,7 @@
 */
 
 #include <QtCore/QEvent>
+#include <QtCore/QDebug>
 #include "mediaobject.h"
 #include "backendheader.h"
 #include "videowidget.h"
@@ -54,7 +55,22 @@ MediaObject::MediaObject(QObject *parent) : MediaNode(AudioSource | VideoSource,
     m_currentTime = 0;
     m_transitionTime = 0;
     m_percentageLoaded = 0;
+    m_bufferingClock.start();
     m_waitNextSwap = false;
+    m_gaplessArmed = false;
+    m_gaplessStartSampleTime = -1;
+    m_nextHeadPrepared = true;
+
+    // How much (in ms) of the next source to decode ahead while
+    // the current one plays, and the most memory (in KB) to use:
+    m_headCacheDuration = 2000;
+    m_headCacheBudget = 4096 * 1024;
+    QByteArray headDuration = qgetenv("PHONON_QT7_HEAD_CACHE_MS");
+    if (!headDuration.isEmpty())
+        m_headCacheDuration = qMax(0, headDuration.toInt());
+    QByteArray headBudget = qgetenv("PHONON_QT7_HEAD_CACHE_KB");
+    if (!headBudget.isEmpty())
+        m_headCacheBudget = qMax(0, headBudget.toInt()) * 1024;
     m_audioEffectCount = 0;
     m_audioOutputCount = 0;
     m_videoEffectCount = 0;
@@ -219,6 +235,7 @@ void MediaObject::setSource(const MediaSource &source)
     bool prevHasVideo = m_videoPlayer->hasVideo();
     qint64 prevTotalTime = totalTime();
     m_waitNextSwap = false;
+    cancelGaplessTransition();
         
     // Cancel cross-fade if any:
     m_nextVideoPlayer->pause();
@@ -235,6 +252,7 @@ void MediaObject::setSource(const MediaSource &source)
     m_nextAudioPlayer->unsetVideoPlayer();
     m_nextVideoPlayer->unsetVideo();
     m_currentTime = 0;
+    m_bufferingEstimator.reset();
         
     // Emit/notify information about the new source:
     QRect videoRect = m_videoPlayer->videoRect();
@@ -274,12 +292,47 @@ void MediaObject::setSource(const MediaSource &source)
 void MediaObject::setNextSource(const MediaSource &source)
 {
     IMPLEMENTED;
+    cancelGaplessTransition();
     m_nextAudioPlayer->unsetVideoPlayer();
     m_nextVideoPlayer->setMediaSource(source);
     m_nextAudioPlayer->setVideoPlayer(m_nextVideoPlayer);
+    startNextHeadCache();
     checkForError();
 }
 
+void MediaObject::startNextHeadCache()
+{
+    // Decode the start of the next source while the current one plays
+    // (see updateNextHeadCache), so that it starts from warm data. The
+    // memory comes out of this media object's head cache budget:
+    m_nextHeadPrepared = true;
+    if (m_nextVideoPlayer->state() == QuickTimeVideoPlayer::NoMedia)
+        return;
+    m_nextHeadPrepared = false;
+
+    if (m_audioSystem != AS_Graph || !m_nextAudioPlayer->hasAudio() || m_headCacheDuration == 0)
+        return;
+    int frames = int(m_nextAudioPlayer->sampleRate() * m_headCacheDuration / 1000);
+    m_nextAudioPlayer->startHeadCache(frames);
+    if (m_nextAudioPlayer->headCacheBytes() > m_headCacheBudget){
+        int bytesPerFrame = m_nextAudioPlayer->headCacheBytes() / frames;
+        m_nextAudioPlayer->startHeadCache(m_headCacheBudget / bytesPerFrame);
+    }
+    if (qgetenv("PHONON_DEBUG") == "1")
+        qDebug() << "MediaObject" << int(this) << "uses" << m_nextAudioPlayer->headCacheBytes()
+            << "bytes to decode ahead the next source";
+}
+
+void MediaObject::updateNextHeadCache()
+{
+    // Do a little of the decoding ahead on each tick:
+    if (m_nextHeadPrepared || m_nextVideoPlayer->isPlaying())
+        return;
+    bool audioLeft = m_nextAudioPlayer->decodeHeadStep();
+    bool videoLeft = m_nextVideoPlayer->hasVideo() && !m_nextVideoPlayer->prepareFirstFrame();
+    m_nextHeadPrepared = !audioLeft && !videoLeft;
+}
+
 void MediaObject::swapCurrentWithNext(qint32 transitionTime)
 {
 	PhononAutoReleasePool pool;
@@ -288,14 +341,21 @@ void MediaObject::swapCurrentWithNext(qint32 transitionTime)
     bool prevHasVideo = m_videoPlayer->hasVideo();
     qint64 prevTotalTime = totalTime();
 
+    // If the next audio player was started gapless, it is already
+    // playing, and the stream specifications are up to date:
+    bool gapless = m_gaplessArmed;
+    m_gaplessArmed = false;
+
     qSwap(m_audioPlayer, m_nextAudioPlayer);
     qSwap(m_videoPlayer, m_nextVideoPlayer);
     m_mediaObjectAudioNode->startCrossFade(transitionTime);
-    m_audioGraph->updateStreamSpecifications();
+    if (!gapless)
+        m_audioGraph->updateStreamSpecifications();
     m_metaData->setVideo(m_videoPlayer);
 
     m_waitNextSwap = false;
     m_currentTime = 0;
+    m_bufferingEstimator.reset();
         
     // Emit/notify information about the new source:
     QRect videoRect = m_videoPlayer->videoRect();
@@ -321,12 +381,63 @@ void MediaObject::swapCurrentWithNext(qint32 transitionTime)
     setupAudioSystem();
     checkForError();
     if (m_state == Phonon::LoadingState){
-        if (setState(Phonon::PlayingState))
-            play_internal();
+        if (setState(Phonon::PlayingState)){
+            if (gapless && m_audioSystem == AS_Graph){
+                // Don't touch the audio. Let video catch up with it instead:
+                m_syncController.reset();
+                m_videoPlayer->seek(m_audioPlayer->currentTime());
+                m_videoPlayer->play();
+                bufferAudioVideo();
+                updateTimer(m_rapidTimer, 100);
+            } else
+                play_internal();
+        }
         checkForError();
     }
 }
 
+void MediaObject::armGaplessTransition()
+{
+    // When the current audio player has scheduled its last audio, we know the
+    // exact sample where it ends. So start the next player at that sample (plus
+    // the transition gap, if any), instead of waiting for a timer tick to swap.
+    // Crossfades (negative transition times) still go through the timer:
+    if (m_gaplessArmed || m_transitionTime < 0 || isCrossFading())
+        return;
+    if (m_state != Phonon::PlayingState || m_audioSystem != AS_Graph)
+        return;
+    if (!m_nextAudioPlayer->hasAudio() || m_nextVideoPlayer->currentTime() > 0)
+        return;
+    Float64 endSampleTime = m_audioPlayer->endSampleTime();
+    if (endSampleTime < 0)
+        return;
+    Float64 sampleRate = m_audioPlayer->sampleRate();
+    if (sampleRate <= 0 || sampleRate != m_nextAudioPlayer->sampleRate())
+        return;
+
+    // Do the work needed for the swap now, rather than at the boundary:
+    m_audioGraph->updateStreamSpecifications();
+    m_mediaObjectAudioNode->prepareGaplessTransition();
+    if (!m_nextAudioPlayer->playAt(RenderTimeline::gaplessStartSampleTime(endSampleTime, m_transitionTime, sampleRate))){
+        m_nextAudioPlayer->pause();
+        m_nextAudioPlayer->seek(0);
+        m_mediaObjectAudioNode->cancelCrossFade();
+        return;
+    }
+    m_gaplessArmed = true;
+    m_gaplessStartSampleTime = m_audioPlayer->startSampleTime();
+}
+
+void MediaObject::cancelGaplessTransition()
+{
+    if (!m_gaplessArmed)
+        return;
+    m_gaplessArmed = false;
+    m_nextAudioPlayer->pause();
+    m_nextAudioPlayer->seek(0);
+    m_mediaObjectAudioNode->cancelCrossFade();
+}
+
 void MediaObject::updateTimer(int &timer, int interval)
 {
     if (timer)
@@ -353,6 +464,7 @@ void MediaObject::play_internal()
 
 void MediaObject::pause_internal()
 {
+    cancelGaplessTransition();
     m_audioGraph->stop();
     m_audioPlayer->pause();
     m_nextAudioPlayer->pause();
@@ -437,6 +549,7 @@ void MediaObject::seek(qint64 milliseconds)
         return;
         
     // Stop cross-fade if any:
+    cancelGaplessTransition();
     m_nextVideoPlayer->unsetVideo();
     m_nextAudioPlayer->unsetVideoPlayer();
     m_mediaObjectAudioNode->cancelCrossFade();
@@ -587,10 +700,21 @@ void MediaObject::updateCurrentTime()
                 pause();
         }
     } else {
-        // We have a next source.
+        // We have a next source. If the current audio was
+        // seeked after starting the next one gapless, the
+        // next one will start at the wrong sample:
+        if (m_gaplessArmed && m_audioPlayer->startSampleTime() != m_gaplessStartSampleTime)
+            cancelGaplessTransition();
+        armGaplessTransition();
+
         // Check if it's time to swap to next source:
         mark = qMax(quint64(0), total + m_transitionTime);
-        if (m_waitNextSwap && m_state == Phonon::PlayingState &&
+        if (m_gaplessArmed){
+            // The next audio is already lined up, so
+            // only the bookkeeping is left to do:
+            if (m_currentTime == total && m_state == Phonon::PlayingState)
+                swapCurrentWithNext(0);
+        } else if (m_waitNextSwap && m_state == Phonon::PlayingState &&
             m_transitionTime < m_swapTime.msecsTo(QTime::currentTime())){
             swapCurrentWithNext(0);
         } else if (mark >= total){
@@ -693,8 +817,9 @@ bool MediaObject::setAudioDeviceOnMovie(int id)
 void MediaObject::updateCrossFade()
 {
     m_mediaObjectAudioNode->updateCrossFade(m_currentTime);   
-    // Clean-up previous movie if done fading:
-    if (m_mediaObjectAudioNode->m_fadeDuration == 0){
+    // Clean-up previous movie if done fading (but leave
+    // a next movie started for a gapless transition):
+    if (m_mediaObjectAudioNode->m_fadeDuration == 0 && !m_gaplessArmed){
         if (m_nextVideoPlayer->isPlaying() || m_nextAudioPlayer->isPlaying()){
             m_nextVideoPlayer->unsetVideo();
             m_nextAudioPlayer->unsetVideoPlayer();
@@ -704,6 +829,32 @@ void MediaObject::updateCrossFade()
 
 void MediaObject::updateBufferStatus()
 {
+    // Pause playback while the download is behind, and
+    // continue when it is estimated to stay ahead:
+    m_bufferingEstimator.addSample(m_bufferingClock.elapsed(), qint64(m_videoPlayer->timeLoaded()),
+        qint64(m_videoPlayer->currentTime()), qint64(m_videoPlayer->duration()));
+    if (m_state == Phonon::PlayingState && m_bufferingEstimator.isBuffering()){
+        if (setState(Phonon::BufferingState)){
+            pause_internal();
+            // Keep polling the download:
+            updateTimer(m_rapidTimer, 100);
+        }
+    } else if (m_state == Phonon::BufferingState && !m_bufferingEstimator.isBuffering()){
+        if (setState(Phonon::PlayingState)){
+            if (m_audioSystem == AS_Graph)
+                m_audioGraph->start();
+            play_internal();
+        }
+        // While buffering, bufferStatus reported buffering progress.
+        // Go back to reporting how much is loaded, right away:
+        m_percentageLoaded = -1;
+    }
+
+    if (m_state == Phonon::BufferingState){
+        emit bufferStatus(m_bufferingEstimator.bufferPercent());
+        return;
+    }
+
     float percent = m_videoPlayer->percentageLoaded();
     if (percent != m_percentageLoaded){
         m_percentageLoaded = percent;
@@ -711,11 +862,21 @@ void MediaObject::updateBufferStatus()
     }
 }
 
+qint64 MediaObject::timeToSafePlay() const
+{
+    // The estimated time (in milliseconds) until playback can continue
+    // without buffering again. 0 when not buffering, -1 if unknown:
+    if (m_state != Phonon::BufferingState)
+        return 0;
+    return m_bufferingEstimator.timeToSafePlay();
+}
+
 void MediaObject::updateAudioBuffers()
 {
     // Schedule audio slices:
     m_audioPlayer->scheduleAudioToGraph();
     m_nextAudioPlayer->scheduleAudioToGraph();
+    updateNextHeadCache();
 }
 
 bool MediaObject::isCrossFading()
@@ -750,16 +911,39 @@ void MediaObject::updateLipSynch(int allowedOffset)
     if (m_videoSinkList.isEmpty() || m_audioSinkList.isEmpty())
         return;
         
-    if (m_videoPlayer->hasVideo()){
-        qint64 diff = m_audioPlayer->currentTime() - m_videoPlayer->currentTime();
-        if (-allowedOffset > diff || diff > allowedOffset)
-            m_audioPlayer->seek(m_videoPlayer->currentTime());
+    if (m_videoPlayer->hasVideo())
+        syncAudioToVideo(m_audioPlayer, m_videoPlayer, m_syncController, allowedOffset);
+
+    if (isCrossFading() && m_nextVideoPlayer->hasVideo())
+        syncAudioToVideo(m_nextAudioPlayer, m_nextVideoPlayer, m_nextSyncController, allowedOffset*2);
+}
+
+void MediaObject::syncAudioToVideo(QuickTimeAudioPlayer *audioPlayer, QuickTimeVideoPlayer *videoPlayer,
+    AVSyncController &controller, int allowedOffset)
+{
+    // An allowed offset of zero means that audio must be exactly where
+    // video is (e.g. when starting to play), so seek. Otherwise, let the
+    // audio play slightly faster or slower to catch up with video, and
+    // only seek if it has drifted too far away for that:
+    qint64 diff = audioPlayer->currentTime() - videoPlayer->currentTime();
+    if (allowedOffset == 0){
+        controller.reset();
+        audioPlayer->setRateAdjustment(1.0);
+        if (diff != 0)
+            audioPlayer->seek(videoPlayer->currentTime());
+        return;
     }
 
-    if (isCrossFading() && m_nextVideoPlayer->hasVideo()){
-        qint64 diff = m_nextAudioPlayer->currentTime() - m_nextVideoPlayer->currentTime();
-        if (-(allowedOffset*2) > diff || diff > (allowedOffset*2))
-            m_nextAudioPlayer->seek(m_nextVideoPlayer->currentTime());
+    controller.setResyncThreshold(allowedOffset * 2);
+    controller.addMeasurement(diff);
+    if (controller.needsResync()){
+        controller.reset();
+        audioPlayer->setRateAdjustment(1.0);
+        audioPlayer->seek(videoPlayer->currentTime());
+    } else if (!audioPlayer->setRateAdjustment(controller.rate())){
+        // The audio player cannot adjust its rate:
+        if (-allowedOffset > diff || diff > allowedOffset)
+            audioPlayer->seek(videoPlayer->currentTime());
     }
 }
 
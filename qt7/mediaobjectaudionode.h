@@ -48,6 +48,7 @@ namespace QT7
             void startCrossFade(qint64 duration);
             void updateCrossFade(qint64 currentTime);
             void cancelCrossFade();
+            void prepareGaplessTransition();
             void setMute(bool mute);
             bool isCrossFading();
 
@@ -59,12 +60,13 @@ namespace QT7
             AudioConnection *m_connection2;
 
             float m_fadeDuration;
+            Float64 m_mixSampleRate;
             float m_volume1;
             float m_volume2;
             float m_mute;
 
-            float applyCurve(float volume);
             void updateVolume();
+            void setBusVolume(AudioConnection *connection, float volume);
 
             void mediaNodeEvent(const MediaNodeEvent *event);
     };
@@ -19,6 +19,7 @@
 #include "quicktimeaudioplayer.h"
 #include "quicktimevideoplayer.h"
 #include "audiomixer.h"
+#include "gainramp.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -38,6 +39,10 @@ MediaObjectAudioNode::MediaObjectAudioNode(QuickTimeAudioPlayer *player1, QuickT
     m_connection2 = new AudioConnection(m_player2, 0, m_mixer, 1);
 
     m_fadeDuration = 0;
+    m_mixSampleRate = 0;
+    m_volume1 = 1;
+    m_volume2 = 0;
+    m_player2->setGain(0);
 }
 
 MediaObjectAudioNode::~MediaObjectAudioNode()
@@ -90,6 +95,17 @@ bool MediaObjectAudioNode::fillInStreamSpecification(AudioConnection *connection
         return m_mixer->fillInStreamSpecification(connection, side);
     } else {
         DEBUG_AUDIO_STREAM("(MediaObjectAudioNode" << int(this) << "fillInStreamSpecification called, role = sink)")
+        // The mixer needs all its inputs at one rate. Keep the rate the
+        // graph was built with, and resample the player that differs.
+        // Being a stereo mixer, it gets surround and mono sources
+        // remixed to stereo first:
+        QuickTimeAudioPlayer *current = static_cast<QuickTimeAudioPlayer *>(m_connection1->m_sourceAudioNode);
+        if (m_mixSampleRate <= 0 && current->videoPlayer())
+            m_mixSampleRate = qMax(Float64(0), current->sampleRate());
+        m_connection1->setSinkSampleRate(m_mixSampleRate);
+        m_connection2->setSinkSampleRate(m_mixSampleRate);
+        m_connection1->setSinkChannelLayoutTag(kAudioChannelLayoutTag_Stereo);
+        m_connection2->setSinkChannelLayoutTag(kAudioChannelLayoutTag_Stereo);
         return (m_connection2->updateStreamSpecification() && m_connection1->updateStreamSpecification());
     }
 }
@@ -103,11 +119,24 @@ bool MediaObjectAudioNode::setStreamSpecification(AudioConnection *connection, C
     return true;
 }
 
+void MediaObjectAudioNode::setBusVolume(AudioConnection *connection, float volume)
+{
+    // Players that render float audio apply their own (sample accurate)
+    // gain, so the mixer should just sum them. For the others, fall
+    // back to the mixer input volume, updated from the GUI thread:
+    QuickTimeAudioPlayer *player = static_cast<QuickTimeAudioPlayer *>(connection->m_sourceAudioNode);
+    if (m_mute)
+        volume = 0;
+    else if (player->appliesGain())
+        volume = 1;
+    m_mixer->setVolume(volume, connection->m_sinkInputBus);
+}
+
 void MediaObjectAudioNode::setMute(bool mute)
 {
     m_mute = mute;
-    m_mixer->setVolume(m_mute ? 0 : m_volume1, m_connection1->m_sinkInputBus);
-    m_mixer->setVolume(m_mute ? 0 : m_volume2, m_connection2->m_sinkInputBus);
+    setBusVolume(m_connection1, m_volume1);
+    setBusVolume(m_connection2, m_volume2);
 }
 
 void MediaObjectAudioNode::updateVolume()
@@ -122,8 +151,8 @@ void MediaObjectAudioNode::updateVolume()
     if (player2)
         player2->setRelativeVolume(m_volume2);
 
-    m_mixer->setVolume(m_volume1, m_connection1->m_sinkInputBus);
-    m_mixer->setVolume(m_volume2, m_connection2->m_sinkInputBus);
+    setBusVolume(m_connection1, m_volume1);
+    setBusVolume(m_connection2, m_volume2);
 }
 
 void MediaObjectAudioNode::startCrossFade(qint64 duration)
@@ -135,25 +164,26 @@ void MediaObjectAudioNode::startCrossFade(qint64 duration)
     m_connection1 = m_connection2;
     m_connection2 = tmp;
 
-    // Init volume:
+    QuickTimeAudioPlayer *fadeIn = static_cast<QuickTimeAudioPlayer *>(m_connection1->m_sourceAudioNode);
+    QuickTimeAudioPlayer *fadeOut = static_cast<QuickTimeAudioPlayer *>(m_connection2->m_sourceAudioNode);
+
+    // Init volume. The ramps run on the render thread from here on,
+    // while updateCrossFade follows them for the video players and
+    // for players that cannot apply their own gain:
     if (m_fadeDuration > 0){
         m_volume1 = 0;
         m_volume2 = 1;
+        fadeIn->rampGain(0, 1, duration, GainCurve::CrossFadeIn);
+        fadeOut->rampGain(-1, 0, duration, GainCurve::Linear);
     } else {
         m_volume1 = 1;
         m_volume2 = 0;
+        fadeIn->setGain(1);
+        fadeOut->setGain(0);
     }
     updateVolume();
 }
 
-float MediaObjectAudioNode::applyCurve(float volume)
-{
-    float newValue = 0;
-    if (volume > 0)
-        newValue = float(0.5f * (2 + log10(volume)));
-    return newValue;
-}
-
 void MediaObjectAudioNode::updateCrossFade(qint64 currentTime)
 {
     // Assume that currentTime starts at 0 and progress.
@@ -163,7 +193,7 @@ void MediaObjectAudioNode::updateCrossFade(qint64 currentTime)
             volume = 1;
             m_fadeDuration = 0;
         }
-        m_volume1 = applyCurve(volume);
+        m_volume1 = GainCurve::value(GainCurve::CrossFadeIn, volume);
         m_volume2 = 1 - volume;
         updateVolume();
     }
@@ -177,17 +207,33 @@ bool MediaObjectAudioNode::isCrossFading()
 void MediaObjectAudioNode::cancelCrossFade()
 {
     m_fadeDuration = 0;
+    m_mixSampleRate = 0;
     m_volume1 = 1;
     m_volume2 = 0;
+    static_cast<QuickTimeAudioPlayer *>(m_connection1->m_sourceAudioNode)->setGain(1);
+    static_cast<QuickTimeAudioPlayer *>(m_connection2->m_sourceAudioNode)->setGain(0);
     updateVolume();
 }
 
+void MediaObjectAudioNode::prepareGaplessTransition()
+{
+    // The next player is about to start exactly where the current
+    // one runs out of audio, so it must be audible from that sample
+    // on. Since they don't overlap, both can play at full volume:
+    m_fadeDuration = 0;
+    m_volume2 = m_volume1;
+    static_cast<QuickTimeAudioPlayer *>(m_connection2->m_sourceAudioNode)->setGain(m_volume2);
+    if (!m_mute)
+        updateVolume();
+}
+
 void MediaObjectAudioNode::mediaNodeEvent(const MediaNodeEvent *event)
 {
     switch (event->type()){
     case MediaNodeEvent::AudioGraphAboutToBeDeleted:
         m_connection1->invalidate();
         m_connection2->invalidate();
+        m_mixSampleRate = 0;
         break;
     case MediaNodeEvent::AudioGraphCannotPlay:
     case MediaNodeEvent::AudioGraphInitialized:
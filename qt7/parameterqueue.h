@@ -0,0 +1,132 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_PARAMETERQUEUE_H
+#define Phonon_QT7_PARAMETERQUEUE_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QVector>
+#include "lockfreequeue.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        A change of one parameter (as in AudioUnitSetParameter), to take
+        effect at a given sample time on the render timeline, or as soon
+        as possible if the time is negative. With a ramp length, the
+        value moves there over that many frames instead of jumping. The
+        ramp starts from the value the queue last set the parameter to,
+        or from 'from' (as the poster saw it) if the queue never set it.
+    */
+    struct ParameterCommand
+    {
+        quint32 parameter;
+        quint32 scope;
+        quint32 element;
+        float value;
+        double sampleTime;
+        quint32 rampFrames;
+        float from;
+    };
+
+    /**
+        Where a ParameterQueue applies its commands. Called on
+        the render thread only, so don't lock or allocate.
+    */
+    class ParameterTarget
+    {
+        public:
+            virtual ~ParameterTarget() {}
+            virtual void setParameterValue(const ParameterCommand &command, float value, quint32 bufferOffset) = 0;
+    };
+
+    /**
+        Hands parameter changes from the GUI thread (post) to the render
+        thread (process, once per buffer) without locks. Commands that are
+        due in the buffer are applied at their offset into it. Ramps are
+        stepped once per buffer, reaching the value the ramp has at the
+        end of each buffer, until done. At most MaxPending commands with a
+        sample time can be outstanding; post rejects more than that.
+
+        The poster can also use send, which keeps what does not fit
+        (the newest command per parameter) and posts it, before anything
+        newer, on the next send or repost. This way an older command
+        still in the queue can never win over a newer one.
+    */
+    class ParameterQueue
+    {
+        public:
+            ParameterQueue(int capacity = 64);
+
+            bool post(const ParameterCommand &command);
+            bool send(const ParameterCommand &command);
+            bool repost();
+            int keptCount() const;
+            void process(ParameterTarget *target, double bufferSampleTime, quint32 frames);
+            void flush(ParameterTarget *target);
+            int pendingCount() const;
+            int rampCount() const;
+
+        private:
+            enum {MaxPending = 32, MaxValues = 32};
+
+            struct Ramp
+            {
+                ParameterCommand command;
+                float from;
+                double startSampleTime;
+            };
+
+            struct Value
+            {
+                ParameterCommand command;
+                float value;
+            };
+
+            void apply(ParameterTarget *target, const ParameterCommand &command, double bufferSampleTime);
+            void applyNow(ParameterTarget *target, ParameterCommand command);
+            void removeRamp(const ParameterCommand &command);
+            void setValue(ParameterTarget *target, const ParameterCommand &command, float value, quint32 bufferOffset);
+            float currentValue(const ParameterCommand &command) const;
+            static bool sameParameter(const ParameterCommand &a, const ParameterCommand &b);
+
+            LockFreeQueue<ParameterCommand> m_commands;
+            // Commands with a sample time, posted but not yet applied:
+            QAtomicInt m_timedCount;
+            ParameterCommand m_pending[MaxPending];
+            int m_pendingCount;
+            Ramp m_ramps[MaxPending];
+            int m_rampCount;
+            // The values last set, so that ramps
+            // never need to ask the target:
+            Value m_values[MaxValues];
+            int m_valueCount;
+            int m_nextValue;
+            // Commands that did not fit (poster side only):
+            QVector<ParameterCommand> m_kept;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_PARAMETERQUEUE_H
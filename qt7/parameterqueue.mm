@@ -0,0 +1,222 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "parameterqueue.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+ParameterQueue::ParameterQueue(int capacity) : m_commands(capacity + 1)
+{
+    m_pendingCount = 0;
+    m_rampCount = 0;
+    m_valueCount = 0;
+    m_nextValue = 0;
+}
+
+bool ParameterQueue::post(const ParameterCommand &command)
+{
+    // Returns false if the queue is full (e.g. because nothing
+    // renders), or if the render thread would have no room to keep
+    // another command with a sample time. Then the caller must apply it:
+    bool timed = command.sampleTime >= 0;
+    if (timed && m_timedCount.fetchAndAddOrdered(1) >= MaxPending){
+        m_timedCount.deref();
+        return false;
+    }
+    if (m_commands.push(command))
+        return true;
+    if (timed)
+        m_timedCount.deref();
+    return false;
+}
+
+bool ParameterQueue::send(const ParameterCommand &command)
+{
+    // Returns false if the command had to be kept. It then
+    // replaces whatever was kept for the same parameter:
+    if (repost() && post(command))
+        return true;
+    for (int i = 0; i < m_kept.size(); ++i){
+        if (sameParameter(m_kept[i], command)){
+            m_kept.remove(i);
+            break;
+        }
+    }
+    m_kept.append(command);
+    return false;
+}
+
+bool ParameterQueue::repost()
+{
+    // Posts the kept commands, oldest first, while they fit.
+    // Returns true if nothing is kept anymore:
+    int posted = 0;
+    while (posted < m_kept.size() && post(m_kept[posted]))
+        ++posted;
+    m_kept.remove(0, posted);
+    return m_kept.isEmpty();
+}
+
+int ParameterQueue::keptCount() const
+{
+    return m_kept.size();
+}
+
+int ParameterQueue::pendingCount() const
+{
+    return m_pendingCount;
+}
+
+int ParameterQueue::rampCount() const
+{
+    return m_rampCount;
+}
+
+bool ParameterQueue::sameParameter(const ParameterCommand &a, const ParameterCommand &b)
+{
+    return a.parameter == b.parameter && a.scope == b.scope && a.element == b.element;
+}
+
+void ParameterQueue::removeRamp(const ParameterCommand &command)
+{
+    for (int i = 0; i < m_rampCount; ++i){
+        if (sameParameter(m_ramps[i].command, command)){
+            m_ramps[i] = m_ramps[--m_rampCount];
+            return;
+        }
+    }
+}
+
+void ParameterQueue::setValue(ParameterTarget *target, const ParameterCommand &command, float value, quint32 bufferOffset)
+{
+    target->setParameterValue(command, value, bufferOffset);
+    for (int i = 0; i < m_valueCount; ++i){
+        if (sameParameter(m_values[i].command, command)){
+            m_values[i].value = value;
+            return;
+        }
+    }
+    // With more parameters than we track, forget the oldest:
+    Value &slot = (m_valueCount < MaxValues) ? m_values[m_valueCount++] : m_values[m_nextValue++ % MaxValues];
+    slot.command = command;
+    slot.value = value;
+}
+
+float ParameterQueue::currentValue(const ParameterCommand &command) const
+{
+    for (int i = 0; i < m_valueCount; ++i){
+        if (sameParameter(m_values[i].command, command))
+            return m_values[i].value;
+    }
+    return command.from;
+}
+
+void ParameterQueue::apply(ParameterTarget *target, const ParameterCommand &command, double bufferSampleTime)
+{
+    // A new value for a parameter replaces any ramp on it:
+    if (command.sampleTime >= 0)
+        m_timedCount.deref();
+    removeRamp(command);
+    double startTime = (command.sampleTime < bufferSampleTime) ? bufferSampleTime : command.sampleTime;
+    if (command.rampFrames == 0 || m_rampCount == MaxPending){
+        setValue(target, command, command.value, quint32(startTime - bufferSampleTime));
+        return;
+    }
+    Ramp &ramp = m_ramps[m_rampCount++];
+    ramp.command = command;
+    ramp.from = currentValue(command);
+    ramp.startSampleTime = startTime;
+}
+
+void ParameterQueue::applyNow(ParameterTarget *target, ParameterCommand command)
+{
+    command.rampFrames = 0;
+    apply(target, command, qMax(0.0, command.sampleTime));
+}
+
+void ParameterQueue::process(ParameterTarget *target, double bufferSampleTime, quint32 frames)
+{
+    // Called on the render thread before each buffer:
+    double bufferEnd = bufferSampleTime + frames;
+    ParameterCommand command;
+    while (m_commands.pop(command)){
+        // post() keeps the commands with a sample
+        // time within what m_pending can hold:
+        if (command.sampleTime >= bufferEnd)
+            m_pending[m_pendingCount++] = command;
+        else
+            apply(target, command, bufferSampleTime);
+    }
+
+    // Apply the commands that are due, in the order they were posted:
+    int kept = 0;
+    for (int i = 0; i < m_pendingCount; ++i){
+        if (m_pending[i].sampleTime < bufferEnd)
+            apply(target, m_pending[i], bufferSampleTime);
+        else
+            m_pending[kept++] = m_pending[i];
+    }
+    m_pendingCount = kept;
+
+    // Step the ramps:
+    for (int i = 0; i < m_rampCount; ++i){
+        Ramp &ramp = m_ramps[i];
+        double offset = qMax(0.0, ramp.startSampleTime - bufferSampleTime);
+        double progress = (bufferEnd - ramp.startSampleTime) / ramp.command.rampFrames;
+        if (progress >= 1){
+            setValue(target, ramp.command, ramp.command.value, quint32(offset));
+            m_ramps[i--] = m_ramps[--m_rampCount];
+        } else {
+            float value = ramp.from + float(progress) * (ramp.command.value - ramp.from);
+            setValue(target, ramp.command, value, quint32(offset));
+        }
+    }
+}
+
+void ParameterQueue::flush(ParameterTarget *target)
+{
+    // For when nothing renders (so the caller can stand in for the
+    // render thread): everything takes its final value right away,
+    // in the order posted. The pending commands came first, and
+    // the kept ones (if the poster is the caller) come last:
+    for (int i = 0; i < m_rampCount; ++i)
+        setValue(target, m_ramps[i].command, m_ramps[i].command.value, 0);
+    m_rampCount = 0;
+
+    for (int i = 0; i < m_pendingCount; ++i)
+        applyNow(target, m_pending[i]);
+    m_pendingCount = 0;
+    ParameterCommand command;
+    while (m_commands.pop(command))
+        applyNow(target, command);
+    // (post never counted these as timed):
+    for (int i = 0; i < m_kept.size(); ++i){
+        command = m_kept[i];
+        command.sampleTime = -1;
+        applyNow(target, command);
+    }
+    m_kept.clear();
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,92 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_PCMCLIPCACHE_H
+#define Phonon_QT7_PCMCLIPCACHE_H
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <phonon/mediasource.h>
+#include <QtCore/QCache>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        All of the audio of a short source, decoded into PCM in the
+        extraction format. Each channel is stored after the other
+        (frames samples each), like the head cache of an audio player.
+    */
+    class PcmClip
+    {
+        public:
+            PcmClip();
+            ~PcmClip();
+
+            int byteSize() const;
+
+            AudioStreamBasicDescription streamDescription;
+            AudioChannelLayout *channelLayout;
+            UInt32 channelLayoutSize;
+            char *data;
+            int frames;
+    };
+
+    /**
+        Process-wide LRU cache of decoded clips, so that short sources
+        (e.g. notification sounds) played over and over are decoded only
+        once. Clips are looked up by file and modification time, and the
+        least recently used ones are dropped when the cache goes over its
+        byte budget. Players keep their clip alive while they use it.
+    */
+    class PcmClipCache
+    {
+        public:
+            static PcmClipCache *instance();
+            static QString keyFor(const MediaSource &source);
+
+            bool accepts(quint64 durationMs) const;
+            QSharedPointer<PcmClip> find(const QString &key);
+            void insert(const QString &key, const QSharedPointer<PcmClip> &clip);
+            void clear();
+
+            void setBudget(int bytes);
+            int budget() const;
+            int bytesUsed() const;
+            void setMaxClipDuration(int milliseconds);
+            int maxClipDuration() const;
+            int hits() const;
+            int misses() const;
+
+        private:
+            PcmClipCache();
+
+            QCache<QString, QSharedPointer<PcmClip> > m_clips;
+            int m_maxClipDuration;
+            int m_hits;
+            int m_misses;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_PCMCLIPCACHE_H
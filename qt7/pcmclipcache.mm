@@ -0,0 +1,167 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pcmclipcache.h"
+#include "backendheader.h"
+#include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
+#include <QtCore/QUrl>
+#include <QtCore/QDebug>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+PcmClip::PcmClip()
+{
+    memset(&streamDescription, 0, sizeof(streamDescription));
+    channelLayout = 0;
+    channelLayoutSize = 0;
+    data = 0;
+    frames = 0;
+}
+
+PcmClip::~PcmClip()
+{
+    free(channelLayout);
+    free(data);
+}
+
+int PcmClip::byteSize() const
+{
+    return int(streamDescription.mChannelsPerFrame * streamDescription.mBytesPerPacket * frames);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+PcmClipCache *PcmClipCache::instance()
+{
+    static PcmClipCache cache;
+    return &cache;
+}
+
+PcmClipCache::PcmClipCache()
+{
+    m_hits = 0;
+    m_misses = 0;
+
+    // Sources of at most PHONON_QT7_CLIP_CACHE_MS are cached, in
+    // at most PHONON_QT7_CLIP_CACHE_KB. Zero turns the cache off:
+    m_maxClipDuration = 5000;
+    int budgetKb = 16 * 1024;
+    QByteArray duration = qgetenv("PHONON_QT7_CLIP_CACHE_MS");
+    if (!duration.isEmpty())
+        m_maxClipDuration = qMax(0, duration.toInt());
+    QByteArray budget = qgetenv("PHONON_QT7_CLIP_CACHE_KB");
+    if (!budget.isEmpty())
+        budgetKb = qMax(0, budget.toInt());
+    m_clips.setMaxCost(budgetKb * 1024);
+}
+
+QString PcmClipCache::keyFor(const MediaSource &source)
+{
+    // Only local files are cached, since that is where we can
+    // tell if the contents changed. Returns an empty key if the
+    // source cannot be cached:
+    QString path;
+    if (source.type() == MediaSource::LocalFile)
+        path = source.fileName();
+    else if (source.type() == MediaSource::Url && source.url().scheme() == QLatin1String("file"))
+        path = source.url().toLocalFile();
+    if (path.isEmpty())
+        return QString();
+
+    QFileInfo info(path);
+    if (!info.exists())
+        return QString();
+    return info.absoluteFilePath() + QLatin1Char('|')
+        + QString::number(info.lastModified().toTime_t()) + QLatin1Char('|')
+        + QString::number(info.size());
+}
+
+bool PcmClipCache::accepts(quint64 durationMs) const
+{
+    return m_clips.maxCost() > 0 && durationMs > 0 && durationMs <= quint64(m_maxClipDuration);
+}
+
+QSharedPointer<PcmClip> PcmClipCache::find(const QString &key)
+{
+    QSharedPointer<PcmClip> *clip = m_clips.object(key);
+    if (!clip){
+        ++m_misses;
+        return QSharedPointer<PcmClip>();
+    }
+    ++m_hits;
+    return *clip;
+}
+
+void PcmClipCache::insert(const QString &key, const QSharedPointer<PcmClip> &clip)
+{
+    // Takes care of dropping the least recently used clips, if needed.
+    // A clip larger than the whole budget is simply not cached:
+    bool inserted = m_clips.insert(key, new QSharedPointer<PcmClip>(clip), clip->byteSize());
+    if (qgetenv("PHONON_DEBUG") == "1")
+        qDebug() << "PcmClipCache" << (inserted ? "cached" : "could not cache") << clip->byteSize()
+            << "bytes. Used:" << bytesUsed() << "of" << budget() << "Hits:" << m_hits << "Misses:" << m_misses;
+}
+
+void PcmClipCache::clear()
+{
+    m_clips.clear();
+}
+
+void PcmClipCache::setBudget(int bytes)
+{
+    m_clips.setMaxCost(qMax(0, bytes));
+}
+
+int PcmClipCache::budget() const
+{
+    return m_clips.maxCost();
+}
+
+int PcmClipCache::bytesUsed() const
+{
+    return m_clips.totalCost();
+}
+
+void PcmClipCache::setMaxClipDuration(int milliseconds)
+{
+    m_maxClipDuration = qMax(0, milliseconds);
+}
+
+int PcmClipCache::maxClipDuration() const
+{
+    return m_maxClipDuration;
+}
+
+int PcmClipCache::hits() const
+{
+    return m_hits;
+}
+
+int PcmClipCache::misses() const
+{
+    return m_misses;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
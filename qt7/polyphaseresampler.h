@@ -0,0 +1,92 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_POLYPHASERESAMPLER_H
+#define Phonon_QT7_POLYPHASERESAMPLER_H
+
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Converts non-interleaved float audio from one fixed sample rate to
+        another, with a polyphase bank of Kaiser windowed sinc filters
+        computed up front. For the usual rates the ratio is exact (44.1 to
+        48 kHz uses 160 phases, stepping 147 at a time), so nothing drifts.
+        Other ratios step a fractional position, and use the nearest of
+        MaxPhases phases.
+
+        Works like VariableResampler: write input with inputBuffer and
+        commitInput, and read output in whatever amounts needed. Only
+        configure allocates, so the rest can run on the render thread
+        as long as no more than maxInputFrames are written at once.
+    */
+    class PolyphaseResampler
+    {
+        public:
+            enum Quality {Fast, Good, Best};
+            enum {MaxPhases = 1024};
+
+            PolyphaseResampler();
+
+            bool configure(double inputRate, double outputRate, int channels,
+                Quality quality = Good, int maxInputFrames = 4096);
+            void reset();
+            bool isPassthrough() const;
+
+            int framesNeeded(int outputFrames) const;
+            float *inputBuffer(int channel, int frames);
+            void commitInput(int frames);
+            int read(float *const *output, int outputFrames);
+
+            double inputRate() const;
+            double outputRate() const;
+            int channelCount() const;
+            int phaseCount() const;
+            int tapsPerPhase() const;
+
+            static float dot(const float *a, const float *b, int count);
+
+        private:
+            void compact();
+
+            double m_inputRate;
+            double m_outputRate;
+            int m_channels;
+            int m_phases;   // L: output steps per input frame
+            int m_step;     // M: phases to move per output frame
+            bool m_exact;
+            double m_ratio;
+            double m_fraction;
+            int m_taps;
+            QVector<float> m_bank;
+            QVector<QVector<float> > m_buffers;
+            int m_capacity;
+            int m_available;
+            int m_index;
+            int m_phase;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_POLYPHASERESAMPLER_H
@@ -0,0 +1,294 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "polyphaseresampler.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define PHONON_QT7_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define PHONON_QT7_NEON
+#endif
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+static int greatestCommonDivisor(int a, int b)
+{
+    while (b){
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double besselI0(double x)
+{
+    // Power series of the modified Bessel function of order zero:
+    double sum = 1;
+    double term = 1;
+    for (int k=1; k<50; ++k){
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+PolyphaseResampler::PolyphaseResampler()
+{
+    m_inputRate = 0;
+    m_outputRate = 0;
+    m_channels = 0;
+    m_phases = 1;
+    m_step = 1;
+    m_exact = true;
+    m_ratio = 1;
+    m_fraction = 0;
+    m_taps = 0;
+    m_capacity = 0;
+    m_available = 0;
+    m_index = 0;
+    m_phase = 0;
+    m_fraction = 0;
+}
+
+bool PolyphaseResampler::configure(double inputRate, double outputRate, int channels, Quality quality, int maxInputFrames)
+{
+    if (inputRate <= 0 || outputRate <= 0 || channels <= 0 || maxInputFrames <= 0)
+        return false;
+    m_inputRate = inputRate;
+    m_outputRate = outputRate;
+    m_channels = channels;
+
+    // The ratio as L/M, exact for integer rates that have a large
+    // enough common divisor. Otherwise, step a fractional position:
+    int in = int(inputRate + 0.5);
+    int out = int(outputRate + 0.5);
+    int divisor = greatestCommonDivisor(in, out);
+    m_exact = fabs(in - inputRate) < 1e-9 && fabs(out - outputRate) < 1e-9 && out / divisor <= MaxPhases;
+    m_phases = m_exact ? out / divisor : int(MaxPhases);
+    m_step = m_exact ? in / divisor : 0;
+    m_ratio = inputRate / outputRate;
+
+    // Cut off below the lower of the two Nyquist frequencies, leaving
+    // a transition band. When going down, the filter gets longer to
+    // keep the same number of zero crossings:
+    static const int tapsForQuality[] = {16, 48, 96};
+    static const double betaForQuality[] = {6.0, 8.0, 10.0};
+    static const double rolloffForQuality[] = {0.90, 0.94, 0.96};
+    double cutoff = qMin(1.0, outputRate / inputRate) * rolloffForQuality[quality];
+    m_taps = int(ceil(tapsForQuality[quality] / qMin(1.0, outputRate / inputRate)));
+    m_taps = qMin((m_taps + 3) & ~3, 256);
+
+    // Phase p is the filter for output positions p / L past an input
+    // frame. Tap k of it weighs the input frame k - (taps / 2 - 1):
+    const double halfWidth = m_taps / 2.0;
+    const double beta = betaForQuality[quality];
+    const double i0Beta = besselI0(beta);
+    m_bank.resize(m_phases * m_taps);
+    for (int p=0; p<m_phases; ++p){
+        float *coefficients = m_bank.data() + p * m_taps;
+        double sum = 0;
+        for (int k=0; k<m_taps; ++k){
+            double t = (k - (halfWidth - 1)) - double(p) / m_phases;
+            double x = t * cutoff * M_PI;
+            double sinc = (fabs(x) < 1e-12) ? 1.0 : sin(x) / x;
+            double r = t / halfWidth;
+            double window = (fabs(r) >= 1) ? 0 : besselI0(beta * sqrt(1 - r * r)) / i0Beta;
+            coefficients[k] = float(cutoff * sinc * window);
+            sum += coefficients[k];
+        }
+        // Unity gain at DC for every phase:
+        for (int k=0; k<m_taps; ++k)
+            coefficients[k] = float(coefficients[k] / sum);
+    }
+
+    m_capacity = maxInputFrames + 2 * m_taps;
+    m_buffers.resize(m_channels);
+    for (int i=0; i<m_channels; ++i)
+        m_buffers[i].resize(m_capacity);
+    reset();
+    return true;
+}
+
+void PolyphaseResampler::reset()
+{
+    // Start with half a filter of silence, so that the first
+    // output frame lines up with the first input frame:
+    for (int i=0; i<m_channels; ++i)
+        memset(m_buffers[i].data(), 0, m_capacity * sizeof(float));
+    m_available = qMax(0, m_taps / 2 - 1);
+    m_index = 0;
+    m_phase = 0;
+    m_fraction = 0;
+}
+
+bool PolyphaseResampler::isPassthrough() const
+{
+    return m_inputRate == m_outputRate;
+}
+
+int PolyphaseResampler::framesNeeded(int outputFrames) const
+{
+    if (outputFrames <= 0)
+        return 0;
+    qint64 lastIndex = m_exact
+        ? m_index + (qint64(m_phase) + qint64(outputFrames - 1) * m_step) / m_phases
+        : m_index + qint64(floor(m_fraction + (outputFrames - 1) * m_ratio)) + 1; // + 1 as the phase rounds
+    int needed = int(lastIndex + m_taps - m_available);
+    return qMax(0, needed);
+}
+
+void PolyphaseResampler::compact()
+{
+    // Move what is still needed to the front of the buffers:
+    if (m_index == 0)
+        return;
+    int keep = m_available - m_index;
+    for (int i=0; i<m_channels; ++i){
+        float *buffer = m_buffers[i].data();
+        memmove(buffer, buffer + m_index, keep * sizeof(float));
+    }
+    m_available = keep;
+    m_index = 0;
+}
+
+float *PolyphaseResampler::inputBuffer(int channel, int frames)
+{
+    // Returns where to write 'frames' new frames for 'channel'.
+    // Call commitInput when all channels are written:
+    if (m_available + frames > m_capacity)
+        compact();
+    if (m_available + frames > m_capacity)
+        return 0;
+    return m_buffers[channel].data() + m_available;
+}
+
+void PolyphaseResampler::commitInput(int frames)
+{
+    m_available = qMin(m_capacity, m_available + frames);
+}
+
+int PolyphaseResampler::read(float *const *output, int outputFrames)
+{
+    int produced = 0;
+    while (produced < outputFrames && m_index + m_taps <= m_available){
+        const float *coefficients = m_bank.constData() + m_phase * m_taps;
+        for (int i=0; i<m_channels; ++i)
+            output[i][produced] = dot(coefficients, m_buffers[i].constData() + m_index, m_taps);
+        ++produced;
+        if (m_exact){
+            m_phase += m_step;
+            m_index += m_phase / m_phases;
+            m_phase %= m_phases;
+        } else {
+            m_fraction += m_ratio;
+            int whole = int(floor(m_fraction));
+            m_index += whole;
+            m_fraction -= whole;
+            m_phase = int(m_fraction * m_phases + 0.5);
+            if (m_phase == m_phases){
+                // Rounds up to the next input frame:
+                m_phase = 0;
+                ++m_index;
+                m_fraction -= 1;
+            }
+        }
+    }
+    return produced;
+}
+
+double PolyphaseResampler::inputRate() const
+{
+    return m_inputRate;
+}
+
+double PolyphaseResampler::outputRate() const
+{
+    return m_outputRate;
+}
+
+int PolyphaseResampler::channelCount() const
+{
+    return m_channels;
+}
+
+int PolyphaseResampler::phaseCount() const
+{
+    return m_phases;
+}
+
+int PolyphaseResampler::tapsPerPhase() const
+{
+    return m_taps;
+}
+
+float PolyphaseResampler::dot(const float *a, const float *b, int count)
+{
+    // count is a multiple of four (see configure):
+#if defined(PHONON_QT7_SSE2)
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i < count; i += 4)
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_shuffle_ps(sum0, sum0, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum0 = _mm_add_ps(sum0, _mm_shuffle_ps(sum0, sum0, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(sum0);
+#elif defined(PHONON_QT7_NEON)
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    for (; i < count; i += 4)
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum0 = vaddq_f32(sum0, sum1);
+    float32x2_t sum = vadd_f32(vget_low_f32(sum0), vget_high_f32(sum0));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    for (int i=0; i<count; i+=4){
+        sum0 += a[i] * b[i];
+        sum1 += a[i + 1] * b[i + 1];
+        sum2 += a[i + 2] * b[i + 2];
+        sum3 += a[i + 3] * b[i + 3];
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+#endif
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -28,7 +28,16 @@
 #include <phonon/mediasource.h>
 #include <Carbon/Carbon.h>
 #include <QtCore/QString>
+#include <QtCore/QVector>
 #include "audionode.h"
+#include "audioslicecontroller.h"
+#include "variableresampler.h"
+#include "gainramp.h"
+#include "lockfreequeue.h"
+#include "decodeblockqueue.h"
+#include "pcmclipcache.h"
+#include "rendertimeline.h"
+#include "sampleconverter.h"
 
 QT_BEGIN_NAMESPACE
 
@@ -39,6 +48,28 @@ namespace QT7
     class AudioGraph;
     class MediaNodeEvent;
     class QuickTimeVideoPlayer;
+    class AudioDecodeThread;
+    class SliceRefillNotifier;
+
+    struct AudioDecodeSeek
+    {
+        TimeRecord time;
+        long samplesRemaining;
+    };
+
+    struct AudioSliceCompletion
+    {
+        AudioSliceCompletion() : index(-1), generation(0) {}
+        int index;
+        int generation;
+    };
+
+    struct AudioRateAnchor
+    {
+        Float64 outputSample;
+        double mediaSample;
+        double rate;
+    };
 
     class QuickTimeAudioPlayer : public AudioNode
     {
@@ -60,9 +91,25 @@ namespace QT7
 
             bool hasAudio();
             bool isPlaying();
-            void scheduleAudioToGraph();
+            void scheduleAudioToGraph(bool adaptSlices = true);
             long regularTaskFrequency();
+            int sliceCount() const;
+            int extractionPacketCount() const;
             quint64 currentTime();
+            bool setRateAdjustment(double rate);
+            double rateAdjustment() const;
+            bool playAt(Float64 renderSampleTime);
+            Float64 startSampleTime() const;
+            Float64 endSampleTime() const;
+            Float64 sampleRate() const;
+
+            void rampGain(float from, float to, qint64 milliseconds, GainCurve::Shape shape = GainCurve::Linear);
+            void setGain(float gain);
+            bool appliesGain() const;
+
+            void startHeadCache(int maxFrames);
+            bool decodeHeadStep();
+            int headCacheBytes() const;
             QString currentTimeString();
             QuickTimeVideoPlayer *videoPlayer();
 
@@ -74,10 +121,45 @@ namespace QT7
             static bool soundPlayerIsAwailable();
 
         private:
+            friend class AudioDecodeThread;
+            friend class SliceRefillNotifier;
+            enum {DecodeBlockCount = 16, DecodeBlockFrames = 4096, MaxSliceCount = 64,
+                GainBlockFrames = 256, MaxGainChannels = 8};
+
             void initSoundExtraction();
             void newGraphNotification();
             void allocateSoundSlices();
-            void scheduleSoundSlices();
+            void releaseSoundSlices();
+            void freeSoundArena();
+            void adaptSoundSlices(int pendingSlices);
+            void scheduleSoundSlices(bool adaptSlices);
+            int fillSoundSlices(int firstSlice, int sliceCount);
+            int fillSoundSlicesFromDecoder(int firstSlice, int sliceCount);
+            int fillSoundSlicesResampled(int firstSlice, int sliceCount);
+            int fillSoundSlicesFromHead(int firstSlice, int sliceCount);
+            void releaseHeadCache();
+            void useClip();
+            void cacheClip(const QString &key);
+            bool canResample() const;
+            void addRateAnchor(double rate);
+            double mediaSampleAt(Float64 outputSample);
+            static OSStatus renderNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+            bool renderTimelineKnown() const;
+            void applyGain(AudioBufferList *data, UInt32 frameCount);
+            void applyConvertedGain(AudioBufferList *data, UInt32 offset, int frames, const float *gains);
+            void postPendingGainCommand();
+            void updateGainFormat();
+            Float64 nextStartSampleTime();
+            void startDecodeThread();
+            void stopDecodeThread();
+            void decodeLoop();
+            void requestDecodeSeek(const TimeRecord &time, long samplesRemaining);
+            static void sliceCompleted(void *userData, ScheduledAudioSlice *slice);
+            void refillRequested();
+            void collectCompletedSlices();
+            void resetSliceState();
+            void updateFreeSlices();
 
             State m_state;
             QuickTimeVideoPlayer *m_videoPlayer;
@@ -87,6 +169,27 @@ namespace QT7
 #endif
 
             ScheduledAudioSlice *m_sliceList;
+            AudioBufferList *m_batchBufferList;
+            void *m_sliceArena;
+            size_t m_sliceArenaSize;
+            bool m_contiguousSlices;
+
+            // Slices are refilled when the audio unit reports them as played:
+            // The completion callback (on the render thread) queues the slice
+            // index in m_completedSlices, and wakes us up through a pipe. Only
+            // the GUI thread touches m_freeSlices and m_sliceScheduled.
+            // Each slice is tagged with the generation it was scheduled in,
+            // and resetting the audio unit starts a new one. That way a
+            // completion reported late for an earlier scheduling is ignored:
+            LockFreeQueue<AudioSliceCompletion> m_completedSlices;
+            QVector<int> m_freeSlices;
+            QVector<char> m_sliceScheduled;
+            QVector<int> m_sliceGenerations;
+            int m_sliceGeneration;
+            int m_scheduledSliceCount;
+            QAtomicInt m_refillRequested;
+            int m_refillPipe[2];
+            SliceRefillNotifier *m_refillNotifier;
             AudioChannelLayout *m_audioChannelLayout;
             UInt32 m_audioChannelLayoutSize;
             AudioStreamBasicDescription m_audioStreamDescription;
@@ -99,10 +202,71 @@ namespace QT7
 
             long m_samplesRemaining;
             int m_sliceCount;
+            int m_carvedSliceCount;
             int m_maxExtractionPacketCount;
+            bool m_sliceRefillStarted;
+            int m_minPendingSlices;
+            AudioSliceController m_sliceController;
 
             Float64 m_sampleTimeStamp;
             quint64 m_startTime;
+
+            // To keep in sync with video, the audio can be played slightly
+            // faster or slower than normal. Once that starts, all audio goes
+            // through m_resampler until the next seek. m_rateAnchors maps
+            // scheduled (output) samples back to samples in the movie:
+            VariableResampler m_resampler;
+            double m_rateAdjustment;
+            bool m_resampling;
+            double m_mediaSampleTimeStamp;
+            QVector<AudioRateAnchor> m_rateAnchors;
+
+            // Where on the render timeline (shared by all players in the
+            // graph) the unit started playing. This lets another player be
+            // started at the exact sample where we run out of audio. The
+            // render thread updates the timeline before each render cycle:
+            RenderTimeline m_timeline;
+            volatile UInt64 m_renderHostTime;
+            Float64 m_requestedStartSampleTime;
+
+            // The gain of the player is applied to the rendered audio
+            // frame by frame, following ramps started from the GUI thread
+            // through m_gainCommands. Only the render thread touches
+            // m_gainRamp. Integer output goes through floats and back.
+            // A command that does not fit in the queue waits (GUI side)
+            // in m_pendingGainCommand:
+            GainRamp m_gainRamp;
+            LockFreeQueue<GainRampCommand> m_gainCommands;
+            GainRampCommand m_pendingGainCommand;
+            bool m_hasPendingGainCommand;
+            volatile bool m_floatOutput;
+            volatile bool m_convertedOutput;
+            SampleConverter m_gainDecoder;
+            SampleConverter m_gainEncoder;
+
+            // Head cache: while another source plays, the first part of
+            // this one can be extracted ahead of time (a little per timer
+            // tick). Playing from the start then begins with these frames,
+            // and extraction goes on from where the head ends:
+            char *m_headBuffer;
+            int m_headCapacity;
+            int m_headFrames;
+            int m_headReadFrame;
+            bool m_headDecoding;
+            bool m_headEndOfStream;
+
+            // A short source can be decoded all at once into a clip that
+            // is kept in the PcmClipCache. The clip then serves as a head
+            // cache holding all of the audio, and is never extracted again:
+            QSharedPointer<PcmClip> m_clip;
+
+            // Decode-ahead: a thread extracts audio into a pool of blocks ahead
+            // of time, and hands them over through m_decodeQueue, which also
+            // passes seeks on to the thread:
+            AudioDecodeThread *m_decodeThread;
+            AudioBufferList *m_decodeBufferLists[DecodeBlockCount];
+            void *m_decodeBlockMemory;
+            DecodeBlockQueue<AudioDecodeSeek> m_decodeQueue;
     };
 
 }} // namespace Phonon::QT7
@@ -20,6 +20,15 @@
 #include "audiograph.h"
 #include "medianodeevent.h"
 #include "medianode.h"
+#include <QtCore/QDebug>
+#include <QtCore/QThread>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QVarLengthArray>
+
+#include <CoreAudio/HostTime.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -28,21 +37,96 @@ namespace Phonon
 namespace QT7
 {
 
-QuickTimeAudioPlayer::QuickTimeAudioPlayer() : AudioNode(0, 1)
+class AudioDecodeThread : public QThread
+{
+public:
+    AudioDecodeThread(QuickTimeAudioPlayer *player) : m_player(player) {}
+protected:
+    void run() { m_player->decodeLoop(); }
+private:
+    QuickTimeAudioPlayer *m_player;
+};
+
+class SliceRefillNotifier : public QSocketNotifier
+{
+public:
+    SliceRefillNotifier(int fd, QuickTimeAudioPlayer *player)
+        : QSocketNotifier(fd, QSocketNotifier::Read), m_player(player) {}
+protected:
+    bool event(QEvent *event)
+    {
+        if (event->type() == QEvent::SockAct){
+            m_player->refillRequested();
+            return true;
+        }
+        return QSocketNotifier::event(event);
+    }
+private:
+    QuickTimeAudioPlayer *m_player;
+};
+
+QuickTimeAudioPlayer::QuickTimeAudioPlayer() : AudioNode(0, 1),
+    m_completedSlices(MaxSliceCount + 1), m_gainCommands(16),
+    m_decodeQueue(DecodeBlockCount)
 {
     m_state = NoMedia;
     m_videoPlayer = 0;
     m_audioChannelLayout = 0;
     m_sliceList = 0;
-    m_sliceCount = 30;
-    m_maxExtractionPacketCount = 4096;
+    m_batchBufferList = 0;
+    m_sliceArena = 0;
+    m_sliceArenaSize = 0;
+    m_carvedSliceCount = 0;
+    m_contiguousSlices = false;
+    m_sliceRefillStarted = false;
+    m_minPendingSlices = INT_MAX;
+    m_scheduledSliceCount = 0;
+    m_sliceGeneration = 0;
+
+    // The completion callback wakes us up by writing to this pipe. It
+    // must never block the render thread, so make it non-blocking:
+    m_refillNotifier = 0;
+    if (pipe(m_refillPipe) == 0){
+        fcntl(m_refillPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(m_refillPipe[1], F_SETFL, O_NONBLOCK);
+        m_refillNotifier = new SliceRefillNotifier(m_refillPipe[0], this);
+    } else {
+        m_refillPipe[0] = m_refillPipe[1] = -1;
+    }
+
+    // The slice buffer size adapts to how timely the slices
+    // are refilled. PHONON_QT7_AUDIO_SLACK is the fraction of
+    // the slices that should still be queued at each refill:
+    m_sliceController.setBounds(4, MaxSliceCount, 512, 8192);
+    QByteArray slack = qgetenv("PHONON_QT7_AUDIO_SLACK");
+    if (!slack.isEmpty())
+        m_sliceController.setTargetSlack(slack.toFloat());
+    m_sliceCount = m_sliceController.sliceCount();
+    m_maxExtractionPacketCount = m_sliceController.packetCount();
     m_audioExtractionComplete = false;
     m_audioEnabled = true;
     m_samplesRemaining = -1;
     m_startTime = 0;
     m_sampleTimeStamp = 0;
+    m_rateAdjustment = 1.0;
+    m_resampling = false;
+    m_mediaSampleTimeStamp = 0;
+    m_renderHostTime = 0;
+    m_requestedStartSampleTime = -1;
+    m_floatOutput = false;
+    m_convertedOutput = false;
+    m_hasPendingGainCommand = false;
+    m_headBuffer = 0;
+    m_headCapacity = 0;
+    m_headFrames = 0;
+    m_headReadFrame = 0;
+    m_headDecoding = false;
+    m_headEndOfStream = false;
     m_audioUnitIsReset = true;
 
+    m_decodeThread = 0;
+    m_decodeBlockMemory = 0;
+
 #ifdef QUICKTIME_C_API_AVAILABLE
     m_audioExtractionRef = 0;
 #endif
@@ -51,6 +135,12 @@ QuickTimeAudioPlayer::QuickTimeAudioPlayer() : AudioNode(0, 1)
 QuickTimeAudioPlayer::~QuickTimeAudioPlayer()
 {
     unsetVideoPlayer();
+    freeSoundArena();
+    delete m_refillNotifier;
+    if (m_refillPipe[0] != -1){
+        close(m_refillPipe[0]);
+        close(m_refillPipe[1]);
+    }
 }
 
 void QuickTimeAudioPlayer::unsetVideoPlayer()
@@ -60,6 +150,9 @@ void QuickTimeAudioPlayer::unsetVideoPlayer()
         BACKEND_ASSERT2(err == noErr, "Could not reset audio player unit when unsetting movie", FATAL_ERROR)
     }
 
+    stopDecodeThread();
+    releaseHeadCache();
+
 #ifdef QUICKTIME_C_API_AVAILABLE
     if (m_audioExtractionRef && m_videoPlayer && m_videoPlayer->hasMovie())
          MovieAudioExtractionEnd(m_audioExtractionRef);
@@ -71,17 +164,17 @@ void QuickTimeAudioPlayer::unsetVideoPlayer()
         m_audioChannelLayout = 0;
     }
     
-    if (m_sliceList){
-        for (int i=0; i<m_sliceCount; i++)
-	        free(m_sliceList[i].mBufferList);
-        free(m_sliceList);
-        m_sliceList = 0;
-    }
+    releaseSoundSlices();
     
     m_videoPlayer = 0;
     m_audioExtractionComplete = false;
     m_samplesRemaining = -1;
     m_sampleTimeStamp = 0;
+    m_mediaSampleTimeStamp = 0;
+    m_rateAdjustment = 1.0;
+    m_resampling = false;
+    m_rateAnchors.clear();
+    m_timeline.cancelStart();
     m_state = NoMedia;
 }
 
@@ -106,8 +199,28 @@ void QuickTimeAudioPlayer::setVideoPlayer(QuickTimeVideoPlayer *videoPlayer)
     unsetVideoPlayer();
     if (videoPlayer && videoPlayer->hasMovie()){
         m_videoPlayer = videoPlayer;
-        initSoundExtraction();
+
+        // Short sources played before are already decoded:
+        PcmClipCache *clipCache = PcmClipCache::instance();
+        QString clipKey;
+        if (clipCache->accepts(videoPlayer->duration()))
+            clipKey = PcmClipCache::keyFor(videoPlayer->mediaSource());
+        if (!clipKey.isEmpty())
+            m_clip = clipCache->find(clipKey);
+
+        if (m_clip)
+            useClip();
+        else
+            initSoundExtraction();
         allocateSoundSlices();
+        if (!m_clip && !clipKey.isEmpty())
+            cacheClip(clipKey);
+
+        // Extracting audio on a separate thread keeps the audio going when
+        // the GUI thread is busy. But it requires that the codecs in use
+        // are thread safe. So it is only done on request:
+        if (!m_clip && qgetenv("PHONON_QT7_AUDIO_DECODE_THREAD") == "1")
+            startDecodeThread();
         m_state = Paused;
         seek(0);
     }
@@ -118,8 +231,9 @@ QuickTimeVideoPlayer *QuickTimeAudioPlayer::videoPlayer()
     return m_videoPlayer;
 }
 
-void QuickTimeAudioPlayer::scheduleAudioToGraph()
+void QuickTimeAudioPlayer::scheduleAudioToGraph(bool adaptSlices)
 {
+    postPendingGainCommand();
     if (!m_videoPlayer || !m_audioEnabled || m_audioExtractionComplete || m_state != Playing)
         return;
 
@@ -127,7 +241,7 @@ void QuickTimeAudioPlayer::scheduleAudioToGraph()
     // If not, flag the need for another audio system, but let
     // the end app know about it:
     gClearError();
-    scheduleSoundSlices();    
+    scheduleSoundSlices(adaptSlices);
     if (gGetErrorType() != NO_ERROR){
         gClearError();
         if (m_audioGraph)
@@ -144,6 +258,7 @@ void QuickTimeAudioPlayer::flush()
         OSStatus err = AudioUnitReset(m_audioUnit, kAudioUnitScope_Global, 0);
         BACKEND_ASSERT2(err == noErr, "Could not reset audio player unit on pause", FATAL_ERROR)
         m_audioUnitIsReset = true;
+        m_timeline.cancelStart();
     }
 }
 
@@ -196,14 +311,25 @@ void QuickTimeAudioPlayer::seek(quint64 milliseconds)
         BACKEND_ASSERT2(err == noErr, "Could not reset audio player unit before seek", FATAL_ERROR)
     }
     m_sampleTimeStamp = 0;
-    for (int i = 0; i < m_sliceCount; i++)
+    m_mediaSampleTimeStamp = 0;
+    m_resampling = false;
+    m_rateAnchors.clear();
+    for (int i = 0; i < m_carvedSliceCount; i++)
 	    m_sliceList[i].mFlags = kScheduledAudioSliceFlag_Complete;
+    resetSliceState();
+
+    // No slices are in use now, so this is the
+    // time to change their size if needed:
+    if (m_maxExtractionPacketCount != m_sliceController.packetCount())
+        allocateSoundSlices();
+    m_sliceRefillStarted = false;
+    m_minPendingSlices = INT_MAX;
 
     // Start to play again immidiatly:
     AudioTimeStamp timeStamp;
     memset(&timeStamp, 0, sizeof(timeStamp));
 	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
-    timeStamp.mSampleTime = -1;
+    timeStamp.mSampleTime = nextStartSampleTime();
 	err = AudioUnitSetProperty(m_audioUnit,
         kAudioUnitProperty_ScheduleStartTimeStamp, kAudioUnitScope_Global,
         0, &timeStamp, sizeof(timeStamp));
@@ -216,16 +342,33 @@ void QuickTimeAudioPlayer::seek(quint64 milliseconds)
 	timeRec.value.hi = 0;
 	timeRec.value.lo = (milliseconds / 1000.0f) * timeRec.scale;
 
-#ifdef QUICKTIME_C_API_AVAILABLE
-	err = MovieAudioExtractionSetProperty(m_audioExtractionRef,
-        kQTPropertyClass_MovieAudioExtraction_Movie,
-        kQTMovieAudioExtractionMoviePropertyID_CurrentTime,
-        sizeof(TimeRecord), &timeRec);
-    BACKEND_ASSERT2(err == noErr, "Could not set current time on audio player unit", FATAL_ERROR)
-#endif
-
     float durationLeftSec = float(m_videoPlayer->duration() - milliseconds) / 1000.0f;
     m_samplesRemaining = (durationLeftSec > 0) ? (durationLeftSec * m_audioStreamDescription.mSampleRate) : -1;
+
+    // Playing from the start can begin with the head cache, if any. The
+    // extraction is then already positioned right after it. A cached clip
+    // holds all of the audio, so it can be played from anywhere:
+    bool useHeadCache = m_clip || (milliseconds == 0 && m_headFrames > 0);
+    m_headDecoding = false;
+    if (m_clip)
+        m_headReadFrame = qMin(m_headFrames, int(milliseconds * m_audioStreamDescription.mSampleRate / 1000));
+    else if (useHeadCache)
+        m_headReadFrame = 0;
+    else
+        releaseHeadCache();
+
+#ifdef QUICKTIME_C_API_AVAILABLE
+    if (m_decodeThread){
+        // The decode thread owns the extraction:
+        requestDecodeSeek(timeRec, m_samplesRemaining);
+    } else if (!useHeadCache){
+    	err = MovieAudioExtractionSetProperty(m_audioExtractionRef,
+            kQTPropertyClass_MovieAudioExtraction_Movie,
+            kQTMovieAudioExtractionMoviePropertyID_CurrentTime,
+            sizeof(TimeRecord), &timeRec);
+        BACKEND_ASSERT2(err == noErr, "Could not set current time on audio player unit", FATAL_ERROR)
+    }
+#endif
     m_audioExtractionComplete = false;
     m_audioUnitIsReset = false;    
     scheduleAudioToGraph();
@@ -241,15 +384,272 @@ quint64 QuickTimeAudioPlayer::currentTime()
             return m_startTime;
     }
 
+    // Before the unit has started (e.g. when it is set to start
+    // at a sample time ahead), the play time is negative:
     Float64 currentUnitTime = getTimeInSamples(kAudioUnitProperty_CurrentPlayTime);
-    if (currentUnitTime == -1)
+    if (currentUnitTime < 0)
         currentUnitTime = 0;
 
     quint64 cTime = quint64(m_startTime +
-        float(currentUnitTime / float(m_audioStreamDescription.mSampleRate)) * 1000.0f);
+        float(mediaSampleAt(currentUnitTime) / float(m_audioStreamDescription.mSampleRate)) * 1000.0f);
     return (m_videoPlayer && cTime > m_videoPlayer->duration()) ? m_videoPlayer->duration() : cTime;
 }
 
+bool QuickTimeAudioPlayer::playAt(Float64 renderSampleTime)
+{
+    // Start to play at the given sample time on the render timeline. Returns
+    // false if that time is not far enough ahead for the first slices to be
+    // scheduled in time, or if the player could not start:
+    if (!m_videoPlayer || !m_audioEnabled || !m_audioUnit)
+        return false;
+    if (!renderTimelineKnown() || !m_timeline.canStartAt(renderSampleTime))
+        return false;
+
+    if (!m_audioUnitIsReset)
+        flush();
+    m_requestedStartSampleTime = renderSampleTime;
+    play();
+    m_requestedStartSampleTime = -1;
+    return m_timeline.startSampleTime() == renderSampleTime;
+}
+
+Float64 QuickTimeAudioPlayer::startSampleTime() const
+{
+    // Returns -1 if not known (yet):
+    return m_timeline.startSampleTime();
+}
+
+Float64 QuickTimeAudioPlayer::endSampleTime() const
+{
+    // The sample time on the render timeline right after
+    // the last scheduled slice, or -1 if more audio is
+    // still to be scheduled (or the start is not known):
+    if (!m_audioExtractionComplete || m_state != Playing)
+        return -1;
+    return m_timeline.endSampleTime(m_sampleTimeStamp);
+}
+
+Float64 QuickTimeAudioPlayer::sampleRate() const
+{
+    return m_audioStreamDescription.mSampleRate;
+}
+
+OSStatus QuickTimeAudioPlayer::renderNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp *timeStamp, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList *data)
+{
+    // Called on the render thread. Don't lock or allocate:
+    QuickTimeAudioPlayer *player = static_cast<QuickTimeAudioPlayer *>(userData);
+    if (*actionFlags & kAudioUnitRenderAction_PostRender){
+        player->applyGain(data, frameCount);
+        return noErr;
+    }
+    if (!(*actionFlags & kAudioUnitRenderAction_PreRender))
+        return noErr;
+    player->m_renderHostTime = (timeStamp->mFlags & kAudioTimeStampHostTimeValid)
+        ? timeStamp->mHostTime : AudioGetCurrentHostTime();
+    player->m_timeline.renderCycle(timeStamp->mSampleTime, frameCount);
+    return noErr;
+}
+
+void QuickTimeAudioPlayer::applyGain(AudioBufferList *data, UInt32 frameCount)
+{
+    // Called on the render thread after the unit has rendered. Pick
+    // up new ramps, and apply the gain frame by frame, in blocks:
+    GainRampCommand command;
+    while (m_gainCommands.pop(command)){
+        float from = (command.from < 0) ? m_gainRamp.gain() : command.from;
+        m_gainRamp.start(from, command.to, command.frames, command.shape);
+    }
+    if (!data || !(m_floatOutput || m_convertedOutput) || m_gainRamp.isUnity())
+        return;
+
+    float gains[GainBlockFrames];
+    for (UInt32 offset = 0; offset < frameCount; offset += GainBlockFrames){
+        int frames = int(qMin(frameCount - offset, UInt32(GainBlockFrames)));
+        m_gainRamp.fillGains(gains, frames);
+        if (m_convertedOutput){
+            applyConvertedGain(data, offset, frames, gains);
+            continue;
+        }
+        for (UInt32 i = 0; i < data->mNumberBuffers; ++i){
+            AudioBuffer &buffer = data->mBuffers[i];
+            float *samples = static_cast<float *>(buffer.mData);
+            if (!samples)
+                continue;
+            if (buffer.mNumberChannels == 1)
+                GainKernel::applyPlanar(samples + offset, gains, frames);
+            else
+                GainKernel::applyInterleaved(samples + offset * buffer.mNumberChannels, buffer.mNumberChannels, gains, frames);
+        }
+    }
+}
+
+void QuickTimeAudioPlayer::applyConvertedGain(AudioBufferList *data, UInt32 offset, int frames, const float *gains)
+{
+    // Decode a block of integer samples to floats (on the stack), apply
+    // the gain there, and encode the result back in place:
+    const SampleConverter::Format &format = m_gainDecoder.sourceFormat();
+    int buffers = format.interleaved ? 1 : format.channels;
+    if (int(data->mNumberBuffers) < buffers)
+        return;
+
+    float converted[MaxGainChannels * GainBlockFrames];
+    const void *samples[MaxGainChannels];
+    void *floats[MaxGainChannels];
+    int bytes = format.bytesPerSample() * (format.interleaved ? format.channels : 1);
+    for (int i = 0; i < buffers; ++i){
+        if (!data->mBuffers[i].mData)
+            return;
+        samples[i] = static_cast<char *>(data->mBuffers[i].mData) + offset * bytes;
+        floats[i] = converted + i * GainBlockFrames;
+    }
+    m_gainDecoder.convert(samples, floats, frames);
+    if (format.interleaved)
+        GainKernel::applyInterleaved(converted, format.channels, gains, frames);
+    else {
+        for (int i = 0; i < buffers; ++i)
+            GainKernel::applyPlanar(converted + i * GainBlockFrames, gains, frames);
+    }
+    m_gainEncoder.convert(floats, const_cast<void *const *>(samples), frames);
+}
+
+void QuickTimeAudioPlayer::updateGainFormat()
+{
+    // The gain is applied to float output directly. Other linear
+    // PCM formats (up to MaxGainChannels) go through floats:
+    const AudioStreamBasicDescription &description = m_audioStreamDescription;
+    m_floatOutput = (description.mFormatID == kAudioFormatLinearPCM)
+        && (description.mFormatFlags & kAudioFormatFlagIsFloat)
+        && description.mBitsPerChannel == 32;
+
+    SampleConverter::Format format;
+    m_convertedOutput = !m_floatOutput
+        && SampleConverter::formatFromStreamDescription(description, format)
+        && format.channels <= MaxGainChannels;
+    if (m_convertedOutput){
+        SampleConverter::Format floats(SampleConverter::Float32, format.channels, format.interleaved);
+        m_gainDecoder.setFormats(format, floats);
+        m_gainEncoder.setFormats(floats, format);
+        // Pick the conversion kernels here rather than on the render thread:
+        SampleConverter::kernelSet();
+    }
+}
+
+void QuickTimeAudioPlayer::rampGain(float from, float to, qint64 milliseconds, GainCurve::Shape shape)
+{
+    // Let the gain move from 'from' (or from where it is now, if
+    // negative) to 'to', starting with the next render cycle:
+    GainRampCommand command;
+    command.from = from;
+    command.to = to;
+    command.frames = quint32(qMax(qint64(0), milliseconds) * qMax(Float64(0), m_audioStreamDescription.mSampleRate) / 1000);
+    command.shape = shape;
+
+    // The render thread drains the queue every cycle, so it only fills
+    // up while the graph is stopped. A command that does not fit is kept
+    // aside, replacing the one kept before it, and posted on a later tick:
+    if (m_hasPendingGainCommand){
+        if (command.from < 0 && m_pendingGainCommand.frames == 0)
+            command.from = m_pendingGainCommand.to;
+        m_pendingGainCommand = command;
+        postPendingGainCommand();
+    } else if (!m_gainCommands.push(command)){
+        m_pendingGainCommand = command;
+        m_hasPendingGainCommand = true;
+    }
+}
+
+void QuickTimeAudioPlayer::postPendingGainCommand()
+{
+    if (m_hasPendingGainCommand && m_gainCommands.push(m_pendingGainCommand))
+        m_hasPendingGainCommand = false;
+}
+
+void QuickTimeAudioPlayer::setGain(float gain)
+{
+    rampGain(gain, gain, 0);
+}
+
+bool QuickTimeAudioPlayer::appliesGain() const
+{
+    // The gain is applied to linear PCM output only. For other formats,
+    // the mixer further down needs to apply the volume instead:
+    return m_floatOutput || m_convertedOutput;
+}
+
+bool QuickTimeAudioPlayer::renderTimelineKnown() const
+{
+    // The timeline is only trusted while the graph is
+    // rendering, i.e. if the last cycle was recent:
+    if (!m_timeline.hasRendered())
+        return false;
+    UInt64 now = AudioGetCurrentHostTime();
+    if (now < m_renderHostTime)
+        return true;
+    return AudioConvertHostTimeToNanos(now - m_renderHostTime) < 100000000; // 100 ms
+}
+
+Float64 QuickTimeAudioPlayer::nextStartSampleTime()
+{
+    // Start the unit at a known sample time if we can. If the graph has
+    // not started rendering yet, start on the next render cycle:
+    return m_timeline.start(m_requestedStartSampleTime, renderTimelineKnown());
+}
+
+bool QuickTimeAudioPlayer::setRateAdjustment(double rate)
+{
+    // Returns false if the rate cannot be adjusted, and
+    // the caller should resync by seeking instead:
+    if (!canResample())
+        return false;
+    m_rateAdjustment = rate;
+    return true;
+}
+
+double QuickTimeAudioPlayer::rateAdjustment() const
+{
+    return m_rateAdjustment;
+}
+
+bool QuickTimeAudioPlayer::canResample() const
+{
+    // The decode thread hands over blocks in the extraction format, so
+    // only direct extraction of (the default) non-interleaved floats
+    // can go through the resampler:
+    if (m_decodeThread || m_clip)
+        return false;
+    const AudioStreamBasicDescription &format = m_audioStreamDescription;
+    return format.mFormatID == kAudioFormatLinearPCM
+        && (format.mFormatFlags & kAudioFormatFlagIsFloat)
+        && (format.mFormatFlags & kAudioFormatFlagIsNonInterleaved)
+        && format.mBitsPerChannel == 32;
+}
+
+void QuickTimeAudioPlayer::addRateAnchor(double rate)
+{
+    if (!m_rateAnchors.isEmpty() && m_rateAnchors.last().rate == rate)
+        return;
+    AudioRateAnchor anchor;
+    anchor.outputSample = m_sampleTimeStamp;
+    anchor.mediaSample = m_mediaSampleTimeStamp;
+    anchor.rate = rate;
+    m_rateAnchors.append(anchor);
+}
+
+double QuickTimeAudioPlayer::mediaSampleAt(Float64 outputSample)
+{
+    // Find the movie sample played at 'outputSample' (counted
+    // since the last seek), and forget anchors we have passed:
+    if (m_rateAnchors.isEmpty())
+        return outputSample;
+    while (m_rateAnchors.size() > 1 && m_rateAnchors[1].outputSample <= outputSample)
+        m_rateAnchors.remove(0);
+    const AudioRateAnchor &anchor = m_rateAnchors.first();
+    if (outputSample < anchor.outputSample)
+        return outputSample;
+    return anchor.mediaSample + (outputSample - anchor.outputSample) * anchor.rate;
+}
+
 QString QuickTimeAudioPlayer::currentTimeString()
 {
     return QuickTimeVideoPlayer::timeToString(currentTime());
@@ -283,6 +683,9 @@ ComponentDescription QuickTimeAudioPlayer::getAudioNodeDescription() const
 
 void QuickTimeAudioPlayer::initializeAudioUnit()
 {
+    m_timeline.reset();
+    OSStatus err = AudioUnitAddRenderNotify(m_audioUnit, renderNotification, this);
+    BACKEND_ASSERT2(err == noErr, "Could not add render notification to audio player unit", NORMAL_ERROR)
 }
 
 bool QuickTimeAudioPlayer::fillInStreamSpecification(AudioConnection *connection, ConnectionSide side)
@@ -308,13 +711,29 @@ long QuickTimeAudioPlayer::regularTaskFrequency(){
     if (!m_audioEnabled || !m_audioUnit || (m_audioGraph && m_audioGraph->graphCannotPlay()))
         return INT_MAX;
 
+    if (m_audioStreamDescription.mSampleRate <= 0)
+        return INT_MAX;
+
     // Calculate how much audio in
     // milliseconds our slices can hold:
-    int packetNeedPerSecond = m_audioStreamDescription.mSampleRate / m_maxExtractionPacketCount;
-    long bufferTimeLengthSec = float(m_sliceCount) / float(packetNeedPerSecond);
-    // Make sure we also get some time to fill the
-    // buffer, so divide the time by two:
-    return (bufferTimeLengthSec * (1000 / 2));
+    float bufferTimeLengthMs = float(m_sliceCount) * float(m_maxExtractionPacketCount)
+        / float(m_audioStreamDescription.mSampleRate) * 1000.0f;
+    // Slices are normally refilled as soon as they have been played,
+    // so the timer is just a fallback. Without the completion wake-up,
+    // make sure we get some time to fill the buffer by dividing by two:
+    if (!m_refillNotifier)
+        bufferTimeLengthMs /= 2;
+    return qMax(long(10), long(bufferTimeLengthMs));
+}
+
+int QuickTimeAudioPlayer::sliceCount() const
+{
+    return m_sliceCount;
+}
+
+int QuickTimeAudioPlayer::extractionPacketCount() const
+{
+    return m_maxExtractionPacketCount;
 }
 
 void QuickTimeAudioPlayer::initSoundExtraction()
@@ -360,10 +779,74 @@ void QuickTimeAudioPlayer::initSoundExtraction()
         kQTMovieAudioExtractionAudioPropertyID_AudioStreamBasicDescription,
         sizeof(m_audioStreamDescription), &m_audioStreamDescription, 0);
     BACKEND_ASSERT2(err == noErr, "Could not get audio stream description from audio extraction", FATAL_ERROR)
+    updateGainFormat();
     
 #endif // QUICKTIME_C_API_AVAILABLE
 }
 
+void QuickTimeAudioPlayer::useClip()
+{
+    // Play from the cached clip instead of the movie. No
+    // extraction is started, so take the format from the clip:
+    m_audioStreamDescription = m_clip->streamDescription;
+    m_audioChannelLayoutSize = m_clip->channelLayoutSize;
+    m_audioChannelLayout = (AudioChannelLayout *) malloc(m_audioChannelLayoutSize);
+    BACKEND_ASSERT2(m_audioChannelLayout, "Could not allocate memory for channel layout on audio player unit", FATAL_ERROR)
+    memcpy(m_audioChannelLayout, m_clip->channelLayout, m_audioChannelLayoutSize);
+    updateGainFormat();
+
+    m_headBuffer = m_clip->data;
+    m_headCapacity = m_clip->frames;
+    m_headFrames = m_clip->frames;
+    m_headReadFrame = 0;
+    m_headEndOfStream = true;
+}
+
+void QuickTimeAudioPlayer::cacheClip(const QString &key)
+{
+    // Decode all of the (short) source now, through the head cache. If
+    // it turns out longer than expected, what got decoded is just used
+    // as a head cache, and extraction goes on after it:
+    int frames = int(m_videoPlayer->duration() * m_audioStreamDescription.mSampleRate / 1000) + m_maxExtractionPacketCount;
+    startHeadCache(frames);
+    while (decodeHeadStep()) {}
+    if (!m_headEndOfStream || m_headFrames == 0 || !m_audioChannelLayout)
+        return;
+
+    PcmClip *clip = new PcmClip();
+    clip->streamDescription = m_audioStreamDescription;
+    clip->channelLayoutSize = m_audioChannelLayoutSize;
+    clip->channelLayout = (AudioChannelLayout *) malloc(m_audioChannelLayoutSize);
+    clip->frames = m_headFrames;
+    if (clip->channelLayout)
+        memcpy(clip->channelLayout, m_audioChannelLayout, m_audioChannelLayoutSize);
+
+    if (m_headFrames == m_headCapacity){
+        clip->data = m_headBuffer;
+    } else {
+        // Pack the channels, so no memory is wasted in the cache:
+        size_t bytesPerChannel = size_t(m_headFrames) * m_audioStreamDescription.mBytesPerPacket;
+        clip->data = static_cast<char *>(malloc(m_audioStreamDescription.mChannelsPerFrame * bytesPerChannel));
+        if (clip->data){
+            for (uint i = 0; i < m_audioStreamDescription.mChannelsPerFrame; ++i)
+                memcpy(clip->data + i * bytesPerChannel, m_headBuffer + i * size_t(m_headCapacity) * m_audioStreamDescription.mBytesPerPacket, bytesPerChannel);
+        }
+        free(m_headBuffer);
+    }
+    m_headBuffer = 0;
+    m_clip = QSharedPointer<PcmClip>(clip);
+    if (!clip->data || !clip->channelLayout){
+        // Out of memory. Play from the movie instead:
+        releaseHeadCache();
+        return;
+    }
+
+    m_headBuffer = clip->data;
+    m_headCapacity = clip->frames;
+    m_headFrames = clip->frames;
+    PcmClipCache::instance()->insert(key, m_clip);
+}
+
 void QuickTimeAudioPlayer::allocateSoundSlices()
 {
 #ifdef QUICKTIME_C_API_AVAILABLE
@@ -373,97 +856,667 @@ void QuickTimeAudioPlayer::allocateSoundSlices()
     // Each ScheduledAudioSlice will contain several audio buffers, one for each sound channel.
     // Each buffer will carry (at most) a specified number of sound packets, and each packet can
     // contain one or more frames.
-
-    // Create a list of ScheduledAudioSlices:
-	m_sliceList = (ScheduledAudioSlice *) calloc(m_sliceCount, sizeof(ScheduledAudioSlice));
-    BACKEND_ASSERT2(m_sliceList, "Could not allocate memory for audio slices", FATAL_ERROR)
-	bzero(m_sliceList, m_sliceCount * sizeof(ScheduledAudioSlice));
-
-    // Calculate the size of the different structures needed:
-	int packetsBufferSize = m_maxExtractionPacketCount * m_audioStreamDescription.mBytesPerPacket;
+    //
+    // Everything is carved out of one arena, laid out as: the slice list, one AudioBufferList
+    // per slice (plus one used for batched extraction), and then one region per channel holding
+    // the buffers of all slices back to back. The arena is kept when the source changes, and only
+    // reallocated if the new source needs more room. The slice list has room for the maximum number
+    // of slices, since the audio unit keeps pointers to scheduled slices, so it cannot move later.
+    m_sliceCount = m_sliceController.sliceCount();
+    m_maxExtractionPacketCount = m_sliceController.packetCount();
+    int maxSliceCount = m_sliceController.maxSliceCount();
+
+    // Calculate the size of the different structures needed, rounded off to Altivec sizes:
     int channels = m_audioStreamDescription.mChannelsPerFrame;
-	int audioBufferListSize = int(sizeof(AudioBufferList) + (channels-1) * sizeof(AudioBuffer));
-	int mallocSize = audioBufferListSize + (packetsBufferSize * m_audioStreamDescription.mChannelsPerFrame);
-
-    // Round off to Altivec sizes:
-    packetsBufferSize = int(((packetsBufferSize + 15) / 16) * 16);
+    int rawPacketsBufferSize = m_maxExtractionPacketCount * m_audioStreamDescription.mBytesPerPacket;
+    int packetsBufferSize = int(((rawPacketsBufferSize + 15) / 16) * 16);
+    int sliceListSize = int(((maxSliceCount * sizeof(ScheduledAudioSlice) + 15) / 16) * 16);
+    int audioBufferListSize = int(sizeof(AudioBufferList) + (channels-1) * sizeof(AudioBuffer));
     audioBufferListSize = int(((audioBufferListSize + 15) / 16) * 16);
+    size_t arenaSize = sliceListSize + size_t(maxSliceCount + 1) * audioBufferListSize
+        + size_t(channels) * maxSliceCount * packetsBufferSize;
+
+    if (arenaSize > m_sliceArenaSize){
+        freeSoundArena();
+        void *sliceArena = 0;
+        int err = posix_memalign(&sliceArena, 16, arenaSize);
+        BACKEND_ASSERT2(err == 0, "Could not allocate memory for audio slices", FATAL_ERROR)
+        m_sliceArena = sliceArena;
+        m_sliceArenaSize = arenaSize;
+    }
+    bzero(m_sliceArena, sliceListSize + size_t(maxSliceCount + 1) * audioBufferListSize);
 
- 	for (int sliceIndex = 0; sliceIndex < m_sliceCount; ++sliceIndex){
-        // Create the memory chunk for this audio slice:
-		AudioBufferList	*audioBufferList = (AudioBufferList*) calloc(1, mallocSize);
-        BACKEND_ASSERT2(audioBufferList, "Could not allocate memory for audio buffer list", FATAL_ERROR)
+    char *arena = static_cast<char *>(m_sliceArena);
+    m_sliceList = reinterpret_cast<ScheduledAudioSlice *>(arena);
+    char *bufferLists = arena + sliceListSize;
+    char *channelData = bufferLists + size_t(maxSliceCount + 1) * audioBufferListSize;
+    size_t channelRegionSize = size_t(maxSliceCount) * packetsBufferSize;
 
+ 	for (int sliceIndex = 0; sliceIndex < maxSliceCount; ++sliceIndex){
         // The AudioBufferList contains an AudioBuffer for each channel in the audio stream:
-		audioBufferList->mNumberBuffers = m_audioStreamDescription.mChannelsPerFrame;
-		for (uint i = 0; i < audioBufferList->mNumberBuffers; ++i){
+		AudioBufferList *audioBufferList = reinterpret_cast<AudioBufferList *>(bufferLists + sliceIndex * audioBufferListSize);
+		audioBufferList->mNumberBuffers = channels;
+		for (int i = 0; i < channels; ++i){
 			audioBufferList->mBuffers[i].mNumberChannels = 1;
-			audioBufferList->mBuffers[i].mData = (char *) audioBufferList + audioBufferListSize + (i * packetsBufferSize);
+			audioBufferList->mBuffers[i].mData = channelData + i * channelRegionSize + sliceIndex * packetsBufferSize;
 			audioBufferList->mBuffers[i].mDataByteSize = packetsBufferSize;
 		}
 
 		m_sliceList[sliceIndex].mBufferList = audioBufferList;
 		m_sliceList[sliceIndex].mNumberFrames = m_maxExtractionPacketCount;
 		m_sliceList[sliceIndex].mTimeStamp.mFlags = kAudioTimeStampSampleTimeValid;
-		m_sliceList[sliceIndex].mCompletionProcUserData = 0;
-		m_sliceList[sliceIndex].mCompletionProc = 0;
+		m_sliceList[sliceIndex].mCompletionProcUserData = this;
+		m_sliceList[sliceIndex].mCompletionProc = sliceCompleted;
 		m_sliceList[sliceIndex].mFlags = kScheduledAudioSliceFlag_Complete;
 		m_sliceList[sliceIndex].mReserved = 0;
 	}
+
+    // Adjacent slices can only be filled with one extraction call
+    // if there are no gaps between their buffers:
+    m_batchBufferList = reinterpret_cast<AudioBufferList *>(bufferLists + maxSliceCount * audioBufferListSize);
+    m_batchBufferList->mNumberBuffers = channels;
+    m_contiguousSlices = (packetsBufferSize == rawPacketsBufferSize);
+    m_carvedSliceCount = maxSliceCount;
+    m_sliceScheduled.fill(0, maxSliceCount);
+    m_sliceGenerations.fill(0, maxSliceCount);
+    resetSliceState();
 	
 #endif // QUICKTIME_C_API_AVAILABLE
 }
 
-void QuickTimeAudioPlayer::scheduleSoundSlices()
+void QuickTimeAudioPlayer::releaseSoundSlices()
+{
+    // Keep the arena for the next source:
+    m_sliceList = 0;
+    m_batchBufferList = 0;
+    m_carvedSliceCount = 0;
+}
+
+void QuickTimeAudioPlayer::freeSoundArena()
+{
+    releaseSoundSlices();
+    free(m_sliceArena);
+    m_sliceArena = 0;
+    m_sliceArenaSize = 0;
+}
+
+void QuickTimeAudioPlayer::adaptSoundSlices(int pendingSlices)
+{
+    if (!m_sliceController.addRefill(pendingSlices))
+        return;
+
+    if (m_scheduledSliceCount == 0 && m_maxExtractionPacketCount != m_sliceController.packetCount()){
+        // Every slice scheduled has been reported back, so none are
+        // in use by the audio unit. That means that all of them can
+        // be resized:
+        allocateSoundSlices();
+    } else {
+        // Slices beyond the new count might still be playing, so just
+        // stop scheduling them. A new slice size has to wait until the
+        // audio unit lets go of all slices (e.g. on the next seek):
+        m_sliceCount = m_sliceController.sliceCount();
+        updateFreeSlices();
+    }
+
+    if (qgetenv("PHONON_DEBUG") == "1")
+        qDebug() << "QuickTimeAudioPlayer" << int(this) << "uses" << m_sliceCount << "audio slices of"
+            << m_maxExtractionPacketCount << "packets (" << m_sliceController.underrunCount() << "underruns )";
+}
+
+void QuickTimeAudioPlayer::scheduleSoundSlices(bool adaptSlices)
 {
 #ifdef QUICKTIME_C_API_AVAILABLE
 
+    if (!m_sliceList)
+        return;
     PhononAutoReleasePool pool;
-	// For each completed (or never used) slice, fill and schedule it.
-	for (int sliceIndex = 0; sliceIndex < m_sliceCount; ++sliceIndex){
-		if (m_sliceList[sliceIndex].mFlags & kScheduledAudioSliceFlag_Complete){
-			if (m_samplesRemaining == 0)
-				m_audioExtractionComplete = true;
-
-			if (!m_audioExtractionComplete){
-			    // Determine how many samples to read:
-				int samplesCount = m_samplesRemaining;
-				if ((samplesCount > m_maxExtractionPacketCount) || (samplesCount == -1))
-					samplesCount = m_maxExtractionPacketCount;
-				m_sliceList[sliceIndex].mTimeStamp.mSampleTime = m_sampleTimeStamp;
-
-	            // Reset buffer sizes:
-	            int byteSize = samplesCount * m_audioStreamDescription.mBytesPerPacket;
-	            for (uint i = 0; i < m_sliceList[sliceIndex].mBufferList->mNumberBuffers; ++i)
-                    m_sliceList[sliceIndex].mBufferList->mBuffers[i].mDataByteSize = byteSize;
-
-	            // Do the extraction:
-                UInt32 flags = 0;
-                UInt32 samplesRead = samplesCount;
-	            OSStatus err = MovieAudioExtractionFillBuffer(
-	                m_audioExtractionRef, &samplesRead, m_sliceList[sliceIndex].mBufferList, &flags);
-                BACKEND_ASSERT2(err == noErr, "Could not fill audio buffers from audio extraction", FATAL_ERROR)
-	            m_audioExtractionComplete = (flags & kQTMovieAudioExtractionComplete);
-
-	            // Play the slice:
-	            if (samplesRead != 0 && m_audioUnit != 0){
-                    m_sliceList[sliceIndex].mNumberFrames = samplesRead;
-                    err = AudioUnitSetProperty(m_audioUnit,
-                        kAudioUnitProperty_ScheduleAudioSlice, kAudioUnitScope_Global,
-                        0, &m_sliceList[sliceIndex], sizeof(ScheduledAudioSlice));
-                    BACKEND_ASSERT2(err == noErr, "Could not schedule audio buffers on audio unit", FATAL_ERROR)
- 	            } else
-					m_sliceList[sliceIndex].mFlags = kScheduledAudioSliceFlag_Complete;
-
-                // Move the window:
-				m_sampleTimeStamp += samplesRead;
-				if (m_samplesRemaining != -1)
-					m_samplesRemaining -= samplesRead;
-			}
+
+    // Take back the slices played since last time, and note how many are
+    // still queued. (Right after a seek, none are expected to be). Each
+    // wake-up refills, but the buffer size only adapts on the timer, to
+    // the fewest slices left queued before any refill since last time.
+    // Otherwise the count would depend on how often we are woken up:
+    collectCompletedSlices();
+    if (m_sliceRefillStarted && !m_audioExtractionComplete){
+        m_minPendingSlices = qMin(m_minPendingSlices, m_scheduledSliceCount);
+        if (adaptSlices){
+            adaptSoundSlices(m_minPendingSlices);
+            m_minPendingSlices = INT_MAX;
+        }
+    }
+    if (m_freeSlices.isEmpty())
+        return;
+
+	// For each run of adjacent free slices, fill them all with
+	// one extraction call, and schedule them one by one:
+	qSort(m_freeSlices);
+	int freeIndex = 0;
+	while (freeIndex < m_freeSlices.size() && !m_audioExtractionComplete){
+		int sliceIndex = m_freeSlices[freeIndex];
+		int runLength = 1;
+		if (m_contiguousSlices){
+    		while (freeIndex + runLength < m_freeSlices.size()
+    		    && m_freeSlices[freeIndex + runLength] == sliceIndex + runLength)
+    		    ++runLength;
+		}
+		for (int i = sliceIndex; i < sliceIndex + runLength; ++i)
+		    m_sliceGenerations[i] = m_sliceGeneration;
+		if (!m_resampling && m_rateAdjustment != 1.0 && m_headFrames == 0 && canResample()){
+		    m_resampling = true;
+		    m_resampler.reset(m_audioStreamDescription.mChannelsPerFrame);
 		}
+		int scheduled = 0;
+		if (m_decodeThread)
+		    scheduled = fillSoundSlicesFromDecoder(sliceIndex, runLength);
+		else if (m_resampling)
+		    scheduled = fillSoundSlicesResampled(sliceIndex, runLength);
+		else
+		    scheduled = fillSoundSlices(sliceIndex, runLength);
+		for (int i = sliceIndex; i < sliceIndex + scheduled; ++i)
+		    m_sliceScheduled[i] = 1;
+		m_scheduledSliceCount += scheduled;
+		if (scheduled < runLength)
+		    break; // Nothing more to schedule right now
+		freeIndex += runLength;
 	}
+	updateFreeSlices();
+    if (m_scheduledSliceCount > 0)
+        m_sliceRefillStarted = true;
+
+#endif // QUICKTIME_C_API_AVAILABLE
+}
+
+int QuickTimeAudioPlayer::fillSoundSlices(int firstSlice, int sliceCount)
+{
+    // Returns the number of slices scheduled:
+    int scheduled = 0;
+#ifdef QUICKTIME_C_API_AVAILABLE
+
+    if (m_samplesRemaining == 0){
+        m_audioExtractionComplete = true;
+        return 0;
+    }
+
+    if (m_headFrames > 0){
+        // Use up the head cache first, and extract the rest:
+        scheduled = fillSoundSlicesFromHead(firstSlice, sliceCount);
+        if (scheduled == sliceCount || m_headFrames > 0 || m_audioExtractionComplete)
+            return scheduled;
+        return scheduled + fillSoundSlices(firstSlice + scheduled, sliceCount - scheduled);
+    }
+
+    // Determine how many samples to read:
+    int samplesCount = m_maxExtractionPacketCount * sliceCount;
+    if (m_samplesRemaining != -1 && m_samplesRemaining < samplesCount)
+        samplesCount = m_samplesRemaining;
+
+    // Point the batch buffer list at the buffers of the first slice. The buffers
+    // of the following slices come right after it, so they get filled too:
+    AudioBufferList *first = m_sliceList[firstSlice].mBufferList;
+    int byteSize = samplesCount * m_audioStreamDescription.mBytesPerPacket;
+    for (uint i = 0; i < m_batchBufferList->mNumberBuffers; ++i){
+        m_batchBufferList->mBuffers[i].mNumberChannels = 1;
+        m_batchBufferList->mBuffers[i].mData = first->mBuffers[i].mData;
+        m_batchBufferList->mBuffers[i].mDataByteSize = byteSize;
+    }
+
+    // Do the extraction:
+    UInt32 flags = 0;
+    UInt32 samplesRead = samplesCount;
+    OSStatus err = MovieAudioExtractionFillBuffer(m_audioExtractionRef, &samplesRead, m_batchBufferList, &flags);
+    BACKEND_ASSERT3(err == noErr, "Could not fill audio buffers from audio extraction", FATAL_ERROR, 0)
+    m_audioExtractionComplete = (flags & kQTMovieAudioExtractionComplete);
+    if (m_samplesRemaining != -1)
+        m_samplesRemaining -= samplesRead;
+    m_mediaSampleTimeStamp += samplesRead;
+
+    // Play the slices:
+    for (int sliceIndex = firstSlice; sliceIndex < firstSlice + sliceCount && samplesRead > 0; ++sliceIndex){
+        ScheduledAudioSlice &slice = m_sliceList[sliceIndex];
+        UInt32 frames = qMin(samplesRead, UInt32(m_maxExtractionPacketCount));
+        for (uint i = 0; i < slice.mBufferList->mNumberBuffers; ++i)
+            slice.mBufferList->mBuffers[i].mDataByteSize = frames * m_audioStreamDescription.mBytesPerPacket;
+        slice.mNumberFrames = frames;
+        slice.mTimeStamp.mSampleTime = m_sampleTimeStamp;
+
+        if (m_audioUnit != 0){
+            err = AudioUnitSetProperty(m_audioUnit,
+                kAudioUnitProperty_ScheduleAudioSlice, kAudioUnitScope_Global,
+                0, &slice, sizeof(ScheduledAudioSlice));
+            BACKEND_ASSERT3(err == noErr, "Could not schedule audio buffers on audio unit", FATAL_ERROR, scheduled)
+        }
+
+        // Move the window:
+        m_sampleTimeStamp += frames;
+        samplesRead -= frames;
+        ++scheduled;
+    }
+
+#endif // QUICKTIME_C_API_AVAILABLE
+    return scheduled;
+}
+
+int QuickTimeAudioPlayer::fillSoundSlicesFromHead(int firstSlice, int sliceCount)
+{
+    // Returns the number of slices scheduled:
+    int scheduled = 0;
+#ifdef QUICKTIME_C_API_AVAILABLE
+
+    UInt32 bytesPerPacket = m_audioStreamDescription.mBytesPerPacket;
+    for (int sliceIndex = firstSlice; sliceIndex < firstSlice + sliceCount && m_headReadFrame < m_headFrames; ++sliceIndex){
+        UInt32 frames = qMin(UInt32(m_headFrames - m_headReadFrame), UInt32(m_maxExtractionPacketCount));
+        if (m_samplesRemaining != -1)
+            frames = qMin(frames, UInt32(m_samplesRemaining));
+        if (frames == 0)
+            break;
+
+        ScheduledAudioSlice &slice = m_sliceList[sliceIndex];
+        for (uint i = 0; i < slice.mBufferList->mNumberBuffers; ++i){
+            const char *head = m_headBuffer + (size_t(i) * m_headCapacity + m_headReadFrame) * bytesPerPacket;
+            memcpy(slice.mBufferList->mBuffers[i].mData, head, frames * bytesPerPacket);
+            slice.mBufferList->mBuffers[i].mDataByteSize = frames * bytesPerPacket;
+        }
+        slice.mNumberFrames = frames;
+        slice.mTimeStamp.mSampleTime = m_sampleTimeStamp;
+
+        if (m_audioUnit != 0){
+            OSStatus err = AudioUnitSetProperty(m_audioUnit,
+                kAudioUnitProperty_ScheduleAudioSlice, kAudioUnitScope_Global,
+                0, &slice, sizeof(ScheduledAudioSlice));
+            BACKEND_ASSERT3(err == noErr, "Could not schedule audio buffers on audio unit", FATAL_ERROR, scheduled)
+        }
+
+        // Move the window:
+        m_headReadFrame += frames;
+        if (m_samplesRemaining != -1)
+            m_samplesRemaining -= frames;
+        m_mediaSampleTimeStamp += frames;
+        m_sampleTimeStamp += frames;
+        ++scheduled;
+    }
+
+    if (m_headReadFrame >= m_headFrames || m_samplesRemaining == 0){
+        if (m_headEndOfStream || m_samplesRemaining == 0)
+            m_audioExtractionComplete = true;
+        // Keep a clip for the next time we play:
+        if (!m_clip)
+            releaseHeadCache();
+    }
 
 #endif // QUICKTIME_C_API_AVAILABLE
+    return scheduled;
+}
+
+void QuickTimeAudioPlayer::startHeadCache(int maxFrames)
+{
+    // Only for a source that is loaded but not played. The decode
+    // thread (if used) already extracts ahead, so no need then. And
+    // a cached clip is already all there:
+    if (m_clip)
+        return;
+    releaseHeadCache();
+#ifdef QUICKTIME_C_API_AVAILABLE
+    if (!m_videoPlayer || !m_audioExtractionRef || !m_batchBufferList || m_decodeThread || m_state == Playing)
+        return;
+    if (maxFrames <= 0 || m_audioStreamDescription.mBytesPerPacket == 0)
+        return;
+
+    size_t size = size_t(m_audioStreamDescription.mChannelsPerFrame) * maxFrames * m_audioStreamDescription.mBytesPerPacket;
+    m_headBuffer = static_cast<char *>(malloc(size));
+    BACKEND_ASSERT2(m_headBuffer, "Could not allocate memory for audio head cache", NORMAL_ERROR)
+    m_headCapacity = maxFrames;
+    m_headDecoding = true;
+
+    // Make sure the extraction starts from the beginning:
+    TimeRecord timeRec;
+	timeRec.scale = m_videoPlayer->timeScale();
+    timeRec.base = 0;
+	timeRec.value.hi = 0;
+	timeRec.value.lo = 0;
+	OSStatus err = MovieAudioExtractionSetProperty(m_audioExtractionRef,
+        kQTPropertyClass_MovieAudioExtraction_Movie,
+        kQTMovieAudioExtractionMoviePropertyID_CurrentTime,
+        sizeof(TimeRecord), &timeRec);
+    if (err != noErr)
+        releaseHeadCache();
+#else
+    Q_UNUSED(maxFrames);
+#endif
+}
+
+bool QuickTimeAudioPlayer::decodeHeadStep()
+{
+    // Extract the next piece of the head cache. Returns
+    // false when there is nothing more to do:
+    if (!m_headDecoding)
+        return false;
+#ifdef QUICKTIME_C_API_AVAILABLE
+    PhononAutoReleasePool pool;
+    UInt32 bytesPerPacket = m_audioStreamDescription.mBytesPerPacket;
+    UInt32 frames = qMin(m_headCapacity - m_headFrames, 4 * m_maxExtractionPacketCount);
+    for (uint i = 0; i < m_batchBufferList->mNumberBuffers; ++i){
+        m_batchBufferList->mBuffers[i].mNumberChannels = 1;
+        m_batchBufferList->mBuffers[i].mData = m_headBuffer + (size_t(i) * m_headCapacity + m_headFrames) * bytesPerPacket;
+        m_batchBufferList->mBuffers[i].mDataByteSize = frames * bytesPerPacket;
+    }
+
+    UInt32 flags = 0;
+    UInt32 samplesRead = frames;
+    OSStatus err = MovieAudioExtractionFillBuffer(m_audioExtractionRef, &samplesRead, m_batchBufferList, &flags);
+    if (err != noErr){
+        // Just play without it:
+        releaseHeadCache();
+        return false;
+    }
+    m_headFrames += samplesRead;
+    m_headEndOfStream = (flags & kQTMovieAudioExtractionComplete);
+    if (m_headEndOfStream || samplesRead == 0 || m_headFrames == m_headCapacity)
+        m_headDecoding = false;
+#endif
+    return m_headDecoding;
+}
+
+int QuickTimeAudioPlayer::headCacheBytes() const
+{
+    return (m_headBuffer && !m_clip) ? int(m_headCapacity * m_audioStreamDescription.mChannelsPerFrame * m_audioStreamDescription.mBytesPerPacket) : 0;
+}
+
+void QuickTimeAudioPlayer::releaseHeadCache()
+{
+    // The memory of a clip belongs to the clip:
+    if (m_clip)
+        m_clip.clear();
+    else
+        free(m_headBuffer);
+    m_headBuffer = 0;
+    m_headCapacity = 0;
+    m_headFrames = 0;
+    m_headReadFrame = 0;
+    m_headDecoding = false;
+    m_headEndOfStream = false;
+}
+
+int QuickTimeAudioPlayer::fillSoundSlicesResampled(int firstSlice, int sliceCount)
+{
+    // Like fillSoundSlices, but the extracted audio goes through
+    // the resampler, so each slice needs a slightly different
+    // amount of movie audio. Returns the number of slices scheduled:
+    int scheduled = 0;
+#ifdef QUICKTIME_C_API_AVAILABLE
+
+    m_resampler.setRate(m_rateAdjustment);
+    UInt32 bytesPerPacket = m_audioStreamDescription.mBytesPerPacket;
+    for (int sliceIndex = firstSlice; sliceIndex < firstSlice + sliceCount; ++sliceIndex){
+        // Extract what the resampler needs to fill one slice:
+        int needed = m_resampler.framesNeeded(m_maxExtractionPacketCount);
+        if (m_samplesRemaining != -1 && m_samplesRemaining < needed)
+            needed = m_samplesRemaining;
+        if (needed > 0 && !m_audioExtractionComplete){
+            for (uint i = 0; i < m_batchBufferList->mNumberBuffers; ++i){
+                m_batchBufferList->mBuffers[i].mNumberChannels = 1;
+                m_batchBufferList->mBuffers[i].mData = m_resampler.inputBuffer(i, needed);
+                m_batchBufferList->mBuffers[i].mDataByteSize = needed * bytesPerPacket;
+            }
+            UInt32 flags = 0;
+            UInt32 samplesRead = needed;
+            OSStatus err = MovieAudioExtractionFillBuffer(m_audioExtractionRef, &samplesRead, m_batchBufferList, &flags);
+            BACKEND_ASSERT3(err == noErr, "Could not fill audio buffers from audio extraction", FATAL_ERROR, scheduled)
+            m_resampler.commitInput(samplesRead);
+            if (m_samplesRemaining != -1)
+                m_samplesRemaining -= samplesRead;
+            if ((flags & kQTMovieAudioExtractionComplete) || m_samplesRemaining == 0)
+                m_audioExtractionComplete = true;
+        }
+
+        ScheduledAudioSlice &slice = m_sliceList[sliceIndex];
+        QVarLengthArray<float *, 8> output(slice.mBufferList->mNumberBuffers);
+        for (uint i = 0; i < slice.mBufferList->mNumberBuffers; ++i)
+            output[i] = static_cast<float *>(slice.mBufferList->mBuffers[i].mData);
+        double consumedBefore = m_resampler.consumedFrames();
+        UInt32 frames = m_resampler.read(output.data(), m_maxExtractionPacketCount);
+        if (frames == 0){
+            // The last input frame cannot be interpolated
+            // against anything, so it is dropped at the end:
+            if (m_audioExtractionComplete)
+                m_resampler.reset(m_audioStreamDescription.mChannelsPerFrame);
+            break;
+        }
+
+        for (uint i = 0; i < slice.mBufferList->mNumberBuffers; ++i)
+            slice.mBufferList->mBuffers[i].mDataByteSize = frames * bytesPerPacket;
+        slice.mNumberFrames = frames;
+        slice.mTimeStamp.mSampleTime = m_sampleTimeStamp;
+
+        if (m_audioUnit != 0){
+            OSStatus err = AudioUnitSetProperty(m_audioUnit,
+                kAudioUnitProperty_ScheduleAudioSlice, kAudioUnitScope_Global,
+                0, &slice, sizeof(ScheduledAudioSlice));
+            BACKEND_ASSERT3(err == noErr, "Could not schedule audio buffers on audio unit", FATAL_ERROR, scheduled)
+        }
+
+        // Move the window:
+        addRateAnchor(m_rateAdjustment);
+        m_mediaSampleTimeStamp += m_resampler.consumedFrames() - consumedBefore;
+        m_sampleTimeStamp += frames;
+        ++scheduled;
+    }
+
+#endif // QUICKTIME_C_API_AVAILABLE
+    return scheduled;
+}
+
+int QuickTimeAudioPlayer::fillSoundSlicesFromDecoder(int firstSlice, int sliceCount)
+{
+    // Fill the slices with audio from the decode thread, and
+    // return the number of slices scheduled. Blocks extracted
+    // before the last seek are dropped on the way:
+    int scheduled = 0;
+    UInt32 bytesPerPacket = m_audioStreamDescription.mBytesPerPacket;
+    for (int sliceIndex = firstSlice; sliceIndex < firstSlice + sliceCount; ++sliceIndex){
+        ScheduledAudioSlice &slice = m_sliceList[sliceIndex];
+        UInt32 frames = 0;
+        while (frames < UInt32(m_maxExtractionPacketCount) && !m_audioExtractionComplete){
+            int index = m_decodeQueue.currentBlock();
+            if (index == -1)
+                break;
+
+            AudioBufferList *blockBufferList = m_decodeBufferLists[index];
+            UInt32 offset = UInt32(m_decodeQueue.currentOffset());
+            UInt32 count = qMin(UInt32(m_decodeQueue.framesLeft()), UInt32(m_maxExtractionPacketCount) - frames);
+            for (uint i = 0; i < slice.mBufferList->mNumberBuffers; ++i){
+                memcpy(static_cast<char *>(slice.mBufferList->mBuffers[i].mData) + frames * bytesPerPacket,
+                    static_cast<char *>(blockBufferList->mBuffers[i].mData) + offset * bytesPerPacket,
+                    count * bytesPerPacket);
+            }
+            frames += count;
+            if (m_decodeQueue.advance(int(count)))
+                m_audioExtractionComplete = true;
+        }
+
+        if (frames == 0)
+            break;
+        for (uint i = 0; i < slice.mBufferList->mNumberBuffers; ++i)
+            slice.mBufferList->mBuffers[i].mDataByteSize = frames * bytesPerPacket;
+        slice.mNumberFrames = frames;
+        slice.mTimeStamp.mSampleTime = m_sampleTimeStamp;
+        if (m_audioUnit != 0){
+            OSStatus err = AudioUnitSetProperty(m_audioUnit,
+                kAudioUnitProperty_ScheduleAudioSlice, kAudioUnitScope_Global,
+                0, &slice, sizeof(ScheduledAudioSlice));
+            BACKEND_ASSERT3(err == noErr, "Could not schedule audio buffers on audio unit", FATAL_ERROR, scheduled)
+        }
+        m_sampleTimeStamp += frames;
+        ++scheduled;
+    }
+    return scheduled;
+}
+
+void QuickTimeAudioPlayer::startDecodeThread()
+{
+#ifdef QUICKTIME_C_API_AVAILABLE
+    // Carve the blocks out of one chunk of memory: first the
+    // buffer lists, then the buffers (one per channel) of each block:
+    int channels = m_audioStreamDescription.mChannelsPerFrame;
+    int blockBufferSize = int(((DecodeBlockFrames * m_audioStreamDescription.mBytesPerPacket + 15) / 16) * 16);
+    int audioBufferListSize = int(sizeof(AudioBufferList) + (channels-1) * sizeof(AudioBuffer));
+    audioBufferListSize = int(((audioBufferListSize + 15) / 16) * 16);
+    size_t size = size_t(DecodeBlockCount) * (audioBufferListSize + channels * blockBufferSize);
+    void *memory = 0;
+    int err = posix_memalign(&memory, 16, size);
+    BACKEND_ASSERT2(err == 0, "Could not allocate memory for audio decoding", NORMAL_ERROR)
+    m_decodeBlockMemory = memory;
+
+    char *bufferLists = static_cast<char *>(m_decodeBlockMemory);
+    char *buffers = bufferLists + DecodeBlockCount * audioBufferListSize;
+    for (int index = 0; index < DecodeBlockCount; ++index){
+        AudioBufferList *bufferList = reinterpret_cast<AudioBufferList *>(bufferLists + index * audioBufferListSize);
+        bufferList->mNumberBuffers = channels;
+        for (int i = 0; i < channels; ++i){
+            bufferList->mBuffers[i].mNumberChannels = 1;
+            bufferList->mBuffers[i].mData = buffers + (index * channels + i) * blockBufferSize;
+            bufferList->mBuffers[i].mDataByteSize = blockBufferSize;
+        }
+        m_decodeBufferLists[index] = bufferList;
+    }
+
+    m_decodeQueue.reset();
+    m_decodeThread = new AudioDecodeThread(this);
+    m_decodeThread->start();
+#endif // QUICKTIME_C_API_AVAILABLE
+}
+
+void QuickTimeAudioPlayer::stopDecodeThread()
+{
+    if (!m_decodeThread)
+        return;
+
+    m_decodeQueue.stop();
+    m_decodeThread->wait();
+    delete m_decodeThread;
+    m_decodeThread = 0;
+
+    m_decodeQueue.reset();
+    free(m_decodeBlockMemory);
+    m_decodeBlockMemory = 0;
+}
+
+void QuickTimeAudioPlayer::decodeLoop()
+{
+#ifdef QUICKTIME_C_API_AVAILABLE
+    EnterMoviesOnThread(0);
+    long samplesRemaining = -1;
+    bool complete = false;
+
+    while (!m_decodeQueue.isStopped()){
+        AudioDecodeSeek seek;
+        if (m_decodeQueue.takeSeek(&seek)){
+            samplesRemaining = seek.samplesRemaining;
+            OSStatus err = MovieAudioExtractionSetProperty(m_audioExtractionRef,
+                kQTPropertyClass_MovieAudioExtraction_Movie,
+                kQTMovieAudioExtractionMoviePropertyID_CurrentTime,
+                sizeof(TimeRecord), &seek.time);
+            complete = (err != noErr);
+        }
+
+        int index = complete ? -1 : m_decodeQueue.acquireBlock();
+        if (index == -1){
+            // Wait for the consumer to release a block, or to seek:
+            m_decodeQueue.waitForConsumer(20);
+            continue;
+        }
+
+        AudioBufferList *bufferList = m_decodeBufferLists[index];
+        UInt32 frames = DecodeBlockFrames;
+        if (samplesRemaining != -1 && samplesRemaining < long(frames))
+            frames = UInt32(samplesRemaining);
+        for (uint i = 0; i < bufferList->mNumberBuffers; ++i)
+            bufferList->mBuffers[i].mDataByteSize = frames * m_audioStreamDescription.mBytesPerPacket;
+
+        UInt32 flags = 0;
+        OSStatus err = noErr;
+        if (frames > 0)
+            err = MovieAudioExtractionFillBuffer(m_audioExtractionRef, &frames, bufferList, &flags);
+        if (err != noErr)
+            frames = 0;
+        if (samplesRemaining != -1)
+            samplesRemaining -= frames;
+        complete = (err != noErr) || (flags & kQTMovieAudioExtractionComplete) || samplesRemaining == 0 || frames == 0;
+        m_decodeQueue.publishBlock(index, int(frames), complete);
+    }
+    ExitMoviesOnThread();
+#endif // QUICKTIME_C_API_AVAILABLE
+}
+
+void QuickTimeAudioPlayer::requestDecodeSeek(const TimeRecord &time, long samplesRemaining)
+{
+    AudioDecodeSeek seek;
+    seek.time = time;
+    seek.samplesRemaining = samplesRemaining;
+    m_decodeQueue.seek(seek);
+}
+
+void QuickTimeAudioPlayer::sliceCompleted(void *userData, ScheduledAudioSlice *slice)
+{
+    // Called on the render thread, so no locking or allocation. Just queue
+    // the slice, and wake up the GUI thread if it is not awake already:
+    QuickTimeAudioPlayer *that = static_cast<QuickTimeAudioPlayer *>(userData);
+    if (!that->m_sliceList)
+        return;
+    AudioSliceCompletion completion;
+    completion.index = int(slice - that->m_sliceList);
+    completion.generation = that->m_sliceGenerations.constData()[completion.index];
+    that->m_completedSlices.push(completion);
+    if (that->m_refillPipe[1] != -1 && that->m_refillRequested.testAndSetOrdered(0, 1)){
+        char wake = 1;
+        write(that->m_refillPipe[1], &wake, 1);
+    }
+}
+
+void QuickTimeAudioPlayer::refillRequested()
+{
+    char buffer[16];
+    while (read(m_refillPipe[0], buffer, sizeof(buffer)) > 0) {}
+    scheduleAudioToGraph(false);
+}
+
+void QuickTimeAudioPlayer::collectCompletedSlices()
+{
+    // Clear the wake-up flag first, so that slices
+    // completing while we collect will wake us again:
+    m_refillRequested.fetchAndStoreOrdered(0);
+    AudioSliceCompletion completion;
+    while (m_completedSlices.pop(completion)){
+        int index = completion.index;
+        if (completion.generation != m_sliceGeneration
+            || index < 0 || index >= m_carvedSliceCount || !m_sliceScheduled[index])
+            continue;
+        m_sliceScheduled[index] = 0;
+        --m_scheduledSliceCount;
+        if (index < m_sliceCount)
+            m_freeSlices << index;
+    }
+}
+
+void QuickTimeAudioPlayer::resetSliceState()
+{
+    // The audio unit has been reset, so no slice is in use.
+    // Completions reported after this for slices scheduled
+    // before it carry an old generation, and are ignored:
+    AudioSliceCompletion completion;
+    while (m_completedSlices.pop(completion)) {}
+    ++m_sliceGeneration;
+    m_sliceScheduled.fill(0);
+    m_scheduledSliceCount = 0;
+    updateFreeSlices();
+}
+
+void QuickTimeAudioPlayer::updateFreeSlices()
+{
+    m_freeSlices.clear();
+    for (int i = 0; i < qMin(m_sliceCount, m_carvedSliceCount); ++i){
+        if (!m_sliceScheduled[i])
+            m_freeSlices << i;
+    }
 }
 
 void QuickTimeAudioPlayer::mediaNodeEvent(const MediaNodeEvent *event)
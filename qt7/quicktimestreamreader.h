@@ -18,12 +18,15 @@
 #ifndef Phonon_QT7_QUICKTIMESTREAMREADER_H
 #define Phonon_QT7_QUICKTIMESTREAMREADER_H
 
+#include "backendheader.h"
 #include <phonon/mediasource.h>
 #include <phonon/streaminterface.h>
-#include <QtCore/QReadWriteLock>
+#include "streamwindow.h"
+#include "streamreadahead.h"
 
-#ifndef QT_MAC_USE_COCOA
-#include <QuickTime/Movies.h>
+#ifdef QUICKTIME_C_API_AVAILABLE
+    #include <QuickTime/QuickTime.h>
+    #undef check // avoid name clash;
 #endif
 
 QT_BEGIN_NAMESPACE
@@ -32,7 +35,7 @@ namespace Phonon
 {
 namespace QT7
 {
-    class QuickTimeStreamReader : public QObject, Phonon::StreamInterface
+    class QuickTimeStreamReader : public QObject, Phonon::StreamInterface, StreamWindow::Feeder, StreamReadAhead::Source
     {
         Q_OBJECT
         Q_INTERFACES(Phonon::StreamInterface)
@@ -41,8 +44,11 @@ namespace QT7
         QuickTimeStreamReader(const Phonon::MediaSource &source);
         ~QuickTimeStreamReader();
 
-        int readData(long offset, long size, void *data);
+        int readData(qint64 offset, long size, void *data);
         bool readAllData();
+        bool prefill(int size);
+        bool canReadProgressively() const;
+        QByteArray head(int size) const;
         QByteArray *pointerToData();
         void writeData(const QByteArray &data);
         void endOfData();
@@ -53,15 +59,55 @@ namespace QT7
         void setCurrentPos(qint64 pos);
         qint64 currentPos() const;
         int currentBufferSize() const;
-#ifndef QT_MAC_USE_COCOA
+        void setWindowSize(int size);
+        int windowSize() const;
+        void setRangeCacheSize(int size);
+        int rangeCacheSize() const;
+        void setSpoolThreshold(int size);
+        int spoolThreshold() const;
+        void setFileTypeHint(const QByteArray &fileType);
+        QByteArray fileTypeHint() const;
+        void startReadAhead(int bytes);
+        int stallCount() const;
+        int stallTime() const;
+#ifdef QUICKTIME_C_API_AVAILABLE
         Movie movieRef();
 #endif
 
-        QByteArray m_buffer;
-        mutable QReadWriteLock m_lock;
+        // The bytes kept in memory when reading progressively. Blocks
+        // released from it go to a range cache, so that seeking back
+        // does not need to refetch them:
+        StreamWindow m_window;
         bool m_seekable;
-        qint64 m_pos;
+        bool m_endOfData;
         qint64 m_size;
+        QByteArray m_fileTypeHint;
+
+        // Preloaded streams larger than m_spoolThreshold are written to an
+        // (unlinked) temporary file, and mapped into memory when complete.
+        // That way the bytes live in the page cache rather than on the heap:
+        int m_spoolThreshold;
+        int m_spoolFile;
+        qint64 m_spoolSize;
+        void *m_spoolMap;
+        QByteArray m_spoolData;
+
+        // Read-ahead: a worker thread calls needData (and seekStream)
+        // ahead of the reader, see startReadAhead:
+        StreamReadAhead m_readAhead;
+
+    private:
+        // Overridden section from StreamWindow::Feeder:
+        bool canSeek() const;
+        void seek(qint64 pos);
+        void fill(qint64 from, qint64 to);
+        bool spoolWindow();
+        bool mapSpoolFile();
+        void closeSpoolFile();
+
+        // Overridden section from StreamReadAhead::Source:
+        void requestData();
+        void requestSeek(qint64 pos);
     };
 
 }} //namespace Phonon::QT7
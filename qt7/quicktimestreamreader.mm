@@ -17,6 +17,14 @@
 
 #include "backendheader.h"
 #include "quicktimestreamreader.h"
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -26,68 +34,220 @@ namespace QT7
 {
 
 QuickTimeStreamReader::QuickTimeStreamReader(const Phonon::MediaSource &source)
+    : m_window(16 * 1024 * 1024), m_readAhead(this)
 {
+    m_seekable = false;
+    m_endOfData = false;
+    m_size = 0;
+
+    // Spool preloaded streams larger than 32MB to disk:
+    m_spoolThreshold = 32 * 1024 * 1024;
+    m_spoolFile = -1;
+    m_spoolSize = 0;
+    m_spoolMap = 0;
+
     connectToSource(source);
 }
 
 QuickTimeStreamReader::~QuickTimeStreamReader()
 {
+    closeSpoolFile();
+    if (m_readAhead.isRunning()){
+        // Stop the worker while we can still serve it:
+        m_readAhead.stop();
+        if (qgetenv("PHONON_DEBUG") == "1")
+            qDebug() << "Stream read-ahead stalled" << m_readAhead.stallCount() << "times, for" << m_readAhead.stallTime() << "ms in total";
+    }
 }
 
 bool QuickTimeStreamReader::readAllData()
 {
-    int oldSize = m_buffer.size();
-    while (m_buffer.size() < m_size){
+    qint64 oldPos = m_window.end();
+    while (m_window.end() < m_size){
         needData();
-        if (oldSize == currentBufferSize())
-            BACKEND_ASSERT3(oldSize != currentBufferSize(),
+        if (oldPos == m_window.end())
+            BACKEND_ASSERT3(oldPos != m_window.end(),
                 "Could not create new movie from IO stream. Not enough free memory to preload the whole movie.",
                 FATAL_ERROR, false)
-        oldSize = m_buffer.size();
+        oldPos = m_window.end();
+
+        if (m_spoolFile != -1 || (m_spoolThreshold > 0 && m_window.bufferSize() > m_spoolThreshold)){
+            if (!spoolWindow())
+                return false;
+        }
+    }
+
+    if (m_spoolFile != -1)
+        return mapSpoolFile();
+    return true;
+}
+
+bool QuickTimeStreamReader::spoolWindow()
+{
+    if (m_spoolFile == -1){
+        // Create the file and unlink it right away, so
+        // that it goes away with us, even if we crash:
+        QByteArray path = QFile::encodeName(QDir::tempPath() + QLatin1String("/phonon_qt7_stream_XXXXXX"));
+        m_spoolFile = mkstemp(path.data());
+        BACKEND_ASSERT3(m_spoolFile != -1, "Could not create temporary file for preloading the movie.", FATAL_ERROR, false)
+        unlink(path.constData());
+    }
+
+    QList<QByteArray> chunks = m_window.takeAll();
+    for (int i=0; i<chunks.size(); ++i){
+        const char *data = chunks[i].constData();
+        int left = chunks[i].size();
+        while (left > 0){
+            ssize_t written = write(m_spoolFile, data, left);
+            if (written == -1 && errno == EINTR)
+                continue;
+            BACKEND_ASSERT3(written > 0, "Could not write movie to temporary file. Not enough free disk space to preload the whole movie.", FATAL_ERROR, false)
+            data += written;
+            left -= int(written);
+            m_spoolSize += written;
+        }
     }
     return true;
 }
 
+bool QuickTimeStreamReader::mapSpoolFile()
+{
+    BACKEND_ASSERT3(m_spoolSize > 0 && m_spoolSize <= qint64(INT_MAX), "Could not preload the movie. The stream is too big.", FATAL_ERROR, false)
+    m_spoolMap = mmap(0, size_t(m_spoolSize), PROT_READ, MAP_SHARED, m_spoolFile, 0);
+    if (m_spoolMap == MAP_FAILED)
+        m_spoolMap = 0;
+    BACKEND_ASSERT3(m_spoolMap, "Could not map the preloaded movie into memory.", FATAL_ERROR, false)
+
+    // Wrap the mapping without copying it. Note that the
+    // data must never be accessed through non-const functions:
+    m_spoolData = QByteArray::fromRawData(static_cast<const char *>(m_spoolMap), int(m_spoolSize));
+    return true;
+}
+
+void QuickTimeStreamReader::closeSpoolFile()
+{
+    m_spoolData.clear();
+    if (m_spoolMap)
+        munmap(m_spoolMap, size_t(m_spoolSize));
+    if (m_spoolFile != -1)
+        close(m_spoolFile);
+    m_spoolMap = 0;
+    m_spoolFile = -1;
+    m_spoolSize = 0;
+}
+
+bool QuickTimeStreamReader::prefill(int size)
+{
+    // Make sure the head of the stream is awailable before a movie is
+    // created from it. This is what the movie importers look at first:
+    qint64 end = (m_size > 0) ? qMin(qint64(size), m_size) : qint64(size);
+    fill(m_window.start(), end);
+    return currentBufferSize() > 0;
+}
+
+bool QuickTimeStreamReader::canReadProgressively() const
+{
+    // Reading on demand means seeking around in the stream,
+    // and QuickTime needs to know the size up front:
+    return m_seekable && m_size > 0;
+}
+
+QByteArray QuickTimeStreamReader::head(int size) const
+{
+    // Return (at most) the first 'size' bytes of the stream,
+    // if they are still in the window:
+    if (m_spoolMap)
+        return m_spoolData.left(size);
+    if (m_window.start() != 0)
+        return QByteArray();
+    size = int(qMin(qint64(size), m_window.end()));
+    QByteArray data;
+    if (size > 0){
+        data.resize(size);
+        m_window.copy(0, size, data.data());
+    }
+    return data;
+}
+
 QByteArray *QuickTimeStreamReader::pointerToData()
 {
-    return &m_buffer;
+    // A preloaded movie needs all its data in one block, so
+    // join the blocks received from the stream (once).
+    // Spooled streams are already in one (mapped) block:
+    if (m_spoolMap)
+        return &m_spoolData;
+    return m_window.join();
+}
+
+bool QuickTimeStreamReader::canSeek() const
+{
+    return m_seekable;
 }
 
-int QuickTimeStreamReader::readData(long offset, long size, void *data)
+void QuickTimeStreamReader::seek(qint64 pos)
 {
-//    QReadLocker readLocker(&m_lock);
-    if (streamSize() != 1 && offset + size > streamSize()){
-        size = streamSize() - offset;
+    m_endOfData = false;
+    if (m_readAhead.isRunning()){
+        m_readAhead.seek(pos);
+        return;
     }
 
-    if (currentPos() - currentBufferSize() != offset)
-        setCurrentPos(offset);
+    // The stream might write new data directly
+    // from seekStream, so don't hold any lock:
+    seekStream(pos);
+}
 
-    int oldSize = currentBufferSize();
-    while (currentBufferSize() < int(size)) {
+void QuickTimeStreamReader::fill(qint64 from, qint64 to)
+{
+    // Ask the stream for more data until the window reaches 'to', or
+    // the stream stops delivering. Data falling out of the window
+    // while doing so is released, except for what starts at 'from':
+    if (m_readAhead.isRunning()){
+        if (m_readAhead.fill(&m_window, from, to))
+            m_endOfData = true;
+        return;
+    }
+
+    qint64 oldPos = m_window.end();
+    while (m_window.end() < to && !m_endOfData){
         needData();
-        if (oldSize == currentBufferSize())
+        if (oldPos == m_window.end())
             break;
-        oldSize = currentBufferSize();
+        oldPos = m_window.end();
+        m_window.trim(from);
     }
-    
-    int bytesRead = qMin(currentBufferSize(), int(size));
-//    QWriteLocker writeLocker(&m_lock);
-    memcpy(data, m_buffer.data(), bytesRead);
-    m_buffer = m_buffer.mid(bytesRead);
+}
 
-    return bytesRead;
+int QuickTimeStreamReader::readData(qint64 offset, long size, void *data)
+{
+    if (m_size > 0 && offset + size > m_size)
+        size = long(m_size - offset);
+    if (size <= 0)
+        return 0;
+    return m_window.read(offset, int(size), static_cast<char *>(data), this);
 }
-    
+
 void QuickTimeStreamReader::writeData(const QByteArray &data)
 {
-    QWriteLocker locker(&m_lock);
-    m_pos += data.size();
-    m_buffer += data;
+    if (data.isEmpty())
+        return;
+    if (!m_readAhead.isRunning()){
+        m_window.append(data);
+        return;
+    }
+
+    // Data can be written both from the read-ahead thread (as a
+    // response to needData), and directly from the application:
+    m_readAhead.write(data);
 }
 
 void QuickTimeStreamReader::endOfData()
 {
+    if (!m_readAhead.isRunning()){
+        m_endOfData = true;
+        return;
+    }
+    m_readAhead.endOfData();
 }
 
 void QuickTimeStreamReader::setStreamSize(qint64 newSize)
@@ -112,23 +272,371 @@ bool QuickTimeStreamReader::streamSeekable() const
 
 void QuickTimeStreamReader::setCurrentPos(qint64 pos)
 {
-    QWriteLocker locker(&m_lock);
-    m_pos = pos;
-    seekStream(pos);
-    m_buffer.clear();
+    m_window.restart(pos);
+    seek(pos);
 }
 
 qint64 QuickTimeStreamReader::currentPos() const
 {
-    return m_pos;
+    return m_window.end();
 }
 
 int QuickTimeStreamReader::currentBufferSize() const
 {
-    QReadLocker locker(&m_lock);
-    return m_buffer.size();
+    return m_window.bufferSize();
+}
+
+void QuickTimeStreamReader::setWindowSize(int size)
+{
+    m_window.setWindowSize(size);
+}
+
+int QuickTimeStreamReader::windowSize() const
+{
+    return m_window.windowSize();
+}
+
+void QuickTimeStreamReader::setRangeCacheSize(int size)
+{
+    m_window.setRangeCacheSize(size);
+}
+
+int QuickTimeStreamReader::rangeCacheSize() const
+{
+    return m_window.rangeCacheSize();
+}
+
+void QuickTimeStreamReader::setSpoolThreshold(int size)
+{
+    // A size of 0 disables spooling:
+    m_spoolThreshold = size;
+}
+
+int QuickTimeStreamReader::spoolThreshold() const
+{
+    return m_spoolThreshold;
+}
+
+void QuickTimeStreamReader::setFileTypeHint(const QByteArray &fileType)
+{
+    m_fileTypeHint = fileType;
+}
+
+QByteArray QuickTimeStreamReader::fileTypeHint() const
+{
+    return m_fileTypeHint;
+}
+
+void QuickTimeStreamReader::startReadAhead(int bytes)
+{
+    // Call needData from a separate thread, and keep (at least) 'bytes'
+    // ahead of the reader. This way the thread reading the movie will not
+    // have to wait for the stream implementation unless it falls behind:
+    m_readAhead.start(bytes, m_window.end());
+}
+
+int QuickTimeStreamReader::stallCount() const
+{
+    return m_readAhead.stallCount();
+}
+
+int QuickTimeStreamReader::stallTime() const
+{
+    return m_readAhead.stallTime();
+}
+
+void QuickTimeStreamReader::requestData()
+{
+    needData();
+}
+
+void QuickTimeStreamReader::requestSeek(qint64 pos)
+{
+    seekStream(pos);
 }
 
+#ifdef QUICKTIME_C_API_AVAILABLE
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// A minimal QuickTime data handler that lets a movie read its data
+// through a QuickTimeStreamReader. The data reference is simply a
+// handle containing a pointer to the reader. All reads are served
+// synchronously from readData.
+
+static const OSType kPhononStreamDataRefType = 'PhSt';
+static const OSType kPhononStreamDataHandlerManufacturer = 'Phon';
+static Component gStreamDataHandler = 0;
+
+struct StreamDataHandlerGlobals
+{
+    ComponentInstance self;
+    Handle dataRef;
+    QuickTimeStreamReader *reader;
+};
+typedef StreamDataHandlerGlobals *StreamDataHandlerGlobalsPtr;
+
+static QuickTimeStreamReader *readerFromDataRef(Handle dataRef)
+{
+    if (!dataRef || GetHandleSize(dataRef) != sizeof(QuickTimeStreamReader *))
+        return 0;
+    return *reinterpret_cast<QuickTimeStreamReader **>(*dataRef);
+}
+
+static qint64 qint64FromWide(const wide *value)
+{
+    return (qint64(value->hi) << 32) | qint64(UInt32(value->lo));
+}
+
+static void qint64ToWide(qint64 value, wide *result)
+{
+    result->hi = SInt32(value >> 32);
+    result->lo = UInt32(value & 0xFFFFFFFF);
+}
+
+static OSErr streamDataHandlerRead(StreamDataHandlerGlobalsPtr globals, void *data, qint64 offset, long size)
+{
+    if (!globals->reader)
+        return notOpenErr;
+    if (globals->reader->readData(offset, size, data) != size)
+        return eofErr;
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerOpen(Handle /*storage*/, ComponentInstance self)
+{
+    StreamDataHandlerGlobalsPtr globals = new StreamDataHandlerGlobals;
+    globals->self = self;
+    globals->dataRef = 0;
+    globals->reader = 0;
+    SetComponentInstanceStorage(self, reinterpret_cast<Handle>(globals));
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerClose(StreamDataHandlerGlobalsPtr globals, ComponentInstance /*self*/)
+{
+    if (globals){
+        if (globals->dataRef)
+            DisposeHandle(globals->dataRef);
+        delete globals;
+    }
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerCanDo(StreamDataHandlerGlobalsPtr /*globals*/, short selector)
+{
+    switch (selector){
+    case kComponentOpenSelect:
+    case kComponentCloseSelect:
+    case kComponentCanDoSelect:
+    case kComponentVersionSelect:
+    case kDataHGetDataSelect:
+    case kDataHScheduleDataSelect:
+    case kDataHScheduleData64Select:
+    case kDataHFinishDataSelect:
+    case kDataHFlushDataSelect:
+    case kDataHTaskSelect:
+    case kDataHOpenForReadSelect:
+    case kDataHCloseForReadSelect:
+    case kDataHSetDataRefSelect:
+    case kDataHGetDataRefSelect:
+    case kDataHCompareDataRefSelect:
+    case kDataHCanUseDataRefSelect:
+    case kDataHGetFileSizeSelect:
+    case kDataHGetFileSize64Select:
+    case kDataHGetAvailableFileSizeSelect:
+    case kDataHGetAvailableFileSize64Select:
+    case kDataHGetPreferredBlockSizeSelect:
+    case kDataHGetFileNameSelect:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static pascal ComponentResult StreamDataHandlerCanUseDataRef(StreamDataHandlerGlobalsPtr /*globals*/, Handle dataRef, long *useFlags)
+{
+    *useFlags = readerFromDataRef(dataRef) ? kDataHCanRead : 0;
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerSetDataRef(StreamDataHandlerGlobalsPtr globals, Handle dataRef)
+{
+    Handle copy = dataRef;
+    OSErr err = HandToHand(&copy);
+    if (err != noErr)
+        return err;
+    if (globals->dataRef)
+        DisposeHandle(globals->dataRef);
+    globals->dataRef = copy;
+    globals->reader = readerFromDataRef(copy);
+    return globals->reader ? noErr : paramErr;
+}
+
+static pascal ComponentResult StreamDataHandlerGetDataRef(StreamDataHandlerGlobalsPtr globals, Handle *dataRef)
+{
+    *dataRef = globals->dataRef;
+    return HandToHand(dataRef);
+}
+
+static pascal ComponentResult StreamDataHandlerCompareDataRef(StreamDataHandlerGlobalsPtr globals, Handle dataRef, Boolean *equal)
+{
+    *equal = readerFromDataRef(dataRef) == globals->reader;
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerOpenForRead(StreamDataHandlerGlobalsPtr globals)
+{
+    return globals->reader ? noErr : notOpenErr;
+}
+
+static pascal ComponentResult StreamDataHandlerNoOp(StreamDataHandlerGlobalsPtr /*globals*/)
+{
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerGetData(StreamDataHandlerGlobalsPtr globals,
+    Handle h, long hOffset, long offset, long size)
+{
+    if (GetHandleSize(h) < hOffset + size){
+        SetHandleSize(h, hOffset + size);
+        OSErr err = MemError();
+        if (err != noErr)
+            return err;
+    }
+    return streamDataHandlerRead(globals, *h + hOffset, offset, size);
+}
+
+static ComponentResult streamDataHandlerSchedule(StreamDataHandlerGlobalsPtr globals, Ptr placeToPutDataPtr,
+    qint64 fileOffset, long dataSize, long refCon, DataHCompletionUPP completionRtn)
+{
+    // A null destination is only a hint about data that will be needed:
+    if (!placeToPutDataPtr)
+        return noErr;
+    OSErr err = streamDataHandlerRead(globals, placeToPutDataPtr, fileOffset, dataSize);
+    if (completionRtn){
+        InvokeDataHCompletionUPP(placeToPutDataPtr, refCon, err, completionRtn);
+        return noErr;
+    }
+    return err;
+}
+
+static pascal ComponentResult StreamDataHandlerScheduleData(StreamDataHandlerGlobalsPtr globals, Ptr placeToPutDataPtr,
+    long fileOffset, long dataSize, long refCon, DataHSchedulePtr /*scheduleRec*/, DataHCompletionUPP completionRtn)
+{
+    return streamDataHandlerSchedule(globals, placeToPutDataPtr, fileOffset, dataSize, refCon, completionRtn);
+}
+
+static pascal ComponentResult StreamDataHandlerScheduleData64(StreamDataHandlerGlobalsPtr globals, Ptr placeToPutDataPtr,
+    const wide *fileOffset, long dataSize, long refCon, DataHSchedulePtr /*scheduleRec*/, DataHCompletionUPP completionRtn)
+{
+    return streamDataHandlerSchedule(globals, placeToPutDataPtr, qint64FromWide(fileOffset), dataSize, refCon, completionRtn);
+}
+
+static pascal ComponentResult StreamDataHandlerGetFileSize(StreamDataHandlerGlobalsPtr globals, long *fileSize)
+{
+    if (!globals->reader)
+        return notOpenErr;
+    *fileSize = long(qMin(globals->reader->streamSize(), qint64(LONG_MAX)));
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerGetFileSize64(StreamDataHandlerGlobalsPtr globals, wide *fileSize)
+{
+    if (!globals->reader)
+        return notOpenErr;
+    qint64ToWide(globals->reader->streamSize(), fileSize);
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerGetPreferredBlockSize(StreamDataHandlerGlobalsPtr /*globals*/, long *blockSize)
+{
+    *blockSize = 64 * 1024;
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerGetFileName(StreamDataHandlerGlobalsPtr globals, Str255 str)
+{
+    // Movie importers are selected from the file name
+    // extension, so let it reflect the requested type:
+    QByteArray name = "stream";
+    if (globals->reader)
+        name += globals->reader->fileTypeHint();
+    int length = qMin(name.size(), 255);
+    str[0] = length;
+    memcpy(str + 1, name.constData(), length);
+    return noErr;
+}
+
+static pascal ComponentResult StreamDataHandlerDispatch(ComponentParameters *params, Handle storage)
+{
+#define DispatchTo(function) return CallComponentFunctionWithStorage(storage, params, (ComponentFunctionUPP)function)
+    switch (params->what){
+    case kComponentOpenSelect: DispatchTo(StreamDataHandlerOpen);
+    case kComponentCloseSelect: DispatchTo(StreamDataHandlerClose);
+    case kComponentCanDoSelect: DispatchTo(StreamDataHandlerCanDo);
+    case kComponentVersionSelect: return 0x00010000;
+    case kDataHGetDataSelect: DispatchTo(StreamDataHandlerGetData);
+    case kDataHScheduleDataSelect: DispatchTo(StreamDataHandlerScheduleData);
+    case kDataHScheduleData64Select: DispatchTo(StreamDataHandlerScheduleData64);
+    case kDataHFinishDataSelect:
+    case kDataHFlushDataSelect:
+    case kDataHTaskSelect:
+    case kDataHCloseForReadSelect: DispatchTo(StreamDataHandlerNoOp);
+    case kDataHOpenForReadSelect: DispatchTo(StreamDataHandlerOpenForRead);
+    case kDataHSetDataRefSelect: DispatchTo(StreamDataHandlerSetDataRef);
+    case kDataHGetDataRefSelect: DispatchTo(StreamDataHandlerGetDataRef);
+    case kDataHCompareDataRefSelect: DispatchTo(StreamDataHandlerCompareDataRef);
+    case kDataHCanUseDataRefSelect: DispatchTo(StreamDataHandlerCanUseDataRef);
+    case kDataHGetFileSizeSelect:
+    case kDataHGetAvailableFileSizeSelect: DispatchTo(StreamDataHandlerGetFileSize);
+    case kDataHGetFileSize64Select:
+    case kDataHGetAvailableFileSize64Select: DispatchTo(StreamDataHandlerGetFileSize64);
+    case kDataHGetPreferredBlockSizeSelect: DispatchTo(StreamDataHandlerGetPreferredBlockSize);
+    case kDataHGetFileNameSelect: DispatchTo(StreamDataHandlerGetFileName);
+    default:
+        return badComponentSelector;
+    }
+#undef DispatchTo
+}
+
+static bool registerStreamDataHandler()
+{
+    if (gStreamDataHandler)
+        return true;
+
+    ComponentDescription description;
+    description.componentType = DataHandlerType;
+    description.componentSubType = kPhononStreamDataRefType;
+    description.componentManufacturer = kPhononStreamDataHandlerManufacturer;
+    description.componentFlags = kDataHCanRead;
+    description.componentFlagsMask = 0;
+    gStreamDataHandler = RegisterComponent(&description,
+        NewComponentRoutineUPP((ComponentRoutineProcPtr)StreamDataHandlerDispatch), 0, 0, 0, 0);
+    return gStreamDataHandler != 0;
+}
+
+Movie QuickTimeStreamReader::movieRef()
+{
+    // Create a movie that pulls its data from this reader on
+    // demand, rather than from a preloaded copy of the stream:
+    BACKEND_ASSERT3(registerStreamDataHandler(), "Could not register stream data handler.", FATAL_ERROR, 0)
+
+    QuickTimeStreamReader *reader = this;
+    Handle dataRef = 0;
+    OSErr err = PtrToHand(&reader, &dataRef, sizeof(reader));
+    BACKEND_ASSERT3(err == noErr, "Could not create data reference for IO stream.", FATAL_ERROR, 0)
+
+    Movie movie = 0;
+    short resId = 0;
+    err = NewMovieFromDataRef(&movie, newMovieActive | newMovieAsyncOK | newMovieDontAskUnresolvedDataRefs,
+        &resId, dataRef, kPhononStreamDataRefType);
+    DisposeHandle(dataRef);
+    BACKEND_ASSERT3(err == noErr && movie, "Could not decode media source.", FATAL_ERROR, 0)
+    return movie;
+}
+
+#endif // QUICKTIME_C_API_AVAILABLE
+
 }} //namespace Phonon::QT7
 
 QT_END_NAMESPACE
@@ -38,6 +38,7 @@ namespace Phonon
 namespace QT7
 {
     class QuickTimeStreamReader;
+    class CachedUrlStream;
 	class VideoRenderWidgetQTMovieView;
 
     class QuickTimeVideoPlayer : QObject
@@ -62,6 +63,7 @@ namespace QT7
             void seek(quint64 milliseconds);
 
             bool videoFrameChanged();
+            bool prepareFirstFrame();
             CVOpenGLTextureRef currentFrameAsCVTexture();
             GLuint currentFrameAsGLTexture();
 			void *currentFrameAsCIImage();
@@ -138,15 +140,17 @@ namespace QT7
 #endif
             VideoFrame m_currentFrame;
             QuickTimeStreamReader *m_streamReader;
+            CachedUrlStream *m_cachedUrlStream;
 
             void createVisualContext();
             void openMovieFromCurrentMediaSource();
             void openMovieFromDataRef(QTDataReference *dataRef);
             void openMovieFromFile();
             void openMovieFromUrl();
-            void openMovieFromStream();
-            void openMovieFromData(QByteArray *data, char *fileType);
-            void openMovieFromDataGuessType(QByteArray *data);
+            void openMovieFromStream(const MediaSource &source);
+            void openMovieFromData(QByteArray *data, const char *fileType);
+            void openMovieFromStreamReader(const char *fileType);
+            void openMovieFromStreamGuessType();
 			QString mediaSourcePath();
 			bool codecExistsAccordingToSuffix(const QString &fileName);
 
@@ -20,6 +20,8 @@
 #include "videowidget.h"
 #include "audiodevice.h"
 #include "quicktimestreamreader.h"
+#include "containersniffer.h"
+#include "cachedurlstream.h"
 
 #include <QtCore/QCoreApplication>
 #include <QtCore/QEventLoop>
@@ -54,6 +56,7 @@ QuickTimeVideoPlayer::QuickTimeVideoPlayer() : QObject(0)
     m_mediaSource = MediaSource();
     m_QTMovie = 0;
     m_streamReader = 0;
+    m_cachedUrlStream = 0;
     m_playbackRate = 1.0f;
     m_masterVolume = 1.0f;
     m_relativeVolume = 1.0f;
@@ -135,6 +138,24 @@ bool QuickTimeVideoPlayer::videoFrameChanged()
 #endif
 }
 
+bool QuickTimeVideoPlayer::prepareFirstFrame()
+{
+    // Let the visual context decode the frame at the current
+    // position while we are not playing, so that it is ready
+    // when we start. Returns true once it is:
+    if (!m_QTMovie || !m_hasVideo || m_state == Playing)
+        return false;
+
+#ifdef QUICKTIME_C_API_AVAILABLE
+    if (!m_visualContext)
+        return false;
+    QTVisualContextTask(m_visualContext);
+    return QTVisualContextIsNewImageAvailable(m_visualContext, 0);
+#else
+    return false;
+#endif
+}
+
 CVOpenGLTextureRef QuickTimeVideoPlayer::currentFrameAsCVTexture()
 {
 #ifdef QUICKTIME_C_API_AVAILABLE
@@ -406,6 +427,8 @@ void QuickTimeVideoPlayer::unsetVideo()
 	m_QTMovie = 0;
     delete m_streamReader;
     m_streamReader = 0;
+    delete m_cachedUrlStream;
+    m_cachedUrlStream = 0;
     m_currentTime = 0;
     m_state = NoMedia;
     m_isDrmProtected = false;
@@ -576,7 +599,7 @@ void QuickTimeVideoPlayer::openMovieFromCurrentMediaSource()
         CASE_UNSUPPORTED("Could not open media source.", FATAL_ERROR)
         break;
     case MediaSource::Stream:
-        openMovieFromStream();
+        openMovieFromStream(m_mediaSource);
         break;
     case MediaSource::Empty:
     case MediaSource::Invalid:
@@ -620,23 +643,61 @@ void QuickTimeVideoPlayer::openMovieFromDataRef(QTDataReference *dataRef)
     }
 }
 
-void QuickTimeVideoPlayer::openMovieFromData(QByteArray *data, char *fileType)
+void QuickTimeVideoPlayer::openMovieFromData(QByteArray *data, const char *fileType)
 {
     PhononAutoReleasePool pool;
     NSString *type = [NSString stringWithUTF8String:fileType];
-    NSData *nsData = [NSData dataWithBytesNoCopy:data->data() length:data->size() freeWhenDone:NO];
+    // Use constData, since data might wrap a read-only mapping:
+    NSData *nsData = [NSData dataWithBytesNoCopy:const_cast<char *>(data->constData()) length:data->size() freeWhenDone:NO];
     QTDataReference *dataRef = [QTDataReference dataReferenceWithReferenceToData:nsData name:type MIMEType:@""];
     openMovieFromDataRef(dataRef);
 }
 
-void QuickTimeVideoPlayer::openMovieFromDataGuessType(QByteArray *data)
+void QuickTimeVideoPlayer::openMovieFromStreamReader(const char *fileType)
+{
+#ifdef QUICKTIME_C_API_AVAILABLE
+    if (m_streamReader->canReadProgressively()){
+        PhononAutoReleasePool pool;
+        m_streamReader->setFileTypeHint(fileType);
+        Movie movie = m_streamReader->movieRef();
+        if (!movie)
+            return;
+
+        NSError *err = 0;
+        m_QTMovie = [[QTMovie movieWithQuickTimeMovie:movie disposeWhenDone:YES error:&err] retain];
+        if (err){
+            [m_QTMovie release];
+            m_QTMovie = 0;
+            setError(err);
+        }
+        return;
+    }
+#endif
+    openMovieFromData(m_streamReader->pointerToData(), fileType);
+}
+
+void QuickTimeVideoPlayer::openMovieFromStreamGuessType()
 {
+    // Most formats can be recognised from the first bytes
+    // of the stream. This saves us from opening the movie
+    // once for each codec tried below:
+    QByteArray head = m_streamReader->head(4096);
+    const char *sniffedType = sniffContainerType(head.constData(), head.size());
+    if (sniffedType){
+        gClearError();
+        openMovieFromStreamReader(sniffedType);
+        if (m_QTMovie)
+            return;
+    }
+
     // It turns out to be better to just try the standard file types rather
     // than using e.g [QTMovie movieFileTypes:QTIncludeCommonTypes]. Some
-    // codecs *think* they can decode the stream, and crash...
-#define TryOpenMovieWithCodec(type) gClearError(); \
-    openMovieFromData(data, "."type); \
-    if (m_QTMovie) return;
+    // codecs *think* they can decode the stream, and crash... The sniffed
+    // type (if any) has already failed, so it is not tried again:
+#define TryOpenMovieWithCodec(type) if (qstrcmp(sniffedType, "."type) != 0){ \
+    gClearError(); \
+    openMovieFromStreamReader("."type); \
+    if (m_QTMovie) return; }
 
     TryOpenMovieWithCodec("avi");
     TryOpenMovieWithCodec("mp4");
@@ -660,6 +721,28 @@ void QuickTimeVideoPlayer::openMovieFromFile()
 
 void QuickTimeVideoPlayer::openMovieFromUrl()
 {
+#ifdef QUICKTIME_C_API_AVAILABLE
+    // Optionally read http urls through a local disk cache, so that
+    // the same media is not downloaded again each time it is played.
+    // PHONON_QT7_URL_CACHE is the size of the cache in MB:
+    int cacheSize = qgetenv("PHONON_QT7_URL_CACHE").toInt();
+    QString scheme = m_mediaSource.url().scheme().toLower();
+    if (cacheSize > 0 && (scheme == QLatin1String("http") || scheme == QLatin1String("https"))){
+        m_cachedUrlStream = new CachedUrlStream(m_mediaSource.url(),
+            CachedUrlStream::defaultCacheDirectory(), qint64(cacheSize) * 1024 * 1024);
+        if (m_cachedUrlStream->open()){
+            openMovieFromStream(MediaSource(m_cachedUrlStream));
+            if (m_QTMovie)
+                return;
+            delete m_streamReader;
+            m_streamReader = 0;
+        }
+        delete m_cachedUrlStream;
+        m_cachedUrlStream = 0;
+        gClearError();
+    }
+#endif
+
     PhononAutoReleasePool pool;
     NSString *urlString = (NSString *)PhononCFString::toCFStringRef(mediaSourcePath());
     NSURL *url = [NSURL URLWithString: urlString];
@@ -667,12 +750,35 @@ void QuickTimeVideoPlayer::openMovieFromUrl()
     openMovieFromDataRef(dataRef);
 }
 
-void QuickTimeVideoPlayer::openMovieFromStream()
+void QuickTimeVideoPlayer::openMovieFromStream(const MediaSource &source)
 {
-    m_streamReader = new QuickTimeStreamReader(m_mediaSource);
+    m_streamReader = new QuickTimeStreamReader(source);
+#ifdef QUICKTIME_C_API_AVAILABLE
+    // Seekable streams of known size are read on demand through a
+    // bounded window, so we only need the head of the stream before
+    // opening the movie. Other streams must be preloaded completely:
+    if (m_streamReader->canReadProgressively()){
+        // Optionally let a worker thread call needData ahead of QuickTime.
+        // This is off by default since it means that the application's
+        // stream object will be called from a thread other than its own:
+        int readAhead = qgetenv("PHONON_QT7_STREAM_READAHEAD").toInt();
+        // Our own url stream does not wait for the network in needData,
+        // and relies on being asked again. So it is always read ahead:
+        if (readAhead <= 0 && m_cachedUrlStream)
+            readAhead = 1024 * 1024;
+        if (readAhead > 0)
+            m_streamReader->startReadAhead(readAhead);
+        if (m_streamReader->prefill(256 * 1024))
+            openMovieFromStreamGuessType();
+        return;
+    }
+#endif
+    QByteArray spoolThreshold = qgetenv("PHONON_QT7_SPOOL_THRESHOLD");
+    if (!spoolThreshold.isEmpty())
+        m_streamReader->setSpoolThreshold(spoolThreshold.toInt());
     if (!m_streamReader->readAllData())
         return;
-    openMovieFromDataGuessType(m_streamReader->pointerToData());
+    openMovieFromStreamGuessType();
 }
 
 MediaSource QuickTimeVideoPlayer::mediaSource() const
@@ -0,0 +1,102 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_REMIXMATRIX_H
+#define Phonon_QT7_REMIXMATRIX_H
+
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Up or down mixes non-interleaved float audio from one channel layout
+        to another. The channels are described by their labels (the values
+        of AudioChannelLabel), and the gains follow ITU-R BS.775: center and
+        surround channels missing in the output go to the sides at -3 dB,
+        and a missing mono or center output gets left and right at -3 dB.
+        Without a LFE output, the LFE channel is dropped, unless
+        PHONON_QT7_REMIX_LFE_DB gives a gain to mix it into the front.
+        Nothing is synthesized when up mixing; channels the input lacks
+        stay silent.
+
+        Those gains add up to more than one when down mixing, which can
+        clip. Such a matrix is scaled down as a whole, so the balance
+        between the outputs stays. By default no output gets more than
+        unity gain in total (Normalize). PHONON_QT7_REMIX_HEADROOM can
+        ask for "none", or for a fixed headroom in dB (like "3") instead.
+
+        Building the matrix allocates, so do that with find, which keeps
+        one matrix per pair of layouts for the rest of the process. apply
+        does not allocate, and can run on the render thread.
+    */
+    class RemixMatrix
+    {
+        public:
+            // Same values as kAudioChannelLabel_*:
+            enum Label {
+                Unused = 0, Left = 1, Right = 2, Center = 3, LFEScreen = 4,
+                LeftSurround = 5, RightSurround = 6, LeftCenter = 7, RightCenter = 8,
+                CenterSurround = 9, LeftSurroundDirect = 10, RightSurroundDirect = 11,
+                RearSurroundLeft = 33, RearSurroundRight = 34, LeftWide = 35, RightWide = 36,
+                LFE2 = 37, Mono = 42
+            };
+
+            enum Headroom {DefaultHeadroom, NoHeadroom, Normalize, FixedHeadroom};
+
+            RemixMatrix(const QVector<quint32> &inputLabels, const QVector<quint32> &outputLabels,
+                Headroom headroom = DefaultHeadroom, float headroomDb = 3);
+
+            static const RemixMatrix *find(const QVector<quint32> &inputLabels, const QVector<quint32> &outputLabels);
+            static QVector<quint32> defaultLabels(int channels);
+
+            int inputChannels() const;
+            int outputChannels() const;
+            float gain(int output, int input) const;
+            bool isIdentity() const;
+
+            void apply(const float *const *input, float *const *output, int frames) const;
+
+        private:
+            struct Term {
+                int input;
+                float gain;
+            };
+
+            static float lfeGain();
+            static Headroom defaultHeadroom(float *headroomDb);
+            void applyHeadroom(Headroom headroom, float headroomDb);
+            void route(int input, quint32 label, float gain, int depth);
+            int indexOf(quint32 label) const;
+            void addGain(int output, int input, float gain);
+
+            QVector<quint32> m_inputLabels;
+            QVector<quint32> m_outputLabels;
+            QVector<float> m_gains;     // output major
+            QVector<Term> m_terms;      // non zero gains, by output
+            QVector<int> m_rowStart;    // first term of each output, and the end
+            bool m_identity;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_REMIXMATRIX_H
@@ -0,0 +1,326 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "remixmatrix.h"
+#include <QtCore/QHash>
+#include <QtCore/QByteArray>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define PHONON_QT7_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define PHONON_QT7_NEON
+#endif
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+static const float Minus3dB = 0.70710678f;
+
+RemixMatrix::RemixMatrix(const QVector<quint32> &inputLabels, const QVector<quint32> &outputLabels,
+    Headroom headroom, float headroomDb)
+{
+    m_inputLabels = inputLabels;
+    m_outputLabels = outputLabels;
+    int inputs = m_inputLabels.size();
+    int outputs = m_outputLabels.size();
+    m_gains.fill(0, inputs * outputs);
+
+    for (int i=0; i<inputs; ++i){
+        quint32 label = m_inputLabels[i];
+        if (label == Unused)
+            continue;
+        route(i, label, 1, 0);
+
+        // Channels that have no place by their label (discrete
+        // channels, or labels not known here) keep their index:
+        bool routed = false;
+        for (int o=0; o<outputs && !routed; ++o)
+            routed = m_gains[o * inputs + i] != 0;
+        bool lfe = (label == LFEScreen || label == LFE2);
+        if (!routed && !lfe && i < outputs && m_outputLabels[i] != Unused)
+            addGain(i, i, 1);
+    }
+    if (headroom == DefaultHeadroom)
+        headroom = defaultHeadroom(&headroomDb);
+    applyHeadroom(headroom, headroomDb);
+
+    // Keep only the gains that matter, row by row:
+    m_identity = (inputs == outputs);
+    m_rowStart.resize(outputs + 1);
+    for (int o=0; o<outputs; ++o){
+        m_rowStart[o] = m_terms.size();
+        for (int i=0; i<inputs; ++i){
+            float value = m_gains[o * inputs + i];
+            if (value != (o == i ? 1.0f : 0.0f))
+                m_identity = false;
+            if (value != 0){
+                Term term;
+                term.input = i;
+                term.gain = value;
+                m_terms.append(term);
+            }
+        }
+    }
+    m_rowStart[outputs] = m_terms.size();
+}
+
+const RemixMatrix *RemixMatrix::find(const QVector<quint32> &inputLabels, const QVector<quint32> &outputLabels)
+{
+    // There are only a handful of layouts in use, so the matrices
+    // are never deleted. The render thread may hold on to any of
+    // them. Only to be called from the main thread:
+    static QHash<QByteArray, RemixMatrix *> matrices;
+    QByteArray key = QByteArray::number(inputLabels.size()) + ':'
+        + QByteArray((const char *) inputLabels.constData(), inputLabels.size() * sizeof(quint32))
+        + QByteArray((const char *) outputLabels.constData(), outputLabels.size() * sizeof(quint32));
+    RemixMatrix *matrix = matrices.value(key);
+    if (!matrix){
+        matrix = new RemixMatrix(inputLabels, outputLabels);
+        matrices.insert(key, matrix);
+    }
+    return matrix;
+}
+
+QVector<quint32> RemixMatrix::defaultLabels(int channels)
+{
+    // The channel order of WAVE files (and of most decoders),
+    // for when a source does not describe its layout:
+    static const quint32 layouts[8][8] = {
+        {Mono},
+        {Left, Right},
+        {Left, Right, Center},
+        {Left, Right, LeftSurround, RightSurround},
+        {Left, Right, Center, LeftSurround, RightSurround},
+        {Left, Right, Center, LFEScreen, LeftSurround, RightSurround},
+        {Left, Right, Center, LFEScreen, LeftSurround, RightSurround, CenterSurround},
+        {Left, Right, Center, LFEScreen, LeftSurround, RightSurround, RearSurroundLeft, RearSurroundRight}
+    };
+    QVector<quint32> labels(qMax(0, channels));
+    for (int i=0; i<channels; ++i){
+        // Otherwise, discrete channels (kAudioChannelLabel_Discrete_N):
+        labels[i] = (channels <= 8) ? layouts[channels - 1][i] : ((1 << 16) | quint32(i));
+    }
+    return labels;
+}
+
+int RemixMatrix::inputChannels() const
+{
+    return m_inputLabels.size();
+}
+
+int RemixMatrix::outputChannels() const
+{
+    return m_outputLabels.size();
+}
+
+float RemixMatrix::gain(int output, int input) const
+{
+    return m_gains[output * m_inputLabels.size() + input];
+}
+
+bool RemixMatrix::isIdentity() const
+{
+    return m_identity;
+}
+
+float RemixMatrix::lfeGain()
+{
+    static float gain = -1;
+    if (gain < 0){
+        gain = 0;
+        QByteArray value = qgetenv("PHONON_QT7_REMIX_LFE_DB");
+        if (!value.isEmpty())
+            gain = float(pow(10.0, value.toDouble() / 20.0));
+    }
+    return gain;
+}
+
+RemixMatrix::Headroom RemixMatrix::defaultHeadroom(float *headroomDb)
+{
+    static Headroom headroom = DefaultHeadroom;
+    static float db = 0;
+    if (headroom == DefaultHeadroom){
+        QByteArray value = qgetenv("PHONON_QT7_REMIX_HEADROOM");
+        bool isNumber = false;
+        double number = value.toDouble(&isNumber);
+        if (value == "none")
+            headroom = NoHeadroom;
+        else if (isNumber){
+            headroom = FixedHeadroom;
+            db = float(number);
+        } else
+            headroom = Normalize;
+    }
+    *headroomDb = db;
+    return headroom;
+}
+
+void RemixMatrix::applyHeadroom(Headroom headroom, float headroomDb)
+{
+    // Only down mixes, where the gains into an
+    // output add up to more than one, are scaled:
+    int inputs = m_inputLabels.size();
+    float largest = 0;
+    for (int o=0; o<m_outputLabels.size(); ++o){
+        float sum = 0;
+        for (int i=0; i<inputs; ++i)
+            sum += m_gains[o * inputs + i];
+        largest = qMax(largest, sum);
+    }
+    if (largest <= 1.0f + 1e-6f)
+        return;
+
+    float scale = 1;
+    if (headroom == Normalize)
+        scale = 1 / largest;
+    else if (headroom == FixedHeadroom)
+        scale = float(pow(10.0, -headroomDb / 20.0));
+    for (int i=0; i<m_gains.size(); ++i)
+        m_gains[i] *= scale;
+}
+
+int RemixMatrix::indexOf(quint32 label) const
+{
+    return m_outputLabels.indexOf(label);
+}
+
+void RemixMatrix::addGain(int output, int input, float gain)
+{
+    m_gains[output * m_inputLabels.size() + input] += gain;
+}
+
+void RemixMatrix::route(int input, quint32 label, float gain, int depth)
+{
+    int output = indexOf(label);
+    if (output != -1){
+        addGain(output, input, gain);
+        return;
+    }
+    if (depth > 4)
+        return;
+
+    switch (label){
+    case Mono:
+    case Center:
+        // Mono and center stand in for each other. Without
+        // either, the channel goes to both sides:
+        if (indexOf(label == Mono ? Center : Mono) != -1)
+            route(input, label == Mono ? Center : Mono, gain, depth + 1);
+        else {
+            route(input, Left, gain * Minus3dB, depth + 1);
+            route(input, Right, gain * Minus3dB, depth + 1);
+        }
+        break;
+    case Left:
+    case Right:
+        // Only a mono output, or a center without sides, takes them:
+        if (indexOf(Mono) != -1)
+            route(input, Mono, gain * Minus3dB, depth + 1);
+        else if (indexOf(Center) != -1 && indexOf(label == Left ? Right : Left) == -1)
+            route(input, Center, gain * Minus3dB, depth + 1);
+        break;
+    case LeftCenter:
+    case LeftWide:
+        route(input, Left, gain, depth + 1);
+        break;
+    case RightCenter:
+    case RightWide:
+        route(input, Right, gain, depth + 1);
+        break;
+    case LeftSurround:
+        route(input, Left, gain * Minus3dB, depth + 1);
+        break;
+    case RightSurround:
+        route(input, Right, gain * Minus3dB, depth + 1);
+        break;
+    case LeftSurroundDirect:
+    case RearSurroundLeft:
+        route(input, LeftSurround, gain, depth + 1);
+        break;
+    case RightSurroundDirect:
+    case RearSurroundRight:
+        route(input, RightSurround, gain, depth + 1);
+        break;
+    case CenterSurround:
+        route(input, LeftSurround, gain * Minus3dB, depth + 1);
+        route(input, RightSurround, gain * Minus3dB, depth + 1);
+        break;
+    case LFEScreen:
+    case LFE2:
+        if (label == LFE2 && indexOf(LFEScreen) != -1)
+            route(input, LFEScreen, gain, depth + 1);
+        else if (lfeGain() > 0){
+            route(input, Left, gain * lfeGain(), depth + 1);
+            route(input, Right, gain * lfeGain(), depth + 1);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void RemixMatrix::apply(const float *const *input, float *const *output, int frames) const
+{
+    // One pass over the frames for each output, summing the inputs
+    // that feed it four frames at a time. The output must not be
+    // one of the inputs:
+    int outputs = m_outputLabels.size();
+    for (int o=0; o<outputs; ++o){
+        const Term *terms = m_terms.constData() + m_rowStart[o];
+        int count = m_rowStart[o + 1] - m_rowStart[o];
+        float *out = output[o];
+        if (count == 0){
+            memset(out, 0, frames * sizeof(float));
+            continue;
+        }
+
+        int f = 0;
+#if defined(PHONON_QT7_SSE2)
+        for (; f + 4 <= frames; f += 4){
+            __m128 sum = _mm_mul_ps(_mm_loadu_ps(input[terms[0].input] + f), _mm_set1_ps(terms[0].gain));
+            for (int t=1; t<count; ++t)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(input[terms[t].input] + f), _mm_set1_ps(terms[t].gain)));
+            _mm_storeu_ps(out + f, sum);
+        }
+#elif defined(PHONON_QT7_NEON)
+        for (; f + 4 <= frames; f += 4){
+            float32x4_t sum = vmulq_n_f32(vld1q_f32(input[terms[0].input] + f), terms[0].gain);
+            for (int t=1; t<count; ++t)
+                sum = vmlaq_n_f32(sum, vld1q_f32(input[terms[t].input] + f), terms[t].gain);
+            vst1q_f32(out + f, sum);
+        }
+#endif
+        for (; f < frames; ++f){
+            float sum = input[terms[0].input][f] * terms[0].gain;
+            for (int t=1; t<count; ++t)
+                sum += input[terms[t].input][f] * terms[t].gain;
+            out[f] = sum;
+        }
+    }
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,66 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_RENDERTIMELINE_H
+#define Phonon_QT7_RENDERTIMELINE_H
+
+#include <QtCore/QtGlobal>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Keeps track of where on the render timeline (the sample times of
+        the render cycles, shared by all audio units in a graph) an audio
+        player unit starts playing. Audio scheduled at sample time t on
+        the unit plays at start + t on the timeline. This lets the next
+        player be started at the exact sample where the current one runs
+        out of audio. The render thread reports each render cycle; all
+        other calls are made from the GUI thread.
+    */
+    class RenderTimeline
+    {
+        public:
+            RenderTimeline();
+
+            void reset();
+            void renderCycle(double sampleTime, int frameCount);
+            bool hasRendered() const;
+
+            bool canStartAt(double sampleTime) const;
+            double start(double requestedSampleTime, bool rendering);
+            void cancelStart();
+            double startSampleTime() const;
+            double endSampleTime(double scheduledFrames) const;
+
+            static double gaplessStartSampleTime(double endSampleTime, qint32 transitionTime, double sampleRate);
+
+        private:
+            volatile double m_renderSampleTime;
+            volatile int m_renderFrameCount;
+            volatile double m_startSampleTime;
+            volatile bool m_resolveStart;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_RENDERTIMELINE_H
@@ -0,0 +1,115 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rendertimeline.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+// Render cycles to leave between now and the start
+// of a unit, for its first slices to be scheduled:
+static const int StartLead = 2;
+
+RenderTimeline::RenderTimeline()
+{
+    reset();
+}
+
+void RenderTimeline::reset()
+{
+    m_renderSampleTime = -1;
+    m_renderFrameCount = 0;
+    m_startSampleTime = -1;
+    m_resolveStart = false;
+}
+
+void RenderTimeline::renderCycle(double sampleTime, int frameCount)
+{
+    // Called on the render thread before each cycle. Don't lock or allocate:
+    m_renderSampleTime = sampleTime;
+    m_renderFrameCount = frameCount;
+    if (m_resolveStart){
+        // The unit was told to start on the next render cycle, which is this one:
+        m_startSampleTime = sampleTime;
+        m_resolveStart = false;
+    }
+}
+
+bool RenderTimeline::hasRendered() const
+{
+    return m_renderSampleTime >= 0;
+}
+
+bool RenderTimeline::canStartAt(double sampleTime) const
+{
+    return hasRendered() && sampleTime >= m_renderSampleTime + StartLead * m_renderFrameCount;
+}
+
+double RenderTimeline::start(double requestedSampleTime, bool rendering)
+{
+    // Returns the sample time to start the unit at. If none is requested,
+    // start a couple of render cycles ahead. If the graph is not rendering
+    // yet, returns -1 (start on the next render cycle), and notes which
+    // cycle that was when it comes:
+    m_resolveStart = false;
+    if (requestedSampleTime >= 0){
+        m_startSampleTime = requestedSampleTime;
+    } else if (rendering && hasRendered()){
+        m_startSampleTime = m_renderSampleTime + StartLead * m_renderFrameCount;
+    } else {
+        m_startSampleTime = -1;
+        m_resolveStart = true;
+    }
+    return m_startSampleTime;
+}
+
+void RenderTimeline::cancelStart()
+{
+    m_resolveStart = false;
+    m_startSampleTime = -1;
+}
+
+double RenderTimeline::startSampleTime() const
+{
+    // Returns -1 if not known (yet):
+    return m_startSampleTime;
+}
+
+double RenderTimeline::endSampleTime(double scheduledFrames) const
+{
+    // The sample time on the timeline right after 'scheduledFrames'
+    // frames played from the start, or -1 if the start is not known:
+    if (m_startSampleTime < 0)
+        return -1;
+    return m_startSampleTime + scheduledFrames;
+}
+
+double RenderTimeline::gaplessStartSampleTime(double endSampleTime, qint32 transitionTime, double sampleRate)
+{
+    // Where the next source should start, when the current ends at
+    // endSampleTime, and 'transitionTime' ms of silence goes between.
+    // Rounded to whole samples, so that no sample is played twice:
+    return endSampleTime + qRound64(double(transitionTime) * sampleRate / 1000.0);
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,107 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_RESAMPLERAUDIONODE_H
+#define Phonon_QT7_RESAMPLERAUDIONODE_H
+
+#include "audionode.h"
+#include "lockfreequeue.h"
+#include "polyphaseresampler.h"
+#include "remixmatrix.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Converts audio to another sample rate and channel layout, for sinks
+        that cannot take the format of their source (see
+        AudioConnection::setSinkSampleRate and setSinkChannelLayoutTag).
+        The input goes through a converter unit that makes it non-interleaved
+        float at the input rate. A second converter, which passes the audio
+        through at the output rate, pulls it through a RemixMatrix and a
+        PolyphaseResampler from its input callback. When the rates and
+        layouts are the same, the audio goes straight through.
+    */
+    class ResamplerAudioNode : public AudioNode
+    {
+        public:
+            ResamplerAudioNode();
+            ~ResamplerAudioNode();
+
+            void setOutputSampleRate(Float64 sampleRate);
+            Float64 outputSampleRate() const;
+            void setOutputChannelLayoutTag(AudioChannelLayoutTag tag);
+            AudioChannelLayoutTag outputChannelLayoutTag() const;
+
+            // Overridden section from AudioNode:
+            void createAndConnectAUNodes();
+            void createAudioUnits();
+            void setGraph(AudioGraph *audioGraph);
+            AUNode getInputAUNode();
+            bool fillInStreamSpecification(AudioConnection *connection, ConnectionSide side);
+            bool setStreamSpecification(AudioConnection *connection, ConnectionSide side);
+
+        protected:
+            ComponentDescription getAudioNodeDescription() const;
+
+        private:
+            enum {MaxPullFrames = 4096, MaxChannels = 16};
+
+            // What the render thread needs to convert one input format:
+            struct Conversion {
+                PolyphaseResampler resampler;
+                const RemixMatrix *remix;           // 0 when the channels map one to one
+                QVector<QVector<float> > scratch;   // the input channels, before the remix
+            };
+
+            static PolyphaseResampler::Quality quality();
+            static AudioStreamBasicDescription floatFormat(Float64 sampleRate, UInt32 channels);
+            static QVector<quint32> channelLabels(const AudioChannelLayout *layout, UInt32 channels);
+            UInt32 outputChannels(UInt32 inputChannels) const;
+            static OSStatus inputRender(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+            OSStatus render(AudioUnitRenderActionFlags *actionFlags, const AudioTimeStamp *timeStamp,
+                UInt32 frameCount, AudioBufferList *data);
+            OSStatus pullInput(Conversion *conversion, Float64 sampleTime, int frames, float *const *destination);
+            void configure(Float64 inputSampleRate, UInt32 channels, const AudioChannelLayout *layout);
+            void deleteRetired();
+
+            AUNode m_inputNode;
+            AudioUnit m_inputUnit;
+            Float64 m_outputSampleRate;
+            AudioChannelLayoutTag m_outputLayoutTag;
+
+            // The conversion in use belongs to the render thread. New ones
+            // are handed over through m_pending, and the ones replaced come
+            // back through m_retired, to be deleted on this side:
+            Conversion *m_conversion;
+            LockFreeQueue<Conversion *> m_pending;
+            LockFreeQueue<Conversion *> m_retired;
+
+            // Render thread only:
+            AudioBufferList *m_pullList;
+            Float64 m_inputSampleTime;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_RESAMPLERAUDIONODE_H
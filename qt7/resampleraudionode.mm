@@ -0,0 +1,472 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resampleraudionode.h"
+#include "audiograph.h"
+#include <AudioToolbox/AudioFormat.h>
+#include <stddef.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+ResamplerAudioNode::ResamplerAudioNode() : AudioNode(1, 1), m_pending(8), m_retired(8)
+{
+    m_inputNode = 0;
+    m_inputUnit = 0;
+    m_outputSampleRate = 0;
+    m_outputLayoutTag = 0;
+    m_conversion = 0;
+    m_pullList = (AudioBufferList *) malloc(offsetof(AudioBufferList, mBuffers) + MaxChannels * sizeof(AudioBuffer));
+    m_pullList->mNumberBuffers = 0;
+    m_inputSampleTime = -1;
+}
+
+ResamplerAudioNode::~ResamplerAudioNode()
+{
+    // Nothing renders once the units are gone, so
+    // all the conversions can be deleted from here:
+    setGraph(0);
+    Conversion *conversion = 0;
+    while (m_pending.pop(conversion))
+        delete conversion;
+    deleteRetired();
+    delete m_conversion;
+    free(m_pullList);
+}
+
+PolyphaseResampler::Quality ResamplerAudioNode::quality()
+{
+    static int quality = -1;
+    if (quality == -1){
+        QByteArray value = qgetenv("PHONON_QT7_RESAMPLER_QUALITY");
+        if (value == "fast")
+            quality = PolyphaseResampler::Fast;
+        else if (value == "best")
+            quality = PolyphaseResampler::Best;
+        else
+            quality = PolyphaseResampler::Good;
+    }
+    return PolyphaseResampler::Quality(quality);
+}
+
+AudioStreamBasicDescription ResamplerAudioNode::floatFormat(Float64 sampleRate, UInt32 channels)
+{
+    AudioStreamBasicDescription format;
+    format.mSampleRate = sampleRate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+    format.mBytesPerPacket = sizeof(Float32);
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = sizeof(Float32);
+    format.mChannelsPerFrame = channels;
+    format.mBitsPerChannel = 32;
+    format.mReserved = 0;
+    return format;
+}
+
+void ResamplerAudioNode::setOutputSampleRate(Float64 sampleRate)
+{
+    // Takes effect when the stream specification is set next:
+    m_outputSampleRate = sampleRate;
+}
+
+Float64 ResamplerAudioNode::outputSampleRate() const
+{
+    return m_outputSampleRate;
+}
+
+void ResamplerAudioNode::setOutputChannelLayoutTag(AudioChannelLayoutTag tag)
+{
+    // Zero keeps the layout of the input. Like the
+    // rate, it takes effect with the next specification:
+    m_outputLayoutTag = tag;
+}
+
+AudioChannelLayoutTag ResamplerAudioNode::outputChannelLayoutTag() const
+{
+    return m_outputLayoutTag;
+}
+
+UInt32 ResamplerAudioNode::outputChannels(UInt32 inputChannels) const
+{
+    return m_outputLayoutTag ? AudioChannelLayoutTag_GetNumberOfChannels(m_outputLayoutTag) : inputChannels;
+}
+
+QVector<quint32> ResamplerAudioNode::channelLabels(const AudioChannelLayout *layout, UInt32 channels)
+{
+    // Layouts given by a tag or a bitmap are expanded
+    // to channel descriptions by AudioToolbox first:
+    QVector<quint32> labels;
+    if (layout && layout->mChannelLayoutTag == kAudioChannelLayoutTag_UseChannelDescriptions){
+        for (UInt32 i=0; i<layout->mNumberChannelDescriptions; ++i)
+            labels.append(layout->mChannelDescriptions[i].mChannelLabel);
+    } else if (layout){
+        AudioFormatPropertyID property = kAudioFormatProperty_ChannelLayoutForTag;
+        const void *specifier = &layout->mChannelLayoutTag;
+        UInt32 specifierSize = sizeof(layout->mChannelLayoutTag);
+        if (layout->mChannelLayoutTag == kAudioChannelLayoutTag_UseChannelBitmap){
+            property = kAudioFormatProperty_ChannelLayoutForBitmap;
+            specifier = &layout->mChannelBitmap;
+            specifierSize = sizeof(layout->mChannelBitmap);
+        }
+        UInt32 size = 0;
+        OSStatus err = AudioFormatGetPropertyInfo(property, specifierSize, specifier, &size);
+        if (err == noErr && size >= sizeof(AudioChannelLayout)){
+            AudioChannelLayout *expanded = (AudioChannelLayout *) malloc(size);
+            err = AudioFormatGetProperty(property, specifierSize, specifier, &size, expanded);
+            if (err == noErr){
+                for (UInt32 i=0; i<expanded->mNumberChannelDescriptions; ++i)
+                    labels.append(expanded->mChannelDescriptions[i].mChannelLabel);
+            }
+            free(expanded);
+        }
+    }
+
+    // Sources that say nothing (or nonsense) about
+    // their layout get the usual one for the count:
+    if (labels.size() != int(channels))
+        return RemixMatrix::defaultLabels(channels);
+    return labels;
+}
+
+ComponentDescription ResamplerAudioNode::getAudioNodeDescription() const
+{
+	ComponentDescription description;
+	description.componentType = kAudioUnitType_FormatConverter;
+	description.componentSubType = kAudioUnitSubType_AUConverter;
+	description.componentManufacturer = kAudioUnitManufacturer_Apple;
+	description.componentFlags = 0;
+	description.componentFlagsMask = 0;
+    return description;
+}
+
+void ResamplerAudioNode::createAndConnectAUNodes()
+{
+    if (m_auNode)
+        return;
+
+    // The output converter is the node of AudioNode. The
+    // input converter is ours, and is pulled by the callback:
+    AudioNode::createAndConnectAUNodes();
+    ComponentDescription description = getAudioNodeDescription();
+    OSStatus err = noErr;
+#if MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_5
+    if (QSysInfo::MacintoshVersion >= QSysInfo::MV_10_5){
+        err = AUGraphAddNode(m_audioGraph->audioGraphRef(), &description, &m_inputNode);
+        BACKEND_ASSERT2(err == noErr, "Could not create new AUNode.", FATAL_ERROR)
+        AURenderCallbackStruct callback;
+        callback.inputProc = inputRender;
+        callback.inputProcRefCon = this;
+        err = AUGraphSetNodeInputCallback(m_audioGraph->audioGraphRef(), m_auNode, 0, &callback);
+        BACKEND_ASSERT2(err == noErr, "Could not set input callback on audio resampler.", FATAL_ERROR)
+        return;
+    }
+#endif
+    err = AUGraphNewNode(m_audioGraph->audioGraphRef(), &description, 0, 0, &m_inputNode);
+    BACKEND_ASSERT2(err == noErr, "Could not create new AUNode.", FATAL_ERROR)
+}
+
+void ResamplerAudioNode::createAudioUnits()
+{
+    if (m_audioUnit)
+        return;
+
+    AudioNode::createAudioUnits();
+    OSStatus err = AUGraphGetNodeInfo(m_audioGraph->audioGraphRef(), m_inputNode, 0, 0, 0, &m_inputUnit);
+    BACKEND_ASSERT2(err == noErr, "Could not get audio unit from audio node.", FATAL_ERROR)
+
+    // Going down in rate, the input is pulled in
+    // larger chunks than the graph asks for:
+    UInt32 maxFrames = MaxPullFrames;
+    AudioUnitSetProperty(m_inputUnit, kAudioUnitProperty_MaximumFramesPerSlice,
+        kAudioUnitScope_Global, 0, &maxFrames, sizeof(maxFrames));
+
+    bool callbackSet = false;
+#if MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_5
+    callbackSet = QSysInfo::MacintoshVersion >= QSysInfo::MV_10_5;
+#endif
+    if (!callbackSet){
+        // No node input callbacks, so set it on the unit:
+        AURenderCallbackStruct callback;
+        callback.inputProc = inputRender;
+        callback.inputProcRefCon = this;
+        err = AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_SetRenderCallback,
+            kAudioUnitScope_Input, 0, &callback, sizeof(callback));
+        BACKEND_ASSERT2(err == noErr, "Could not set input callback on audio resampler.", FATAL_ERROR)
+    }
+}
+
+void ResamplerAudioNode::setGraph(AudioGraph *audioGraph)
+{
+    if (m_audioGraph == audioGraph)
+        return;
+
+    if (m_inputNode)
+        AUGraphRemoveNode(m_audioGraph->audioGraphRef(), m_inputNode);
+    m_inputNode = 0;
+    m_inputUnit = 0;
+    AudioNode::setGraph(audioGraph);
+}
+
+AUNode ResamplerAudioNode::getInputAUNode()
+{
+    return m_inputNode;
+}
+
+bool ResamplerAudioNode::fillInStreamSpecification(AudioConnection *connection, ConnectionSide side)
+{
+    bool ok = AudioNode::fillInStreamSpecification(connection, side);
+    if (ok && side == Source && connection->m_hasSourceSpecification){
+        // What comes out is float, at the output rate and layout:
+        AudioStreamBasicDescription &format = connection->m_sourceStreamDescription;
+        Float64 sampleRate = (m_outputSampleRate > 0) ? m_outputSampleRate : format.mSampleRate;
+        format = floatFormat(sampleRate, outputChannels(format.mChannelsPerFrame));
+        if (m_outputLayoutTag){
+            free(connection->m_sourceChannelLayout);
+            connection->m_sourceChannelLayout = (AudioChannelLayout *) calloc(1, sizeof(AudioChannelLayout));
+            connection->m_sourceChannelLayout->mChannelLayoutTag = m_outputLayoutTag;
+            connection->m_sourceChannelLayoutSize = sizeof(AudioChannelLayout);
+        }
+    }
+    return ok;
+}
+
+bool ResamplerAudioNode::setStreamSpecification(AudioConnection *connection, ConnectionSide side)
+{
+    if (side == Sink){
+        // The input converter takes the source format, and makes
+        // float of it at the same rate and with the same channels:
+        if (!connection->m_hasSinkSpecification && !connection->m_hasSourceSpecification)
+            return true;
+        bool useSink = connection->m_hasSinkSpecification;
+        const AudioStreamBasicDescription &input = useSink
+            ? connection->m_sinkStreamDescription : connection->m_sourceStreamDescription;
+        AudioChannelLayout *layout = useSink ? connection->m_sinkChannelLayout : connection->m_sourceChannelLayout;
+        UInt32 layoutSize = useSink ? connection->m_sinkChannelLayoutSize : connection->m_sourceChannelLayoutSize;
+        if (input.mChannelsPerFrame == 0 || input.mChannelsPerFrame > MaxChannels
+            || outputChannels(input.mChannelsPerFrame) > MaxChannels)
+            return false;
+
+        AudioStreamBasicDescription output = floatFormat(input.mSampleRate, input.mChannelsPerFrame);
+        OSStatus err = AudioUnitSetProperty(m_inputUnit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Input, 0, &input, sizeof(input));
+        if (err == noErr)
+            err = AudioUnitSetProperty(m_inputUnit, kAudioUnitProperty_StreamFormat,
+                kAudioUnitScope_Output, 0, &output, sizeof(output));
+        if (err != noErr){
+            DEBUG_AUDIO_STREAM("ResamplerAudioNode" << int(this) << " - failed setting stream format")
+            return false;
+        }
+        AudioUnitSetProperty(m_inputUnit, kAudioUnitProperty_AudioChannelLayout, kAudioUnitScope_Input, 0, layout, layoutSize);
+        AudioUnitSetProperty(m_inputUnit, kAudioUnitProperty_AudioChannelLayout, kAudioUnitScope_Output, 0, layout, layoutSize);
+        configure(input.mSampleRate, input.mChannelsPerFrame, layoutSize ? layout : 0);
+        return true;
+    }
+
+    // The output converter passes the audio through:
+    if (!connection->m_hasSourceSpecification)
+        return true;
+    const AudioStreamBasicDescription &format = connection->m_sourceStreamDescription;
+    OSStatus err = AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_StreamFormat,
+        kAudioUnitScope_Input, 0, &format, sizeof(format));
+    if (err == noErr)
+        err = AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_StreamFormat,
+            kAudioUnitScope_Output, 0, &format, sizeof(format));
+    if (err != noErr){
+        DEBUG_AUDIO_STREAM("ResamplerAudioNode" << int(this) << " - failed setting stream format")
+        return false;
+    }
+    AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_AudioChannelLayout, kAudioUnitScope_Input,
+        0, connection->m_sourceChannelLayout, connection->m_sourceChannelLayoutSize);
+    AudioUnitSetProperty(m_audioUnit, kAudioUnitProperty_AudioChannelLayout, kAudioUnitScope_Output,
+        0, connection->m_sourceChannelLayout, connection->m_sourceChannelLayoutSize);
+    return true;
+}
+
+void ResamplerAudioNode::configure(Float64 inputSampleRate, UInt32 channels, const AudioChannelLayout *layout)
+{
+    // The filter bank and the remix matrix are computed
+    // here, and then handed over to the render thread:
+    deleteRetired();
+    Float64 outputSampleRate = (m_outputSampleRate > 0) ? m_outputSampleRate : inputSampleRate;
+    Conversion *conversion = new Conversion();
+    conversion->remix = 0;
+    UInt32 outChannels = outputChannels(channels);
+    if (m_outputLayoutTag){
+        AudioChannelLayout outputLayout;
+        memset(&outputLayout, 0, sizeof(outputLayout));
+        outputLayout.mChannelLayoutTag = m_outputLayoutTag;
+        const RemixMatrix *remix = RemixMatrix::find(channelLabels(layout, channels), channelLabels(&outputLayout, outChannels));
+        if (!remix->isIdentity()){
+            conversion->remix = remix;
+            conversion->scratch.resize(channels);
+            for (UInt32 i=0; i<channels; ++i)
+                conversion->scratch[i].resize(MaxPullFrames);
+        }
+    }
+
+    if (!conversion->resampler.configure(inputSampleRate, outputSampleRate, outChannels, quality(), MaxPullFrames)
+        || !m_pending.push(conversion)){
+        delete conversion;
+        return;
+    }
+    DEBUG_AUDIO_STREAM("ResamplerAudioNode" << int(this) << "converts" << inputSampleRate << "Hz to"
+        << outputSampleRate << "Hz, using" << conversion->resampler.phaseCount() << "phases of"
+        << conversion->resampler.tapsPerPhase() << "taps, and" << channels << "to" << outChannels << "channels")
+}
+
+void ResamplerAudioNode::deleteRetired()
+{
+    Conversion *conversion = 0;
+    while (m_retired.pop(conversion))
+        delete conversion;
+}
+
+OSStatus ResamplerAudioNode::inputRender(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp *timeStamp, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList *data)
+{
+    // Called on the render thread. Don't lock or allocate:
+    return static_cast<ResamplerAudioNode *>(userData)->render(actionFlags, timeStamp, frameCount, data);
+}
+
+OSStatus ResamplerAudioNode::pullInput(Conversion *conversion, Float64 sampleTime, int frames, float *const *destination)
+{
+    // Renders the input into destination (one buffer for each
+    // output channel), going through the scratch buffers to remix:
+    const RemixMatrix *remix = conversion->remix;
+    int channels = remix ? remix->inputChannels() : conversion->resampler.channelCount();
+    m_pullList->mNumberBuffers = channels;
+    for (int i=0; i<channels; ++i){
+        m_pullList->mBuffers[i].mNumberChannels = 1;
+        m_pullList->mBuffers[i].mDataByteSize = frames * sizeof(float);
+        m_pullList->mBuffers[i].mData = remix ? conversion->scratch[i].data() : destination[i];
+    }
+
+    AudioTimeStamp inputTime;
+    memset(&inputTime, 0, sizeof(inputTime));
+    inputTime.mFlags = kAudioTimeStampSampleTimeValid;
+    inputTime.mSampleTime = sampleTime;
+    AudioUnitRenderActionFlags flags = 0;
+    OSStatus err = AudioUnitRender(m_inputUnit, &flags, &inputTime, 0, frames, m_pullList);
+    if (err != noErr || !remix)
+        return err;
+
+    const float *input[MaxChannels];
+    for (int i=0; i<channels; ++i)
+        input[i] = static_cast<const float *>(m_pullList->mBuffers[i].mData);
+    remix->apply(input, destination, frames);
+    return noErr;
+}
+
+OSStatus ResamplerAudioNode::render(AudioUnitRenderActionFlags *actionFlags, const AudioTimeStamp *timeStamp,
+    UInt32 frameCount, AudioBufferList *data)
+{
+    // Take over the latest conversion. m_retired is at least as
+    // large as m_pending, so there is always room for the old ones:
+    Conversion *next = 0;
+    while (m_pending.pop(next)){
+        if (m_conversion)
+            m_retired.push(m_conversion);
+        m_conversion = next;
+        m_inputSampleTime = -1;
+    }
+
+    Conversion *conversion = m_conversion;
+    PolyphaseResampler *resampler = conversion ? &conversion->resampler : 0;
+    if (!resampler || !m_inputUnit || data->mNumberBuffers != UInt32(resampler->channelCount())){
+        for (UInt32 i=0; i<data->mNumberBuffers; ++i){
+            if (data->mBuffers[i].mData)
+                memset(data->mBuffers[i].mData, 0, data->mBuffers[i].mDataByteSize);
+        }
+        *actionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+        return noErr;
+    }
+
+    // The input runs on a timeline of its own, in input frames:
+    if (m_inputSampleTime < 0)
+        m_inputSampleTime = floor(timeStamp->mSampleTime * resampler->inputRate() / resampler->outputRate());
+
+    if (resampler->isPassthrough() && !conversion->remix){
+        AudioTimeStamp inputTime;
+        memset(&inputTime, 0, sizeof(inputTime));
+        inputTime.mFlags = kAudioTimeStampSampleTimeValid;
+        inputTime.mSampleTime = m_inputSampleTime;
+        m_inputSampleTime += frameCount;
+        return AudioUnitRender(m_inputUnit, actionFlags, &inputTime, 0, frameCount, data);
+    }
+
+    float *output[MaxChannels];
+    for (UInt32 i=0; i<data->mNumberBuffers; ++i){
+        output[i] = static_cast<float *>(data->mBuffers[i].mData);
+        if (!output[i])
+            return kAudioUnitErr_InvalidParameter;
+    }
+
+    if (resampler->isPassthrough()){
+        // Only the channels change:
+        if (frameCount > MaxPullFrames)
+            return kAudioUnitErr_TooManyFramesToProcess;
+        OSStatus err = pullInput(conversion, m_inputSampleTime, frameCount, output);
+        if (err != noErr)
+            return err;
+        m_inputSampleTime += frameCount;
+        for (UInt32 i=0; i<data->mNumberBuffers; ++i)
+            data->mBuffers[i].mDataByteSize = frameCount * sizeof(float);
+        return noErr;
+    }
+
+    // Going down in rate, one cycle can need more input than the
+    // resampler holds (1156 frames from 192 to 44.1 kHz take over
+    // 5000), so read what each pull makes available as we go:
+    int produced = resampler->read(output, frameCount);
+    while (produced < int(frameCount)){
+        int frames = qMin(resampler->framesNeeded(frameCount - produced), int(MaxPullFrames));
+        if (frames <= 0)
+            break;
+        float *input[MaxChannels];
+        for (UInt32 i=0; i<data->mNumberBuffers; ++i){
+            input[i] = resampler->inputBuffer(i, frames);
+            if (!input[i])
+                return kAudioUnitErr_TooManyFramesToProcess;
+        }
+        OSStatus err = pullInput(conversion, m_inputSampleTime, frames, input);
+        if (err != noErr)
+            return err;
+        resampler->commitInput(frames);
+        m_inputSampleTime += frames;
+
+        float *rest[MaxChannels];
+        for (UInt32 i=0; i<data->mNumberBuffers; ++i)
+            rest[i] = output[i] + produced;
+        produced += resampler->read(rest, frameCount - produced);
+    }
+
+    for (UInt32 i=0; i<data->mNumberBuffers; ++i){
+        data->mBuffers[i].mDataByteSize = frameCount * sizeof(float);
+        if (produced < int(frameCount))
+            memset(output[i] + produced, 0, (frameCount - produced) * sizeof(float));
+    }
+    return noErr;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,100 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_SAMPLECONVERTER_H
+#define Phonon_QT7_SAMPLECONVERTER_H
+
+#include <QtCore/QtGlobal>
+
+struct AudioStreamBasicDescription;
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Converts audio between the sample formats we meet in the audio
+        path: 16, 24 (packed) and 32 bit integers, and 32 bit floats,
+        interleaved or planar (one buffer per channel), in either byte
+        order. Everything goes through floats on the way.
+
+        The inner loops exist in a scalar version and in SSE2, AVX2 and
+        NEON versions. The best set the CPU supports is picked at run
+        time, unless PHONON_QT7_SIMD names another one (scalar, sse2,
+        avx2 or neon). All sets give the same result, bit for bit.
+    */
+    class SampleConverter
+    {
+        public:
+            enum SampleType {Int16, Int24, Int32, Float32};
+            enum KernelSet {Scalar, SSE2, AVX2, NEON, BestKernelSet};
+
+            struct Format
+            {
+                Format(SampleType type = Float32, int channels = 2, bool interleaved = false, bool bigEndian = isNativeBigEndian());
+                int bytesPerSample() const;
+                bool operator==(const Format &other) const;
+
+                SampleType type;
+                int channels;
+                bool interleaved;
+                bool bigEndian;
+            };
+
+            SampleConverter();
+            SampleConverter(const Format &source, const Format &destination);
+            void setFormats(const Format &source, const Format &destination);
+            const Format &sourceFormat() const;
+            const Format &destinationFormat() const;
+
+            // Interleaved formats use one buffer, planar
+            // formats one buffer per channel:
+            void convert(const void *const *source, void *const *destination, int frames) const;
+
+            static bool formatFromStreamDescription(const AudioStreamBasicDescription &description, Format &format);
+            static bool isNativeBigEndian();
+
+            static bool setKernelSet(KernelSet set);
+            static KernelSet kernelSet();
+            static const char *kernelSetName(KernelSet set);
+
+            // The inner loops of the current kernel set, on
+            // contiguous samples in native byte order:
+            static void int16ToFloat(const qint16 *source, float *destination, int count);
+            static void floatToInt16(const float *source, qint16 *destination, int count);
+            static void int32ToFloat(const qint32 *source, float *destination, int count);
+            static void floatToInt32(const float *source, qint32 *destination, int count);
+            static void swapBytes16(const void *source, void *destination, int count);
+            static void swapBytes32(const void *source, void *destination, int count);
+
+        private:
+            void convertChannels(const char *const *source, char *const *destination, int offset, int frames) const;
+            void decode(const char *source, float *destination, int count) const;
+            void encode(const float *source, char *destination, int count) const;
+
+            Format m_source;
+            Format m_destination;
+            bool m_copyOnly;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_SAMPLECONVERTER_H
@@ -0,0 +1,756 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sampleconverter.h"
+#include <QtCore/QByteArray>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define PHONON_QT7_SSE2
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  include <immintrin.h>
+#  define PHONON_QT7_AVX2
+#  define PHONON_QT7_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define PHONON_QT7_NEON
+#endif
+#if defined(__APPLE__)
+#  include <sys/sysctl.h>
+#  include <CoreAudio/CoreAudioTypes.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+// Floats are clamped to [-1, 1] on the way to integers. Since 2^31 is
+// not a valid 32 bit integer, the largest float below it is used as the
+// upper limit for Int32. Rounding is to nearest (even), both in the
+// scalar code (lrintf) and in the vector code (the default SSE/NEON mode):
+static const float Int16Scale = 32768.0f;
+static const float Int16Max = 32767.0f;
+static const float Int24Scale = 8388608.0f;
+static const float Int24Max = 8388607.0f;
+static const float Int32Scale = 2147483648.0f;
+static const float Int32Max = 2147483520.0f;
+
+// Number of samples converted per block on the stack:
+static const int BlockSamples = 1024;
+
+struct ConversionKernels
+{
+    void (*int16ToFloat)(const qint16 *source, float *destination, int count);
+    void (*floatToInt16)(const float *source, qint16 *destination, int count);
+    void (*int32ToFloat)(const qint32 *source, float *destination, int count);
+    void (*floatToInt32)(const float *source, qint32 *destination, int count);
+    void (*swapBytes16)(const void *source, void *destination, int count);
+    void (*swapBytes32)(const void *source, void *destination, int count);
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Scalar:
+
+static inline float clamp(float value, float low, float high)
+{
+    return value < low ? low : (value > high ? high : value);
+}
+
+static void scalarInt16ToFloat(const qint16 *source, float *destination, int count)
+{
+    for (int i=0; i<count; ++i)
+        destination[i] = float(source[i]) * (1.0f / Int16Scale);
+}
+
+static void scalarFloatToInt16(const float *source, qint16 *destination, int count)
+{
+    for (int i=0; i<count; ++i)
+        destination[i] = qint16(lrintf(clamp(source[i] * Int16Scale, -Int16Scale, Int16Max)));
+}
+
+static void scalarInt32ToFloat(const qint32 *source, float *destination, int count)
+{
+    for (int i=0; i<count; ++i)
+        destination[i] = float(source[i]) * (1.0f / Int32Scale);
+}
+
+static void scalarFloatToInt32(const float *source, qint32 *destination, int count)
+{
+    for (int i=0; i<count; ++i)
+        destination[i] = qint32(lrintf(clamp(source[i] * Int32Scale, -Int32Scale, Int32Max)));
+}
+
+static void scalarSwapBytes16(const void *source, void *destination, int count)
+{
+    const quint16 *s = static_cast<const quint16 *>(source);
+    quint16 *d = static_cast<quint16 *>(destination);
+    for (int i=0; i<count; ++i)
+        d[i] = quint16((s[i] << 8) | (s[i] >> 8));
+}
+
+static void scalarSwapBytes32(const void *source, void *destination, int count)
+{
+    const quint32 *s = static_cast<const quint32 *>(source);
+    quint32 *d = static_cast<quint32 *>(destination);
+    for (int i=0; i<count; ++i){
+        quint32 v = s[i];
+        d[i] = (v << 24) | ((v << 8) & 0x00ff0000) | ((v >> 8) & 0x0000ff00) | (v >> 24);
+    }
+}
+
+static void int24ToFloat(const char *source, float *destination, int count, bool bigEndian)
+{
+    const quint8 *s = reinterpret_cast<const quint8 *>(source);
+    for (int i=0; i<count; ++i, s += 3){
+        qint32 value = bigEndian ? ((s[0] << 16) | (s[1] << 8) | s[2]) : ((s[2] << 16) | (s[1] << 8) | s[0]);
+        value = (value ^ 0x800000) - 0x800000; // sign extend
+        destination[i] = float(value) * (1.0f / Int24Scale);
+    }
+}
+
+static void floatToInt24(const float *source, char *destination, int count, bool bigEndian)
+{
+    quint8 *d = reinterpret_cast<quint8 *>(destination);
+    for (int i=0; i<count; ++i, d += 3){
+        quint32 value = quint32(lrintf(clamp(source[i] * Int24Scale, -Int24Scale, Int24Max)));
+        d[bigEndian ? 2 : 0] = quint8(value);
+        d[1] = quint8(value >> 8);
+        d[bigEndian ? 0 : 2] = quint8(value >> 16);
+    }
+}
+
+static const ConversionKernels scalarKernels = {
+    scalarInt16ToFloat, scalarFloatToInt16, scalarInt32ToFloat,
+    scalarFloatToInt32, scalarSwapBytes16, scalarSwapBytes32
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// SSE2:
+
+#ifdef PHONON_QT7_SSE2
+static void sse2Int16ToFloat(const qint16 *source, float *destination, int count)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / Int16Scale);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(destination + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    scalarInt16ToFloat(source + i, destination + i, count - i);
+}
+
+static void sse2FloatToInt16(const float *source, qint16 *destination, int count)
+{
+    const __m128 scale = _mm_set1_ps(Int16Scale);
+    const __m128 low = _mm_set1_ps(-Int16Scale);
+    const __m128 high = _mm_set1_ps(Int16Max);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source + i), scale), low), high);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source + i + 4), scale), low), high);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), packed);
+    }
+    scalarFloatToInt16(source + i, destination + i, count - i);
+}
+
+static void sse2Int32ToFloat(const qint32 *source, float *destination, int count)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / Int32Scale);
+    int i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+        _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    scalarInt32ToFloat(source + i, destination + i, count - i);
+}
+
+static void sse2FloatToInt32(const float *source, qint32 *destination, int count)
+{
+    const __m128 scale = _mm_set1_ps(Int32Scale);
+    const __m128 low = _mm_set1_ps(-Int32Scale);
+    const __m128 high = _mm_set1_ps(Int32Max);
+    int i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source + i), scale), low), high);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm_cvtps_epi32(v));
+    }
+    scalarFloatToInt32(source + i, destination + i, count - i);
+}
+
+static void sse2SwapBytes16(const void *source, void *destination, int count)
+{
+    const quint16 *s = static_cast<const quint16 *>(source);
+    quint16 *d = static_cast<quint16 *>(destination);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), v);
+    }
+    scalarSwapBytes16(s + i, d + i, count - i);
+}
+
+static void sse2SwapBytes32(const void *source, void *destination, int count)
+{
+    const quint32 *s = static_cast<const quint32 *>(source);
+    quint32 *d = static_cast<quint32 *>(destination);
+    const __m128i mask1 = _mm_set1_epi32(0x00ff0000);
+    const __m128i mask2 = _mm_set1_epi32(0x0000ff00);
+    int i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        __m128i outer = _mm_or_si128(_mm_slli_epi32(v, 24), _mm_srli_epi32(v, 24));
+        __m128i inner = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 8), mask1), _mm_and_si128(_mm_srli_epi32(v, 8), mask2));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), _mm_or_si128(outer, inner));
+    }
+    scalarSwapBytes32(s + i, d + i, count - i);
+}
+
+static const ConversionKernels sse2Kernels = {
+    sse2Int16ToFloat, sse2FloatToInt16, sse2Int32ToFloat,
+    sse2FloatToInt32, sse2SwapBytes16, sse2SwapBytes32
+};
+#endif // PHONON_QT7_SSE2
+
+/////////////////////////////////////////////////////////////////////////////
+// AVX2 (compiled for AVX2 function by function, and only used
+// if the CPU supports it):
+
+#ifdef PHONON_QT7_AVX2
+PHONON_QT7_TARGET_AVX2 static void avx2Int16ToFloat(const qint16 *source, float *destination, int count)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / Int16Scale);
+    int i = 0;
+    for (; i + 16 <= count; i += 16){
+        __m256i low = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i)));
+        __m256i high = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i + 8)));
+        _mm256_storeu_ps(destination + i, _mm256_mul_ps(_mm256_cvtepi32_ps(low), scale));
+        _mm256_storeu_ps(destination + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), scale));
+    }
+    scalarInt16ToFloat(source + i, destination + i, count - i);
+}
+
+PHONON_QT7_TARGET_AVX2 static void avx2FloatToInt16(const float *source, qint16 *destination, int count)
+{
+    const __m256 scale = _mm256_set1_ps(Int16Scale);
+    const __m256 low = _mm256_set1_ps(-Int16Scale);
+    const __m256 high = _mm256_set1_ps(Int16Max);
+    int i = 0;
+    for (; i + 16 <= count; i += 16){
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i), scale), low), high);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i + 8), scale), low), high);
+        // Packing works within 128 bit lanes, so put the quarters back in order:
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i), packed);
+    }
+    scalarFloatToInt16(source + i, destination + i, count - i);
+}
+
+PHONON_QT7_TARGET_AVX2 static void avx2Int32ToFloat(const qint32 *source, float *destination, int count)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / Int32Scale);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+        _mm256_storeu_ps(destination + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    scalarInt32ToFloat(source + i, destination + i, count - i);
+}
+
+PHONON_QT7_TARGET_AVX2 static void avx2FloatToInt32(const float *source, qint32 *destination, int count)
+{
+    const __m256 scale = _mm256_set1_ps(Int32Scale);
+    const __m256 low = _mm256_set1_ps(-Int32Scale);
+    const __m256 high = _mm256_set1_ps(Int32Max);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(source + i), scale), low), high);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i), _mm256_cvtps_epi32(v));
+    }
+    scalarFloatToInt32(source + i, destination + i, count - i);
+}
+
+PHONON_QT7_TARGET_AVX2 static void avx2SwapBytes16(const void *source, void *destination, int count)
+{
+    const quint16 *s = static_cast<const quint16 *>(source);
+    quint16 *d = static_cast<quint16 *>(destination);
+    const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                           1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    int i = 0;
+    for (; i + 16 <= count; i += 16){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), _mm256_shuffle_epi8(v, order));
+    }
+    scalarSwapBytes16(s + i, d + i, count - i);
+}
+
+PHONON_QT7_TARGET_AVX2 static void avx2SwapBytes32(const void *source, void *destination, int count)
+{
+    const quint32 *s = static_cast<const quint32 *>(source);
+    quint32 *d = static_cast<quint32 *>(destination);
+    const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), _mm256_shuffle_epi8(v, order));
+    }
+    scalarSwapBytes32(s + i, d + i, count - i);
+}
+
+static const ConversionKernels avx2Kernels = {
+    avx2Int16ToFloat, avx2FloatToInt16, avx2Int32ToFloat,
+    avx2FloatToInt32, avx2SwapBytes16, avx2SwapBytes32
+};
+#endif // PHONON_QT7_AVX2
+
+/////////////////////////////////////////////////////////////////////////////
+// NEON (rounding float to integer needs ARMv8, so
+// 32 bit ARM uses the scalar code for that):
+
+#ifdef PHONON_QT7_NEON
+static void neonInt16ToFloat(const qint16 *source, float *destination, int count)
+{
+    const float scale = 1.0f / Int16Scale;
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        int16x8_t v = vld1q_s16(source + i);
+        vst1q_f32(destination + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(destination + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    }
+    scalarInt16ToFloat(source + i, destination + i, count - i);
+}
+
+static void neonInt32ToFloat(const qint32 *source, float *destination, int count)
+{
+    const float scale = 1.0f / Int32Scale;
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(destination + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(source + i)), scale));
+    scalarInt32ToFloat(source + i, destination + i, count - i);
+}
+
+#ifdef __aarch64__
+static void neonFloatToInt16(const float *source, qint16 *destination, int count)
+{
+    const float32x4_t low = vdupq_n_f32(-Int16Scale);
+    const float32x4_t high = vdupq_n_f32(Int16Max);
+    int i = 0;
+    for (; i + 8 <= count; i += 8){
+        float32x4_t a = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(source + i), Int16Scale), low), high);
+        float32x4_t b = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(source + i + 4), Int16Scale), low), high);
+        vst1q_s16(destination + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b))));
+    }
+    scalarFloatToInt16(source + i, destination + i, count - i);
+}
+
+static void neonFloatToInt32(const float *source, qint32 *destination, int count)
+{
+    const float32x4_t low = vdupq_n_f32(-Int32Scale);
+    const float32x4_t high = vdupq_n_f32(Int32Max);
+    int i = 0;
+    for (; i + 4 <= count; i += 4){
+        float32x4_t v = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(source + i), Int32Scale), low), high);
+        vst1q_s32(destination + i, vcvtnq_s32_f32(v));
+    }
+    scalarFloatToInt32(source + i, destination + i, count - i);
+}
+#else
+#  define neonFloatToInt16 scalarFloatToInt16
+#  define neonFloatToInt32 scalarFloatToInt32
+#endif
+
+static void neonSwapBytes16(const void *source, void *destination, int count)
+{
+    const quint8 *s = static_cast<const quint8 *>(source);
+    quint8 *d = static_cast<quint8 *>(destination);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        vst1q_u8(d + 2 * i, vrev16q_u8(vld1q_u8(s + 2 * i)));
+    scalarSwapBytes16(s + 2 * i, d + 2 * i, count - i);
+}
+
+static void neonSwapBytes32(const void *source, void *destination, int count)
+{
+    const quint8 *s = static_cast<const quint8 *>(source);
+    quint8 *d = static_cast<quint8 *>(destination);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_u8(d + 4 * i, vrev32q_u8(vld1q_u8(s + 4 * i)));
+    scalarSwapBytes32(s + 4 * i, d + 4 * i, count - i);
+}
+
+static const ConversionKernels neonKernels = {
+    neonInt16ToFloat, neonFloatToInt16, neonInt32ToFloat,
+    neonFloatToInt32, neonSwapBytes16, neonSwapBytes32
+};
+#endif // PHONON_QT7_NEON
+
+/////////////////////////////////////////////////////////////////////////////
+// Dispatch:
+
+static bool cpuHasAvx2()
+{
+#if !defined(PHONON_QT7_AVX2)
+    return false;
+#elif defined(__APPLE__)
+    int value = 0;
+    size_t size = sizeof(value);
+    return sysctlbyname("hw.optional.avx2_0", &value, &size, 0, 0) == 0 && value != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static const ConversionKernels *kernelsFor(SampleConverter::KernelSet set)
+{
+    switch (set){
+    case SampleConverter::Scalar:
+        return &scalarKernels;
+#ifdef PHONON_QT7_SSE2
+    case SampleConverter::SSE2:
+        return &sse2Kernels;
+#endif
+#ifdef PHONON_QT7_AVX2
+    case SampleConverter::AVX2:
+        return cpuHasAvx2() ? &avx2Kernels : 0;
+#endif
+#ifdef PHONON_QT7_NEON
+    case SampleConverter::NEON:
+        return &neonKernels;
+#endif
+    case SampleConverter::BestKernelSet:
+        if (kernelsFor(SampleConverter::AVX2))
+            return kernelsFor(SampleConverter::AVX2);
+        if (kernelsFor(SampleConverter::SSE2))
+            return kernelsFor(SampleConverter::SSE2);
+        if (kernelsFor(SampleConverter::NEON))
+            return kernelsFor(SampleConverter::NEON);
+        return &scalarKernels;
+    default:
+        return 0;
+    }
+}
+
+// Picking the kernels is idempotent, so a race
+// on first use does no harm:
+static const ConversionKernels *gKernels = 0;
+static SampleConverter::KernelSet gKernelSet = SampleConverter::Scalar;
+
+static const ConversionKernels &kernels()
+{
+    if (!gKernels){
+        QByteArray requested = qgetenv("PHONON_QT7_SIMD").toLower();
+        for (int set = SampleConverter::Scalar; set < SampleConverter::BestKernelSet; ++set){
+            if (requested == SampleConverter::kernelSetName(SampleConverter::KernelSet(set))
+                && SampleConverter::setKernelSet(SampleConverter::KernelSet(set)))
+                return *gKernels;
+        }
+        SampleConverter::setKernelSet(SampleConverter::BestKernelSet);
+    }
+    return *gKernels;
+}
+
+bool SampleConverter::setKernelSet(KernelSet set)
+{
+    // Returns false if the set is not supported here:
+    const ConversionKernels *k = kernelsFor(set);
+    if (!k)
+        return false;
+    if (set == BestKernelSet){
+        for (int s = Scalar; s < BestKernelSet; ++s){
+            if (kernelsFor(KernelSet(s)) == k)
+                set = KernelSet(s);
+        }
+    }
+    gKernelSet = set;
+    gKernels = k;
+    return true;
+}
+
+SampleConverter::KernelSet SampleConverter::kernelSet()
+{
+    kernels();
+    return gKernelSet;
+}
+
+const char *SampleConverter::kernelSetName(KernelSet set)
+{
+    switch (set){
+    case Scalar: return "scalar";
+    case SSE2: return "sse2";
+    case AVX2: return "avx2";
+    case NEON: return "neon";
+    default: return "best";
+    }
+}
+
+void SampleConverter::int16ToFloat(const qint16 *source, float *destination, int count)
+{
+    kernels().int16ToFloat(source, destination, count);
+}
+
+void SampleConverter::floatToInt16(const float *source, qint16 *destination, int count)
+{
+    kernels().floatToInt16(source, destination, count);
+}
+
+void SampleConverter::int32ToFloat(const qint32 *source, float *destination, int count)
+{
+    kernels().int32ToFloat(source, destination, count);
+}
+
+void SampleConverter::floatToInt32(const float *source, qint32 *destination, int count)
+{
+    kernels().floatToInt32(source, destination, count);
+}
+
+void SampleConverter::swapBytes16(const void *source, void *destination, int count)
+{
+    kernels().swapBytes16(source, destination, count);
+}
+
+void SampleConverter::swapBytes32(const void *source, void *destination, int count)
+{
+    kernels().swapBytes32(source, destination, count);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Formats:
+
+SampleConverter::Format::Format(SampleType t, int c, bool i, bool b)
+    : type(t), channels(c), interleaved(i), bigEndian(b)
+{
+}
+
+int SampleConverter::Format::bytesPerSample() const
+{
+    switch (type){
+    case Int16: return 2;
+    case Int24: return 3;
+    default: return 4;
+    }
+}
+
+bool SampleConverter::Format::operator==(const Format &other) const
+{
+    // One channel is the same interleaved or not, and
+    // byte order does not matter for single bytes:
+    return type == other.type && channels == other.channels
+        && (interleaved == other.interleaved || channels == 1)
+        && bigEndian == other.bigEndian;
+}
+
+bool SampleConverter::isNativeBigEndian()
+{
+    return QSysInfo::ByteOrder == QSysInfo::BigEndian;
+}
+
+#if defined(__APPLE__)
+bool SampleConverter::formatFromStreamDescription(const AudioStreamBasicDescription &description, Format &format)
+{
+    // Returns false for formats we cannot convert:
+    if (description.mFormatID != kAudioFormatLinearPCM || description.mChannelsPerFrame == 0)
+        return false;
+    UInt32 flags = description.mFormatFlags;
+    format.channels = description.mChannelsPerFrame;
+    format.interleaved = !(flags & kAudioFormatFlagIsNonInterleaved);
+    format.bigEndian = (flags & kAudioFormatFlagIsBigEndian);
+
+    // Samples must fill their bytes (e.g. no 24 bits in 32):
+    int bytesPerSample = format.interleaved
+        ? description.mBytesPerFrame / description.mChannelsPerFrame : description.mBytesPerFrame;
+    if (description.mBitsPerChannel != UInt32(bytesPerSample * 8))
+        return false;
+    if (flags & kAudioFormatFlagIsFloat){
+        format.type = Float32;
+        return description.mBitsPerChannel == 32;
+    }
+    if (!(flags & kAudioFormatFlagIsSignedInteger))
+        return false;
+    switch (description.mBitsPerChannel){
+    case 16: format.type = Int16; return true;
+    case 24: format.type = Int24; return true;
+    case 32: format.type = Int32; return true;
+    default: return false;
+    }
+}
+#endif // __APPLE__
+
+/////////////////////////////////////////////////////////////////////////////
+// Conversion:
+
+SampleConverter::SampleConverter()
+{
+    setFormats(Format(), Format());
+}
+
+SampleConverter::SampleConverter(const Format &source, const Format &destination)
+{
+    setFormats(source, destination);
+}
+
+void SampleConverter::setFormats(const Format &source, const Format &destination)
+{
+    Q_ASSERT(source.channels == destination.channels);
+    Q_ASSERT(source.channels <= BlockSamples);
+    m_source = source;
+    m_destination = destination;
+    m_copyOnly = (source == destination);
+}
+
+const SampleConverter::Format &SampleConverter::sourceFormat() const
+{
+    return m_source;
+}
+
+const SampleConverter::Format &SampleConverter::destinationFormat() const
+{
+    return m_destination;
+}
+
+void SampleConverter::convert(const void *const *source, void *const *destination, int frames) const
+{
+    const char *const *s = reinterpret_cast<const char *const *>(source);
+    char *const *d = reinterpret_cast<char *const *>(destination);
+    if (m_copyOnly){
+        int buffers = m_source.interleaved ? 1 : m_source.channels;
+        int size = frames * m_source.bytesPerSample() * (m_source.interleaved ? m_source.channels : 1);
+        for (int i=0; i<buffers; ++i)
+            memcpy(d[i], s[i], size);
+        return;
+    }
+
+    // Work in blocks that fit in the buffers on the stack:
+    bool interleaved = m_source.interleaved || m_destination.interleaved;
+    int blockFrames = interleaved ? BlockSamples / m_source.channels : BlockSamples;
+    for (int offset = 0; offset < frames; offset += blockFrames)
+        convertChannels(s, d, offset, qMin(blockFrames, frames - offset));
+}
+
+void SampleConverter::convertChannels(const char *const *source, char *const *destination, int offset, int frames) const
+{
+    float samples[BlockSamples];
+    float channel[BlockSamples];
+    int channels = m_source.channels;
+    int sourceBytes = m_source.bytesPerSample();
+    int destinationBytes = m_destination.bytesPerSample();
+
+    if (m_source.interleaved && m_destination.interleaved){
+        decode(source[0] + offset * channels * sourceBytes, samples, frames * channels);
+        encode(samples, destination[0] + offset * channels * destinationBytes, frames * channels);
+    } else if (!m_source.interleaved && !m_destination.interleaved){
+        for (int c=0; c<channels; ++c){
+            decode(source[c] + offset * sourceBytes, samples, frames);
+            encode(samples, destination[c] + offset * destinationBytes, frames);
+        }
+    } else if (m_source.interleaved){
+        decode(source[0] + offset * channels * sourceBytes, samples, frames * channels);
+        for (int c=0; c<channels; ++c){
+            for (int i=0; i<frames; ++i)
+                channel[i] = samples[i * channels + c];
+            encode(channel, destination[c] + offset * destinationBytes, frames);
+        }
+    } else {
+        for (int c=0; c<channels; ++c){
+            decode(source[c] + offset * sourceBytes, channel, frames);
+            for (int i=0; i<frames; ++i)
+                samples[i * channels + c] = channel[i];
+        }
+        encode(samples, destination[0] + offset * channels * destinationBytes, frames * channels);
+    }
+}
+
+void SampleConverter::decode(const char *source, float *destination, int count) const
+{
+    // Integers in the other byte order are swapped
+    // into a scratch buffer before converting:
+    const ConversionKernels &k = kernels();
+    bool swap = (m_source.bigEndian != isNativeBigEndian());
+    quint32 scratch[BlockSamples];
+    switch (m_source.type){
+    case Int16:
+        if (swap){
+            k.swapBytes16(source, scratch, count);
+            source = reinterpret_cast<const char *>(scratch);
+        }
+        k.int16ToFloat(reinterpret_cast<const qint16 *>(source), destination, count);
+        break;
+    case Int24:
+        int24ToFloat(source, destination, count, m_source.bigEndian);
+        break;
+    case Int32:
+        if (swap){
+            k.swapBytes32(source, scratch, count);
+            source = reinterpret_cast<const char *>(scratch);
+        }
+        k.int32ToFloat(reinterpret_cast<const qint32 *>(source), destination, count);
+        break;
+    case Float32:
+        if (swap)
+            k.swapBytes32(source, destination, count);
+        else
+            memcpy(destination, source, count * sizeof(float));
+        break;
+    }
+}
+
+void SampleConverter::encode(const float *source, char *destination, int count) const
+{
+    // Integers in the other byte order are
+    // swapped in place after converting:
+    const ConversionKernels &k = kernels();
+    bool swap = (m_destination.bigEndian != isNativeBigEndian());
+    switch (m_destination.type){
+    case Int16:
+        k.floatToInt16(source, reinterpret_cast<qint16 *>(destination), count);
+        if (swap)
+            k.swapBytes16(destination, destination, count);
+        break;
+    case Int24:
+        floatToInt24(source, destination, count, m_destination.bigEndian);
+        break;
+    case Int32:
+        k.floatToInt32(source, reinterpret_cast<qint32 *>(destination), count);
+        if (swap)
+            k.swapBytes32(destination, destination, count);
+        break;
+    case Float32:
+        if (swap)
+            k.swapBytes32(source, destination, count);
+        else
+            memcpy(destination, source, count * sizeof(float));
+        break;
+    }
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
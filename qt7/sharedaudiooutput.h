@@ -0,0 +1,105 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_SHAREDAUDIOOUTPUT_H
+#define Phonon_QT7_SHAREDAUDIOOUTPUT_H
+
+#include <AudioToolbox/AudioToolbox.h>
+#include <AudioUnit/AudioUnit.h>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QVector>
+#include <QtCore/QList>
+#include <QtCore/QHash>
+#include "backendheader.h"
+#include "parameterqueue.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        One device stream for the whole process. Instead of opening
+        their own output unit, audio outputs (with
+        PHONON_QT7_SHARED_OUTPUT=1) end their graph in a generic output
+        unit, and attach it to a bus on the mixer in here. The mixer
+        pulls audio from all attached units on the one render thread
+        of the shared device stream. Busses are handed out and taken
+        back as outputs come and go, and the mixer grows when needed.
+    */
+    class SharedAudioOutput
+    {
+        public:
+            static bool isEnabled();
+            static SharedAudioOutput *instance();
+            static SharedAudioOutput *existingInstance();
+
+            bool attach(AudioUnit unit, AUGraph graph);
+            void release(AudioUnit unit);
+            void releaseGraph(AUGraph graph);
+            void setActive(AudioUnit unit, bool active);
+            void setVolume(AudioUnit unit, float volume);
+            bool setAudioDevice(AudioDeviceID device);
+
+            AudioStreamBasicDescription streamFormat() const;
+            int busCount() const;
+            int attachedCount() const;
+
+        private:
+            struct Bus
+            {
+                AudioUnit volatile unit;
+                AUGraph graph;
+                QAtomicInt active;
+                QAtomicInt rendering;
+            };
+
+            SharedAudioOutput();
+            ~SharedAudioOutput();
+
+            bool openGraph();
+            void closeGraph();
+            bool setBusCount(int count);
+            void releaseBus(int bus);
+            void startOrStop();
+
+            static OSStatus mixerNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+            static OSStatus renderBus(void *userData, AudioUnitRenderActionFlags *actionFlags,
+                const AudioTimeStamp *timeStamp, UInt32 busNumber, UInt32 frameCount, AudioBufferList *data);
+
+            AUGraph m_graph;
+            AUNode m_mixerNode;
+            AUNode m_outputNode;
+            AudioUnit m_mixerUnit;
+            AudioUnit m_outputUnit;
+            AudioStreamBasicDescription m_streamFormat;
+            QVector<Bus *> m_busses;
+            QList<int> m_freeBusses;
+            QHash<AudioUnit, int> m_busForUnit;
+            ParameterQueue m_parameterQueue;
+            AudioDeviceID m_audioDevice;
+            int m_maxBusCount;
+            bool m_running;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_SHAREDAUDIOOUTPUT_H
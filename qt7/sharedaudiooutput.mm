@@ -0,0 +1,392 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sharedaudiooutput.h"
+#include "audiodevice.h"
+#include "audionode.h"
+#include <unistd.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+static SharedAudioOutput *sharedAudioOutput = 0;
+
+bool SharedAudioOutput::isEnabled()
+{
+    static int enabled = -1;
+    if (enabled == -1)
+        enabled = (qgetenv("PHONON_QT7_SHARED_OUTPUT") == "1") ? 1 : 0;
+    return enabled == 1;
+}
+
+SharedAudioOutput *SharedAudioOutput::instance()
+{
+    if (!sharedAudioOutput)
+        sharedAudioOutput = new SharedAudioOutput();
+    return sharedAudioOutput;
+}
+
+SharedAudioOutput *SharedAudioOutput::existingInstance()
+{
+    return sharedAudioOutput;
+}
+
+SharedAudioOutput::SharedAudioOutput()
+{
+    m_graph = 0;
+    m_mixerNode = 0;
+    m_outputNode = 0;
+    m_mixerUnit = 0;
+    m_outputUnit = 0;
+    m_audioDevice = 0;
+    m_running = false;
+
+    m_maxBusCount = 1024;
+    QByteArray maxBusses = qgetenv("PHONON_QT7_SHARED_OUTPUT_BUSSES");
+    if (!maxBusses.isEmpty() && maxBusses.toInt() > 0)
+        m_maxBusCount = maxBusses.toInt();
+
+    // The format the mixer works in. The sample rate is
+    // changed to match the device when the graph opens:
+    m_streamFormat.mSampleRate = 44100;
+    m_streamFormat.mFormatID = kAudioFormatLinearPCM;
+    m_streamFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+    m_streamFormat.mBytesPerPacket = sizeof(Float32);
+    m_streamFormat.mFramesPerPacket = 1;
+    m_streamFormat.mBytesPerFrame = sizeof(Float32);
+    m_streamFormat.mChannelsPerFrame = 2;
+    m_streamFormat.mBitsPerChannel = 32;
+    m_streamFormat.mReserved = 0;
+}
+
+SharedAudioOutput::~SharedAudioOutput()
+{
+    closeGraph();
+    qDeleteAll(m_busses);
+}
+
+bool SharedAudioOutput::openGraph()
+{
+    OSStatus err = NewAUGraph(&m_graph);
+    BACKEND_ASSERT3(err == noErr, "Could not create shared audio graph.", NORMAL_ERROR, false)
+
+    ComponentDescription mixerDescription;
+    mixerDescription.componentType = kAudioUnitType_Mixer;
+    mixerDescription.componentSubType = kAudioUnitSubType_StereoMixer;
+    mixerDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
+    mixerDescription.componentFlags = 0;
+    mixerDescription.componentFlagsMask = 0;
+
+    ComponentDescription outputDescription = mixerDescription;
+    outputDescription.componentType = kAudioUnitType_Output;
+    outputDescription.componentSubType = kAudioUnitSubType_DefaultOutput;
+
+#if MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_5
+    if (QSysInfo::MacintoshVersion >= QSysInfo::MV_10_5){
+        err = AUGraphAddNode(m_graph, &mixerDescription, &m_mixerNode);
+        if (err == noErr)
+            err = AUGraphAddNode(m_graph, &outputDescription, &m_outputNode);
+    } else
+#endif
+    {
+        err = AUGraphNewNode(m_graph, &mixerDescription, 0, 0, &m_mixerNode);
+        if (err == noErr)
+            err = AUGraphNewNode(m_graph, &outputDescription, 0, 0, &m_outputNode);
+    }
+    BACKEND_ASSERT3(err == noErr, "Could not create nodes in shared audio graph.", NORMAL_ERROR, false)
+
+    err = AUGraphConnectNodeInput(m_graph, m_mixerNode, 0, m_outputNode, 0);
+    BACKEND_ASSERT3(err == noErr, "Could not connect nodes in shared audio graph.", NORMAL_ERROR, false)
+    err = AUGraphOpen(m_graph);
+    BACKEND_ASSERT3(err == noErr, "Could not open shared audio graph.", NORMAL_ERROR, false)
+    AUGraphGetNodeInfo(m_graph, m_mixerNode, 0, 0, 0, &m_mixerUnit);
+    AUGraphGetNodeInfo(m_graph, m_outputNode, 0, 0, 0, &m_outputUnit);
+    err = AudioUnitAddRenderNotify(m_mixerUnit, mixerNotification, this);
+    BACKEND_ASSERT3(err == noErr, "Could not add render notification to shared audio mixer.", NORMAL_ERROR, false)
+
+    if (m_audioDevice)
+        AudioDevice::setDevice(m_outputUnit, m_audioDevice, AudioDevice::Out);
+
+    // Mix at the rate of the device, so that
+    // the output unit does not need to convert:
+    AudioStreamBasicDescription deviceFormat;
+    UInt32 size = sizeof(deviceFormat);
+    err = AudioUnitGetProperty(m_outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &deviceFormat, &size);
+    if (err == noErr && deviceFormat.mSampleRate > 0)
+        m_streamFormat.mSampleRate = deviceFormat.mSampleRate;
+
+    err = AudioUnitSetProperty(m_mixerUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output,
+        0, &m_streamFormat, sizeof(m_streamFormat));
+    BACKEND_ASSERT3(err == noErr, "Could not set stream format on shared audio mixer.", NORMAL_ERROR, false)
+    err = AudioUnitSetProperty(m_outputUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input,
+        0, &m_streamFormat, sizeof(m_streamFormat));
+    BACKEND_ASSERT3(err == noErr, "Could not set stream format on shared audio output.", NORMAL_ERROR, false)
+
+    if (!setBusCount(qMax(m_busses.size(), qMin(32, m_maxBusCount))))
+        return false;
+
+    err = AUGraphInitialize(m_graph);
+    BACKEND_ASSERT3(err == noErr, "Could not initialize shared audio graph.", NORMAL_ERROR, false)
+    DEBUG_AUDIO_GRAPH("Shared audio output opened with" << m_busses.size() << "busses")
+    return true;
+}
+
+void SharedAudioOutput::closeGraph()
+{
+    if (!m_graph)
+        return;
+    AUGraphStop(m_graph);
+    AUGraphUninitialize(m_graph);
+    AUGraphClose(m_graph);
+    DisposeAUGraph(m_graph);
+    m_graph = 0;
+    m_mixerUnit = 0;
+    m_outputUnit = 0;
+    m_running = false;
+}
+
+bool SharedAudioOutput::setBusCount(int count)
+{
+    // Only call this while the graph is uninitialized. The busses
+    // are allocated one by one, since the render callbacks keep
+    // pointers to them:
+    while (m_busses.size() < count){
+        Bus *bus = new Bus;
+        bus->unit = 0;
+        bus->graph = 0;
+        m_freeBusses.append(m_busses.size());
+        m_busses.append(bus);
+    }
+
+    UInt32 busCount = m_busses.size();
+    OSStatus err = AudioUnitSetProperty(m_mixerUnit, kAudioUnitProperty_BusCount, kAudioUnitScope_Input,
+        0, &busCount, sizeof(busCount));
+    BACKEND_ASSERT3(err == noErr, "Could not set number of busses on shared audio mixer.", NORMAL_ERROR, false)
+
+    for (int i=0; i<m_busses.size(); ++i){
+        err = AudioUnitSetProperty(m_mixerUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input,
+            i, &m_streamFormat, sizeof(m_streamFormat));
+        BACKEND_ASSERT3(err == noErr, "Could not set stream format on shared audio mixer bus.", NORMAL_ERROR, false)
+        AURenderCallbackStruct callback;
+        callback.inputProc = renderBus;
+        callback.inputProcRefCon = m_busses[i];
+        err = AudioUnitSetProperty(m_mixerUnit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input,
+            i, &callback, sizeof(callback));
+        BACKEND_ASSERT3(err == noErr, "Could not set render callback on shared audio mixer bus.", NORMAL_ERROR, false)
+    }
+    return true;
+}
+
+bool SharedAudioOutput::attach(AudioUnit unit, AUGraph graph)
+{
+    if (m_busForUnit.contains(unit))
+        return true;
+    if (!m_graph && !openGraph()){
+        closeGraph();
+        return false;
+    }
+
+    if (m_freeBusses.isEmpty()){
+        int count = qMin(m_busses.size() * 2, m_maxBusCount);
+        if (count <= m_busses.size())
+            return false;
+        // The mixer can only change its bus count while uninitialized.
+        // Stopping the graph also means nobody is rendering now:
+        AUGraphStop(m_graph);
+        m_running = false;
+        AUGraphUninitialize(m_graph);
+        bool ok = setBusCount(count);
+        OSStatus err = AUGraphInitialize(m_graph);
+        startOrStop();
+        BACKEND_ASSERT3(ok && err == noErr, "Could not add busses to shared audio mixer.", NORMAL_ERROR, false)
+        DEBUG_AUDIO_GRAPH("Shared audio output grew to" << m_busses.size() << "busses")
+    }
+
+    int busIndex = m_freeBusses.takeFirst();
+    Bus *bus = m_busses[busIndex];
+    bus->graph = graph;
+    bus->active = 0;
+    bus->unit = unit;
+    m_busForUnit.insert(unit, busIndex);
+    AudioUnitSetParameter(m_mixerUnit, kStereoMixerParam_Volume, kAudioUnitScope_Input, busIndex, 1, 0);
+    return true;
+}
+
+void SharedAudioOutput::releaseBus(int busIndex)
+{
+    Bus *bus = m_busses[busIndex];
+    m_busForUnit.remove(bus->unit);
+    bus->unit = 0;
+    bus->graph = 0;
+    bus->active.fetchAndStoreOrdered(0);
+    // The render thread might be inside the unit we just took
+    // away. Since the caller is about to dispose it, wait:
+    while (int(bus->rendering) != 0)
+        usleep(100);
+    m_freeBusses.append(busIndex);
+    startOrStop();
+}
+
+void SharedAudioOutput::release(AudioUnit unit)
+{
+    QHash<AudioUnit, int>::const_iterator it = m_busForUnit.constFind(unit);
+    if (it != m_busForUnit.constEnd())
+        releaseBus(it.value());
+}
+
+void SharedAudioOutput::releaseGraph(AUGraph graph)
+{
+    for (int i=0; i<m_busses.size(); ++i){
+        if (m_busses[i]->unit && m_busses[i]->graph == graph)
+            releaseBus(i);
+    }
+}
+
+void SharedAudioOutput::setActive(AudioUnit unit, bool active)
+{
+    QHash<AudioUnit, int>::const_iterator it = m_busForUnit.constFind(unit);
+    if (it == m_busForUnit.constEnd())
+        return;
+    m_busses[it.value()]->active = active ? 1 : 0;
+    startOrStop();
+}
+
+void SharedAudioOutput::setVolume(AudioUnit unit, float volume)
+{
+    QHash<AudioUnit, int>::const_iterator it = m_busForUnit.constFind(unit);
+    if (it == m_busForUnit.constEnd() || !m_mixerUnit)
+        return;
+
+    // Let the render thread apply it, unless it is not running:
+    ParameterCommand command;
+    command.parameter = kStereoMixerParam_Volume;
+    command.scope = kAudioUnitScope_Input;
+    command.element = it.value();
+    command.value = volume;
+    command.sampleTime = -1;
+    command.rampFrames = UInt32(AudioNode::VolumeRampMilliseconds * m_streamFormat.mSampleRate / 1000);
+    command.from = volume;
+    AudioUnitGetParameter(m_mixerUnit, kStereoMixerParam_Volume, kAudioUnitScope_Input, it.value(), &command.from);
+    if (m_running){
+        // A command that does not fit is kept, and posted
+        // after those still queued, so it cannot lose to them:
+        m_parameterQueue.send(command);
+        return;
+    }
+
+    // Let what is still queued take effect first:
+    AudioUnitParameterTarget target(m_mixerUnit);
+    m_parameterQueue.flush(&target);
+    OSStatus err = AudioUnitSetParameter(m_mixerUnit, kStereoMixerParam_Volume, kAudioUnitScope_Input, it.value(), volume, 0);
+    BACKEND_ASSERT2(err == noErr, "Could not set volume on shared audio mixer bus.", NORMAL_ERROR)
+}
+
+bool SharedAudioOutput::setAudioDevice(AudioDeviceID device)
+{
+    // All outputs share the device stream, so this
+    // moves every attached output to the new device:
+    m_audioDevice = device;
+    if (!m_outputUnit || !device)
+        return true;
+    return AudioDevice::setDevice(m_outputUnit, device, AudioDevice::Out);
+}
+
+void SharedAudioOutput::startOrStop()
+{
+    // Keep the device stream running only while
+    // at least one of the attached outputs plays:
+    if (!m_graph)
+        return;
+    bool active = false;
+    for (int i=0; i<m_busses.size() && !active; ++i)
+        active = m_busses[i]->unit && int(m_busses[i]->active);
+
+    if (active && !m_running){
+        OSStatus err = AUGraphStart(m_graph);
+        m_running = (err == noErr);
+        DEBUG_AUDIO_GRAPH("Shared audio output" << (m_running ? "started" : "could not start"))
+    } else if (!active && m_running){
+        AUGraphStop(m_graph);
+        m_running = false;
+        DEBUG_AUDIO_GRAPH("Shared audio output stopped")
+    }
+
+    // Volume changes that did not fit in the queue:
+    if (m_running)
+        m_parameterQueue.repost();
+    else if (m_mixerUnit){
+        AudioUnitParameterTarget target(m_mixerUnit);
+        m_parameterQueue.flush(&target);
+    }
+}
+
+AudioStreamBasicDescription SharedAudioOutput::streamFormat() const
+{
+    return m_streamFormat;
+}
+
+int SharedAudioOutput::busCount() const
+{
+    return m_busses.size();
+}
+
+int SharedAudioOutput::attachedCount() const
+{
+    return m_busForUnit.size();
+}
+
+OSStatus SharedAudioOutput::mixerNotification(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp *timeStamp, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList */*data*/)
+{
+    // Called on the render thread before the mixer renders:
+    if (!(*actionFlags & kAudioUnitRenderAction_PreRender))
+        return noErr;
+    SharedAudioOutput *output = static_cast<SharedAudioOutput *>(userData);
+    AudioUnitParameterTarget target(output->m_mixerUnit);
+    output->m_parameterQueue.process(&target, timeStamp->mSampleTime, frameCount);
+    return noErr;
+}
+
+OSStatus SharedAudioOutput::renderBus(void *userData, AudioUnitRenderActionFlags *actionFlags,
+    const AudioTimeStamp *timeStamp, UInt32 /*busNumber*/, UInt32 frameCount, AudioBufferList *data)
+{
+    // Called on the render thread of the shared device stream. Pull
+    // the audio from the generic output unit that ends the graph of
+    // the attached output, or play silence if it is not playing:
+    Bus *bus = static_cast<Bus *>(userData);
+    bus->rendering.ref();
+    AudioUnit unit = bus->unit;
+    OSStatus err = -1;
+    if (unit && int(bus->active))
+        err = AudioUnitRender(unit, actionFlags, timeStamp, 0, frameCount, data);
+    bus->rendering.deref();
+
+    if (err != noErr){
+        for (UInt32 i=0; i<data->mNumberBuffers; ++i)
+            memset(data->mBuffers[i].mData, 0, data->mBuffers[i].mDataByteSize);
+        *actionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+    }
+    return noErr;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
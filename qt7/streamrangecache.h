@@ -0,0 +1,73 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_STREAMRANGECACHE_H
+#define Phonon_QT7_STREAMRANGECACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMap>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Keeps blocks of stream data that has already been read, indexed on
+        their offset in the stream. This lets a stream reader serve data
+        it has seen before without asking the stream to seek back. When
+        the total size exceeds the budget, the least recently used blocks
+        are released.
+    */
+    class StreamRangeCache
+    {
+        public:
+            StreamRangeCache(int maxSize);
+            virtual ~StreamRangeCache();
+
+            void insert(qint64 offset, const QByteArray &data);
+            int read(qint64 offset, int size, char *data);
+            void clear();
+
+            void setMaxSize(int maxSize);
+            int maxSize() const;
+            int size() const;
+
+        private:
+            struct Range {
+                QByteArray data;
+                quint64 lastUsed;
+            };
+
+            QMap<qint64, Range> m_ranges;
+            QMap<quint64, qint64> m_usage;
+            quint64 m_useCounter;
+            int m_maxSize;
+            int m_size;
+
+            QMap<qint64, Range>::iterator rangeAt(qint64 offset);
+            void touch(QMap<qint64, Range>::iterator it);
+            void remove(QMap<qint64, Range>::iterator it);
+            void evict();
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_STREAMRANGECACHE_H
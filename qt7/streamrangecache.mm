@@ -0,0 +1,148 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "streamrangecache.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+StreamRangeCache::StreamRangeCache(int maxSize)
+{
+    m_useCounter = 0;
+    m_maxSize = maxSize;
+    m_size = 0;
+}
+
+StreamRangeCache::~StreamRangeCache()
+{
+}
+
+void StreamRangeCache::insert(qint64 offset, const QByteArray &data)
+{
+    if (data.isEmpty() || data.size() > m_maxSize)
+        return;
+    qint64 end = offset + data.size();
+
+    // No range is allowed to contain another. This keeps both the start
+    // and the end offsets sorted, so a lookup only needs to check the
+    // range starting closest before the requested offset:
+    QMap<qint64, Range>::iterator it = rangeAt(offset);
+    if (it != m_ranges.end() && it.key() + it.value().data.size() >= end){
+        touch(it);
+        return;
+    }
+
+    it = m_ranges.lowerBound(offset);
+    while (it != m_ranges.end() && it.key() + it.value().data.size() <= end){
+        QMap<qint64, Range>::iterator next = it + 1;
+        remove(it);
+        it = next;
+    }
+
+    Range range;
+    range.data = data;
+    range.lastUsed = ++m_useCounter;
+    m_ranges.insert(offset, range);
+    m_usage.insert(range.lastUsed, offset);
+    m_size += data.size();
+    evict();
+}
+
+int StreamRangeCache::read(qint64 offset, int size, char *data)
+{
+    // Copy from as many adjacent (or overlapping) ranges
+    // as possible, and return the number of bytes found:
+    int bytesRead = 0;
+    while (bytesRead < size){
+        QMap<qint64, Range>::iterator it = rangeAt(offset);
+        if (it == m_ranges.end())
+            break;
+        touch(it);
+        int skip = int(offset - it.key());
+        int length = qMin(size - bytesRead, it.value().data.size() - skip);
+        memcpy(data + bytesRead, it.value().data.constData() + skip, length);
+        bytesRead += length;
+        offset += length;
+    }
+    return bytesRead;
+}
+
+void StreamRangeCache::clear()
+{
+    m_ranges.clear();
+    m_usage.clear();
+    m_size = 0;
+}
+
+void StreamRangeCache::setMaxSize(int maxSize)
+{
+    m_maxSize = maxSize;
+    evict();
+}
+
+int StreamRangeCache::maxSize() const
+{
+    return m_maxSize;
+}
+
+int StreamRangeCache::size() const
+{
+    return m_size;
+}
+
+QMap<qint64, StreamRangeCache::Range>::iterator StreamRangeCache::rangeAt(qint64 offset)
+{
+    // Find the range starting at, or closest before, offset.
+    // Return end() if that range does not contain offset:
+    QMap<qint64, Range>::iterator it = m_ranges.upperBound(offset);
+    if (it == m_ranges.begin())
+        return m_ranges.end();
+    --it;
+    if (it.key() + it.value().data.size() <= offset)
+        return m_ranges.end();
+    return it;
+}
+
+void StreamRangeCache::touch(QMap<qint64, Range>::iterator it)
+{
+    m_usage.remove(it.value().lastUsed);
+    it.value().lastUsed = ++m_useCounter;
+    m_usage.insert(it.value().lastUsed, it.key());
+}
+
+void StreamRangeCache::remove(QMap<qint64, Range>::iterator it)
+{
+    m_usage.remove(it.value().lastUsed);
+    m_size -= it.value().data.size();
+    m_ranges.erase(it);
+}
+
+void StreamRangeCache::evict()
+{
+    while (m_size > m_maxSize && !m_usage.isEmpty()){
+        QMap<quint64, qint64>::iterator oldest = m_usage.begin();
+        remove(m_ranges.find(oldest.value()));
+    }
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,116 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef Phonon_QT7_STREAMREADAHEAD_H
+#define Phonon_QT7_STREAMREADAHEAD_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    class StreamWindow;
+    class StreamReadAheadThread;
+
+    /**
+        Reads a stream ahead of its consumer. A worker thread asks a Source
+        for data (and to seek), and the blocks written in response are
+        queued until the consumer moves them into a StreamWindow with fill.
+        The worker stops asking once readAhead bytes are queued.
+
+        Blocks are tagged with the seek generation they were written in, so
+        that blocks written before a seek can be recognised and dropped.
+        The source may write from any thread, so everything shared with the
+        worker is protected by one mutex. It is never held while calling
+        the source.
+    */
+    class StreamReadAhead
+    {
+        public:
+            class Source
+            {
+                public:
+                    virtual ~Source() {}
+                    // Called from the worker thread. Deliver with write
+                    // (now or later), or endOfData:
+                    virtual void requestData() = 0;
+                    virtual void requestSeek(qint64 pos) = 0;
+            };
+
+            StreamReadAhead(Source *source);
+            ~StreamReadAhead();
+
+            void start(int readAhead, qint64 pos);
+            void stop();
+            bool isRunning() const;
+
+            // Producer side, any thread:
+            void write(const QByteArray &data);
+            void endOfData();
+
+            // Consumer side:
+            void seek(qint64 pos);
+            bool fill(StreamWindow *window, qint64 from, qint64 to);
+            void setIdleTimeout(int ms);
+            int bytesQueued() const;
+            int stallCount() const;
+            int stallTime() const;
+
+        private:
+            struct Chunk
+            {
+                Chunk() : generation(0), endOfData(false) {}
+                QByteArray data;
+                int generation;
+                bool endOfData;
+            };
+
+            friend class StreamReadAheadThread;
+            void loop();
+            bool takeChunks(StreamWindow *window, bool *endOfData);
+
+            Source *m_source;
+            StreamReadAheadThread *m_thread;
+            QList<Chunk> m_queue;
+            mutable QMutex m_mutex;
+            QWaitCondition m_producerWait;
+            QWaitCondition m_consumerWait;
+            int m_bytesQueued;
+            int m_seekGeneration;
+            qint64 m_seekTarget;
+            int m_producerGeneration;
+            qint64 m_producedBytes;
+            bool m_producerEndOfData;
+            int m_readAhead;
+            bool m_stop;
+
+            // Consumer side only:
+            int m_idleTimeout;
+            int m_stallCount;
+            int m_stallTime;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_STREAMREADAHEAD_H
@@ -0,0 +1,248 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "streamreadahead.h"
+#include "streamwindow.h"
+#include <QtCore/QThread>
+#include <QtCore/QTime>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+class StreamReadAheadThread : public QThread
+{
+public:
+    StreamReadAheadThread(StreamReadAhead *readAhead) : m_readAhead(readAhead) {}
+protected:
+    void run() { m_readAhead->loop(); }
+private:
+    StreamReadAhead *m_readAhead;
+};
+
+StreamReadAhead::StreamReadAhead(Source *source)
+{
+    m_source = source;
+    m_thread = 0;
+    m_bytesQueued = 0;
+    m_seekGeneration = 0;
+    m_seekTarget = 0;
+    m_producerGeneration = 0;
+    m_producedBytes = 0;
+    m_producerEndOfData = false;
+    m_readAhead = 0;
+    m_stop = false;
+    // Give the stream some time to deliver before giving up, since it
+    // might be waiting for e.g. the network. But don't wait forever:
+    m_idleTimeout = 10000;
+    m_stallCount = 0;
+    m_stallTime = 0;
+}
+
+StreamReadAhead::~StreamReadAhead()
+{
+    stop();
+}
+
+void StreamReadAhead::start(int readAhead, qint64 pos)
+{
+    // Keep (at least) 'readAhead' bytes ahead of the consumer, starting
+    // at 'pos'. The source is expected to be positioned there already:
+    if (m_thread || readAhead <= 0)
+        return;
+    m_readAhead = readAhead;
+    m_seekTarget = pos;
+    m_stop = false;
+    m_thread = new StreamReadAheadThread(this);
+    m_thread->start();
+}
+
+void StreamReadAhead::stop()
+{
+    // Note that the source must still be alive here,
+    // since the worker might be calling it:
+    if (!m_thread)
+        return;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stop = true;
+        m_producerWait.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = 0;
+}
+
+bool StreamReadAhead::isRunning() const
+{
+    return m_thread != 0;
+}
+
+void StreamReadAhead::write(const QByteArray &data)
+{
+    if (data.isEmpty())
+        return;
+    QMutexLocker locker(&m_mutex);
+    Chunk chunk;
+    chunk.data = data;
+    chunk.generation = m_producerGeneration;
+    m_queue << chunk;
+    m_bytesQueued += data.size();
+    m_producedBytes += data.size();
+    m_consumerWait.wakeAll();
+}
+
+void StreamReadAhead::endOfData()
+{
+    QMutexLocker locker(&m_mutex);
+    m_producerEndOfData = true;
+    Chunk chunk;
+    chunk.generation = m_producerGeneration;
+    chunk.endOfData = true;
+    m_queue << chunk;
+    m_consumerWait.wakeAll();
+}
+
+void StreamReadAhead::seek(qint64 pos)
+{
+    // Let the worker do the seek. Anything
+    // already queued belongs to the previous generation:
+    QMutexLocker locker(&m_mutex);
+    m_seekTarget = pos;
+    ++m_seekGeneration;
+    m_queue.clear();
+    m_bytesQueued = 0;
+    m_producerWait.wakeAll();
+}
+
+bool StreamReadAhead::fill(StreamWindow *window, qint64 from, qint64 to)
+{
+    // Move queued blocks into the window until it reaches 'to', releasing
+    // what falls out of it except for what starts at 'from'. Returns true
+    // if the end of the stream was reached:
+    bool endOfData = false;
+    QTime idleTime;
+    idleTime.start();
+    while (window->end() < to && !endOfData){
+        if (takeChunks(window, &endOfData)){
+            window->trim(from);
+            idleTime.restart();
+            continue;
+        }
+        if (idleTime.elapsed() > m_idleTimeout)
+            break;
+
+        ++m_stallCount;
+        QTime stallTime;
+        stallTime.start();
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_queue.isEmpty())
+                m_consumerWait.wait(&m_mutex, 100);
+        }
+        m_stallTime += stallTime.elapsed();
+    }
+    return endOfData;
+}
+
+void StreamReadAhead::setIdleTimeout(int ms)
+{
+    m_idleTimeout = ms;
+}
+
+int StreamReadAhead::bytesQueued() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytesQueued;
+}
+
+int StreamReadAhead::stallCount() const
+{
+    return m_stallCount;
+}
+
+int StreamReadAhead::stallTime() const
+{
+    return m_stallTime;
+}
+
+void StreamReadAhead::loop()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stop){
+        if (m_producerGeneration != m_seekGeneration){
+            // Data written from now on belongs to the new position:
+            m_producerGeneration = m_seekGeneration;
+            m_producerEndOfData = false;
+            qint64 target = m_seekTarget;
+            locker.unlock();
+            m_source->requestSeek(target);
+            locker.relock();
+            continue;
+        }
+
+        if (m_producerEndOfData || m_bytesQueued >= m_readAhead){
+            // Far enough ahead. Wait for the consumer to read or seek:
+            m_producerWait.wait(&m_mutex);
+            continue;
+        }
+
+        qint64 produced = m_producedBytes;
+        locker.unlock();
+        m_source->requestData();
+        locker.relock();
+        if (produced == m_producedBytes && m_producerGeneration == m_seekGeneration
+            && !m_producerEndOfData && !m_stop){
+            // The stream did not write right away. It might do so later
+            // (e.g. from the network), so don't ask again immediately:
+            m_producerWait.wait(&m_mutex, 20);
+        }
+    }
+}
+
+bool StreamReadAhead::takeChunks(StreamWindow *window, bool *endOfData)
+{
+    QList<Chunk> chunks;
+    int generation;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_queue.isEmpty())
+            return false;
+        chunks = m_queue;
+        m_queue.clear();
+        m_bytesQueued = 0;
+        generation = m_seekGeneration;
+        m_producerWait.wakeAll();
+    }
+
+    for (int i=0; i<chunks.size(); ++i){
+        const Chunk &chunk = chunks[i];
+        if (chunk.generation != generation)
+            continue;
+        if (chunk.endOfData)
+            *endOfData = true;
+        else
+            window->append(chunk.data);
+    }
+    return true;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
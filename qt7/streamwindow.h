@@ -0,0 +1,96 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_STREAMWINDOW_H
+#define Phonon_QT7_STREAMWINDOW_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QReadWriteLock>
+#include "streamrangecache.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        The part of a stream kept in memory while reading it progressively:
+        the bytes from start() up to end(), where end() is where the stream
+        will deliver next. The window is kept as a list of the (implicitly
+        shared) blocks received from the stream, so no data is moved when
+        appending or releasing. Blocks that slide out of the window go to
+        a StreamRangeCache, so that reading back does not need to seek.
+
+        read serves a request from the window or the cache, and otherwise
+        asks a Feeder to seek or deliver more. The window never holds much
+        more than windowSize bytes behind the last read.
+    */
+    class StreamWindow
+    {
+        public:
+            class Feeder
+            {
+                public:
+                    virtual ~Feeder() {}
+                    virtual bool canSeek() const = 0;
+                    // The window has been restarted at pos. Deliver from there:
+                    virtual void seek(qint64 pos) = 0;
+                    // Append until end() reaches 'to', or the stream stops
+                    // delivering. Call trim(from) as blocks come in:
+                    virtual void fill(qint64 from, qint64 to) = 0;
+            };
+
+            StreamWindow(int rangeCacheSize);
+
+            int read(qint64 offset, int size, char *data, Feeder *feeder);
+            void append(const QByteArray &data);
+            void restart(qint64 pos);
+            void trim(qint64 keepFrom);
+            void copy(qint64 offset, int size, char *data) const;
+            QList<QByteArray> takeAll();
+            QByteArray *join();
+
+            qint64 start() const;
+            qint64 end() const;
+            int bufferSize() const;
+            int chunkCount() const;
+
+            void setWindowSize(int size);
+            int windowSize() const;
+            void setRangeCacheSize(int size);
+            int rangeCacheSize() const;
+
+        private:
+            // m_chunkOffset is the number of bytes already
+            // released from the first block:
+            QList<QByteArray> m_chunks;
+            int m_chunkOffset;
+            int m_bufferSize;
+            qint64 m_start;
+            qint64 m_end;
+            int m_windowSize;
+            StreamRangeCache m_rangeCache;
+            mutable QReadWriteLock m_lock;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_STREAMWINDOW_H
@@ -0,0 +1,237 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "streamwindow.h"
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+StreamWindow::StreamWindow(int rangeCacheSize) : m_rangeCache(rangeCacheSize)
+{
+    m_chunkOffset = 0;
+    m_bufferSize = 0;
+    m_start = 0;
+    m_end = 0;
+    // QuickTime tends to re-read data close to what it just read,
+    // so keep some history behind the read position as well:
+    m_windowSize = 4 * 1024 * 1024;
+}
+
+int StreamWindow::read(qint64 offset, int size, char *data, Feeder *feeder)
+{
+    if (size <= 0)
+        return 0;
+
+    // Data outside the window might have been read before. If so,
+    // serve what we can from the range cache, and read the rest from
+    // the stream. This avoids seeking the stream when scrubbing:
+    if (offset < start() || offset >= end()){
+        int cached;
+        {
+            QWriteLocker locker(&m_lock);
+            cached = m_rangeCache.read(offset, size, data);
+        }
+        if (cached == size)
+            return cached;
+        if (cached > 0)
+            return cached + read(offset + cached, size - cached, data + cached, feeder);
+    }
+
+    // Data that has slid out of the window, or that lies too far
+    // ahead to be worth streaming towards, needs a seek:
+    if (offset < start() || offset > end() + m_windowSize){
+        if (feeder->canSeek()){
+            restart(offset);
+            feeder->seek(offset);
+        } else if (offset < start())
+            return 0;
+    }
+
+    feeder->fill(offset, offset + size);
+
+    int bytesRead = int(qMin(qint64(size), end() - offset));
+    if (bytesRead <= 0)
+        return 0;
+    copy(offset, bytesRead, data);
+    trim(offset + bytesRead);
+    return bytesRead;
+}
+
+void StreamWindow::append(const QByteArray &data)
+{
+    if (data.isEmpty())
+        return;
+    QWriteLocker locker(&m_lock);
+    m_end += data.size();
+    m_bufferSize += data.size();
+    m_chunks << data;
+}
+
+void StreamWindow::restart(qint64 pos)
+{
+    // Everything in the window goes to the range cache:
+    QWriteLocker locker(&m_lock);
+    qint64 chunkStart = m_start - m_chunkOffset;
+    for (int i=0; i<m_chunks.size(); ++i){
+        m_rangeCache.insert(chunkStart, m_chunks[i]);
+        chunkStart += m_chunks[i].size();
+    }
+    m_chunks.clear();
+    m_chunkOffset = 0;
+    m_bufferSize = 0;
+    m_start = pos;
+    m_end = pos;
+}
+
+void StreamWindow::trim(qint64 keepFrom)
+{
+    // Release whole blocks (to the range cache), and
+    // step into the first remaining one:
+    QWriteLocker locker(&m_lock);
+    qint64 dropTo = qMin(keepFrom, m_end - m_windowSize);
+    if (dropTo <= m_start)
+        return;
+
+    int drop = int(dropTo - m_start);
+    qint64 chunkStart = m_start - m_chunkOffset;
+    m_start = dropTo;
+    m_bufferSize -= drop;
+    while (drop > 0){
+        int left = m_chunks.first().size() - m_chunkOffset;
+        if (drop < left){
+            m_chunkOffset += drop;
+            break;
+        }
+        drop -= left;
+        m_rangeCache.insert(chunkStart, m_chunks.first());
+        chunkStart += m_chunks.first().size();
+        m_chunks.removeFirst();
+        m_chunkOffset = 0;
+    }
+}
+
+void StreamWindow::copy(qint64 offset, int size, char *data) const
+{
+    // Skip to the block containing offset, and copy from there.
+    // The range must be inside the window:
+    QReadLocker locker(&m_lock);
+    qint64 skip = offset - m_start + m_chunkOffset;
+    int i = 0;
+    while (skip >= m_chunks[i].size()){
+        skip -= m_chunks[i].size();
+        ++i;
+    }
+    while (size > 0){
+        int length = qMin(size, int(m_chunks[i].size() - skip));
+        memcpy(data, m_chunks[i].constData() + skip, length);
+        data += length;
+        size -= length;
+        skip = 0;
+        ++i;
+    }
+}
+
+QList<QByteArray> StreamWindow::takeAll()
+{
+    // Hand over the window, without passing it
+    // to the range cache. The window ends up empty:
+    QWriteLocker locker(&m_lock);
+    QList<QByteArray> chunks = m_chunks;
+    if (!chunks.isEmpty() && m_chunkOffset > 0)
+        chunks.first() = chunks.first().mid(m_chunkOffset);
+    m_chunks.clear();
+    m_chunkOffset = 0;
+    m_bufferSize = 0;
+    m_start = m_end;
+    return chunks;
+}
+
+QByteArray *StreamWindow::join()
+{
+    // Join the blocks into one (once), for
+    // users that need all the data in one place:
+    QWriteLocker locker(&m_lock);
+    if (m_chunks.size() != 1 || m_chunkOffset != 0){
+        QByteArray data;
+        data.resize(m_bufferSize);
+        char *dest = data.data();
+        for (int i=0; i<m_chunks.size(); ++i){
+            int skip = (i == 0) ? m_chunkOffset : 0;
+            int length = m_chunks[i].size() - skip;
+            memcpy(dest, m_chunks[i].constData() + skip, length);
+            dest += length;
+        }
+        m_chunks.clear();
+        m_chunks << data;
+        m_chunkOffset = 0;
+    }
+    return &m_chunks.first();
+}
+
+qint64 StreamWindow::start() const
+{
+    QReadLocker locker(&m_lock);
+    return m_start;
+}
+
+qint64 StreamWindow::end() const
+{
+    QReadLocker locker(&m_lock);
+    return m_end;
+}
+
+int StreamWindow::bufferSize() const
+{
+    QReadLocker locker(&m_lock);
+    return m_bufferSize;
+}
+
+int StreamWindow::chunkCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_chunks.size();
+}
+
+void StreamWindow::setWindowSize(int size)
+{
+    m_windowSize = qMax(size, 64 * 1024);
+}
+
+int StreamWindow::windowSize() const
+{
+    return m_windowSize;
+}
+
+void StreamWindow::setRangeCacheSize(int size)
+{
+    QWriteLocker locker(&m_lock);
+    m_rangeCache.setMaxSize(size);
+}
+
+int StreamWindow::rangeCacheSize() const
+{
+    return m_rangeCache.maxSize();
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,221 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "audioslicecontroller.h"
+#include <limits.h>
+
+using namespace Phonon::QT7;
+
+// Simulates an audio player in steps of one millisecond: the audio unit
+// plays the queued slices in real time and wakes the GUI thread for each
+// slice played. The GUI thread refills when it gets to it, and reports to
+// the controller on a timer, the way QuickTimeAudioPlayer does:
+class SlicePlayback
+{
+    public:
+        SlicePlayback(AudioSliceController *controller, int timerInterval)
+        {
+            m_controller = controller;
+            m_timerInterval = timerInterval;
+            m_queued = 0;
+            m_played = 0;
+            m_wakeUpTime = -1;
+            m_minPending = INT_MAX;
+            m_dry = false;
+            underruns = 0;
+            reports = 0;
+        }
+
+        // The GUI thread is busy for 'stall' ms every 'period' ms:
+        void run(int duration, int period, int stall)
+        {
+            refill();
+            for (int t=0; t<duration; ++t){
+                play();
+                bool busy = period > 0 && t % period < stall;
+                if (busy)
+                    continue;
+                if (m_wakeUpTime >= 0 && t >= m_wakeUpTime){
+                    m_wakeUpTime = -1;
+                    m_minPending = qMin(m_minPending, m_queued);
+                    refill();
+                }
+                if (t % m_timerInterval == 0){
+                    m_minPending = qMin(m_minPending, m_queued);
+                    m_controller->addRefill(m_minPending);
+                    ++reports;
+                    m_minPending = INT_MAX;
+                    refill();
+                }
+            }
+        }
+
+        int bufferMs() const
+        {
+            return m_controller->sliceCount() * sliceMs();
+        }
+
+        int underruns;
+        int reports;
+
+    private:
+        AudioSliceController *m_controller;
+        int m_timerInterval;
+        int m_queued;
+        int m_played;
+        int m_wakeUpTime;
+        int m_minPending;
+        bool m_dry;
+
+        int sliceMs() const
+        {
+            // 44.1 kHz:
+            return qMax(1, m_controller->packetCount() * 10 / 441);
+        }
+
+        void play()
+        {
+            if (m_queued == 0){
+                if (!m_dry)
+                    ++underruns;
+                m_dry = true;
+                return;
+            }
+            m_dry = false;
+            if (++m_played < sliceMs())
+                return;
+            m_played = 0;
+            --m_queued;
+            if (m_wakeUpTime < 0)
+                m_wakeUpTime = 0;
+        }
+
+        void refill()
+        {
+            // Slices beyond a shrunk count are just not queued again:
+            m_queued = qMax(m_queued, m_controller->sliceCount());
+        }
+};
+
+class AudioSliceControllerTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void growsOnUnderrun();
+        void growsForStalls();
+        void shrinksWithPromptRefills();
+        void ignoresWakeUpFrequency();
+        void higherSlackMeansBiggerBuffer();
+        void staysWithinBounds();
+};
+
+void AudioSliceControllerTest::growsOnUnderrun()
+{
+    AudioSliceController controller;
+    controller.reset(8, 1024);
+    QVERIFY(controller.addRefill(0));
+    QCOMPARE(controller.underrunCount(), 1);
+    QCOMPARE(controller.sliceCount(), 12);
+    QCOMPARE(controller.packetCount(), 1024);
+}
+
+void AudioSliceControllerTest::growsForStalls()
+{
+    // A small buffer, and a GUI thread that is busy for 200 ms every
+    // two seconds. The buffer must grow until it covers the stalls:
+    AudioSliceController controller;
+    controller.reset(4, 512);
+    SlicePlayback playback(&controller, 50);
+    playback.run(30000, 2000, 200);
+    QVERIFY(controller.underrunCount() > 0);
+    QVERIFY(playback.bufferMs() > 200);
+
+    int underruns = playback.underruns;
+    playback.run(60000, 2000, 200);
+    QCOMPARE(playback.underruns, underruns);
+}
+
+void AudioSliceControllerTest::shrinksWithPromptRefills()
+{
+    // Refills that always happen right away need little buffering:
+    AudioSliceController controller;
+    controller.reset(30, 4096);
+    int initialMs = 30 * 4096 * 10 / 441;
+    SlicePlayback playback(&controller, 50);
+    playback.run(120000, 0, 0);
+    QCOMPARE(playback.underruns, 0);
+    QVERIFY(playback.bufferMs() < initialMs / 4);
+}
+
+void AudioSliceControllerTest::ignoresWakeUpFrequency()
+{
+    // The slack seen between timer ticks decides, not the number of
+    // wake-ups: the same stalls give the same buffer, whether the
+    // timer runs often or seldom:
+    AudioSliceController often;
+    often.reset(4, 512);
+    SlicePlayback oftenPlayback(&often, 20);
+    oftenPlayback.run(60000, 1000, 100);
+
+    AudioSliceController seldom;
+    seldom.reset(4, 512);
+    SlicePlayback seldomPlayback(&seldom, 100);
+    seldomPlayback.run(60000, 1000, 100);
+
+    QVERIFY(oftenPlayback.bufferMs() > 100);
+    QVERIFY(seldomPlayback.bufferMs() > 100);
+    QVERIFY(qAbs(oftenPlayback.bufferMs() - seldomPlayback.bufferMs()) <= seldomPlayback.bufferMs() / 2);
+}
+
+void AudioSliceControllerTest::higherSlackMeansBiggerBuffer()
+{
+    AudioSliceController low;
+    low.setTargetSlack(0.1f);
+    low.reset(4, 512);
+    SlicePlayback lowPlayback(&low, 50);
+    lowPlayback.run(60000, 1000, 100);
+
+    AudioSliceController high;
+    high.setTargetSlack(0.6f);
+    high.reset(4, 512);
+    SlicePlayback highPlayback(&high, 50);
+    highPlayback.run(60000, 1000, 100);
+
+    QVERIFY(highPlayback.bufferMs() > lowPlayback.bufferMs());
+}
+
+void AudioSliceControllerTest::staysWithinBounds()
+{
+    AudioSliceController controller;
+    controller.setBounds(4, 16, 512, 2048);
+    controller.reset(100, 100000);
+    QCOMPARE(controller.sliceCount(), 16);
+    QCOMPARE(controller.packetCount(), 2048);
+    for (int i=0; i<100; ++i)
+        controller.addRefill(0);
+    QCOMPARE(controller.sliceCount(), 16);
+    QCOMPARE(controller.packetCount(), 2048);
+    for (int i=0; i<10000; ++i)
+        controller.addRefill(controller.sliceCount());
+    QCOMPARE(controller.sliceCount(), 4);
+    QCOMPARE(controller.packetCount(), 512);
+}
+
+QTEST_MAIN(AudioSliceControllerTest)
+#include "audioslicecontrollertest.moc"
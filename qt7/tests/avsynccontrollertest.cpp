@@ -0,0 +1,186 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "avsynccontroller.h"
+
+using namespace Phonon::QT7;
+
+// Two simulated clocks: video runs on the system clock, and audio on a
+// sound card clock that is off by 'skew' ppm. Audio plays at the rate
+// the controller asks for, and the drift is measured every 'interval'
+// ms with some measurement noise, like MediaObject::updateLipSynch:
+class SimulatedClocks
+{
+    public:
+        SimulatedClocks(AVSyncController *controller, double skew, double initialDrift)
+        {
+            m_controller = controller;
+            m_skew = skew;
+            m_noise = 0;
+            m_seed = 1;
+            drift = initialDrift;
+            maxRateAdjustment = 0;
+            resyncs = 0;
+        }
+
+        void setNoise(double ms)
+        {
+            m_noise = ms;
+        }
+
+        void run(qint64 duration, int interval)
+        {
+            for (qint64 t=0; t<duration; t+=interval){
+                double audioSpeed = (1.0 + m_skew / 1000000.0) * m_controller->rate();
+                drift += interval * (audioSpeed - 1.0);
+                m_controller->addMeasurement(qint64(qRound(drift + noise())));
+                maxRateAdjustment = qMax(maxRateAdjustment, qAbs(m_controller->rate() - 1.0) * 1000000.0);
+                if (m_controller->needsResync()){
+                    // A hard resync puts audio where video is:
+                    ++resyncs;
+                    drift = 0;
+                    m_controller->reset();
+                }
+            }
+        }
+
+        double drift;
+        double maxRateAdjustment;
+        int resyncs;
+
+    private:
+        AVSyncController *m_controller;
+        double m_skew;
+        double m_noise;
+        quint32 m_seed;
+
+        double noise()
+        {
+            m_seed = m_seed * 1664525u + 1013904223u;
+            return m_noise * (double(m_seed >> 8) / double(1 << 24) * 2.0 - 1.0);
+        }
+};
+
+class AVSyncControllerTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void playsAtNormalRateWhenInSync();
+        void slowsDownAudioAhead();
+        void speedsUpAudioBehind();
+        void catchesUpWithoutResync();
+        void followsSkewedClock();
+        void filtersNoise();
+        void resyncsOnLargeDrift();
+        void resyncsOnSingleJump();
+        void respectsMaxAdjustment();
+};
+
+void AVSyncControllerTest::playsAtNormalRateWhenInSync()
+{
+    AVSyncController controller;
+    for (int i=0; i<100; ++i)
+        controller.addMeasurement(i % 2 ? 3 : -3);
+    QCOMPARE(controller.rate(), 1.0);
+    QVERIFY(!controller.needsResync());
+}
+
+void AVSyncControllerTest::slowsDownAudioAhead()
+{
+    AVSyncController controller;
+    controller.addMeasurement(30);
+    QVERIFY(controller.rate() < 1.0);
+    QVERIFY(controller.rate() >= 1.0 - 500 / 1000000.0);
+}
+
+void AVSyncControllerTest::speedsUpAudioBehind()
+{
+    AVSyncController controller;
+    controller.addMeasurement(-30);
+    QVERIFY(controller.rate() > 1.0);
+    QVERIFY(controller.rate() <= 1.0 + 500 / 1000000.0);
+}
+
+void AVSyncControllerTest::catchesUpWithoutResync()
+{
+    // 40 ms off is within what rate adjustment should fix, at
+    // 500 ppm that takes 80 seconds and more:
+    AVSyncController controller;
+    SimulatedClocks clocks(&controller, 0, 40);
+    clocks.run(5 * 60 * 1000, 20);
+    QCOMPARE(clocks.resyncs, 0);
+    QVERIFY(qAbs(clocks.drift) <= 6);
+}
+
+void AVSyncControllerTest::followsSkewedClock()
+{
+    // A sound card clock 200 ppm fast drifts 12 ms per minute.
+    // The controller keeps it in sync for an hour:
+    AVSyncController controller;
+    SimulatedClocks clocks(&controller, 200, 0);
+    clocks.run(60 * 60 * 1000, 20);
+    QCOMPARE(clocks.resyncs, 0);
+    QVERIFY(qAbs(clocks.drift) <= 15);
+    QVERIFY(qAbs(controller.rate() - 1.0 / 1.0002) < 100 / 1000000.0);
+}
+
+void AVSyncControllerTest::filtersNoise()
+{
+    // Measurements jitter by up to 20 ms, the real drift is zero:
+    AVSyncController controller;
+    SimulatedClocks clocks(&controller, 0, 0);
+    clocks.setNoise(20);
+    clocks.run(10 * 60 * 1000, 20);
+    QCOMPARE(clocks.resyncs, 0);
+    QVERIFY(qAbs(controller.filteredDrift()) < 10);
+    QVERIFY(qAbs(clocks.drift) < 10);
+}
+
+void AVSyncControllerTest::resyncsOnLargeDrift()
+{
+    AVSyncController controller;
+    for (int i=0; i<100 && !controller.needsResync(); ++i)
+        controller.addMeasurement(150);
+    QVERIFY(controller.needsResync());
+}
+
+void AVSyncControllerTest::resyncsOnSingleJump()
+{
+    AVSyncController controller;
+    controller.addMeasurement(0);
+    controller.addMeasurement(250);
+    QVERIFY(controller.needsResync());
+    controller.reset();
+    QVERIFY(!controller.needsResync());
+    QCOMPARE(controller.rate(), 1.0);
+}
+
+void AVSyncControllerTest::respectsMaxAdjustment()
+{
+    AVSyncController controller;
+    controller.setMaxAdjustment(100);
+    controller.setResyncThreshold(1000);
+    SimulatedClocks clocks(&controller, 0, 90);
+    clocks.run(60 * 1000, 20);
+    QVERIFY(clocks.maxRateAdjustment <= 100.0001);
+    QVERIFY(clocks.maxRateAdjustment > 99);
+}
+
+QTEST_MAIN(AVSyncControllerTest)
+#include "avsynccontrollertest.moc"
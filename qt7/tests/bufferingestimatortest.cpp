@@ -0,0 +1,126 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "bufferingestimator.h"
+
+using namespace Phonon::QT7;
+
+// All times in milliseconds. Samples are taken every 100 ms,
+// like MediaObject does while playing or buffering:
+class BufferingEstimatorTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void doesNotBufferWithoutLoadInfo();
+        void startsBelowLowWatermark();
+        void continuesWhenDownloadStaysAhead();
+        void waitsForSlowDownload();
+        void continuesAtHighWatermarkWithoutRate();
+        void continuesWhenFullyLoaded();
+};
+
+void BufferingEstimatorTest::doesNotBufferWithoutLoadInfo()
+{
+    BufferingEstimator estimator;
+    for (qint64 t=0; t<2000; t+=100)
+        estimator.addSample(t, 0, t, 60000);
+    QVERIFY(!estimator.isBuffering());
+    QCOMPARE(estimator.bufferPercent(), 100);
+}
+
+void BufferingEstimatorTest::startsBelowLowWatermark()
+{
+    BufferingEstimator estimator;
+    estimator.addSample(0, 5000, 3000, 60000);
+    QVERIFY(!estimator.isBuffering());
+    estimator.addSample(100, 5000, 4500, 60000);
+    QVERIFY(estimator.isBuffering());
+}
+
+void BufferingEstimatorTest::continuesWhenDownloadStaysAhead()
+{
+    // Download at twice the playback speed, with playback paused:
+    BufferingEstimator estimator;
+    qint64 t = 0;
+    for (; t<=2000; t+=100)
+        estimator.addSample(t, 500 + 2 * t, 500, 10000);
+    QVERIFY(estimator.downloadRate() > 1.5f);
+
+    // The rest of the movie downloads faster than it plays, so only
+    // the high watermark is waited for:
+    while (estimator.isBuffering() && t < 60000){
+        estimator.addSample(t, 500 + 2 * t, 500, 10000);
+        t += 100;
+    }
+    QVERIFY(!estimator.isBuffering());
+    QVERIFY(t < 4000);
+}
+
+void BufferingEstimatorTest::waitsForSlowDownload()
+{
+    // Download at half the playback speed. Playback can only continue
+    // when the rest downloads before playback reaches the end:
+    BufferingEstimator estimator;
+    qint64 t = 0;
+    estimator.addSample(t, 500, 0, 20000);
+    QVERIFY(estimator.isBuffering());
+    while (estimator.isBuffering() && t < 60000){
+        t += 100;
+        estimator.addSample(t, 500 + t / 2, 0, 20000);
+        if (t == 2000){
+            // (20000 - 1500) / 0.5 - 20000 ms from now:
+            QVERIFY(qAbs(estimator.timeToSafePlay() - 17000) < 100);
+            QVERIFY(estimator.bufferPercent() > 0 && estimator.bufferPercent() < 20);
+        }
+    }
+    QVERIFY(!estimator.isBuffering());
+    QVERIFY(qAbs(t - 19000) < 200);
+}
+
+void BufferingEstimatorTest::continuesAtHighWatermarkWithoutRate()
+{
+    // The download has stalled, so there is no rate to estimate
+    // the time to safe play from:
+    BufferingEstimator estimator;
+    estimator.setWatermarks(1000, 3000);
+    for (qint64 t=0; t<2000; t+=100)
+        estimator.addSample(t, 3500, 3000, 60000);
+    QVERIFY(estimator.isBuffering());
+    QCOMPARE(estimator.timeToSafePlay(), qint64(-1));
+    QCOMPARE(estimator.bufferPercent(), 16);
+
+    // Seeking back puts the high watermark ahead of the play position.
+    // That is enough to continue:
+    estimator.addSample(2000, 3500, 0, 60000);
+    QCOMPARE(estimator.timeToSafePlay(), qint64(-1));
+    QVERIFY(!estimator.isBuffering());
+}
+
+void BufferingEstimatorTest::continuesWhenFullyLoaded()
+{
+    BufferingEstimator estimator;
+    estimator.addSample(0, 500, 0, 10000);
+    QVERIFY(estimator.isBuffering());
+    estimator.addSample(100, 10000, 0, 10000);
+    QVERIFY(!estimator.isBuffering());
+    QCOMPARE(estimator.timeToSafePlay(), qint64(0));
+}
+
+QTEST_MAIN(BufferingEstimatorTest)
+#include "bufferingestimatortest.moc"
@@ -0,0 +1,97 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_CONTAINERFIXTURES_H
+#define Phonon_QT7_CONTAINERFIXTURES_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+// The first bytes of one file of each container format the backend knows,
+// padded with media-like noise to the 4 KB the player hands the sniffer:
+struct ContainerFixture
+{
+    const char *name;
+    const char *expected;
+    QByteArray head;
+};
+
+static QByteArray fixtureNoise(int size, int seed)
+{
+    QByteArray noise(size, 0);
+    quint32 x = 0x9E3779B9u * quint32(seed + 1);
+    for (int i=0; i<size; ++i){
+        x = x * 1664525u + 1013904223u;
+        noise[i] = char(x >> 24);
+    }
+    return noise;
+}
+
+static ContainerFixture containerFixture(const char *name, const char *expected, const QByteArray &header)
+{
+    ContainerFixture fixture;
+    fixture.name = name;
+    fixture.expected = expected;
+    fixture.head = header + fixtureNoise(4096 - header.size(), header.size());
+    return fixture;
+}
+
+static QByteArray mpegAudioFrames(int frameCount)
+{
+    // MPEG 1 Layer III, 128 kbit/s, 44.1 kHz, no padding: 417 byte frames:
+    QByteArray frames;
+    for (int i=0; i<frameCount; ++i)
+        frames += QByteArray::fromHex("fffb9064") + fixtureNoise(417 - 4, i);
+    return frames;
+}
+
+static QList<ContainerFixture> containerFixtures()
+{
+    QList<ContainerFixture> fixtures;
+    fixtures << containerFixture("avi", ".avi", QByteArray::fromHex(
+        "52494646 f0ef0100 41564920 4c495354 66010000 6864726c 61766968 38000000"));
+    fixtures << containerFixture("wav", ".wav", QByteArray::fromHex(
+        "52494646 24a00f00 57415645 666d7420 10000000 01000200 44ac0000 10b10200"));
+    fixtures << containerFixture("mp4", ".mp4", QByteArray::fromHex(
+        "00000020 66747970 69736f6d 00000200 69736f6d 69736f32 61766331 6d703431"));
+    fixtures << containerFixture("m4a", ".mp4", QByteArray::fromHex(
+        "00000020 66747970 4d344120 00000000 4d344120 6d703432 69736f6d 00000000"));
+    fixtures << containerFixture("m4p", ".m4p", QByteArray::fromHex(
+        "0000001c 66747970 4d345020 00000000 4d345020 6d703432 69736f6d"));
+    fixtures << containerFixture("mov (ftyp)", ".mov", QByteArray::fromHex(
+        "00000014 66747970 71742020 20050300 71742020"));
+    fixtures << containerFixture("mov (wide)", ".mov", QByteArray::fromHex(
+        "00000008 77696465 0036f4a1 6d646174"));
+    fixtures << containerFixture("mov (moov)", ".mov", QByteArray::fromHex(
+        "0000a3c1 6d6f6f76 0000006c 6d766864"));
+    fixtures << containerFixture("ogg", ".ogg", QByteArray::fromHex(
+        "4f676753 00020000 00000000 00003e5c 00000000 9b1a84c7 011e0176 6f726269"));
+    fixtures << containerFixture("wmv", ".wmv", QByteArray::fromHex(
+        "3026b275 8e66cf11 a6d900aa 0062ce6c 8e150000 00000000 07000000 0102"));
+    fixtures << containerFixture("mpeg 1 system", ".m1s", QByteArray::fromHex(
+        "000001ba 21000100 0180085f 000001bb 000c8008 5f04e1ff e0e6c0c0"));
+    fixtures << containerFixture("mpeg 2 program", ".mpeg", QByteArray::fromHex(
+        "000001ba 44000400 0401018b fff80000 01bb0012 80c5e104 e1ffe0e0"));
+    fixtures << containerFixture("mpeg video", ".mpeg", QByteArray::fromHex(
+        "000001b3 16011023 ffffe018 000001b8 00080000"));
+    fixtures << containerFixture("mp3 (id3)", ".mp3", QByteArray::fromHex(
+        "49443303 00000000 0f765449 54320000 000b0000 00546974 6c650000"));
+    fixtures << containerFixture("mp3 (raw)", ".mp3", mpegAudioFrames(3));
+    return fixtures;
+}
+
+#endif // Phonon_QT7_CONTAINERFIXTURES_H
@@ -0,0 +1,71 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "containersniffer.h"
+#include "containerfixtures.h"
+
+using namespace Phonon::QT7;
+
+// Sniffing replaces up to ten movie opens, each of which reads and
+// parses the stream. It should cost next to nothing in comparison:
+class ContainerSnifferBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void sniffFirstType();
+        void sniffLastType();
+        void sniffAllFixtures();
+        void sniffUnknown();
+};
+
+void ContainerSnifferBenchmark::sniffFirstType()
+{
+    ContainerFixture fixture = containerFixtures().first();
+    QBENCHMARK {
+        sniffContainerType(fixture.head.constData(), fixture.head.size());
+    }
+}
+
+void ContainerSnifferBenchmark::sniffLastType()
+{
+    ContainerFixture fixture = containerFixtures().last();
+    QBENCHMARK {
+        sniffContainerType(fixture.head.constData(), fixture.head.size());
+    }
+}
+
+void ContainerSnifferBenchmark::sniffAllFixtures()
+{
+    QList<ContainerFixture> fixtures = containerFixtures();
+    QBENCHMARK {
+        for (int i=0; i<fixtures.size(); ++i)
+            sniffContainerType(fixtures[i].head.constData(), fixtures[i].head.size());
+    }
+}
+
+void ContainerSnifferBenchmark::sniffUnknown()
+{
+    QByteArray noise = fixtureNoise(4096, 0);
+    QBENCHMARK {
+        sniffContainerType(noise.constData(), noise.size());
+    }
+}
+
+QTEST_MAIN(ContainerSnifferBenchmark)
+#include "containersnifferbenchmark.moc"
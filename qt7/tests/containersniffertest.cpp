@@ -0,0 +1,119 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "containersniffer.h"
+#include "containerfixtures.h"
+
+using namespace Phonon::QT7;
+
+class ContainerSnifferTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void recognisesFixtures();
+        void recognisesShortHeads();
+        void rejectsTooLittleData();
+        void rejectsUnknownRiff();
+        void rejectsUnknownPackHeader();
+        void rejectsLoneFrameSync();
+        void rejectsText();
+        void rejectsNoise();
+};
+
+void ContainerSnifferTest::recognisesFixtures()
+{
+    QList<ContainerFixture> fixtures = containerFixtures();
+    for (int i=0; i<fixtures.size(); ++i){
+        const ContainerFixture &fixture = fixtures[i];
+        const char *type = sniffContainerType(fixture.head.constData(), fixture.head.size());
+        QVERIFY2(type && qstrcmp(type, fixture.expected) == 0, fixture.name);
+    }
+}
+
+void ContainerSnifferTest::recognisesShortHeads()
+{
+    // The start of a stream might be all there is. Everything but
+    // raw MPEG audio (which needs two frames) is known from 16 bytes:
+    QList<ContainerFixture> fixtures = containerFixtures();
+    for (int i=0; i<fixtures.size(); ++i){
+        const ContainerFixture &fixture = fixtures[i];
+        if (qstrcmp(fixture.name, "mp3 (raw)") == 0)
+            continue;
+        const char *type = sniffContainerType(fixture.head.constData(), 16);
+        QVERIFY2(type && qstrcmp(type, fixture.expected) == 0, fixture.name);
+    }
+}
+
+void ContainerSnifferTest::rejectsTooLittleData()
+{
+    QVERIFY(!sniffContainerType(0, 4096));
+    QVERIFY(!sniffContainerType("RIF", 3));
+    QVERIFY(!sniffContainerType("RIFF\x24\xa0\x0f\x00WAV", 11));
+
+    // Only the first of two MPEG audio frames:
+    QByteArray frames = mpegAudioFrames(2);
+    QVERIFY(!sniffContainerType(frames.constData(), 417));
+    QVERIFY(sniffContainerType(frames.constData(), 421));
+}
+
+void ContainerSnifferTest::rejectsUnknownRiff()
+{
+    QByteArray head = QByteArray::fromHex("52494646 00100000 524d4944 64617461") + fixtureNoise(64, 1);
+    QVERIFY(!sniffContainerType(head.constData(), head.size()));
+}
+
+void ContainerSnifferTest::rejectsUnknownPackHeader()
+{
+    QByteArray head = QByteArray::fromHex("000001ba 00000000") + fixtureNoise(64, 2);
+    QVERIFY(!sniffContainerType(head.constData(), head.size()));
+}
+
+void ContainerSnifferTest::rejectsLoneFrameSync()
+{
+    // A frame sync followed by something that is not a frame:
+    QByteArray head = QByteArray::fromHex("fffb9064") + QByteArray(1024, 0);
+    QVERIFY(!sniffContainerType(head.constData(), head.size()));
+
+    // Reserved version, layer, bitrate and sample rate fields:
+    QVERIFY(!sniffContainerType("\xff\xeb\x90\x64", 4));
+    QVERIFY(!sniffContainerType("\xff\xf9\x90\x64", 4));
+    QVERIFY(!sniffContainerType("\xff\xfb\xf0\x64", 4));
+    QVERIFY(!sniffContainerType("\xff\xfb\x9c\x64", 4));
+}
+
+void ContainerSnifferTest::rejectsText()
+{
+    QByteArray head("<!DOCTYPE html>\n<html><head><title>404 Not Found</title></head></html>\n");
+    QVERIFY(!sniffContainerType(head.constData(), head.size()));
+}
+
+void ContainerSnifferTest::rejectsNoise()
+{
+    // Guessing wrong costs more than not guessing:
+    int recognised = 0;
+    for (int seed=0; seed<1000; ++seed){
+        QByteArray noise = fixtureNoise(4096, seed);
+        if (sniffContainerType(noise.constData(), noise.size()))
+            ++recognised;
+    }
+    QCOMPARE(recognised, 0);
+}
+
+QTEST_MAIN(ContainerSnifferTest)
+#include "containersniffertest.moc"
@@ -0,0 +1,207 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QtTest/QtTest>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include "decodeblockqueue.h"
+
+using namespace Phonon::QT7;
+
+enum {BlockCount = 4, BlockFrames = 512};
+
+// Decodes a stream of 'length' frames, where each frame holds its
+// own position, standing in for the QuickTime audio extraction:
+class FakeDecoder : public QThread
+{
+    public:
+        FakeDecoder(DecodeBlockQueue<qint64> *queue, qint64 length)
+            : samples(BlockCount * BlockFrames)
+        {
+            m_queue = queue;
+            m_length = length;
+        }
+
+        QVector<qint64> samples;
+
+    protected:
+        void run()
+        {
+            qint64 pos = 0;
+            bool complete = false;
+            int decoded = 0;
+            while (!m_queue->isStopped()){
+                qint64 seek;
+                if (m_queue->takeSeek(&seek)){
+                    pos = seek;
+                    complete = false;
+                }
+
+                int index = complete ? -1 : m_queue->acquireBlock();
+                if (index == -1){
+                    m_queue->waitForConsumer(20);
+                    continue;
+                }
+
+                // Take some time now and then, like a real decoder:
+                if (++decoded % 8 == 0)
+                    usleep(200);
+                int frames = int(qMin(qint64(BlockFrames), m_length - pos));
+                for (int i=0; i<frames; ++i)
+                    samples[index * BlockFrames + i] = pos + i;
+                pos += frames;
+                complete = (pos >= m_length);
+                m_queue->publishBlock(index, frames, complete);
+            }
+        }
+
+    private:
+        DecodeBlockQueue<qint64> *m_queue;
+        qint64 m_length;
+};
+
+class DecodeBlockQueueTest : public QObject
+{
+    Q_OBJECT
+
+    private:
+        // Read 'count' frames (or up to the end), waiting for the decoder
+        // as needed. Returns false if a frame is not where it should be:
+        static bool readFrames(DecodeBlockQueue<qint64> *queue, FakeDecoder *decoder,
+            qint64 *pos, int count, bool *endOfStream)
+        {
+            *endOfStream = false;
+            while (count > 0 && !*endOfStream){
+                int index = queue->currentBlock();
+                if (index == -1){
+                    QTest::qSleep(1);
+                    continue;
+                }
+                int frames = qMin(queue->framesLeft(), count);
+                const qint64 *samples = decoder->samples.constData() + index * BlockFrames + queue->currentOffset();
+                for (int i=0; i<frames; ++i){
+                    if (samples[i] != *pos + i)
+                        return false;
+                }
+                *pos += frames;
+                count -= frames;
+                *endOfStream = queue->advance(frames);
+            }
+            return true;
+        }
+
+    private slots:
+        void deliversFramesInOrder();
+        void seeksInTheMiddleOfABlock();
+        void seeksAfterEndOfStream();
+        void stopsWithAllBlocksInUse();
+};
+
+void DecodeBlockQueueTest::deliversFramesInOrder()
+{
+    const qint64 length = 100000;
+    DecodeBlockQueue<qint64> queue(BlockCount);
+    FakeDecoder decoder(&queue, length);
+    decoder.start();
+
+    qint64 pos = 0;
+    bool endOfStream = false;
+    while (!endOfStream){
+        // Read amounts that do not line up with the blocks:
+        QVERIFY(readFrames(&queue, &decoder, &pos, 1000, &endOfStream));
+    }
+    queue.stop();
+    decoder.wait();
+
+    QCOMPARE(pos, length);
+    QCOMPARE(queue.currentBlock(), -1);
+}
+
+void DecodeBlockQueueTest::seeksInTheMiddleOfABlock()
+{
+    // Seek after reading part of a block, while the decoder is busy
+    // filling others for the old position. Only frames from the
+    // new position may come out after the seek:
+    const qint64 length = 1000000;
+    DecodeBlockQueue<qint64> queue(BlockCount);
+    FakeDecoder decoder(&queue, length);
+    decoder.start();
+
+    qint64 pos = 0;
+    bool endOfStream = false;
+    QVERIFY(readFrames(&queue, &decoder, &pos, 700, &endOfStream));
+    QCOMPARE(queue.currentOffset(), 700 - BlockFrames);
+
+    srand(7);
+    for (int i=0; i<300; ++i){
+        pos = qint64(rand() % int(length - 10000));
+        queue.seek(pos);
+        int count = 1 + rand() % (3 * BlockFrames);
+        qint64 start = pos;
+        QVERIFY(readFrames(&queue, &decoder, &pos, count, &endOfStream));
+        QCOMPARE(pos, start + count);
+        QVERIFY(!endOfStream);
+    }
+    queue.stop();
+    decoder.wait();
+}
+
+void DecodeBlockQueueTest::seeksAfterEndOfStream()
+{
+    const qint64 length = 3000;
+    DecodeBlockQueue<qint64> queue(BlockCount);
+    FakeDecoder decoder(&queue, length);
+    decoder.start();
+
+    qint64 pos = 0;
+    bool endOfStream = false;
+    QVERIFY(readFrames(&queue, &decoder, &pos, 10000, &endOfStream));
+    QVERIFY(endOfStream);
+    QCOMPARE(pos, length);
+
+    pos = 10;
+    queue.seek(pos);
+    QVERIFY(readFrames(&queue, &decoder, &pos, 10000, &endOfStream));
+    QVERIFY(endOfStream);
+    QCOMPARE(pos, length);
+    queue.stop();
+    decoder.wait();
+}
+
+void DecodeBlockQueueTest::stopsWithAllBlocksInUse()
+{
+    DecodeBlockQueue<qint64> queue(BlockCount);
+    FakeDecoder decoder(&queue, 1000000);
+    decoder.start();
+
+    // Never read, so that the decoder runs out of free blocks:
+    QTest::qSleep(50);
+    QTime time;
+    time.start();
+    queue.stop();
+    decoder.wait();
+    QVERIFY(time.elapsed() < 1000);
+    QCOMPARE(queue.acquireBlock(), -1);
+
+    // Everything is free again after a reset:
+    queue.reset();
+    for (int i=0; i<BlockCount; ++i)
+        QVERIFY(queue.acquireBlock() != -1);
+    QCOMPARE(queue.acquireBlock(), -1);
+}
+
+QTEST_MAIN(DecodeBlockQueueTest)
+#include "decodeblockqueuetest.moc"
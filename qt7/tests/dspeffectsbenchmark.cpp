@@ -0,0 +1,104 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "dspeffects.h"
+#include <math.h>
+#include <string.h>
+
+using namespace Phonon::QT7;
+
+// Each effect runs on the render thread for every buffer, so its cost
+// per buffer of stereo audio is what counts:
+class DspEffectsBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void equalizer();
+        void equalizerAllBands();
+        void compressor();
+        void gainPan();
+        void gainPanRamp();
+
+    private:
+        void run(DspEffect *effect);
+};
+
+enum {Frames = 512, Channels = 2};
+
+void DspEffectsBenchmark::run(DspEffect *effect)
+{
+    // The input is copied in every time, as effects with a gain below
+    // one would otherwise take it down into denormals:
+    effect->setFormat(44100, Channels);
+    QVector<float> input(Frames * Channels), data(Frames * Channels);
+    for (int i=0; i<input.size(); ++i)
+        input[i] = 0.5f * float(sin(i * 0.05));
+    float *channels[Channels] = {data.data(), data.data() + Frames};
+    QBENCHMARK {
+        memcpy(data.data(), input.constData(), data.size() * sizeof(float));
+        effect->process(channels, Frames);
+    }
+}
+
+void DspEffectsBenchmark::equalizer()
+{
+    EqualizerEffect effect;
+    effect.setValue(4, 6);
+    run(&effect);
+}
+
+void DspEffectsBenchmark::equalizerAllBands()
+{
+    EqualizerEffect effect;
+    for (int band=0; band<EqualizerEffect::BandCount; ++band)
+        effect.setValue(band * 3 + 1, 3);
+    run(&effect);
+}
+
+void DspEffectsBenchmark::compressor()
+{
+    CompressorEffect effect;
+    run(&effect);
+}
+
+void DspEffectsBenchmark::gainPan()
+{
+    GainPanEffect effect;
+    effect.setValue(GainPanEffect::Pan, 0.5f);
+    run(&effect);
+}
+
+void DspEffectsBenchmark::gainPanRamp()
+{
+    // A parameter change every buffer, so every buffer ramps:
+    GainPanEffect effect;
+    effect.setFormat(44100, Channels);
+    QVector<float> data(Frames * Channels);
+    float *channels[Channels] = {data.data(), data.data() + Frames};
+    float pan = 0;
+    QBENCHMARK {
+        data.fill(0.5f);
+        pan = (pan > 0.9f) ? -1 : pan + 0.01f;
+        effect.setValue(GainPanEffect::Pan, pan);
+        effect.process(channels, Frames);
+    }
+}
+
+QTEST_MAIN(DspEffectsBenchmark)
+#include "dspeffectsbenchmark.moc"
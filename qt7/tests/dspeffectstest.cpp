@@ -0,0 +1,239 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "dspeffects.h"
+#include <math.h>
+
+using namespace Phonon::QT7;
+
+// Checks the built-in effects against values worked out by hand (or
+// by a plain reference implementation), rather than against whatever
+// they happened to output when written:
+class DspEffectsTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void gainPanIsConstantPower();
+        void gainPanRampsOverOneBuffer();
+        void equalizerFlatIsTransparent();
+        void equalizerBoostsBand();
+        void biquadCascadeMatchesReference();
+        void compressorSteadyState();
+        void compressorBelowThreshold();
+        void scaleRampEndsOnTarget();
+};
+
+static const double SampleRate = 44100;
+
+static QVector<float> sine(double frequency, float amplitude, int frames)
+{
+    QVector<float> samples(frames);
+    for (int i=0; i<frames; ++i)
+        samples[i] = amplitude * float(sin(2 * M_PI * frequency * i / SampleRate));
+    return samples;
+}
+
+static double rmsDb(const float *samples, int frames)
+{
+    double sum = 0;
+    for (int i=0; i<frames; ++i)
+        sum += double(samples[i]) * samples[i];
+    return 10 * log10(sum / frames);
+}
+
+static void processInBuffers(DspEffect *effect, QVector<float> *channels, int channelCount, int bufferFrames = 512)
+{
+    int frames = channels[0].size();
+    for (int offset = 0; offset < frames; offset += bufferFrames){
+        float *buffers[DspEffect::MaxChannels];
+        for (int c=0; c<channelCount; ++c)
+            buffers[c] = channels[c].data() + offset;
+        effect->process(buffers, qMin(bufferFrames, frames - offset));
+    }
+}
+
+static void gainPanGains(float pan, float *left, float *right)
+{
+    GainPanEffect effect;
+    effect.setFormat(SampleRate, 2);
+    effect.setValue(GainPanEffect::Pan, pan);
+    effect.reset();
+    float l = 1, r = 1;
+    float *channels[2] = {&l, &r};
+    effect.process(channels, 1);
+    *left = l;
+    *right = r;
+}
+
+void DspEffectsTest::gainPanIsConstantPower()
+{
+    float left, right;
+    gainPanGains(-1, &left, &right);
+    QCOMPARE(left, 1.0f);
+    QVERIFY(qAbs(right) < 1e-6f);
+    gainPanGains(0, &left, &right);
+    QVERIFY(qAbs(left - float(M_SQRT1_2)) < 1e-6f);
+    QVERIFY(qAbs(right - float(M_SQRT1_2)) < 1e-6f);
+    gainPanGains(1, &left, &right);
+    QVERIFY(qAbs(left) < 1e-6f);
+    QCOMPARE(right, 1.0f);
+
+    for (int i = -10; i <= 10; ++i){
+        gainPanGains(i / 10.0f, &left, &right);
+        QVERIFY(qAbs(left * left + right * right - 1.0f) < 1e-5f);
+    }
+}
+
+void DspEffectsTest::gainPanRampsOverOneBuffer()
+{
+    GainPanEffect effect;
+    effect.setFormat(SampleRate, 1);
+    effect.setValue(GainPanEffect::GainDb, -6);
+    QVector<float> ones(256, 1.0f);
+    float *channels[1] = {ones.data()};
+    effect.process(channels, 256);
+    const float target = float(pow(10.0, -6 / 20.0));
+    QVERIFY(ones[0] > 0.99f);
+    QVERIFY(ones[128] < ones[0] && ones[128] > target);
+    QCOMPARE(ones[255], target);
+
+    // Steady from then on:
+    QVector<float> next(256, 1.0f);
+    channels[0] = next.data();
+    effect.process(channels, 256);
+    QCOMPARE(next[0], target);
+}
+
+void DspEffectsTest::equalizerFlatIsTransparent()
+{
+    EqualizerEffect effect;
+    effect.setFormat(SampleRate, 2);
+    QVector<float> channels[2] = {sine(440, 0.5f, 4096), sine(3000, 0.25f, 4096)};
+    QVector<float> expected[2] = {channels[0], channels[1]};
+    processInBuffers(&effect, channels, 2);
+    QVERIFY(channels[0] == expected[0]);
+    QVERIFY(channels[1] == expected[1]);
+}
+
+void DspEffectsTest::equalizerBoostsBand()
+{
+    // A peaking band boosts its center frequency by its gain,
+    // and leaves frequencies far from it nearly alone:
+    const int frames = 44100;
+    const int settled = 4410;
+    for (int c = 0; c < 2; ++c){
+        EqualizerEffect effect;
+        effect.setFormat(SampleRate, 1);
+        effect.setValue(3, 1000);
+        effect.setValue(4, 12);
+        effect.setValue(5, 1);
+        double frequency = (c == 0) ? 1000 : 50;
+        QVector<float> channel = sine(frequency, 0.1f, frames);
+        double before = rmsDb(channel.constData() + settled, frames - settled);
+        processInBuffers(&effect, &channel, 1);
+        double after = rmsDb(channel.constData() + settled, frames - settled);
+        if (c == 0)
+            QVERIFY(qAbs(after - before - 12) < 0.05);
+        else
+            QVERIFY(qAbs(after - before) < 0.5);
+    }
+}
+
+void DspEffectsTest::biquadCascadeMatchesReference()
+{
+    // Three channels leave one lane of the vector unused. The
+    // reference runs each channel through each section in turn:
+    const int channelCount = 3, frames = 1000, sections = 2;
+    const float coefficients[sections * 5] = {
+        0.2929f, 0.5858f, 0.2929f, -0.0000f, 0.1716f,
+        1.0500f, -1.8000f, 0.8000f, -1.8000f, 0.8500f
+    };
+    QVector<float> channels[channelCount];
+    for (int c=0; c<channelCount; ++c)
+        channels[c] = sine(300 * (c + 1), 0.5f, frames);
+
+    QVector<float> expected[channelCount];
+    for (int c=0; c<channelCount; ++c){
+        expected[c] = channels[c];
+        for (int s=0; s<sections; ++s){
+            const float *k = coefficients + s * 5;
+            double s1 = 0, s2 = 0;
+            for (int i=0; i<frames; ++i){
+                double x = expected[c][i];
+                double y = k[0] * x + s1;
+                s1 = k[1] * x - k[3] * y + s2;
+                s2 = k[2] * x - k[4] * y;
+                expected[c][i] = float(y);
+            }
+        }
+    }
+
+    float *buffers[channelCount];
+    for (int c=0; c<channelCount; ++c)
+        buffers[c] = channels[c].data();
+    float z1[sections * DspEffect::MaxChannels], z2[sections * DspEffect::MaxChannels];
+    memset(z1, 0, sizeof(z1));
+    memset(z2, 0, sizeof(z2));
+    DspKernel::biquadCascade(buffers, channelCount, frames, coefficients, sections, z1, z2);
+    for (int c=0; c<channelCount; ++c){
+        for (int i=0; i<frames; ++i)
+            QVERIFY(qAbs(channels[c][i] - expected[c][i]) < 1e-4f);
+    }
+}
+
+void DspEffectsTest::compressorSteadyState()
+{
+    // Above the threshold, the level rises by 1 dB per 'ratio' dB:
+    // a full scale sine, 20 dB over a -20 dB threshold at 4:1, comes
+    // out 15 dB down.
+    CompressorEffect effect;
+    effect.setFormat(SampleRate, 1);
+    effect.setValue(CompressorEffect::ThresholdDb, -20);
+    effect.setValue(CompressorEffect::Ratio, 4);
+    QVector<float> channel = sine(1000, 1.0f, 44100);
+    processInBuffers(&effect, &channel, 1);
+    float peak = DspKernel::peak(channel.constData() + 22050, 22050);
+    QVERIFY(qAbs(20 * log10(peak) + 15) < 0.5);
+    QVERIFY(qAbs(20 * log10(effect.currentGain()) + 15) < 0.5);
+}
+
+void DspEffectsTest::compressorBelowThreshold()
+{
+    CompressorEffect effect;
+    effect.setFormat(SampleRate, 2);
+    QVector<float> channels[2] = {sine(500, 0.05f, 8192), sine(700, 0.05f, 8192)};
+    QVector<float> expected[2] = {channels[0], channels[1]};
+    processInBuffers(&effect, channels, 2);
+    QVERIFY(channels[0] == expected[0]);
+    QVERIFY(channels[1] == expected[1]);
+}
+
+void DspEffectsTest::scaleRampEndsOnTarget()
+{
+    for (int frames = 1; frames < 12; ++frames){
+        QVector<float> data(frames, 2.0f);
+        DspKernel::scaleRamp(data.data(), 0, 0.5f, frames);
+        QCOMPARE(data[frames - 1], 1.0f);
+        for (int i=1; i<frames; ++i)
+            QVERIFY(data[i] > data[i - 1]);
+    }
+}
+
+QTEST_MAIN(DspEffectsTest)
+#include "dspeffectstest.moc"
@@ -0,0 +1,84 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "gainramp.h"
+
+using namespace Phonon::QT7;
+
+// The gain is applied on the render thread for every frame of every
+// player and mixer, so it must stay far below the cost of a cycle:
+class GainRampBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void fillGains();
+        void applyPlanar();
+        void applyStereo();
+        void applyFiveOne();
+        void applySevenOne();
+
+    private:
+        void applyInterleaved(int channels);
+};
+
+enum {Frames = 4096};
+
+void GainRampBenchmark::fillGains()
+{
+    GainRamp ramp;
+    float gains[Frames];
+    QBENCHMARK {
+        ramp.start(0, 1, Frames, GainCurve::CrossFadeIn);
+        ramp.fillGains(gains, Frames);
+    }
+}
+
+void GainRampBenchmark::applyPlanar()
+{
+    QVector<float> gains(Frames, 0.5f), data(Frames, 0.25f);
+    QBENCHMARK {
+        GainKernel::applyPlanar(data.data(), gains.constData(), Frames);
+    }
+}
+
+void GainRampBenchmark::applyInterleaved(int channels)
+{
+    QVector<float> gains(Frames, 0.5f), data(Frames * channels, 0.25f);
+    QBENCHMARK {
+        GainKernel::applyInterleaved(data.data(), channels, gains.constData(), Frames);
+    }
+}
+
+void GainRampBenchmark::applyStereo()
+{
+    applyInterleaved(2);
+}
+
+void GainRampBenchmark::applyFiveOne()
+{
+    applyInterleaved(6);
+}
+
+void GainRampBenchmark::applySevenOne()
+{
+    applyInterleaved(8);
+}
+
+QTEST_MAIN(GainRampBenchmark)
+#include "gainrampbenchmark.moc"
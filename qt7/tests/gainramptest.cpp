@@ -0,0 +1,119 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "gainramp.h"
+
+using namespace Phonon::QT7;
+
+class GainRampTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void curvesSpanUnitRange();
+        void rampReachesTarget();
+        void fallingRampMirrorsRisingRamp();
+        void rampIsContinuousAcrossBlocks();
+        void kernelsMatchReference();
+};
+
+void GainRampTest::curvesSpanUnitRange()
+{
+    for (int s = 0; s < GainCurve::ShapeCount; ++s){
+        GainCurve::Shape shape = GainCurve::Shape(s);
+        QCOMPARE(GainCurve::value(shape, 0), 0.0f);
+        QCOMPARE(GainCurve::value(shape, 1), 1.0f);
+        for (int i = 1; i <= 100; ++i)
+            QVERIFY(GainCurve::value(shape, i / 100.0f) >= GainCurve::value(shape, (i - 1) / 100.0f));
+    }
+    QVERIFY(qAbs(GainCurve::value(GainCurve::Fade3Decibel, 0.5f) - 0.7071f) < 0.001f);
+    QVERIFY(qAbs(GainCurve::value(GainCurve::Linear, 0.5f) - 0.5f) < 0.0001f);
+}
+
+void GainRampTest::rampReachesTarget()
+{
+    GainRamp ramp;
+    QVERIFY(ramp.isUnity());
+    ramp.start(1, 0.25f, 100);
+    float gains[150];
+    ramp.fillGains(gains, 150);
+    QCOMPARE(gains[0], 1.0f);
+    QVERIFY(qAbs(gains[50] - 0.625f) < 0.0001f);
+    for (int i = 100; i < 150; ++i)
+        QCOMPARE(gains[i], 0.25f);
+    QVERIFY(!ramp.isRamping());
+    QCOMPARE(ramp.gain(), 0.25f);
+}
+
+void GainRampTest::fallingRampMirrorsRisingRamp()
+{
+    GainRamp rising, falling;
+    rising.start(0, 1, 400, GainCurve::Fade12Decibel);
+    falling.start(1, 0, 400, GainCurve::Fade12Decibel);
+    float up[401], down[401];
+    rising.fillGains(up, 401);
+    falling.fillGains(down, 401);
+    for (int i = 1; i < 400; ++i)
+        QVERIFY(qAbs(up[i] - down[400 - i]) < 0.0001f);
+}
+
+void GainRampTest::rampIsContinuousAcrossBlocks()
+{
+    // Filling in blocks gives the same gains as filling at once:
+    GainRamp whole, blocks;
+    whole.start(0.2f, 0.9f, 1000, GainCurve::CrossFadeIn);
+    blocks.start(0.2f, 0.9f, 1000, GainCurve::CrossFadeIn);
+    float expected[1200], gains[1200];
+    whole.fillGains(expected, 1200);
+    for (int offset = 0; offset < 1200; offset += 37)
+        blocks.fillGains(gains + offset, qMin(37, 1200 - offset));
+    for (int i = 0; i < 1200; ++i)
+        QCOMPARE(gains[i], expected[i]);
+}
+
+void GainRampTest::kernelsMatchReference()
+{
+    // Odd frame counts leave a tail after the vector loops:
+    const int frames = 259;
+    float gains[frames];
+    for (int f = 0; f < frames; ++f)
+        gains[f] = 1.0f - f / float(frames);
+
+    for (int channels = 1; channels <= 8; ++channels){
+        QVector<float> data(frames * channels), expected(frames * channels);
+        for (int i = 0; i < data.size(); ++i)
+            data[i] = expected[i] = float(sin(i * 0.1));
+        for (int f = 0; f < frames; ++f){
+            for (int c = 0; c < channels; ++c)
+                expected[f * channels + c] *= gains[f];
+        }
+        GainKernel::applyInterleaved(data.data(), channels, gains, frames);
+        QVERIFY(data == expected);
+    }
+
+    QVector<float> planar(frames), expected(frames);
+    for (int i = 0; i < frames; ++i){
+        planar[i] = float(cos(i * 0.1));
+        expected[i] = planar[i] * gains[i];
+    }
+    GainKernel::applyPlanar(planar.data(), gains, frames);
+    QVERIFY(planar == expected);
+}
+
+QTEST_MAIN(GainRampTest)
+#include "gainramptest.moc"
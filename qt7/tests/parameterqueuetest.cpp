@@ -0,0 +1,216 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "parameterqueue.h"
+
+using namespace Phonon::QT7;
+
+// Records what the queue sets, as an audio unit would take it:
+class RecordingTarget : public ParameterTarget
+{
+    public:
+        struct Change
+        {
+            quint32 parameter;
+            float value;
+            quint32 bufferOffset;
+        };
+
+        void setParameterValue(const ParameterCommand &command, float value, quint32 bufferOffset)
+        {
+            Change change = {command.parameter, value, bufferOffset};
+            changes.append(change);
+        }
+
+        QList<Change> changes;
+};
+
+class ParameterQueueTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void appliesAtSampleTime();
+        void rejectsTooManyTimedCommands();
+        void rampStartsFromLastValue();
+        void rampStartsFromPostedValue();
+        void flushAppliesEverything();
+        void sendKeepsNewestValue();
+        void flushAppliesKeptLast();
+};
+
+static ParameterCommand parameterCommand(quint32 parameter, float value, double sampleTime = -1, quint32 rampFrames = 0, float from = 0)
+{
+    ParameterCommand command;
+    command.parameter = parameter;
+    command.scope = 0;
+    command.element = 0;
+    command.value = value;
+    command.sampleTime = sampleTime;
+    command.rampFrames = rampFrames;
+    command.from = from;
+    return command;
+}
+
+void ParameterQueueTest::appliesAtSampleTime()
+{
+    ParameterQueue queue;
+    RecordingTarget target;
+    QVERIFY(queue.post(parameterCommand(1, 0.5f, 1100)));
+    QVERIFY(queue.post(parameterCommand(2, 0.25f)));
+
+    queue.process(&target, 0, 512);
+    QCOMPARE(target.changes.size(), 1);
+    QCOMPARE(target.changes[0].parameter, quint32(2));
+    QCOMPARE(queue.pendingCount(), 1);
+
+    queue.process(&target, 512, 512);
+    QCOMPARE(target.changes.size(), 1);
+    queue.process(&target, 1024, 512);
+    QCOMPARE(target.changes.size(), 2);
+    QCOMPARE(target.changes[1].value, 0.5f);
+    QCOMPARE(target.changes[1].bufferOffset, quint32(76));
+    QCOMPARE(queue.pendingCount(), 0);
+}
+
+void ParameterQueueTest::rejectsTooManyTimedCommands()
+{
+    // The render thread keeps at most 32 commands that are not due
+    // yet. Instead of applying the extra ones early, post refuses them:
+    ParameterQueue queue(64);
+    RecordingTarget target;
+    int posted = 0;
+    while (posted < 64 && queue.post(parameterCommand(posted, 1, 100000 + posted)))
+        ++posted;
+    QCOMPARE(posted, 32);
+    QVERIFY(queue.post(parameterCommand(100, 1)));
+
+    queue.process(&target, 0, 512);
+    QCOMPARE(target.changes.size(), 1);
+    QCOMPARE(queue.pendingCount(), 32);
+    QVERIFY(!queue.post(parameterCommand(101, 1, 200000)));
+
+    // Once some are applied, there is room again:
+    queue.process(&target, 100000, 16);
+    QCOMPARE(queue.pendingCount(), 16);
+    QVERIFY(queue.post(parameterCommand(101, 1, 200000)));
+}
+
+void ParameterQueueTest::rampStartsFromLastValue()
+{
+    ParameterQueue queue;
+    RecordingTarget target;
+    queue.post(parameterCommand(1, 0.2f));
+    queue.process(&target, 0, 100);
+
+    // The posted 'from' is stale; the queue knows better:
+    queue.post(parameterCommand(1, 1.0f, -1, 400, 0.9f));
+    for (int i = 1; i <= 4; ++i)
+        queue.process(&target, i * 100, 100);
+    QCOMPARE(target.changes.size(), 5);
+    QVERIFY(qAbs(target.changes[1].value - 0.4f) < 0.0001f);
+    QVERIFY(qAbs(target.changes[2].value - 0.6f) < 0.0001f);
+    QCOMPARE(target.changes[4].value, 1.0f);
+    QCOMPARE(queue.rampCount(), 0);
+}
+
+void ParameterQueueTest::rampStartsFromPostedValue()
+{
+    ParameterQueue queue;
+    RecordingTarget target;
+    queue.post(parameterCommand(1, 1.0f, -1, 200, 0.5f));
+    queue.process(&target, 0, 100);
+    QCOMPARE(target.changes.size(), 1);
+    QVERIFY(qAbs(target.changes[0].value - 0.75f) < 0.0001f);
+}
+
+void ParameterQueueTest::flushAppliesEverything()
+{
+    ParameterQueue queue;
+    RecordingTarget target;
+    queue.post(parameterCommand(1, 0.5f, 5000));
+    queue.post(parameterCommand(2, 0.5f, -1, 1000, 0));
+    queue.process(&target, 0, 100);
+    queue.post(parameterCommand(1, 0.75f));
+    target.changes.clear();
+
+    queue.flush(&target);
+    QCOMPARE(queue.pendingCount(), 0);
+    QCOMPARE(queue.rampCount(), 0);
+    QCOMPARE(target.changes.size(), 3);
+    QCOMPARE(target.changes[0].parameter, quint32(2));
+    QCOMPARE(target.changes[0].value, 0.5f);
+    QCOMPARE(target.changes[1].value, 0.5f);
+    QCOMPARE(target.changes[2].value, 0.75f);
+
+    // The timed command no longer counts against the limit:
+    for (int i = 0; i < 32; ++i)
+        QVERIFY(queue.post(parameterCommand(i, 1, 100000)));
+}
+
+void ParameterQueueTest::sendKeepsNewestValue()
+{
+    // Fill the queue, as it fills while nothing renders:
+    ParameterQueue queue(4);
+    RecordingTarget target;
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(queue.send(parameterCommand(1, 0.1f * i)));
+    QVERIFY(!queue.send(parameterCommand(1, 0.8f)));
+    QVERIFY(!queue.send(parameterCommand(2, 0.5f)));
+    QVERIFY(!queue.send(parameterCommand(1, 0.9f)));
+    QCOMPARE(queue.keptCount(), 2);
+
+    // Nothing kept can be posted before the queue drains:
+    QVERIFY(!queue.repost());
+    queue.process(&target, 0, 512);
+    QCOMPARE(target.changes.last().value, 0.3f);
+
+    QVERIFY(queue.repost());
+    QCOMPARE(queue.keptCount(), 0);
+    target.changes.clear();
+    queue.process(&target, 512, 512);
+    QCOMPARE(target.changes.size(), 2);
+    QCOMPARE(target.changes[0].parameter, quint32(2));
+    QCOMPARE(target.changes[0].value, 0.5f);
+    QCOMPARE(target.changes[1].parameter, quint32(1));
+    QCOMPARE(target.changes[1].value, 0.9f);
+
+    // With nothing kept, send posts right away:
+    QVERIFY(queue.send(parameterCommand(1, 1.0f)));
+}
+
+void ParameterQueueTest::flushAppliesKeptLast()
+{
+    ParameterQueue queue(2);
+    RecordingTarget target;
+    queue.send(parameterCommand(1, 0.25f));
+    queue.send(parameterCommand(1, 0.5f));
+    QVERIFY(!queue.send(parameterCommand(1, 0.75f, 100000)));
+
+    queue.flush(&target);
+    QCOMPARE(queue.keptCount(), 0);
+    QCOMPARE(target.changes.size(), 3);
+    QCOMPARE(target.changes.last().value, 0.75f);
+
+    // The kept timed command never counted against the limit:
+    for (int i = 0; i < 2; ++i)
+        QVERIFY(queue.post(parameterCommand(i, 1, 100000)));
+}
+
+QTEST_MAIN(ParameterQueueTest)
+#include "parameterqueuetest.moc"
@@ -0,0 +1,88 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "polyphaseresampler.h"
+#include <math.h>
+#include <string.h>
+
+using namespace Phonon::QT7;
+
+// The cost of converting one render buffer of stereo audio, per
+// quality and for the usual conversions:
+class PolyphaseResamplerBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void upFast();
+        void upGood();
+        void upBest();
+        void downGood();
+        void fractionalGood();
+
+    private:
+        void run(double inputRate, double outputRate, PolyphaseResampler::Quality quality);
+};
+
+enum {Frames = 512, Channels = 2};
+
+void PolyphaseResamplerBenchmark::run(double inputRate, double outputRate, PolyphaseResampler::Quality quality)
+{
+    PolyphaseResampler resampler;
+    resampler.configure(inputRate, outputRate, Channels, quality);
+    QVector<float> input(4096);
+    for (int i=0; i<input.size(); ++i)
+        input[i] = 0.5f * float(sin(i * 0.05));
+    QVector<float> output(Frames * Channels);
+    float *channels[Channels] = {output.data(), output.data() + Frames};
+    QBENCHMARK {
+        int needed = resampler.framesNeeded(Frames);
+        for (int c=0; c<Channels; ++c)
+            memcpy(resampler.inputBuffer(c, needed), input.constData(), needed * sizeof(float));
+        resampler.commitInput(needed);
+        resampler.read(channels, Frames);
+    }
+}
+
+void PolyphaseResamplerBenchmark::upFast()
+{
+    run(44100, 48000, PolyphaseResampler::Fast);
+}
+
+void PolyphaseResamplerBenchmark::upGood()
+{
+    run(44100, 48000, PolyphaseResampler::Good);
+}
+
+void PolyphaseResamplerBenchmark::upBest()
+{
+    run(44100, 48000, PolyphaseResampler::Best);
+}
+
+void PolyphaseResamplerBenchmark::downGood()
+{
+    run(48000, 44100, PolyphaseResampler::Good);
+}
+
+void PolyphaseResamplerBenchmark::fractionalGood()
+{
+    run(44100, 44100 * 1.0003, PolyphaseResampler::Good);
+}
+
+QTEST_MAIN(PolyphaseResamplerBenchmark)
+#include "polyphaseresamplerbenchmark.moc"
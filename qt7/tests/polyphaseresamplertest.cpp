@@ -0,0 +1,221 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "polyphaseresampler.h"
+#include <math.h>
+
+using namespace Phonon::QT7;
+
+static const double Pi = 3.14159265358979323846;
+
+// Resamples 'frames' of a sine (a different phase per channel) in
+// chunks of 'chunk' output frames, as the resampler node would. The
+// input for a chunk is written at most 'maxWrite' frames at a time
+// (if not zero), reading what each write makes available in between:
+static QVector<QVector<float> > resampleSine(PolyphaseResampler &resampler, double frequency, double amplitude, int frames, int chunk,
+    int maxWrite = 0)
+{
+    int channels = resampler.channelCount();
+    QVector<QVector<float> > output(channels);
+    qint64 written = 0;
+    for (int c=0; c<channels; ++c)
+        output[c].resize(frames);
+    int produced = 0;
+    while (produced < frames){
+        int count = qMin(chunk, frames - produced);
+        int got = 0;
+        do {
+            int needed = resampler.framesNeeded(count - got);
+            if (maxWrite > 0)
+                needed = qMin(needed, maxWrite);
+            for (int c=0; c<channels; ++c){
+                float *in = resampler.inputBuffer(c, needed);
+                if (!in)
+                    return QVector<QVector<float> >();
+                for (int i=0; i<needed; ++i)
+                    in[i] = float(amplitude * sin(2 * Pi * frequency * (written + i) / resampler.inputRate() + c));
+            }
+            resampler.commitInput(needed);
+            written += needed;
+            float *out[8];
+            for (int c=0; c<channels; ++c)
+                out[c] = output[c].data() + produced + got;
+            got += resampler.read(out, count - got);
+        } while (got < count && maxWrite > 0);
+        if (got != count)
+            return QVector<QVector<float> >();
+        produced += got;
+    }
+    return output;
+}
+
+// The error against the ideal sine at the output times, in dB
+// below the signal, skipping the first 'skip' frames:
+static double signalToNoise(const QVector<float> &output, double frequency, double outputRate, int channel, int skip)
+{
+    double signal = 0, noise = 0;
+    for (int i=skip; i<output.size(); ++i){
+        double ideal = sin(2 * Pi * frequency * i / outputRate + channel);
+        signal += ideal * ideal;
+        noise += (output[i] - ideal) * (output[i] - ideal);
+    }
+    return 10 * log10(signal / noise);
+}
+
+static double levelDb(const QVector<float> &output, int skip)
+{
+    double sum = 0;
+    for (int i=skip; i<output.size(); ++i)
+        sum += double(output[i]) * output[i];
+    return 10 * log10(2 * sum / (output.size() - skip));
+}
+
+class PolyphaseResamplerTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void exactRatios();
+        void unityAtDc();
+        void qualityOfSine();
+        void fractionalRatio();
+        void rejectsAliases();
+        void chunkingDoesNotMatter();
+        void downsamplingInSeveralWrites();
+        void dotMatchesScalar();
+};
+
+void PolyphaseResamplerTest::exactRatios()
+{
+    PolyphaseResampler resampler;
+    QVERIFY(resampler.configure(44100, 48000, 2));
+    QCOMPARE(resampler.phaseCount(), 160);
+    QVERIFY(resampler.configure(48000, 44100, 2));
+    QCOMPARE(resampler.phaseCount(), 147);
+    QVERIFY(resampler.configure(22050, 44100, 1));
+    QCOMPARE(resampler.phaseCount(), 2);
+    QVERIFY(resampler.tapsPerPhase() % 4 == 0);
+    QVERIFY(!resampler.configure(0, 44100, 2));
+}
+
+void PolyphaseResamplerTest::unityAtDc()
+{
+    PolyphaseResampler resampler;
+    resampler.configure(44100, 48000, 1);
+    int needed = resampler.framesNeeded(1000);
+    float *in = resampler.inputBuffer(0, needed);
+    for (int i=0; i<needed; ++i)
+        in[i] = 0.5f;
+    resampler.commitInput(needed);
+    QVector<float> out(1000);
+    float *channels[1] = {out.data()};
+    QCOMPARE(resampler.read(channels, 1000), 1000);
+    for (int i=100; i<1000; ++i)
+        QVERIFY(qAbs(out[i] - 0.5f) < 1e-4f);
+}
+
+void PolyphaseResamplerTest::qualityOfSine()
+{
+    // A 1 kHz sine, from 44.1 to 48 kHz. Better
+    // qualities must not do worse than the minimum:
+    const double minimumDb[] = {60, 85, 110};
+    for (int q = PolyphaseResampler::Fast; q <= PolyphaseResampler::Best; ++q){
+        PolyphaseResampler resampler;
+        resampler.configure(44100, 48000, 2, PolyphaseResampler::Quality(q));
+        QVector<QVector<float> > output = resampleSine(resampler, 1000, 1, 48000, 512);
+        QCOMPARE(output.size(), 2);
+        for (int c=0; c<2; ++c){
+            double snr = signalToNoise(output[c], 1000, 48000, c, 1000);
+            QVERIFY(snr > minimumDb[q]);
+        }
+    }
+}
+
+void PolyphaseResamplerTest::fractionalRatio()
+{
+    // A ratio that is not exact steps a fractional position
+    // over MaxPhases phases, and stays close to the ideal:
+    PolyphaseResampler resampler;
+    resampler.configure(44100, 44100 * 1.0003, 1);
+    QCOMPARE(resampler.phaseCount(), int(PolyphaseResampler::MaxPhases));
+    QVector<QVector<float> > output = resampleSine(resampler, 1000, 1, 44100, 441);
+    QCOMPARE(output.size(), 1);
+    double snr = signalToNoise(output[0], 1000, 44100 * 1.0003, 0, 1000);
+    QVERIFY(snr > 80);
+}
+
+void PolyphaseResamplerTest::rejectsAliases()
+{
+    // Going down from 48 to 44.1 kHz, a tone above the new Nyquist
+    // frequency would fold back into the audible range:
+    PolyphaseResampler resampler;
+    resampler.configure(48000, 44100, 1, PolyphaseResampler::Good);
+    QVector<QVector<float> > output = resampleSine(resampler, 23000, 1, 44100, 512);
+    QVERIFY(levelDb(output[0], 1000) < -70);
+
+    // While a tone well inside the passband comes through at full level:
+    resampler.reset();
+    output = resampleSine(resampler, 10000, 1, 44100, 512);
+    QVERIFY(qAbs(levelDb(output[0], 1000)) < 0.1);
+}
+
+void PolyphaseResamplerTest::chunkingDoesNotMatter()
+{
+    PolyphaseResampler whole, chunked;
+    whole.configure(44100, 48000, 2);
+    chunked.configure(44100, 48000, 2);
+    // Up to the 4096 input frames it was configured for at a time:
+    QVector<QVector<float> > expected = resampleSine(whole, 440, 0.5, 9000, 3000);
+    QVector<QVector<float> > output = resampleSine(chunked, 440, 0.5, 9000, 37);
+    QCOMPARE(expected.size(), 2);
+    QVERIFY(output == expected);
+    QVERIFY(resampleSine(whole, 440, 0.5, 9000, 9000).isEmpty());
+}
+
+void PolyphaseResamplerTest::downsamplingInSeveralWrites()
+{
+    // From 192 kHz, 1156 output frames need more
+    // input than fits in the 4096 frames at once:
+    PolyphaseResampler whole, pulled;
+    whole.configure(192000, 44100, 2, PolyphaseResampler::Good, 16384);
+    pulled.configure(192000, 44100, 2);
+    QVERIFY(pulled.framesNeeded(1156) > 4096);
+    QVector<QVector<float> > expected = resampleSine(whole, 440, 0.5, 5000, 1156);
+    QVector<QVector<float> > output = resampleSine(pulled, 440, 0.5, 5000, 1156, 4096);
+    QCOMPARE(expected.size(), 2);
+    QVERIFY(output == expected);
+    QVERIFY(resampleSine(pulled, 440, 0.5, 5000, 1156).isEmpty());
+}
+
+void PolyphaseResamplerTest::dotMatchesScalar()
+{
+    float a[256], b[256];
+    for (int i=0; i<256; ++i){
+        a[i] = float(sin(i * 0.3));
+        b[i] = float(cos(i * 0.7));
+    }
+    for (int count = 4; count <= 256; count += 4){
+        double expected = 0;
+        for (int i=0; i<count; ++i)
+            expected += double(a[i]) * b[i];
+        QVERIFY(qAbs(PolyphaseResampler::dot(a, b, count) - expected) < 1e-4);
+    }
+}
+
+QTEST_MAIN(PolyphaseResamplerTest)
+#include "polyphaseresamplertest.moc"
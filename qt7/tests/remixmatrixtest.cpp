@@ -0,0 +1,183 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "remixmatrix.h"
+
+using namespace Phonon::QT7;
+
+static const float Minus3dB = 0.70710678f;
+
+static QVector<quint32> labels(quint32 a, quint32 b = 0, quint32 c = 0, quint32 d = 0, quint32 e = 0, quint32 f = 0)
+{
+    quint32 all[6] = {a, b, c, d, e, f};
+    QVector<quint32> result;
+    for (int i=0; i<6 && all[i]; ++i)
+        result.append(all[i]);
+    return result;
+}
+
+static bool fuzzyEqual(float a, float b)
+{
+    return qAbs(a - b) < 1e-6f;
+}
+
+class RemixMatrixTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void sameLayoutIsIdentity();
+        void defaultLabels();
+        void fiveOneToStereoWithoutHeadroom();
+        void fiveOneToStereoNormalized();
+        void fiveOneToStereoFixedHeadroom();
+        void stereoToMono();
+        void upMixIsNotScaled();
+        void rearToSurround();
+        void applyMatchesGains();
+};
+
+void RemixMatrixTest::sameLayoutIsIdentity()
+{
+    QVector<quint32> fiveOne = RemixMatrix::defaultLabels(6);
+    RemixMatrix matrix(fiveOne, fiveOne);
+    QVERIFY(matrix.isIdentity());
+    QVERIFY(!RemixMatrix(fiveOne, RemixMatrix::defaultLabels(2)).isIdentity());
+}
+
+void RemixMatrixTest::defaultLabels()
+{
+    QVERIFY(RemixMatrix::defaultLabels(1) == labels(RemixMatrix::Mono));
+    QVERIFY(RemixMatrix::defaultLabels(6) == labels(RemixMatrix::Left, RemixMatrix::Right, RemixMatrix::Center,
+        RemixMatrix::LFEScreen, RemixMatrix::LeftSurround, RemixMatrix::RightSurround));
+    QCOMPARE(RemixMatrix::defaultLabels(10)[9], quint32((1 << 16) | 9));
+}
+
+void RemixMatrixTest::fiveOneToStereoWithoutHeadroom()
+{
+    // ITU-R BS.775: center and surrounds into the sides at -3 dB,
+    // and no LFE:
+    RemixMatrix matrix(RemixMatrix::defaultLabels(6), RemixMatrix::defaultLabels(2), RemixMatrix::NoHeadroom);
+    QCOMPARE(matrix.gain(0, 0), 1.0f);
+    QCOMPARE(matrix.gain(0, 1), 0.0f);
+    QVERIFY(fuzzyEqual(matrix.gain(0, 2), Minus3dB));
+    QCOMPARE(matrix.gain(0, 3), 0.0f);
+    QVERIFY(fuzzyEqual(matrix.gain(0, 4), Minus3dB));
+    QCOMPARE(matrix.gain(0, 5), 0.0f);
+    QCOMPARE(matrix.gain(1, 1), 1.0f);
+    QVERIFY(fuzzyEqual(matrix.gain(1, 2), Minus3dB));
+    QVERIFY(fuzzyEqual(matrix.gain(1, 5), Minus3dB));
+}
+
+void RemixMatrixTest::fiveOneToStereoNormalized()
+{
+    // The same proportions, but no output can go over full scale:
+    RemixMatrix itu(RemixMatrix::defaultLabels(6), RemixMatrix::defaultLabels(2), RemixMatrix::NoHeadroom);
+    RemixMatrix matrix(RemixMatrix::defaultLabels(6), RemixMatrix::defaultLabels(2), RemixMatrix::Normalize);
+    const float scale = 1 / (1 + 2 * Minus3dB);
+    for (int o=0; o<2; ++o){
+        float sum = 0;
+        for (int i=0; i<6; ++i){
+            QVERIFY(fuzzyEqual(matrix.gain(o, i), itu.gain(o, i) * scale));
+            sum += matrix.gain(o, i);
+        }
+        QVERIFY(fuzzyEqual(sum, 1));
+    }
+}
+
+void RemixMatrixTest::fiveOneToStereoFixedHeadroom()
+{
+    RemixMatrix itu(RemixMatrix::defaultLabels(6), RemixMatrix::defaultLabels(2), RemixMatrix::NoHeadroom);
+    RemixMatrix matrix(RemixMatrix::defaultLabels(6), RemixMatrix::defaultLabels(2), RemixMatrix::FixedHeadroom, 3);
+    for (int o=0; o<2; ++o){
+        for (int i=0; i<6; ++i)
+            QVERIFY(qAbs(matrix.gain(o, i) - itu.gain(o, i) * Minus3dB) < 1e-3f);
+    }
+}
+
+void RemixMatrixTest::stereoToMono()
+{
+    RemixMatrix itu(RemixMatrix::defaultLabels(2), RemixMatrix::defaultLabels(1), RemixMatrix::NoHeadroom);
+    QVERIFY(fuzzyEqual(itu.gain(0, 0), Minus3dB));
+    QVERIFY(fuzzyEqual(itu.gain(0, 1), Minus3dB));
+    RemixMatrix matrix(RemixMatrix::defaultLabels(2), RemixMatrix::defaultLabels(1), RemixMatrix::Normalize);
+    QVERIFY(fuzzyEqual(matrix.gain(0, 0), 0.5f));
+    QVERIFY(fuzzyEqual(matrix.gain(0, 1), 0.5f));
+}
+
+void RemixMatrixTest::upMixIsNotScaled()
+{
+    // Nothing is synthesized, and nothing needs headroom:
+    RemixMatrix matrix(RemixMatrix::defaultLabels(2), RemixMatrix::defaultLabels(6), RemixMatrix::Normalize);
+    QCOMPARE(matrix.gain(0, 0), 1.0f);
+    QCOMPARE(matrix.gain(1, 1), 1.0f);
+    for (int o=2; o<6; ++o){
+        QCOMPARE(matrix.gain(o, 0), 0.0f);
+        QCOMPARE(matrix.gain(o, 1), 0.0f);
+    }
+
+    // A mono source goes to the center, if there is one:
+    RemixMatrix mono(RemixMatrix::defaultLabels(1), RemixMatrix::defaultLabels(6));
+    QCOMPARE(mono.gain(2, 0), 1.0f);
+    QCOMPARE(mono.gain(0, 0), 0.0f);
+}
+
+void RemixMatrixTest::rearToSurround()
+{
+    // 7.1 to 5.1: the rear channels join the surrounds, which
+    // then need headroom:
+    RemixMatrix itu(RemixMatrix::defaultLabels(8), RemixMatrix::defaultLabels(6), RemixMatrix::NoHeadroom);
+    QCOMPARE(itu.gain(4, 4), 1.0f);
+    QCOMPARE(itu.gain(4, 6), 1.0f);
+    QCOMPARE(itu.gain(5, 7), 1.0f);
+    QCOMPARE(itu.gain(3, 3), 1.0f);
+    RemixMatrix matrix(RemixMatrix::defaultLabels(8), RemixMatrix::defaultLabels(6), RemixMatrix::Normalize);
+    QVERIFY(fuzzyEqual(matrix.gain(4, 6), 0.5f));
+    QVERIFY(fuzzyEqual(matrix.gain(0, 0), 0.5f));
+}
+
+void RemixMatrixTest::applyMatchesGains()
+{
+    // An odd frame count leaves a tail after the vector loop:
+    const int frames = 37;
+    RemixMatrix matrix(RemixMatrix::defaultLabels(6), RemixMatrix::defaultLabels(2));
+    QVector<QVector<float> > input(6);
+    const float *in[6];
+    for (int i=0; i<6; ++i){
+        input[i].resize(frames);
+        for (int f=0; f<frames; ++f)
+            input[i][f] = float(i + 1) * 0.01f * (f + 1);
+        in[i] = input[i].constData();
+    }
+    QVector<float> left(frames), right(frames);
+    float *out[2] = {left.data(), right.data()};
+    matrix.apply(in, out, frames);
+
+    for (int f=0; f<frames; ++f){
+        float expected[2] = {0, 0};
+        for (int o=0; o<2; ++o){
+            for (int i=0; i<6; ++i)
+                expected[o] += matrix.gain(o, i) * input[i][f];
+        }
+        QVERIFY(qAbs(left[f] - expected[0]) < 1e-5f);
+        QVERIFY(qAbs(right[f] - expected[1]) < 1e-5f);
+    }
+}
+
+QTEST_MAIN(RemixMatrixTest)
+#include "remixmatrixtest.moc"
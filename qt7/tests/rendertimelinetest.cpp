@@ -0,0 +1,224 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "rendertimeline.h"
+
+using namespace Phonon::QT7;
+
+// A player unit with a synthetic source: sample i of the source has the
+// value first + i, so any gap or overlap shows in the rendered output.
+// Scheduled audio plays at the unit's start sample on the timeline:
+class SyntheticPlayer
+{
+    public:
+        SyntheticPlayer(int frames, int first)
+        {
+            m_frames = frames;
+            m_first = first;
+            scheduled = 0;
+        }
+
+        void scheduleAll(int sliceFrames)
+        {
+            while (scheduled < m_frames)
+                scheduled += qMin(sliceFrames, m_frames - scheduled);
+        }
+
+        float sampleAt(double sampleTime) const
+        {
+            double start = timeline.startSampleTime();
+            if (start < 0 || sampleTime < start || sampleTime >= start + scheduled)
+                return 0;
+            return float(m_first + int(sampleTime - start));
+        }
+
+        RenderTimeline timeline;
+        int scheduled;
+
+    private:
+        int m_frames;
+        int m_first;
+};
+
+// Renders cycles of 'frameCount' frames from 'sampleTime' on,
+// mixing the players the way the mixer in the graph does:
+class SimulatedGraph
+{
+    public:
+        SimulatedGraph(double sampleTime, int frameCount)
+        {
+            m_sampleTime = sampleTime;
+            m_frameCount = frameCount;
+        }
+
+        void render(SyntheticPlayer *a, SyntheticPlayer *b, int cycles)
+        {
+            for (int c=0; c<cycles; ++c){
+                a->timeline.renderCycle(m_sampleTime, m_frameCount);
+                b->timeline.renderCycle(m_sampleTime, m_frameCount);
+                for (int i=0; i<m_frameCount; ++i)
+                    output << a->sampleAt(m_sampleTime + i) + b->sampleAt(m_sampleTime + i);
+                m_sampleTime += m_frameCount;
+            }
+        }
+
+        QVector<float> output;
+
+    private:
+        double m_sampleTime;
+        int m_frameCount;
+};
+
+class RenderTimelineTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void resolvesStartOnFirstCycle();
+        void startsAheadWhenRendering();
+        void startsAtRequestedTime();
+        void rejectsStartTooSoon();
+        void cancelsStart();
+        void concatenatesWithoutGap();
+        void concatenatesAtOddRates();
+        void insertsTransitionGap();
+        void roundsTransitionToWholeSamples();
+};
+
+void RenderTimelineTest::resolvesStartOnFirstCycle()
+{
+    RenderTimeline timeline;
+    QVERIFY(!timeline.hasRendered());
+    QCOMPARE(timeline.start(-1, false), -1.0);
+    QCOMPARE(timeline.startSampleTime(), -1.0);
+    QCOMPARE(timeline.endSampleTime(1000), -1.0);
+    timeline.renderCycle(5120, 512);
+    QCOMPARE(timeline.startSampleTime(), 5120.0);
+    timeline.renderCycle(5632, 512);
+    QCOMPARE(timeline.startSampleTime(), 5120.0);
+    QCOMPARE(timeline.endSampleTime(1000), 6120.0);
+}
+
+void RenderTimelineTest::startsAheadWhenRendering()
+{
+    RenderTimeline timeline;
+    timeline.renderCycle(5120, 512);
+    QCOMPARE(timeline.start(-1, true), 5120.0 + 2 * 512);
+    timeline.renderCycle(5632, 512);
+    QCOMPARE(timeline.startSampleTime(), 5120.0 + 2 * 512);
+}
+
+void RenderTimelineTest::startsAtRequestedTime()
+{
+    RenderTimeline timeline;
+    timeline.renderCycle(5120, 512);
+    QCOMPARE(timeline.start(100000, true), 100000.0);
+    QCOMPARE(timeline.endSampleTime(441), 100441.0);
+}
+
+void RenderTimelineTest::rejectsStartTooSoon()
+{
+    RenderTimeline timeline;
+    QVERIFY(!timeline.canStartAt(100000));
+    timeline.renderCycle(5120, 512);
+    QVERIFY(!timeline.canStartAt(5120));
+    QVERIFY(!timeline.canStartAt(5120 + 512));
+    QVERIFY(timeline.canStartAt(5120 + 2 * 512));
+}
+
+void RenderTimelineTest::cancelsStart()
+{
+    RenderTimeline timeline;
+    timeline.start(-1, false);
+    timeline.cancelStart();
+    timeline.renderCycle(5120, 512);
+    QCOMPARE(timeline.startSampleTime(), -1.0);
+
+    timeline.reset();
+    QVERIFY(!timeline.hasRendered());
+}
+
+// Plays 'first' and then 'second' gapless (with 'transitionTime' ms of
+// silence between), and checks the rendered output sample by sample:
+static void checkConcatenation(int firstFrames, int secondFrames, int sliceFrames,
+    int cycleFrames, double sampleRate, qint32 transitionTime)
+{
+    SyntheticPlayer first(firstFrames, 1);
+    SyntheticPlayer second(secondFrames, firstFrames + 1);
+    SimulatedGraph graph(123456, cycleFrames);
+
+    // The first source starts with the graph. Once it has
+    // scheduled all its audio, its end is known:
+    first.timeline.start(-1, false);
+    first.scheduleAll(sliceFrames);
+    graph.render(&first, &second, 3);
+
+    // Then the second is lined up where the first ends:
+    double end = first.timeline.endSampleTime(first.scheduled);
+    double start = RenderTimeline::gaplessStartSampleTime(end, transitionTime, sampleRate);
+    QVERIFY(second.timeline.canStartAt(start));
+    QCOMPARE(second.timeline.start(start, true), start);
+    second.scheduleAll(sliceFrames);
+    graph.render(&first, &second, (firstFrames + secondFrames) / cycleFrames + int(sampleRate) / cycleFrames);
+
+    // The output is silence, then 1, 2, 3, ... through both sources, with
+    // exactly the transition time of silence at the boundary:
+    const QVector<float> &output = graph.output;
+    int gap = int(start - end);
+    int i = 0;
+    while (i < output.size() && output[i] == 0)
+        ++i;
+    QCOMPARE(i, 0);
+    for (int n=1; n<=firstFrames; ++n, ++i)
+        QCOMPARE(output[i], float(n));
+    for (int g=0; g<gap; ++g, ++i)
+        QCOMPARE(output[i], 0.0f);
+    for (int n=firstFrames + 1; n<=firstFrames + secondFrames; ++n, ++i)
+        QCOMPARE(output[i], float(n));
+    for (; i<output.size(); ++i)
+        QCOMPARE(output[i], 0.0f);
+}
+
+void RenderTimelineTest::concatenatesWithoutGap()
+{
+    checkConcatenation(57331, 20000, 4096, 512, 44100, 0);
+}
+
+void RenderTimelineTest::concatenatesAtOddRates()
+{
+    // Slices and sources that are no multiple of the render cycle:
+    checkConcatenation(48001, 777, 1000, 471, 48000, 0);
+    checkConcatenation(5000, 3, 7, 512, 22050, 0);
+}
+
+void RenderTimelineTest::insertsTransitionGap()
+{
+    checkConcatenation(30000, 30000, 4096, 512, 44100, 10);
+    checkConcatenation(30000, 30000, 4096, 512, 44100, 250);
+}
+
+void RenderTimelineTest::roundsTransitionToWholeSamples()
+{
+    QCOMPARE(RenderTimeline::gaplessStartSampleTime(1000, 0, 44100), 1000.0);
+    QCOMPARE(RenderTimeline::gaplessStartSampleTime(1000, 1, 44100), 1044.0);
+    QCOMPARE(RenderTimeline::gaplessStartSampleTime(1000, 10, 44100), 1441.0);
+    QCOMPARE(RenderTimeline::gaplessStartSampleTime(1000, 1, 22050), 1022.0);
+}
+
+QTEST_MAIN(RenderTimelineTest)
+#include "rendertimelinetest.moc"
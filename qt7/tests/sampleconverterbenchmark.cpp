@@ -0,0 +1,199 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include <QtCore/QTime>
+#include "sampleconverter.h"
+
+using namespace Phonon::QT7;
+
+// Reports the throughput of each kernel set in GB/s (of source
+// samples), and how it compares to the scalar set:
+class SampleConverterBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void int16ToFloat();
+        void floatToInt16();
+        void int32ToFloat();
+        void floatToInt32();
+        void swapBytes32();
+        void bigEndianInt16ToPlanarFloat();
+        void planarFloatToInt16();
+        void int24ToFloat();
+
+    private:
+        typedef void (*Run)(void *context);
+        void measure(const char *name, Run run, void *context, qint64 bytes);
+};
+
+enum {Frames = 4096, Channels = 2, Samples = Frames * Channels};
+
+struct Buffers
+{
+    Buffers() : int16s(Samples), int32s(Samples), floats(Samples), bytes(Samples * 4, 0)
+    {
+        for (int i=0; i<Samples; ++i){
+            floats[i] = float(sin(i * 0.01));
+            int16s[i] = qint16(floats[i] * 32767);
+            int32s[i] = qint32(floats[i] * 2147483647.0);
+        }
+    }
+    QVector<qint16> int16s;
+    QVector<qint32> int32s;
+    QVector<float> floats;
+    QByteArray bytes;
+};
+
+void SampleConverterBenchmark::measure(const char *name, Run run, void *context, qint64 bytes)
+{
+    double scalarRate = 0;
+    for (int s = SampleConverter::Scalar; s < SampleConverter::BestKernelSet; ++s){
+        SampleConverter::KernelSet set = SampleConverter::KernelSet(s);
+        if (!SampleConverter::setKernelSet(set))
+            continue;
+        // Run for at least 200 ms to get past the
+        // resolution of the clock:
+        int iterations = 0;
+        QTime time;
+        time.start();
+        do {
+            for (int i=0; i<64; ++i)
+                run(context);
+            iterations += 64;
+        } while (time.elapsed() < 200);
+        double rate = double(bytes) * iterations / (time.elapsed() / 1000.0) / 1e9;
+        if (set == SampleConverter::Scalar)
+            scalarRate = rate;
+        qDebug() << name << SampleConverter::kernelSetName(set) << rate << "GB/s,"
+            << rate / scalarRate << "x scalar";
+    }
+    SampleConverter::setKernelSet(SampleConverter::BestKernelSet);
+}
+
+static void runInt16ToFloat(void *context)
+{
+    Buffers *b = static_cast<Buffers *>(context);
+    SampleConverter::int16ToFloat(b->int16s.constData(), b->floats.data(), Samples);
+}
+
+static void runFloatToInt16(void *context)
+{
+    Buffers *b = static_cast<Buffers *>(context);
+    SampleConverter::floatToInt16(b->floats.constData(), b->int16s.data(), Samples);
+}
+
+static void runInt32ToFloat(void *context)
+{
+    Buffers *b = static_cast<Buffers *>(context);
+    SampleConverter::int32ToFloat(b->int32s.constData(), b->floats.data(), Samples);
+}
+
+static void runFloatToInt32(void *context)
+{
+    Buffers *b = static_cast<Buffers *>(context);
+    SampleConverter::floatToInt32(b->floats.constData(), b->int32s.data(), Samples);
+}
+
+static void runSwapBytes32(void *context)
+{
+    Buffers *b = static_cast<Buffers *>(context);
+    SampleConverter::swapBytes32(b->int32s.constData(), b->bytes.data(), Samples);
+}
+
+struct Conversion
+{
+    SampleConverter converter;
+    const void *source[Channels];
+    void *destination[Channels];
+};
+
+static void runConversion(void *context)
+{
+    Conversion *c = static_cast<Conversion *>(context);
+    c->converter.convert(c->source, c->destination, Frames);
+}
+
+void SampleConverterBenchmark::int16ToFloat()
+{
+    Buffers buffers;
+    measure("int16ToFloat", runInt16ToFloat, &buffers, Samples * sizeof(qint16));
+}
+
+void SampleConverterBenchmark::floatToInt16()
+{
+    Buffers buffers;
+    measure("floatToInt16", runFloatToInt16, &buffers, Samples * sizeof(float));
+}
+
+void SampleConverterBenchmark::int32ToFloat()
+{
+    Buffers buffers;
+    measure("int32ToFloat", runInt32ToFloat, &buffers, Samples * sizeof(qint32));
+}
+
+void SampleConverterBenchmark::floatToInt32()
+{
+    Buffers buffers;
+    measure("floatToInt32", runFloatToInt32, &buffers, Samples * sizeof(float));
+}
+
+void SampleConverterBenchmark::swapBytes32()
+{
+    Buffers buffers;
+    measure("swapBytes32", runSwapBytes32, &buffers, Samples * sizeof(qint32));
+}
+
+void SampleConverterBenchmark::bigEndianInt16ToPlanarFloat()
+{
+    // AIFF style input, as the mixer wants it:
+    Buffers buffers;
+    Conversion c;
+    c.converter.setFormats(SampleConverter::Format(SampleConverter::Int16, Channels, true, true),
+        SampleConverter::Format(SampleConverter::Float32, Channels, false));
+    c.source[0] = buffers.int16s.constData();
+    c.destination[0] = buffers.floats.data();
+    c.destination[1] = buffers.floats.data() + Frames;
+    measure("bigEndianInt16ToPlanarFloat", runConversion, &c, Samples * sizeof(qint16));
+}
+
+void SampleConverterBenchmark::planarFloatToInt16()
+{
+    Buffers buffers;
+    Conversion c;
+    c.converter.setFormats(SampleConverter::Format(SampleConverter::Float32, Channels, false),
+        SampleConverter::Format(SampleConverter::Int16, Channels, true));
+    c.source[0] = buffers.floats.constData();
+    c.source[1] = buffers.floats.constData() + Frames;
+    c.destination[0] = buffers.int16s.data();
+    measure("planarFloatToInt16", runConversion, &c, Samples * sizeof(float));
+}
+
+void SampleConverterBenchmark::int24ToFloat()
+{
+    Buffers buffers;
+    Conversion c;
+    c.converter.setFormats(SampleConverter::Format(SampleConverter::Int24, Channels, true),
+        SampleConverter::Format(SampleConverter::Float32, Channels, true));
+    c.source[0] = buffers.bytes.constData();
+    c.destination[0] = buffers.floats.data();
+    measure("int24ToFloat", runConversion, &c, Samples * 3);
+}
+
+QTEST_MAIN(SampleConverterBenchmark)
+#include "sampleconverterbenchmark.moc"
@@ -0,0 +1,186 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "sampleconverter.h"
+
+using namespace Phonon::QT7;
+
+// Every kernel set must give the same result as the scalar one:
+class SampleConverterTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void cleanup();
+        void kernelsMatchScalar();
+        void int16RoundTrip();
+        void int24RoundTrip();
+        void floatsAreClipped();
+        void interleavedToPlanar();
+        void byteOrder();
+};
+
+static QVector<float> testSignal(int count)
+{
+    // A sine with some values beyond full scale, to exercise clipping:
+    QVector<float> samples(count);
+    for (int i=0; i<count; ++i)
+        samples[i] = float(1.2 * sin(i * 0.0137) + 0.001 * (i % 7));
+    return samples;
+}
+
+void SampleConverterTest::cleanup()
+{
+    SampleConverter::setKernelSet(SampleConverter::BestKernelSet);
+}
+
+void SampleConverterTest::kernelsMatchScalar()
+{
+    // Odd counts leave a scalar tail after the vector loops:
+    const int count = 1031;
+    QVector<float> floats = testSignal(count);
+    QVector<qint16> int16s(count);
+    QVector<qint32> int32s(count);
+    for (int i=0; i<count; ++i){
+        int16s[i] = qint16((i * 2654435761u) >> 16);
+        int32s[i] = qint32(i * 2654435761u);
+    }
+
+    SampleConverter::setKernelSet(SampleConverter::Scalar);
+    QVector<qint16> expected16(count);
+    QVector<qint32> expected32(count);
+    QVector<float> expectedFrom16(count), expectedFrom32(count);
+    QVector<qint16> expectedSwap16(count);
+    QVector<qint32> expectedSwap32(count);
+    SampleConverter::floatToInt16(floats.constData(), expected16.data(), count);
+    SampleConverter::floatToInt32(floats.constData(), expected32.data(), count);
+    SampleConverter::int16ToFloat(int16s.constData(), expectedFrom16.data(), count);
+    SampleConverter::int32ToFloat(int32s.constData(), expectedFrom32.data(), count);
+    SampleConverter::swapBytes16(int16s.constData(), expectedSwap16.data(), count);
+    SampleConverter::swapBytes32(int32s.constData(), expectedSwap32.data(), count);
+
+    for (int s = SampleConverter::SSE2; s < SampleConverter::BestKernelSet; ++s){
+        if (!SampleConverter::setKernelSet(SampleConverter::KernelSet(s)))
+            continue;
+        QVector<qint16> out16(count);
+        QVector<qint32> out32(count);
+        QVector<float> from16(count), from32(count);
+        QVector<qint16> swap16(count);
+        QVector<qint32> swap32(count);
+        SampleConverter::floatToInt16(floats.constData(), out16.data(), count);
+        SampleConverter::floatToInt32(floats.constData(), out32.data(), count);
+        SampleConverter::int16ToFloat(int16s.constData(), from16.data(), count);
+        SampleConverter::int32ToFloat(int32s.constData(), from32.data(), count);
+        SampleConverter::swapBytes16(int16s.constData(), swap16.data(), count);
+        SampleConverter::swapBytes32(int32s.constData(), swap32.data(), count);
+        QVERIFY(out16 == expected16);
+        QVERIFY(out32 == expected32);
+        QVERIFY(memcmp(from16.constData(), expectedFrom16.constData(), count * sizeof(float)) == 0);
+        QVERIFY(memcmp(from32.constData(), expectedFrom32.constData(), count * sizeof(float)) == 0);
+        QVERIFY(swap16 == expectedSwap16);
+        QVERIFY(swap32 == expectedSwap32);
+    }
+}
+
+void SampleConverterTest::int16RoundTrip()
+{
+    // Every 16 bit value survives the trip through floats:
+    QVector<qint16> samples(65536);
+    for (int i=0; i<samples.size(); ++i)
+        samples[i] = qint16(i - 32768);
+    QVector<float> floats(samples.size());
+    QVector<qint16> back(samples.size());
+
+    SampleConverter::Format int16s(SampleConverter::Int16, 1, true);
+    SampleConverter::Format float32s(SampleConverter::Float32, 1, true);
+    const void *source = samples.constData();
+    void *middle = floats.data();
+    void *destination = back.data();
+    SampleConverter(int16s, float32s).convert(&source, &middle, samples.size());
+    SampleConverter(float32s, int16s).convert(const_cast<const void *const *>(&middle), &destination, samples.size());
+    QVERIFY(back == samples);
+}
+
+void SampleConverterTest::int24RoundTrip()
+{
+    // Packed 24 bit samples, three bytes each:
+    const int count = 4099;
+    QByteArray samples(count * 3, 0);
+    for (int i=0; i<count; ++i){
+        qint32 value = qint32((i * 2654435761u) >> 8) - (1 << 23);
+        memcpy(samples.data() + i * 3, &value, 3);
+    }
+    QVector<float> floats(count);
+    QByteArray back(count * 3, 0);
+
+    SampleConverter::Format int24s(SampleConverter::Int24, 1, true, false);
+    SampleConverter::Format float32s(SampleConverter::Float32, 1, true);
+    const void *source = samples.constData();
+    void *middle = floats.data();
+    void *destination = back.data();
+    SampleConverter(int24s, float32s).convert(&source, &middle, count);
+    for (int i=0; i<count; ++i)
+        QVERIFY(floats[i] >= -1.0f && floats[i] < 1.0f);
+    SampleConverter(float32s, int24s).convert(const_cast<const void *const *>(&middle), &destination, count);
+    QVERIFY(back == samples);
+}
+
+void SampleConverterTest::floatsAreClipped()
+{
+    float floats[4] = {2.0f, -2.0f, 1.0f, -1.0f};
+    qint16 int16s[4];
+    SampleConverter::floatToInt16(floats, int16s, 4);
+    QCOMPARE(int(int16s[0]), 32767);
+    QCOMPARE(int(int16s[1]), -32768);
+    QCOMPARE(int(int16s[2]), 32767);
+    QCOMPARE(int(int16s[3]), -32768);
+}
+
+void SampleConverterTest::interleavedToPlanar()
+{
+    const qint16 interleaved[8] = {0, 16384, -16384, 8192, 32767, -32768, 0, 0};
+    float left[4], right[4];
+    const void *source = interleaved;
+    void *destination[2] = {left, right};
+    SampleConverter converter(SampleConverter::Format(SampleConverter::Int16, 2, true),
+        SampleConverter::Format(SampleConverter::Float32, 2, false));
+    converter.convert(&source, destination, 4);
+    QCOMPARE(left[0], 0.0f);
+    QCOMPARE(right[0], 0.5f);
+    QCOMPARE(left[1], -0.5f);
+    QCOMPARE(right[1], 0.25f);
+    QCOMPARE(left[2], 32767.0f / 32768.0f);
+    QCOMPARE(right[2], -1.0f);
+}
+
+void SampleConverterTest::byteOrder()
+{
+    // Big endian 16 bit samples, as in AIFF:
+    const unsigned char bigEndian[4] = {0x40, 0x00, 0xc0, 0x00};
+    float floats[2];
+    const void *source = bigEndian;
+    void *destination = floats;
+    SampleConverter converter(SampleConverter::Format(SampleConverter::Int16, 1, true, true),
+        SampleConverter::Format(SampleConverter::Float32, 1, true));
+    converter.convert(&source, &destination, 2);
+    QCOMPARE(floats[0], 0.5f);
+    QCOMPARE(floats[1], -0.5f);
+}
+
+QTEST_MAIN(SampleConverterTest)
+#include "sampleconvertertest.moc"
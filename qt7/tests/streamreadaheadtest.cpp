@@ -0,0 +1,202 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QtTest/QtTest>
+#include "streamreadahead.h"
+#include "streamwindow.h"
+
+using namespace Phonon::QT7;
+
+// A stream of 'size' bytes that takes 'delay' ms to deliver each block
+// of 'blockSize' bytes, standing in for a slow AbstractMediaStream:
+class SlowStream : public StreamReadAhead::Source
+{
+    public:
+        SlowStream(qint64 size, int blockSize, int delay)
+        {
+            readAhead = 0;
+            m_size = size;
+            m_blockSize = blockSize;
+            m_delay = delay;
+            m_pos = 0;
+            seeks = 0;
+        }
+
+        static char byteAt(qint64 pos)
+        {
+            return char((pos * 7) ^ (pos >> 11));
+        }
+
+        void requestData()
+        {
+            if (m_delay < 0)
+                return;
+            QTest::qSleep(m_delay);
+            if (m_pos >= m_size){
+                readAhead->endOfData();
+                return;
+            }
+            int length = int(qMin(qint64(m_blockSize), m_size - m_pos));
+            QByteArray block;
+            block.resize(length);
+            for (int i=0; i<length; ++i)
+                block.data()[i] = byteAt(m_pos + i);
+            m_pos += length;
+            readAhead->write(block);
+        }
+
+        void requestSeek(qint64 pos)
+        {
+            ++seeks;
+            m_pos = pos;
+        }
+
+        StreamReadAhead *readAhead;
+        int seeks;
+
+    private:
+        qint64 m_size;
+        qint64 m_pos;
+        int m_blockSize;
+        int m_delay;
+};
+
+class StreamReadAheadTest : public QObject
+{
+    Q_OBJECT
+
+    private:
+        static bool windowMatches(const StreamWindow &window, qint64 from, qint64 to)
+        {
+            QByteArray data;
+            data.resize(int(to - from));
+            window.copy(from, data.size(), data.data());
+            for (int i=0; i<data.size(); ++i){
+                if (data[i] != SlowStream::byteAt(from + i))
+                    return false;
+            }
+            return true;
+        }
+
+    private slots:
+        void readsSlowStreamInOrder();
+        void seeksInTheMiddleOfABlock();
+        void boundsTheQueuedBytes();
+        void reportsEndOfData();
+        void givesUpOnIdleStream();
+};
+
+void StreamReadAheadTest::readsSlowStreamInOrder()
+{
+    SlowStream stream(256 * 1024, 4096, 2);
+    StreamReadAhead readAhead(&stream);
+    stream.readAhead = &readAhead;
+    StreamWindow window(0);
+
+    readAhead.start(32 * 1024, 0);
+    qint64 to = 0;
+    while (to < 256 * 1024){
+        // Read in steps that do not line up with the blocks:
+        to = qMin(to + 10000, qint64(256 * 1024));
+        QVERIFY(!readAhead.fill(&window, 0, to));
+        QVERIFY(window.end() >= to);
+    }
+    readAhead.stop();
+
+    QCOMPARE(window.start(), qint64(0));
+    QVERIFY(windowMatches(window, 0, window.end()));
+    QVERIFY(readAhead.stallCount() > 0);
+    QCOMPARE(stream.seeks, 0);
+}
+
+void StreamReadAheadTest::seeksInTheMiddleOfABlock()
+{
+    // Seek while the worker is busy delivering a block for the old
+    // position. That block must not end up in the window:
+    SlowStream stream(1024 * 1024, 4096, 5);
+    StreamReadAhead readAhead(&stream);
+    stream.readAhead = &readAhead;
+    StreamWindow window(0);
+
+    readAhead.start(64 * 1024, 0);
+    readAhead.fill(&window, 0, 10000);
+    QVERIFY(windowMatches(window, 0, 10000));
+
+    qint64 targets[] = {70001, 3, 500000, 123457};
+    for (int i=0; i<4; ++i){
+        QTest::qSleep(2);
+        window.restart(targets[i]);
+        readAhead.seek(targets[i]);
+    }
+    qint64 pos = targets[3];
+    QVERIFY(!readAhead.fill(&window, pos, pos + 20000));
+    readAhead.stop();
+
+    QCOMPARE(window.start(), pos);
+    QVERIFY(window.end() >= pos + 20000);
+    QVERIFY(windowMatches(window, pos, window.end()));
+    QVERIFY(stream.seeks >= 1);
+}
+
+void StreamReadAheadTest::boundsTheQueuedBytes()
+{
+    SlowStream stream(1024 * 1024, 4096, 0);
+    StreamReadAhead readAhead(&stream);
+    stream.readAhead = &readAhead;
+
+    readAhead.start(32 * 1024, 0);
+    QTest::qSleep(100);
+    int queued = readAhead.bytesQueued();
+    readAhead.stop();
+
+    QVERIFY(queued >= 32 * 1024);
+    QVERIFY(queued < 32 * 1024 + 4096);
+}
+
+void StreamReadAheadTest::reportsEndOfData()
+{
+    SlowStream stream(10000, 4096, 1);
+    StreamReadAhead readAhead(&stream);
+    stream.readAhead = &readAhead;
+    StreamWindow window(0);
+
+    readAhead.start(32 * 1024, 0);
+    QVERIFY(readAhead.fill(&window, 0, 1024 * 1024));
+    readAhead.stop();
+
+    QCOMPARE(window.end(), qint64(10000));
+    QVERIFY(windowMatches(window, 0, 10000));
+}
+
+void StreamReadAheadTest::givesUpOnIdleStream()
+{
+    // A stream that never writes:
+    SlowStream stream(10000, 4096, -1);
+    StreamReadAhead readAhead(&stream);
+    stream.readAhead = &readAhead;
+    StreamWindow window(0);
+
+    readAhead.setIdleTimeout(50);
+    readAhead.start(32 * 1024, 0);
+    QVERIFY(!readAhead.fill(&window, 0, 4096));
+    readAhead.stop();
+
+    QCOMPARE(window.end(), qint64(0));
+    QVERIFY(readAhead.stallCount() > 0);
+}
+
+QTEST_MAIN(StreamReadAheadTest)
+#include "streamreadaheadtest.moc"
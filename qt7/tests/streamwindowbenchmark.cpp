@@ -0,0 +1,148 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "streamwindow.h"
+
+using namespace Phonon::QT7;
+
+static const int BufferedSize = 1024 * 1024;
+static const int BlockSize = 64 * 1024;
+
+// How QuickTimeStreamReader used to buffer: one QByteArray, appended
+// to on every write, and copied (less what was read) on every read:
+class SingleBuffer
+{
+    public:
+        void write(const QByteArray &data)
+        {
+            m_buffer += data;
+        }
+
+        int read(int size, char *data)
+        {
+            int bytesRead = qMin(m_buffer.size(), size);
+            memcpy(data, m_buffer.data(), bytesRead);
+            m_buffer = m_buffer.mid(bytesRead);
+            return bytesRead;
+        }
+
+    private:
+        QByteArray m_buffer;
+};
+
+// Everything is written up front, so there is nothing to fill:
+class WrittenStream : public StreamWindow::Feeder
+{
+    public:
+        bool canSeek() const { return false; }
+        void seek(qint64) {}
+        void fill(qint64, qint64) {}
+};
+
+class StreamWindowBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase();
+        void singleBufferSmallReads();
+        void singleBufferMediumReads();
+        void singleBufferLargeReads();
+        void streamWindowSmallReads();
+        void streamWindowMediumReads();
+        void streamWindowLargeReads();
+
+    private:
+        void benchmarkSingleBuffer(int readSize);
+        void benchmarkStreamWindow(int readSize);
+
+        QList<QByteArray> m_blocks;
+};
+
+void StreamWindowBenchmark::initTestCase()
+{
+    // The blocks are shared, as they would be when the
+    // application writes them through writeData:
+    for (int i=0; i<BufferedSize / BlockSize; ++i)
+        m_blocks << QByteArray(BlockSize, char(i));
+}
+
+void StreamWindowBenchmark::benchmarkSingleBuffer(int readSize)
+{
+    QByteArray data(readSize, 0);
+    QBENCHMARK {
+        SingleBuffer buffer;
+        for (int i=0; i<m_blocks.size(); ++i)
+            buffer.write(m_blocks[i]);
+        int total = 0;
+        while (total < BufferedSize)
+            total += buffer.read(readSize, data.data());
+    }
+}
+
+void StreamWindowBenchmark::benchmarkStreamWindow(int readSize)
+{
+    QByteArray data(readSize, 0);
+    WrittenStream stream;
+    QBENCHMARK {
+        StreamWindow window(0);
+        window.setWindowSize(64 * 1024);
+        for (int i=0; i<m_blocks.size(); ++i)
+            window.append(m_blocks[i]);
+        int total = 0;
+        while (total < BufferedSize)
+            total += window.read(total, readSize, data.data(), &stream);
+    }
+}
+
+// MPEG transport stream packets, QuickTime's
+// preferred block size, and large sample reads:
+
+void StreamWindowBenchmark::singleBufferSmallReads()
+{
+    benchmarkSingleBuffer(188);
+}
+
+void StreamWindowBenchmark::singleBufferMediumReads()
+{
+    benchmarkSingleBuffer(4 * 1024);
+}
+
+void StreamWindowBenchmark::singleBufferLargeReads()
+{
+    benchmarkSingleBuffer(256 * 1024);
+}
+
+void StreamWindowBenchmark::streamWindowSmallReads()
+{
+    benchmarkStreamWindow(188);
+}
+
+void StreamWindowBenchmark::streamWindowMediumReads()
+{
+    benchmarkStreamWindow(4 * 1024);
+}
+
+void StreamWindowBenchmark::streamWindowLargeReads()
+{
+    benchmarkStreamWindow(256 * 1024);
+}
+
+QTEST_MAIN(StreamWindowBenchmark)
+
+#include "streamwindowbenchmark.moc"
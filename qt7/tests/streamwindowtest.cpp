@@ -0,0 +1,292 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "streamwindow.h"
+
+using namespace Phonon::QT7;
+
+// A stream of 'size' bytes that delivers blocks of 'blockSize'
+// bytes, standing in for an AbstractMediaStream:
+class SyntheticStream : public StreamWindow::Feeder
+{
+    public:
+        SyntheticStream(StreamWindow *window, qint64 size, int blockSize, bool seekable)
+        {
+            m_window = window;
+            m_size = size;
+            m_blockSize = blockSize;
+            m_seekable = seekable;
+            m_pos = 0;
+            seeks = 0;
+            delivered = 0;
+            maxBufferSize = 0;
+        }
+
+        static char byteAt(qint64 pos)
+        {
+            return char((pos * 7) ^ (pos >> 11));
+        }
+
+        bool canSeek() const
+        {
+            return m_seekable;
+        }
+
+        void seek(qint64 pos)
+        {
+            ++seeks;
+            m_pos = pos;
+        }
+
+        void fill(qint64 from, qint64 to)
+        {
+            while (m_window->end() < to && m_pos < m_size){
+                int length = int(qMin(qint64(m_blockSize), m_size - m_pos));
+                QByteArray block;
+                block.resize(length);
+                for (int i=0; i<length; ++i)
+                    block.data()[i] = byteAt(m_pos + i);
+                m_pos += length;
+                delivered += length;
+                m_window->append(block);
+                m_window->trim(from);
+                maxBufferSize = qMax(maxBufferSize, m_window->bufferSize());
+            }
+        }
+
+        int seeks;
+        qint64 delivered;
+        int maxBufferSize;
+
+    private:
+        StreamWindow *m_window;
+        qint64 m_size;
+        qint64 m_pos;
+        int m_blockSize;
+        bool m_seekable;
+};
+
+class StreamWindowTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void readsSequentially();
+        void keepsMemoryBoundedByWindow();
+        void readsBackInsideWindow();
+        void readsBackFromRangeCache();
+        void seeksBackWhenNotCached();
+        void seeksFarAhead();
+        void streamsTowardsNearAhead();
+        void cannotReadBackWithoutSeeking();
+        void readsShortAtEndOfStream();
+        void joinsWindow();
+        void takesWindow();
+
+    private:
+        static bool verify(const QByteArray &data, qint64 offset);
+        static QByteArray read(StreamWindow &window, SyntheticStream &stream, qint64 offset, int size);
+};
+
+bool StreamWindowTest::verify(const QByteArray &data, qint64 offset)
+{
+    for (int i=0; i<data.size(); ++i){
+        if (data.at(i) != SyntheticStream::byteAt(offset + i))
+            return false;
+    }
+    return true;
+}
+
+QByteArray StreamWindowTest::read(StreamWindow &window, SyntheticStream &stream, qint64 offset, int size)
+{
+    QByteArray data;
+    data.resize(size);
+    data.resize(window.read(offset, size, data.data(), &stream));
+    return data;
+}
+
+void StreamWindowTest::readsSequentially()
+{
+    StreamWindow window(16 * 1024 * 1024);
+    window.setWindowSize(256 * 1024);
+    SyntheticStream stream(&window, 8 * 1024 * 1024, 3001, true);
+
+    // Odd request sizes, crossing block boundaries all the time:
+    qint64 offset = 0;
+    int size = 1;
+    while (offset < 8 * 1024 * 1024){
+        size = (size * 31 + 17) % 70000 + 1;
+        QByteArray data = read(window, stream, offset, size);
+        QVERIFY(!data.isEmpty());
+        QVERIFY(verify(data, offset));
+        offset += data.size();
+    }
+    QCOMPARE(offset, qint64(8 * 1024 * 1024));
+    QCOMPARE(stream.seeks, 0);
+    QCOMPARE(stream.delivered, qint64(8 * 1024 * 1024));
+}
+
+void StreamWindowTest::keepsMemoryBoundedByWindow()
+{
+    // Memory is O(window), not O(stream):
+    StreamWindow window(0);
+    window.setWindowSize(128 * 1024);
+    SyntheticStream stream(&window, 64 * 1024 * 1024, 65536, true);
+    for (qint64 offset=0; offset<64 * 1024 * 1024; offset+=32768)
+        QCOMPARE(read(window, stream, offset, 32768).size(), 32768);
+    QVERIFY(stream.maxBufferSize <= 128 * 1024 + 2 * 65536);
+    QVERIFY(window.bufferSize() <= 128 * 1024 + 65536);
+}
+
+void StreamWindowTest::readsBackInsideWindow()
+{
+    StreamWindow window(0);
+    window.setWindowSize(1024 * 1024);
+    SyntheticStream stream(&window, 4 * 1024 * 1024, 4096, true);
+    QCOMPARE(read(window, stream, 0, 512 * 1024).size(), 512 * 1024);
+    QByteArray data = read(window, stream, 1000, 10000);
+    QCOMPARE(data.size(), 10000);
+    QVERIFY(verify(data, 1000));
+    QCOMPARE(stream.seeks, 0);
+    QCOMPARE(stream.delivered, qint64(512 * 1024));
+}
+
+void StreamWindowTest::readsBackFromRangeCache()
+{
+    StreamWindow window(16 * 1024 * 1024);
+    window.setWindowSize(64 * 1024);
+    SyntheticStream stream(&window, 4 * 1024 * 1024, 4096, true);
+    for (qint64 offset=0; offset<2 * 1024 * 1024; offset+=8192)
+        read(window, stream, offset, 8192);
+    QVERIFY(window.start() > 0);
+
+    QByteArray data = read(window, stream, 100, 100000);
+    QCOMPARE(data.size(), 100000);
+    QVERIFY(verify(data, 100));
+    QCOMPARE(stream.seeks, 0);
+    QCOMPARE(stream.delivered, qint64(2 * 1024 * 1024));
+}
+
+void StreamWindowTest::seeksBackWhenNotCached()
+{
+    StreamWindow window(0);
+    window.setWindowSize(64 * 1024);
+    SyntheticStream stream(&window, 4 * 1024 * 1024, 4096, true);
+    for (qint64 offset=0; offset<1024 * 1024; offset+=8192)
+        read(window, stream, offset, 8192);
+
+    QByteArray data = read(window, stream, 100, 1000);
+    QCOMPARE(data.size(), 1000);
+    QVERIFY(verify(data, 100));
+    QCOMPARE(stream.seeks, 1);
+    QCOMPARE(window.start(), qint64(100));
+}
+
+void StreamWindowTest::seeksFarAhead()
+{
+    // Seeking beats streaming through what lies between:
+    StreamWindow window(0);
+    window.setWindowSize(64 * 1024);
+    SyntheticStream stream(&window, 64 * 1024 * 1024, 4096, true);
+    read(window, stream, 0, 1000);
+    QByteArray data = read(window, stream, 32 * 1024 * 1024, 1000);
+    QCOMPARE(data.size(), 1000);
+    QVERIFY(verify(data, 32 * 1024 * 1024));
+    QCOMPARE(stream.seeks, 1);
+    QVERIFY(stream.delivered < 16 * 1024);
+}
+
+void StreamWindowTest::streamsTowardsNearAhead()
+{
+    StreamWindow window(0);
+    window.setWindowSize(256 * 1024);
+    SyntheticStream stream(&window, 4 * 1024 * 1024, 4096, true);
+    read(window, stream, 0, 1000);
+    QByteArray data = read(window, stream, 200 * 1024, 1000);
+    QCOMPARE(data.size(), 1000);
+    QVERIFY(verify(data, 200 * 1024));
+    QCOMPARE(stream.seeks, 0);
+}
+
+void StreamWindowTest::cannotReadBackWithoutSeeking()
+{
+    StreamWindow window(0);
+    window.setWindowSize(64 * 1024);
+    SyntheticStream stream(&window, 4 * 1024 * 1024, 4096, false);
+    for (qint64 offset=0; offset<1024 * 1024; offset+=8192)
+        read(window, stream, offset, 8192);
+    QCOMPARE(read(window, stream, 0, 1000).size(), 0);
+
+    // But far ahead can still be reached by streaming:
+    QByteArray data = read(window, stream, 3 * 1024 * 1024, 1000);
+    QCOMPARE(data.size(), 1000);
+    QVERIFY(verify(data, 3 * 1024 * 1024));
+    QCOMPARE(stream.seeks, 0);
+}
+
+void StreamWindowTest::readsShortAtEndOfStream()
+{
+    StreamWindow window(0);
+    SyntheticStream stream(&window, 10000, 4096, true);
+    QByteArray data = read(window, stream, 9000, 4000);
+    QCOMPARE(data.size(), 1000);
+    QVERIFY(verify(data, 9000));
+    QCOMPARE(read(window, stream, 10000, 100).size(), 0);
+}
+
+void StreamWindowTest::joinsWindow()
+{
+    StreamWindow window(0);
+    window.setWindowSize(64 * 1024);
+    SyntheticStream stream(&window, 1024 * 1024, 1000, true);
+    for (qint64 offset=0; offset<512 * 1024; offset+=5000)
+        read(window, stream, offset, 5000);
+    QVERIFY(window.chunkCount() > 1);
+
+    qint64 start = window.start();
+    int size = window.bufferSize();
+    QByteArray *data = window.join();
+    QCOMPARE(data->size(), size);
+    QVERIFY(verify(*data, start));
+    QCOMPARE(window.chunkCount(), 1);
+}
+
+void StreamWindowTest::takesWindow()
+{
+    StreamWindow window(0);
+    SyntheticStream stream(&window, 1024 * 1024, 1000, true);
+    read(window, stream, 0, 100000);
+    window.trim(1500);
+    window.setWindowSize(64 * 1024);
+    window.trim(1500);
+    QCOMPARE(window.start(), qint64(1500));
+
+    qint64 offset = window.start();
+    QList<QByteArray> chunks = window.takeAll();
+    for (int i=0; i<chunks.size(); ++i){
+        QVERIFY(verify(chunks[i], offset));
+        offset += chunks[i].size();
+    }
+    QCOMPARE(offset, window.end());
+    QCOMPARE(window.bufferSize(), 0);
+    QCOMPARE(window.start(), window.end());
+}
+
+QTEST_MAIN(StreamWindowTest)
+
+#include "streamwindowtest.moc"
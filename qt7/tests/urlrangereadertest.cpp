@@ -0,0 +1,370 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QtTest/QtTest>
+#include <QtCore/QDir>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include "urlrangereader.h"
+
+using namespace Phonon::QT7;
+
+// Stands in for an http server on the loopback interface. It answers
+// one request at a time from its own thread, range requests after
+// 'delay' ms:
+class LoopbackServer : public QThread, public UrlRangeReader::Fetcher
+{
+    public:
+        enum Behaviour {HonourRanges, IgnoreRanges, AlignRanges, NoRanges};
+
+        LoopbackServer(qint64 size, Behaviour behaviour, int delay)
+        {
+            m_behaviour = behaviour;
+            m_delay = delay;
+            m_resource.resize(int(size));
+            for (int i=0; i<m_resource.size(); ++i)
+                m_resource.data()[i] = byteAt(i);
+            m_fetch = 0;
+            m_done = false;
+            m_cancel = false;
+            m_stop = false;
+            rangeRequests = 0;
+            start();
+        }
+
+        ~LoopbackServer()
+        {
+            {
+                QMutexLocker locker(&m_mutex);
+                m_stop = true;
+                m_cancel = true;
+                m_requestWait.wakeAll();
+            }
+            wait();
+        }
+
+        static char byteAt(qint64 pos)
+        {
+            return char((pos * 13) ^ (pos >> 9));
+        }
+
+        void startFetch(UrlFetch *fetch)
+        {
+            QMutexLocker locker(&m_mutex);
+            m_fetch = fetch;
+            m_done = false;
+            m_cancel = false;
+            m_requestWait.wakeAll();
+        }
+
+        bool waitForFetch(int timeout)
+        {
+            QMutexLocker locker(&m_mutex);
+            QTime time;
+            time.start();
+            while (m_fetch && !m_done){
+                int timeLeft = timeout - time.elapsed();
+                if (timeLeft <= 0)
+                    return false;
+                m_resultWait.wait(&m_mutex, timeLeft);
+            }
+            return true;
+        }
+
+        void cancelFetch()
+        {
+            QMutexLocker locker(&m_mutex);
+            m_cancel = true;
+            while (m_fetch && !m_done)
+                m_resultWait.wait(&m_mutex);
+            if (m_fetch)
+                m_fetch->failed = true;
+            m_fetch = 0;
+        }
+
+        int rangeRequests;
+
+    protected:
+        void run()
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_stop){
+                if (!m_fetch || m_done){
+                    m_requestWait.wait(&m_mutex);
+                    continue;
+                }
+                UrlFetch *fetch = m_fetch;
+                QTime time;
+                time.start();
+                while (!fetch->head && !m_cancel && time.elapsed() < m_delay)
+                    m_requestWait.wait(&m_mutex, 5);
+                if (m_cancel)
+                    fetch->failed = true;
+                else
+                    answer(fetch);
+                m_done = true;
+                m_resultWait.wakeAll();
+            }
+        }
+
+    private:
+        void answer(UrlFetch *fetch)
+        {
+            qint64 size = m_resource.size();
+            if (fetch->head){
+                fetch->status = 200;
+                fetch->contentLength = size;
+                fetch->eTag = "\"v1\"";
+                if (m_behaviour != NoRanges)
+                    fetch->acceptRanges = "bytes";
+                return;
+            }
+
+            ++rangeRequests;
+            qint64 first = fetch->offset;
+            if (m_behaviour == IgnoreRanges){
+                fetch->status = 200;
+                fetch->data = m_resource.left(fetch->size);
+                return;
+            }
+            if (m_behaviour == AlignRanges)
+                first = first & ~qint64(4095);
+            qint64 last = qMin(fetch->offset + fetch->size, size) - 1;
+            fetch->status = 206;
+            fetch->contentRange = "bytes " + QByteArray::number(first) + '-' + QByteArray::number(last)
+                + '/' + QByteArray::number(size);
+            fetch->data = m_resource.mid(int(first), int(qMin(qint64(fetch->size), last - first + 1)));
+        }
+
+        QByteArray m_resource;
+        Behaviour m_behaviour;
+        int m_delay;
+        QMutex m_mutex;
+        QWaitCondition m_requestWait;
+        QWaitCondition m_resultWait;
+        UrlFetch *m_fetch;
+        bool m_done;
+        bool m_cancel;
+        bool m_stop;
+};
+
+class UrlRangeReaderTest : public QObject
+{
+    Q_OBJECT
+
+    private:
+        QString m_directory;
+
+        // Read until data arrives, or the reader gives up:
+        static UrlRangeReader::Result readBlock(UrlRangeReader *reader, QByteArray *data)
+        {
+            UrlRangeReader::Result result = reader->read(data);
+            while (result == UrlRangeReader::Pending){
+                QTest::qSleep(1);
+                result = reader->read(data);
+            }
+            return result;
+        }
+
+        static bool matches(const QByteArray &data, qint64 offset)
+        {
+            for (int i=0; i<data.size(); ++i){
+                if (data[i] != LoopbackServer::byteAt(offset + i))
+                    return false;
+            }
+            return true;
+        }
+
+        void removeCache()
+        {
+            QDir dir(m_directory);
+            QFileInfoList entries = dir.entryInfoList(QStringList() << QLatin1String("*.index") << QLatin1String("*.data"));
+            for (int i=0; i<entries.size(); ++i)
+                QFile::remove(entries[i].filePath());
+            QDir().rmdir(m_directory);
+        }
+
+    private slots:
+        void init();
+        void cleanup();
+        void readsThroughTheCache();
+        void doesNotWaitForTheServer();
+        void dropsRequestsOnSeek();
+        void rejectsMisplacedRanges();
+        void acceptsWholeResourceAtStartOnly();
+        void givesUpOnSilentServer();
+        void refusesServerWithoutRanges();
+        void parsesContentRange();
+};
+
+void UrlRangeReaderTest::init()
+{
+    m_directory = QDir::tempPath() + QLatin1String("/phonon_qt7_urlrangereadertest");
+    removeCache();
+}
+
+void UrlRangeReaderTest::cleanup()
+{
+    removeCache();
+}
+
+void UrlRangeReaderTest::readsThroughTheCache()
+{
+    const qint64 size = 300000;
+    LoopbackServer server(size, LoopbackServer::HonourRanges, 1);
+    {
+        UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+        reader.setBlockSize(64 * 1024);
+        QVERIFY(reader.open("http://localhost/media"));
+        QCOMPARE(reader.size(), size);
+
+        QByteArray data;
+        while (reader.pos() < size){
+            qint64 pos = reader.pos();
+            QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Data));
+            QVERIFY(matches(data, pos));
+        }
+        QCOMPARE(int(reader.read(&data)), int(UrlRangeReader::EndOfData));
+        QCOMPARE(reader.cachedBytes(), size);
+    }
+    QCOMPARE(server.rangeRequests, 5);
+
+    // Reading again is served from disk:
+    UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+    reader.setBlockSize(64 * 1024);
+    QVERIFY(reader.open("http://localhost/media"));
+    reader.seek(100000);
+    QByteArray data;
+    QCOMPARE(int(reader.read(&data)), int(UrlRangeReader::Data));
+    QCOMPARE(data.size(), 64 * 1024);
+    QVERIFY(matches(data, 100000));
+    QCOMPARE(server.rangeRequests, 5);
+}
+
+void UrlRangeReaderTest::doesNotWaitForTheServer()
+{
+    LoopbackServer server(100000, LoopbackServer::HonourRanges, 200);
+    UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+    QVERIFY(reader.open("http://localhost/media"));
+
+    QTime time;
+    time.start();
+    QByteArray data;
+    QCOMPARE(int(reader.read(&data)), int(UrlRangeReader::Pending));
+    QCOMPARE(int(reader.read(&data)), int(UrlRangeReader::Pending));
+    QVERIFY(time.elapsed() < 100);
+    QVERIFY(data.isEmpty());
+
+    QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Data));
+    QVERIFY(time.elapsed() >= 150);
+    QCOMPARE(data.size(), 100000);
+    QVERIFY(matches(data, 0));
+}
+
+void UrlRangeReaderTest::dropsRequestsOnSeek()
+{
+    LoopbackServer server(200000, LoopbackServer::HonourRanges, 50);
+    UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+    reader.setBlockSize(4096);
+    QVERIFY(reader.open("http://localhost/media"));
+
+    QByteArray data;
+    QCOMPARE(int(reader.read(&data)), int(UrlRangeReader::Pending));
+    reader.seek(150001);
+    QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Data));
+    QCOMPARE(data.size(), 4096);
+    QVERIFY(matches(data, 150001));
+    QCOMPARE(reader.pos(), qint64(150001 + 4096));
+
+    // Only the range read is cached:
+    QCOMPARE(reader.cachedBytes(), qint64(4096));
+}
+
+void UrlRangeReaderTest::rejectsMisplacedRanges()
+{
+    // A server answering from another offset than asked
+    // for must not end up in the cache at the wrong place:
+    LoopbackServer server(100000, LoopbackServer::AlignRanges, 0);
+    UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+    reader.setBlockSize(4096);
+    QVERIFY(reader.open("http://localhost/media"));
+
+    QByteArray data;
+    reader.seek(8192);
+    QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Data));
+    QVERIFY(matches(data, 8192));
+
+    reader.seek(5000);
+    QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Failed));
+    QVERIFY(data.isEmpty());
+    QCOMPARE(reader.cachedBytes(), qint64(4096));
+}
+
+void UrlRangeReaderTest::acceptsWholeResourceAtStartOnly()
+{
+    LoopbackServer server(100000, LoopbackServer::IgnoreRanges, 0);
+    UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+    reader.setBlockSize(4096);
+    QVERIFY(reader.open("http://localhost/media"));
+
+    QByteArray data;
+    QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Data));
+    QCOMPARE(data.size(), 4096);
+    QVERIFY(matches(data, 0));
+
+    reader.seek(50000);
+    QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Failed));
+    QCOMPARE(reader.cachedBytes(), qint64(4096));
+}
+
+void UrlRangeReaderTest::givesUpOnSilentServer()
+{
+    LoopbackServer server(100000, LoopbackServer::HonourRanges, 60000);
+    UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+    QVERIFY(reader.open("http://localhost/media"));
+    reader.setTimeout(50);
+
+    QTime time;
+    time.start();
+    QByteArray data;
+    QCOMPARE(int(readBlock(&reader, &data)), int(UrlRangeReader::Failed));
+    QVERIFY(time.elapsed() < 1000);
+    QCOMPARE(reader.cachedBytes(), qint64(0));
+}
+
+void UrlRangeReaderTest::refusesServerWithoutRanges()
+{
+    LoopbackServer server(100000, LoopbackServer::NoRanges, 0);
+    UrlRangeReader reader(m_directory, 1024 * 1024, &server);
+    QVERIFY(!reader.open("http://localhost/media"));
+}
+
+void UrlRangeReaderTest::parsesContentRange()
+{
+    QVERIFY(UrlRangeReader::contentRangeMatches("bytes 100-199/1000", 100, 100, 1000));
+    QVERIFY(UrlRangeReader::contentRangeMatches("bytes 100-199/*", 100, 50, 1000));
+    QVERIFY(!UrlRangeReader::contentRangeMatches("bytes 0-99/1000", 100, 100, 1000));
+    QVERIFY(!UrlRangeReader::contentRangeMatches("bytes 100-149/1000", 100, 100, 1000));
+    QVERIFY(!UrlRangeReader::contentRangeMatches("bytes 100-199/2000", 100, 100, 1000));
+    QVERIFY(!UrlRangeReader::contentRangeMatches("bytes 900-1000/1000", 900, 101, 1000));
+    QVERIFY(!UrlRangeReader::contentRangeMatches("items 100-199/1000", 100, 100, 1000));
+    QVERIFY(!UrlRangeReader::contentRangeMatches("bytes */1000", 100, 100, 1000));
+    QVERIFY(!UrlRangeReader::contentRangeMatches("", 100, 100, 1000));
+}
+
+QTEST_MAIN(UrlRangeReaderTest)
+#include "urlrangereadertest.moc"
@@ -0,0 +1,195 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtTest/QtTest>
+#include "variableresampler.h"
+#include <math.h>
+
+using namespace Phonon::QT7;
+
+static const double Pi = 3.14159265358979323846;
+
+// A sine of 'frequency' cycles per frame, per channel a different phase:
+static float sineAt(double frame, int channel, double frequency)
+{
+    return float(sin(2.0 * Pi * frequency * frame + channel));
+}
+
+// Feeds the resampler the input frames it asks for, like the audio player
+// does from its sound card clock, and collects the output:
+class SineSource
+{
+    public:
+        SineSource(VariableResampler *resampler, int channels, double frequency)
+        {
+            m_resampler = resampler;
+            m_channels = channels;
+            m_frequency = frequency;
+            written = 0;
+        }
+
+        int pull(QVector<QVector<float> > &output, int frames)
+        {
+            int needed = m_resampler->framesNeeded(frames);
+            for (int c=0; c<m_channels; ++c){
+                float *in = m_resampler->inputBuffer(c, needed);
+                for (int i=0; i<needed; ++i)
+                    in[i] = sineAt(double(written + i), c, m_frequency);
+            }
+            m_resampler->commitInput(needed);
+            written += needed;
+
+            QVector<float *> out(m_channels);
+            for (int c=0; c<m_channels; ++c){
+                int start = output[c].size();
+                output[c].resize(start + frames);
+                out[c] = output[c].data() + start;
+            }
+            int produced = m_resampler->read(out.data(), frames);
+            for (int c=0; c<m_channels; ++c)
+                output[c].resize(output[c].size() - frames + produced);
+            return produced;
+        }
+
+        qint64 written;
+
+    private:
+        VariableResampler *m_resampler;
+        int m_channels;
+        double m_frequency;
+};
+
+class VariableResamplerTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void passesThroughAtUnityRate();
+        void producesWhatWasAskedFor();
+        void countsConsumedFrames();
+        void followsRate();
+        void changesRateWithoutDiscontinuity();
+        void streamsInAnyBlockSize();
+};
+
+void VariableResamplerTest::passesThroughAtUnityRate()
+{
+    VariableResampler resampler;
+    resampler.reset(2);
+    SineSource source(&resampler, 2, 0.01);
+    QVector<QVector<float> > output(2);
+    QCOMPARE(source.pull(output, 4096), 4096);
+    for (int c=0; c<2; ++c){
+        for (int i=0; i<4096; ++i)
+            QCOMPARE(output[c][i], sineAt(i, c, 0.01));
+    }
+}
+
+void VariableResamplerTest::producesWhatWasAskedFor()
+{
+    double rates[] = {0.9995, 0.9999, 1.0, 1.0001, 1.0005};
+    for (int r=0; r<5; ++r){
+        VariableResampler resampler;
+        resampler.reset(1);
+        resampler.setRate(rates[r]);
+        SineSource source(&resampler, 1, 0.01);
+        QVector<QVector<float> > output(1);
+        for (int i=0; i<100; ++i)
+            QCOMPARE(source.pull(output, 512), 512);
+    }
+}
+
+void VariableResamplerTest::countsConsumedFrames()
+{
+    // The consumed count is what the audio clock is measured in, so it
+    // must be exact (up to the fraction not yet consumed):
+    VariableResampler resampler;
+    resampler.reset(1);
+    resampler.setRate(1.0003);
+    SineSource source(&resampler, 1, 0.01);
+    QVector<QVector<float> > output(1);
+    for (int i=0; i<1000; ++i)
+        source.pull(output, 441);
+    QVERIFY(qAbs(resampler.consumedFrames() - 441000 * 1.0003) < 1e-6 * 441000);
+    QVERIFY(source.written - resampler.consumedFrames() <= 2);
+}
+
+void VariableResamplerTest::followsRate()
+{
+    // At rate r, output frame n is input frame n * r. Linear interpolation
+    // of a sine is off by at most (2 pi f)^2 / 8, about -52 dB at 1 kHz:
+    double rate = 1.0005;
+    double frequency = 1000.0 / 44100.0;
+    VariableResampler resampler;
+    resampler.reset(2);
+    resampler.setRate(rate);
+    SineSource source(&resampler, 2, frequency);
+    QVector<QVector<float> > output(2);
+    for (int i=0; i<200; ++i)
+        source.pull(output, 441);
+    float bound = float(2.0 * Pi * frequency * 2.0 * Pi * frequency / 8.0) * 1.01f;
+    float maxError = 0;
+    for (int c=0; c<2; ++c){
+        for (int n=0; n<output[c].size(); ++n)
+            maxError = qMax(maxError, qAbs(output[c][n] - sineAt(n * rate, c, frequency)));
+    }
+    QVERIFY(maxError <= bound);
+}
+
+void VariableResamplerTest::changesRateWithoutDiscontinuity()
+{
+    // Change the rate at each block, as the sync controller may. The
+    // output must stay a smooth sine: no step larger than the largest
+    // step of the sine itself:
+    double frequency = 440.0 / 44100.0;
+    VariableResampler resampler;
+    resampler.reset(1);
+    SineSource source(&resampler, 1, frequency);
+    QVector<QVector<float> > output(1);
+    for (int i=0; i<200; ++i){
+        resampler.setRate(i % 2 ? 1.0005 : 0.9995);
+        source.pull(output, 256);
+    }
+    float maxStep = float(2.0 * Pi * frequency * 1.0005) * 1.001f;
+    for (int n=1; n<output[0].size(); ++n)
+        QVERIFY(qAbs(output[0][n] - output[0][n - 1]) <= maxStep);
+}
+
+void VariableResamplerTest::streamsInAnyBlockSize()
+{
+    VariableResampler whole;
+    whole.reset(1);
+    whole.setRate(0.9997);
+    SineSource wholeSource(&whole, 1, 0.013);
+    QVector<QVector<float> > wholeOutput(1);
+    wholeSource.pull(wholeOutput, 10000);
+
+    VariableResampler blocks;
+    blocks.reset(1);
+    blocks.setRate(0.9997);
+    SineSource blockSource(&blocks, 1, 0.013);
+    QVector<QVector<float> > blockOutput(1);
+    int sizes[] = {1, 7, 64, 333, 1000, 2};
+    for (int i=0; blockOutput[0].size() < 10000; ++i)
+        blockSource.pull(blockOutput, qMin(sizes[i % 6], 10000 - blockOutput[0].size()));
+
+    for (int n=0; n<10000; ++n)
+        QVERIFY(qAbs(blockOutput[0][n] - wholeOutput[0][n]) < 1e-5f);
+}
+
+QTEST_MAIN(VariableResamplerTest)
+#include "variableresamplertest.moc"
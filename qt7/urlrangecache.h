@@ -0,0 +1,80 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_URLRANGECACHE_H
+#define Phonon_QT7_URLRANGECACHE_H
+
+#include <QtCore/QFile>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        A disk cache for byte ranges of remote media. Each url is stored
+        as a (sparse) data file, together with an index file that lists
+        the ranges present, and the validators (ETag/Last-Modified) the
+        ranges were fetched with. If the validators change, the cached
+        ranges are thrown away. When the total size of the cache would
+        exceed its limit, the least recently opened entries are removed.
+        The index is written now and then while writing, and on close.
+    */
+    class UrlRangeCache
+    {
+        public:
+            UrlRangeCache(const QString &directory, qint64 maxSize);
+            virtual ~UrlRangeCache();
+
+            bool open(const QByteArray &url, const QByteArray &validator, qint64 size);
+            void close();
+            bool isOpen() const;
+
+            int read(qint64 offset, int size, char *data);
+            void write(qint64 offset, const QByteArray &data);
+            qint64 nextCachedOffset(qint64 offset) const;
+            qint64 cachedBytes() const;
+
+        private:
+            QString m_directory;
+            qint64 m_maxSize;
+            QString m_key;
+            QFile m_dataFile;
+            QByteArray m_url;
+            QByteArray m_validator;
+            qint64 m_size;
+            QMap<qint64, qint64> m_ranges; // start -> end
+            qint64 m_cachedBytes;
+            qint64 m_otherBytes;   // size of all other entries
+            qint64 m_unsavedBytes; // written since the index was saved
+
+            QString indexPath(const QString &key) const;
+            QString dataPath(const QString &key) const;
+            bool loadIndex();
+            void saveIndex();
+            void removeEntry(const QString &key);
+            void evict(qint64 keepBytes);
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_URLRANGECACHE_H
@@ -0,0 +1,251 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "urlrangecache.h"
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+static const quint32 IndexMagic = 0x50515243; // 'PQRC'
+static const quint32 IndexVersion = 1;
+
+// Save the index after each 4MB written (and on close). Ranges
+// written after that are lost if we never get to close:
+static const qint64 IndexSaveInterval = 4 * 1024 * 1024;
+
+UrlRangeCache::UrlRangeCache(const QString &directory, qint64 maxSize)
+{
+    m_directory = directory;
+    m_maxSize = maxSize;
+    m_size = 0;
+    m_cachedBytes = 0;
+    m_otherBytes = 0;
+    m_unsavedBytes = 0;
+}
+
+UrlRangeCache::~UrlRangeCache()
+{
+    close();
+}
+
+bool UrlRangeCache::open(const QByteArray &url, const QByteArray &validator, qint64 size)
+{
+    close();
+    if (!QDir().mkpath(m_directory))
+        return false;
+
+    m_key = QString::fromLatin1(QCryptographicHash::hash(url, QCryptographicHash::Md5).toHex());
+    m_url = url;
+    m_validator = validator;
+    m_size = size;
+
+    // Only keep what we have if it was fetched from the same version of
+    // the resource. Otherwise start over. (Saving the index also marks
+    // the entry as the most recently used one):
+    if (!loadIndex())
+        removeEntry(m_key);
+    m_dataFile.setFileName(dataPath(m_key));
+    if (!m_dataFile.open(QIODevice::ReadWrite)){
+        m_ranges.clear();
+        m_cachedBytes = 0;
+        return false;
+    }
+    saveIndex();
+    evict(m_cachedBytes);
+    return true;
+}
+
+void UrlRangeCache::close()
+{
+    if (!m_dataFile.isOpen())
+        return;
+    m_dataFile.close();
+    saveIndex();
+    m_ranges.clear();
+    m_cachedBytes = 0;
+}
+
+bool UrlRangeCache::isOpen() const
+{
+    return m_dataFile.isOpen();
+}
+
+int UrlRangeCache::read(qint64 offset, int size, char *data)
+{
+    // Return the number of bytes cached from offset and on (up to size):
+    if (!isOpen())
+        return 0;
+    QMap<qint64, qint64>::const_iterator it = m_ranges.upperBound(offset);
+    if (it == m_ranges.constBegin())
+        return 0;
+    --it;
+    if (it.value() <= offset)
+        return 0;
+
+    int length = int(qMin(qint64(size), it.value() - offset));
+    if (!m_dataFile.seek(offset))
+        return 0;
+    qint64 bytesRead = m_dataFile.read(data, length);
+    return bytesRead > 0 ? int(bytesRead) : 0;
+}
+
+void UrlRangeCache::write(qint64 offset, const QByteArray &data)
+{
+    if (!isOpen() || data.isEmpty())
+        return;
+
+    // Make room by removing other entries. Entries
+    // larger than the whole cache are left incomplete:
+    qint64 keepBytes = m_cachedBytes + data.size();
+    if (m_otherBytes + keepBytes > m_maxSize){
+        if (m_otherBytes > 0)
+            evict(keepBytes);
+        if (m_otherBytes + keepBytes > m_maxSize)
+            return;
+    }
+    if (!m_dataFile.seek(offset) || m_dataFile.write(data) != data.size())
+        return;
+
+    // Merge the new range with all ranges it overlaps or touches:
+    qint64 start = offset;
+    qint64 end = offset + data.size();
+    QMap<qint64, qint64>::iterator it = m_ranges.upperBound(start);
+    if (it != m_ranges.begin() && (it - 1).value() >= start)
+        --it;
+    while (it != m_ranges.end() && it.key() <= end){
+        start = qMin(start, it.key());
+        end = qMax(end, it.value());
+        m_cachedBytes -= it.value() - it.key();
+        it = m_ranges.erase(it);
+    }
+    m_ranges.insert(start, end);
+    m_cachedBytes += end - start;
+    m_unsavedBytes += data.size();
+    if (m_unsavedBytes >= IndexSaveInterval)
+        saveIndex();
+}
+
+qint64 UrlRangeCache::nextCachedOffset(qint64 offset) const
+{
+    // Return where the first cached range after offset starts:
+    QMap<qint64, qint64>::const_iterator it = m_ranges.upperBound(offset);
+    return (it == m_ranges.constEnd()) ? m_size : it.key();
+}
+
+qint64 UrlRangeCache::cachedBytes() const
+{
+    return m_cachedBytes;
+}
+
+QString UrlRangeCache::indexPath(const QString &key) const
+{
+    return m_directory + QLatin1Char('/') + key + QLatin1String(".index");
+}
+
+QString UrlRangeCache::dataPath(const QString &key) const
+{
+    return m_directory + QLatin1Char('/') + key + QLatin1String(".data");
+}
+
+bool UrlRangeCache::loadIndex()
+{
+    m_ranges.clear();
+    m_cachedBytes = 0;
+
+    QFile file(indexPath(m_key));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&file);
+    quint32 magic, version;
+    QByteArray url, validator;
+    qint64 size, cachedBytes;
+    QMap<qint64, qint64> ranges;
+    stream >> magic >> version;
+    if (magic != IndexMagic || version != IndexVersion)
+        return false;
+    stream >> url >> validator >> size >> cachedBytes >> ranges;
+    if (stream.status() != QDataStream::Ok || url != m_url || validator != m_validator || size != m_size)
+        return false;
+    m_ranges = ranges;
+    m_cachedBytes = cachedBytes;
+    return true;
+}
+
+void UrlRangeCache::saveIndex()
+{
+    m_unsavedBytes = 0;
+    QFile file(indexPath(m_key));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+    QDataStream stream(&file);
+    stream << IndexMagic << IndexVersion << m_url << m_validator << m_size << m_cachedBytes << m_ranges;
+}
+
+void UrlRangeCache::removeEntry(const QString &key)
+{
+    QFile::remove(indexPath(key));
+    QFile::remove(dataPath(key));
+}
+
+void UrlRangeCache::evict(qint64 keepBytes)
+{
+    // Remove the least recently used entries (judged by when their
+    // index was last written) until they fit in the cache together
+    // with keepBytes of the open entry. The size of each entry is
+    // stored in its index, so read it from there:
+    QDir dir(m_directory);
+    QFileInfoList entries = dir.entryInfoList(QStringList() << QLatin1String("*.index"), QDir::Files, QDir::Time | QDir::Reversed);
+
+    QList<QPair<QString, qint64> > sizes;
+    qint64 total = 0;
+    for (int i=0; i<entries.size(); ++i){
+        if (entries[i].completeBaseName() == m_key)
+            continue;
+        QFile file(entries[i].filePath());
+        qint64 cachedBytes = 0;
+        if (file.open(QIODevice::ReadOnly)){
+            QDataStream stream(&file);
+            quint32 magic, version;
+            QByteArray url, validator;
+            qint64 size;
+            stream >> magic >> version >> url >> validator >> size >> cachedBytes;
+            if (stream.status() != QDataStream::Ok || magic != IndexMagic)
+                cachedBytes = 0;
+        }
+        sizes << qMakePair(entries[i].completeBaseName(), cachedBytes);
+        total += cachedBytes;
+    }
+
+    for (int i=0; i<sizes.size() && total + keepBytes > m_maxSize; ++i){
+        removeEntry(sizes[i].first);
+        total -= sizes[i].second;
+    }
+    m_otherBytes = total;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
@@ -0,0 +1,116 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef Phonon_QT7_URLRANGEREADER_H
+#define Phonon_QT7_URLRANGEREADER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QTime>
+#include "urlrangecache.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    // A request to the server, and the answer to it:
+    struct UrlFetch
+    {
+        UrlFetch(bool head, qint64 offset, int size)
+            : head(head), offset(offset), size(size), status(0),
+            contentLength(0), finished(false), failed(false) {}
+
+        bool head;
+        qint64 offset;
+        int size;
+        int status;
+        qint64 contentLength;
+        QByteArray acceptRanges;
+        QByteArray contentRange;
+        QByteArray eTag;
+        QByteArray lastModified;
+        QByteArray data;
+        bool finished;
+        bool failed;
+    };
+
+    /**
+        Reads a remote resource through a UrlRangeCache. Ranges already
+        on disk are read from there, and only the gaps are fetched from
+        the server using range requests. This requires that the server
+        reports the size of the resource, accepts range requests, and
+        provides an ETag or Last-Modified header.
+
+        read never waits for the server. A missing range is requested
+        from a Fetcher, and read answers Pending until it arrives. Only
+        answers that cover the requested offset are used and cached.
+    */
+    class UrlRangeReader
+    {
+        public:
+            class Fetcher
+            {
+                public:
+                    virtual ~Fetcher() {}
+                    // Send the request in the background. Only one
+                    // request is outstanding at a time:
+                    virtual void startFetch(UrlFetch *fetch) = 0;
+                    // Return true if the request has finished (or failed),
+                    // waiting at most 'timeout' ms for it to do so:
+                    virtual bool waitForFetch(int timeout) = 0;
+                    // Fail the request, and return once it is let go of:
+                    virtual void cancelFetch() = 0;
+            };
+
+            enum Result {Data, Pending, EndOfData, Failed};
+
+            UrlRangeReader(const QString &cacheDirectory, qint64 cacheSize, Fetcher *fetcher);
+            ~UrlRangeReader();
+
+            bool open(const QByteArray &url);
+            void close();
+            Result read(QByteArray *data);
+            void seek(qint64 pos);
+            qint64 pos() const;
+            qint64 size() const;
+            qint64 cachedBytes() const;
+
+            void setBlockSize(int size);
+            void setTimeout(int ms);
+
+            static bool contentRangeMatches(const QByteArray &contentRange, qint64 offset, int size, qint64 totalSize);
+
+        private:
+            UrlRangeCache m_cache;
+            Fetcher *m_fetcher;
+            UrlFetch *m_fetch;
+            QTime m_fetchTime;
+            qint64 m_pos;
+            qint64 m_size;
+            int m_blockSize;
+            int m_timeout;
+
+            bool fetchNow(UrlFetch *fetch);
+            bool isUsable(const UrlFetch *fetch) const;
+            void dropFetch();
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_URLRANGEREADER_H
@@ -0,0 +1,202 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "urlrangereader.h"
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+UrlRangeReader::UrlRangeReader(const QString &cacheDirectory, qint64 cacheSize, Fetcher *fetcher)
+    : m_cache(cacheDirectory, cacheSize)
+{
+    m_fetcher = fetcher;
+    m_fetch = 0;
+    m_pos = 0;
+    m_size = 0;
+    // Fetch 256KB per request, and give up on
+    // requests not answered within 20 seconds:
+    m_blockSize = 256 * 1024;
+    m_timeout = 20000;
+}
+
+UrlRangeReader::~UrlRangeReader()
+{
+    close();
+}
+
+bool UrlRangeReader::open(const QByteArray &url)
+{
+    // Ask the server for the size of the resource, if it
+    // can serve ranges of it, and what version it is:
+    close();
+    UrlFetch head(true, 0, 0);
+    if (!fetchNow(&head))
+        return false;
+    qint64 size = head.contentLength;
+    if (head.status != 200 || size <= 0 || !head.acceptRanges.contains("bytes")
+        || (head.eTag.isEmpty() && head.lastModified.isEmpty()))
+        return false;
+
+    QByteArray validator = head.eTag + '|' + head.lastModified;
+    if (!m_cache.open(url, validator, size))
+        return false;
+    m_size = size;
+    m_pos = 0;
+    return true;
+}
+
+void UrlRangeReader::close()
+{
+    dropFetch();
+    m_cache.close();
+}
+
+UrlRangeReader::Result UrlRangeReader::read(QByteArray *data)
+{
+    data->clear();
+    if (m_pos >= m_size)
+        return EndOfData;
+
+    if (m_fetch){
+        // The request is always for m_pos, since seek drops
+        // requests for other positions. Wait for the answer:
+        if (!m_fetcher->waitForFetch(0)){
+            if (m_fetchTime.elapsed() < m_timeout)
+                return Pending;
+            m_fetcher->cancelFetch();
+        }
+        UrlFetch *fetch = m_fetch;
+        m_fetch = 0;
+        bool usable = isUsable(fetch);
+        if (usable){
+            *data = fetch->data;
+            m_cache.write(m_pos, *data);
+            m_pos += data->size();
+        }
+        delete fetch;
+        return usable ? Data : Failed;
+    }
+
+    // Serve from the cache if possible:
+    int size = int(qMin(qint64(m_blockSize), m_size - m_pos));
+    data->resize(size);
+    int cached = m_cache.read(m_pos, size, data->data());
+    if (cached > 0){
+        data->resize(cached);
+        m_pos += cached;
+        return Data;
+    }
+    data->clear();
+
+    // Otherwise fetch data up to where the next cached range starts:
+    qint64 gapEnd = qMin(m_pos + size, m_cache.nextCachedOffset(m_pos));
+    m_fetch = new UrlFetch(false, m_pos, int(gapEnd - m_pos));
+    m_fetchTime.start();
+    m_fetcher->startFetch(m_fetch);
+    return Pending;
+}
+
+void UrlRangeReader::seek(qint64 pos)
+{
+    // A request for another position is of no use any more:
+    if (m_fetch && m_fetch->offset != pos)
+        dropFetch();
+    m_pos = pos;
+}
+
+qint64 UrlRangeReader::pos() const
+{
+    return m_pos;
+}
+
+qint64 UrlRangeReader::size() const
+{
+    return m_size;
+}
+
+qint64 UrlRangeReader::cachedBytes() const
+{
+    return m_cache.cachedBytes();
+}
+
+void UrlRangeReader::setBlockSize(int size)
+{
+    m_blockSize = size;
+}
+
+void UrlRangeReader::setTimeout(int ms)
+{
+    m_timeout = ms;
+}
+
+bool UrlRangeReader::contentRangeMatches(const QByteArray &contentRange, qint64 offset, int size, qint64 totalSize)
+{
+    // The header reads "bytes first-last/total", where total
+    // is '*' if the server does not know the size:
+    if (!contentRange.startsWith("bytes "))
+        return false;
+    int dash = contentRange.indexOf('-');
+    int slash = contentRange.indexOf('/');
+    if (dash == -1 || slash < dash)
+        return false;
+
+    bool firstOk, lastOk;
+    qint64 first = contentRange.mid(6, dash - 6).trimmed().toLongLong(&firstOk);
+    qint64 last = contentRange.mid(dash + 1, slash - dash - 1).toLongLong(&lastOk);
+    QByteArray total = contentRange.mid(slash + 1);
+    if (!firstOk || !lastOk || first != offset || last - first + 1 < size || last >= totalSize)
+        return false;
+    return total == "*" || total.toLongLong() == totalSize;
+}
+
+bool UrlRangeReader::fetchNow(UrlFetch *fetch)
+{
+    m_fetcher->startFetch(fetch);
+    if (!m_fetcher->waitForFetch(m_timeout))
+        m_fetcher->cancelFetch();
+    return !fetch->failed;
+}
+
+bool UrlRangeReader::isUsable(const UrlFetch *fetch) const
+{
+    if (fetch->failed || fetch->data.isEmpty())
+        return false;
+    // A server that ignores the range answers with the whole
+    // resource. That is only usable if we asked for the start of it:
+    if (fetch->status == 200)
+        return fetch->offset == 0;
+    // Otherwise the answer must start where we asked:
+    return fetch->status == 206
+        && contentRangeMatches(fetch->contentRange, fetch->offset, fetch->data.size(), m_size);
+}
+
+void UrlRangeReader::dropFetch()
+{
+    if (!m_fetch)
+        return;
+    if (!m_fetcher->waitForFetch(0))
+        m_fetcher->cancelFetch();
+    delete m_fetch;
+    m_fetch = 0;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
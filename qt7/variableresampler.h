@@ -0,0 +1,66 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef Phonon_QT7_VARIABLERESAMPLER_H
+#define Phonon_QT7_VARIABLERESAMPLER_H
+
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+    /**
+        Resamples non-interleaved float audio by a ratio close to one,
+        using linear interpolation (which is plenty for adjustments of a
+        few hundred ppm). Input is written into an internal buffer, and
+        output is pulled in whatever amounts needed. The rate is the
+        number of input frames consumed per output frame, and can be
+        changed at any time without discontinuities.
+    */
+    class VariableResampler
+    {
+        public:
+            VariableResampler();
+
+            void reset(int channels);
+            void setRate(double rate);
+            double rate() const;
+
+            int framesNeeded(int outputFrames) const;
+            float *inputBuffer(int channel, int frames);
+            void commitInput(int frames);
+            int read(float *const *output, int outputFrames);
+
+            int availableInput() const;
+            double consumedFrames() const;
+
+        private:
+            QVector<QVector<float> > m_buffers;
+            int m_available;
+            double m_position;
+            double m_consumed;
+            double m_rate;
+    };
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE
+
+#endif // Phonon_QT7_VARIABLERESAMPLER_H
@@ -0,0 +1,128 @@
+/*  This file is part of the KDE project.
+
+    Copyright (C) 2009 Nokia Corporation and/or its subsidiary(-ies).
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2.1 or 3 of the License.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "variableresampler.h"
+#include <math.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace Phonon
+{
+namespace QT7
+{
+
+VariableResampler::VariableResampler()
+{
+    m_rate = 1.0;
+    reset(0);
+}
+
+void VariableResampler::reset(int channels)
+{
+    m_buffers.resize(channels);
+    for (int i=0; i<channels; ++i)
+        m_buffers[i].clear();
+    m_available = 0;
+    m_position = 0;
+    m_consumed = 0;
+}
+
+void VariableResampler::setRate(double rate)
+{
+    m_rate = rate;
+}
+
+double VariableResampler::rate() const
+{
+    return m_rate;
+}
+
+int VariableResampler::framesNeeded(int outputFrames) const
+{
+    // Interpolating the last output frame needs the
+    // input frame before and after its position:
+    if (outputFrames <= 0)
+        return 0;
+    double last = m_position + (outputFrames - 1) * m_rate;
+    int needed = int(floor(last)) + 2 - m_available;
+    return qMax(0, needed);
+}
+
+float *VariableResampler::inputBuffer(int channel, int frames)
+{
+    // Returns where to write 'frames' new frames for 'channel'.
+    // Call commitInput when all channels are written:
+    QVector<float> &buffer = m_buffers[channel];
+    if (buffer.size() < m_available + frames)
+        buffer.resize(m_available + frames);
+    return buffer.data() + m_available;
+}
+
+void VariableResampler::commitInput(int frames)
+{
+    m_available += frames;
+}
+
+int VariableResampler::read(float *const *output, int outputFrames)
+{
+    int channels = m_buffers.size();
+    int produced = 0;
+    double position = m_position;
+    while (produced < outputFrames){
+        int index = int(position);
+        if (index + 1 >= m_available)
+            break;
+        float fraction = float(position - index);
+        for (int c=0; c<channels; ++c){
+            const float *in = m_buffers[c].constData() + index;
+            output[c][produced] = in[0] + fraction * (in[1] - in[0]);
+        }
+        position += m_rate;
+        ++produced;
+    }
+
+    // Drop the input frames that will not be needed again:
+    int drop = qMin(int(position), m_available);
+    if (drop > 0){
+        for (int c=0; c<channels; ++c){
+            float *data = m_buffers[c].data();
+            memmove(data, data + drop, (m_available - drop) * sizeof(float));
+        }
+        m_available -= drop;
+        position -= drop;
+    }
+    m_consumed += (position + drop) - m_position;
+    m_position = position;
+    return produced;
+}
+
+int VariableResampler::availableInput() const
+{
+    return m_available;
+}
+
+double VariableResampler::consumedFrames() const
+{
+    // The (fractional) number of input frames
+    // consumed since reset:
+    return m_consumed;
+}
+
+}} // namespace Phonon::QT7
+
+QT_END_NAMESPACE